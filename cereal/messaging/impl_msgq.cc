@@ -58,8 +58,21 @@ void MSGQMessage::takeOwnership(char * d, size_t sz) {
   data = d;
 }
 
+void MSGQMessage::borrow(char * d, size_t sz, msgq_queue_t * q) {
+  size = sz;
+  data = d;
+  borrowed_q = q;
+}
+
+bool MSGQMessage::valid() {
+  return borrowed_q == NULL || msgq_msg_borrow_valid(borrowed_q);
+}
+
 void MSGQMessage::close() {
-  if (size > 0){
+  if (borrowed_q != NULL){
+    msgq_msg_release(borrowed_q);
+    borrowed_q = NULL;
+  } else if (size > 0){
     delete[] data;
   }
   size = 0;
@@ -83,7 +96,10 @@ int MSGQSubSocket::connect(Context *context, std::string endpoint, std::string a
     return r;
   }
 
-  msgq_init_subscriber(q);
+  r = msgq_init_subscriber(q);
+  if (r != 0){
+    return r;
+  }
 
   if (conflate){
     q->read_conflate = true;
@@ -95,7 +111,7 @@ int MSGQSubSocket::connect(Context *context, std::string endpoint, std::string a
 }
 
 
-Message * MSGQSubSocket::receive(bool non_blocking){
+Message * MSGQSubSocket::receive(bool non_blocking, bool borrow){
   msgq_do_exit = 0;
 
   void (*prev_handler_sigint)(int);
@@ -109,7 +125,8 @@ Message * MSGQSubSocket::receive(bool non_blocking){
 
   MSGQMessage *r = NULL;
 
-  int rc = msgq_msg_recv(&msg, q);
+  auto recv_fn = borrow ? msgq_msg_recv_borrow : msgq_msg_recv;
+  int rc = recv_fn(&msg, q);
 
   // Hack to implement blocking read with a poller. Don't use this
   while (!non_blocking && rc == 0 && msgq_do_exit == 0){
@@ -119,7 +136,7 @@ Message * MSGQSubSocket::receive(bool non_blocking){
     int t = (timeout != -1) ? timeout : 100;
 
     int n = msgq_poll(items, 1, t);
-    rc = msgq_msg_recv(&msg, q);
+    rc = recv_fn(&msg, q);
 
     // The poll indicated a message was ready, but the receive failed. Try again
     if (n == 1 && rc == 0){
@@ -141,10 +158,19 @@ Message * MSGQSubSocket::receive(bool non_blocking){
 
   if (rc > 0){
     if (msgq_do_exit){
-      msgq_msg_close(&msg); // Free unused message on exit
+      // Free unused message on exit
+      if (borrow){
+        msgq_msg_release(q);
+      } else {
+        msgq_msg_close(&msg);
+      }
     } else {
       r = new MSGQMessage;
-      r->takeOwnership(msg.data, msg.size);
+      if (borrow){
+        r->borrow(msg.data, msg.size, q);
+      } else {
+        r->takeOwnership(msg.data, msg.size);
+      }
     }
   }
 
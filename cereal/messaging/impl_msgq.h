@@ -19,12 +19,15 @@ class MSGQMessage : public Message {
 private:
   char * data;
   size_t size;
+  msgq_queue_t * borrowed_q = NULL;
 public:
   void init(size_t size);
   void init(char *data, size_t size);
   void takeOwnership(char *data, size_t size);
+  void borrow(char *data, size_t size, msgq_queue_t *q);
   size_t getSize(){return size;}
   char * getData(){return data;}
+  bool valid();
   void close();
   ~MSGQMessage();
 };
@@ -33,11 +36,13 @@ class MSGQSubSocket : public SubSocket {
 private:
   msgq_queue_t * q = NULL;
   int timeout;
+  Message *receive(bool non_blocking, bool borrow);
 public:
   int connect(Context *context, std::string endpoint, std::string address, bool conflate=false, bool check_endpoint=true);
   void setTimeout(int timeout);
   void * getRawSocket() {return (void*)q;}
-  Message *receive(bool non_blocking=false);
+  Message *receive(bool non_blocking=false) { return receive(non_blocking, false); }
+  Message *borrow(bool non_blocking=false) { return receive(non_blocking, true); }
   ~MSGQSubSocket();
 };
 
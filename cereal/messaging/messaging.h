@@ -28,6 +28,8 @@ public:
   virtual void close() = 0;
   virtual size_t getSize() = 0;
   virtual char * getData() = 0;
+  // False if a borrowed message was overwritten by the publisher while it was in use
+  virtual bool valid() { return true; }
   virtual ~Message(){};
 };
 
@@ -37,6 +39,9 @@ public:
   virtual int connect(Context *context, std::string endpoint, std::string address, bool conflate=false, bool check_endpoint=true) = 0;
   virtual void setTimeout(int timeout) = 0;
   virtual Message *receive(bool non_blocking=false) = 0;
+  // Like receive, but the message may point directly into the transport's buffer.
+  // Check valid() after reading the data, the buffer is released when the message is deleted.
+  virtual Message *borrow(bool non_blocking=false) { return receive(non_blocking); }
   virtual void * getRawSocket() = 0;
   static SubSocket * create();
   static SubSocket * create(Context * context, std::string endpoint, std::string address="127.0.0.1", bool conflate=false, bool check_endpoint=true);
@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <csignal>
 #include <random>
+#include <climits>
 
 #include <poll.h>
 #include <sys/ioctl.h>
@@ -18,15 +19,76 @@
 #include <sys/syscall.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
 
 #include <stdio.h>
 
 #include "msgq.h"
 
+// Readers block on a futex word in a global shared wake table, indexed by thread id.
+// Writers only bump and wake it when the reader announced it is waiting via read_waiting.
+// Define MSGQ_SIGNAL_WAKEUP to fall back to the old SIGUSR2 + nanosleep path.
+#if !defined(__linux__) && !defined(MSGQ_SIGNAL_WAKEUP)
+#define MSGQ_SIGNAL_WAKEUP
+#endif
+
+#define MSGQ_WAKE_PATH "/dev/shm/msgq_wake"
+#define MSGQ_WAKE_SLOTS 4096
+#define MSGQ_POLL_SLICE_MS 100
+
+#ifdef MSGQ_SIGNAL_WAKEUP
 void sigusr2_handler(int signal) {
   assert(signal == SIGUSR2);
 }
 
+static void thread_signal(uint32_t tid) {
+  #ifndef SYS_tkill
+    // TODO: this won't work for multithreaded programs
+    kill(tid, SIGUSR2);
+  #else
+    syscall(SYS_tkill, tid, SIGUSR2);
+  #endif
+}
+#else
+static std::atomic<uint32_t> *msgq_wake_table(){
+  static std::atomic<uint32_t> *table = []() -> std::atomic<uint32_t>* {
+    size_t len = MSGQ_WAKE_SLOTS * sizeof(uint32_t);
+    int fd = open(MSGQ_WAKE_PATH, O_RDWR | O_CREAT, 0777);
+    if (fd < 0) {
+      std::cout << "Warning, could not open: " << MSGQ_WAKE_PATH << std::endl;
+      return NULL;
+    }
+
+    if (ftruncate(fd, len) < 0) {
+      close(fd);
+      return NULL;
+    }
+
+    void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (mem == MAP_FAILED) ? NULL : reinterpret_cast<std::atomic<uint32_t>*>(mem);
+  }();
+  return table;
+}
+
+static std::atomic<uint32_t> *thread_wake_word(uint32_t tid){
+  std::atomic<uint32_t> *table = msgq_wake_table();
+  return (table == NULL) ? NULL : &table[tid % MSGQ_WAKE_SLOTS];
+}
+
+static void thread_signal(uint32_t tid) {
+  // Slots are shared by tids that collide modulo the table size, so wake everyone.
+  // Colliding readers see a spurious wakeup and go back to sleep.
+  std::atomic<uint32_t> *word = thread_wake_word(tid);
+  if (word != NULL){
+    word->fetch_add(1);
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+  }
+}
+#endif
+
 uint64_t msgq_get_uid(void){
   std::random_device rd("/dev/urandom");
   std::uniform_int_distribution<uint64_t> distribution(0,std::numeric_limits<uint32_t>::max());
@@ -84,7 +146,9 @@ void msgq_wait_for_subscriber(msgq_queue_t *q){
 
 int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
   assert(size < 0xFFFFFFFF); // Buffer must be smaller than 2^32 bytes
+#ifdef MSGQ_SIGNAL_WAKEUP
   std::signal(SIGUSR2, sigusr2_handler);
+#endif
 
   const char * prefix = "/dev/shm/";
   char * full_path = new char[strlen(path) + strlen(prefix) + 1];
@@ -123,11 +187,14 @@ int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
     q->read_pointers[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_pointers[i]);
     q->read_valids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_valids[i]);
     q->read_uids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_uids[i]);
+    q->read_waiting[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_waiting[i]);
   }
 
   q->data = mem + sizeof(msgq_header_t);
   q->size = size;
   q->reader_id = -1;
+  q->borrow_read_pointer = 0;
+  q->evicted = false;
 
   q->endpoint = path;
   q->read_conflate = false;
@@ -136,6 +203,12 @@ int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
 }
 
 void msgq_close_queue(msgq_queue_t *q){
+  // Give our reader slot back, unless it was already taken over
+  if (q->reader_id >= 0){
+    uint64_t uid = q->read_uid_local;
+    std::atomic_compare_exchange_strong(q->read_uids[q->reader_id], &uid, (uint64_t)0);
+  }
+
   if (q->mmap_p != NULL){
     munmap(q->mmap_p, q->size + sizeof(msgq_header_t));
   }
@@ -152,68 +225,75 @@ void msgq_init_publisher(msgq_queue_t * q) {
   for (size_t i = 0; i < NUM_READERS; i++){
     *q->read_valids[i] = false;
     *q->read_uids[i] = 0;
+    *q->read_waiting[i] = false;
   }
 
   q->write_uid_local = uid;
 }
 
-static void thread_signal(uint32_t tid) {
-  #ifndef SYS_tkill
-    // TODO: this won't work for multithreaded programs
-    kill(tid, SIGUSR2);
-  #else
-    syscall(SYS_tkill, tid, SIGUSR2);
-  #endif
+static bool thread_alive(uint32_t tid) {
+  // Signal 0 only checks for existence
+  return kill(tid, 0) == 0 || errno != ESRCH;
 }
 
-void msgq_init_subscriber(msgq_queue_t * q) {
+int msgq_init_subscriber(msgq_queue_t * q) {
   assert(q != NULL);
   assert(q->num_readers != NULL);
 
   uint64_t uid = msgq_get_uid();
 
   // Get reader id
-  while (true){
-    uint64_t cur_num_readers = *q->num_readers;
-    uint64_t new_num_readers = cur_num_readers + 1;
-
-    // No more slots available. Reset all subscribers to kick out inactive ones
-    if (new_num_readers > NUM_READERS){
-      std::cout << "Warning, evicting all subscribers!" << std::endl;
-      *q->num_readers = 0;
+  int id = -1;
+  while (id < 0){
+    // Claim the first free slot. Use atomic compare and swap to handle race condition
+    // where two subscribers start at the same time
+    for (int i = 0; i < NUM_READERS; i++){
+      uint64_t free_uid = 0;
+      if (std::atomic_compare_exchange_strong(q->read_uids[i], &free_uid, uid)){
+        id = i;
+        break;
+      }
+    }
+    if (id >= 0){
+      break;
+    }
 
-      for (size_t i = 0; i < NUM_READERS; i++){
+    // No more slots available. Reclaim the slots of readers whose thread is gone
+    bool reclaimed = false;
+    for (int i = 0; i < NUM_READERS; i++){
+      uint64_t old_uid = *q->read_uids[i];
+      if (old_uid != 0 && !thread_alive(old_uid & 0xFFFFFFFF) &&
+          std::atomic_compare_exchange_strong(q->read_uids[i], &old_uid, (uint64_t)0)){
         *q->read_valids[i] = false;
-
-        uint64_t old_uid = *q->read_uids[i];
-        *q->read_uids[i] = 0;
-
-        // Wake up reader in case they are in a poll
-        thread_signal(old_uid & 0xFFFFFFFF);
+        reclaimed = true;
       }
-
-      continue;
     }
 
-    // Use atomic compare and swap to handle race condition
-    // where two subscribers start at the same time
-    if (std::atomic_compare_exchange_strong(q->num_readers,
-                                            &cur_num_readers,
-                                            new_num_readers)){
-      q->reader_id = cur_num_readers;
-      q->read_uid_local = uid;
-
-      // We start with read_valid = false,
-      // on the first read the read pointer will be synchronized with the write pointer
-      *q->read_valids[cur_num_readers] = false;
-      *q->read_pointers[cur_num_readers] = 0;
-      *q->read_uids[cur_num_readers] = uid;
-      break;
+    if (!reclaimed){
+      std::cout << "Warning, no free reader slots: " << q->endpoint << std::endl;
+      return -1;
     }
   }
 
+  // We start with read_valid = false,
+  // on the first read the read pointer will be synchronized with the write pointer
+  *q->read_valids[id] = false;
+  *q->read_pointers[id] = 0;
+  *q->read_waiting[id] = false;
+
+  // Publishers only look at slots below num_readers
+  uint64_t cur_num_readers = *q->num_readers;
+  while (cur_num_readers < (uint64_t)id + 1 &&
+         !std::atomic_compare_exchange_strong(q->num_readers, &cur_num_readers, (uint64_t)id + 1)){
+  }
+
+  q->reader_id = id;
+  q->read_uid_local = uid;
+  q->evicted = false;
+
   //std::cout << "New subscriber id: " << q->reader_id << " uid: " << q->read_uid_local << " " << q->endpoint << std::endl;
   msgq_reset_reader(q);
+  return 0;
 }
 
 int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
@@ -293,6 +373,12 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
 
   // Notify readers
   for (uint64_t i = 0; i < num_readers; i++){
+#ifndef MSGQ_SIGNAL_WAKEUP
+    // Readers that are not blocked in msgq_poll will see the new write pointer on their next check
+    if (!*q->read_waiting[i]){
+      continue;
+    }
+#endif
     uint64_t reader_uid = *q->read_uids[i];
     thread_signal(reader_uid & 0xFFFFFFFF);
   }
@@ -307,8 +393,13 @@ int msgq_msg_ready(msgq_queue_t * q){
   assert(id >= 0); // Make sure subscriber is initialized
 
   if (q->read_uid_local != *q->read_uids[id]){
-    std::cout << q->endpoint << ": Reader was evicted, reconnecting" << std::endl;
-    msgq_init_subscriber(q);
+    if (!q->evicted){
+      std::cout << q->endpoint << ": Reader was evicted, reconnecting" << std::endl;
+      q->evicted = true;
+    }
+    if (msgq_init_subscriber(q) != 0){
+      return 0;
+    }
     goto start;
   }
 
@@ -328,14 +419,23 @@ int msgq_msg_ready(msgq_queue_t * q){
   return (read_pointer != write_pointer);
 }
 
-int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
+// Returns a view of the next message directly in the shared ring, without advancing the read pointer.
+// The payload is 8-byte aligned. The view stays valid until the writer laps the reader,
+// check msgq_msg_borrow_valid after using the data, and call msgq_msg_release to move on.
+int msgq_msg_recv_borrow(msgq_msg_t * msg, msgq_queue_t * q){
  start:
   int id = q->reader_id;
   assert(id >= 0); // Make sure subscriber is initialized
 
   if (q->read_uid_local != *q->read_uids[id]){
-    std::cout << q->endpoint << ": Reader was evicted, reconnecting" << std::endl;
-    msgq_init_subscriber(q);
+    if (!q->evicted){
+      std::cout << q->endpoint << ": Reader was evicted, reconnecting" << std::endl;
+      q->evicted = true;
+    }
+    if (msgq_init_subscriber(q) != 0){
+      msg->size = 0;
+      return 0;
+    }
     goto start;
   }
 
@@ -392,40 +492,101 @@ int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
     }
   }
 
-  // Copy message
-  if (msgq_msg_init_size(msg, size) < 0)
-    return -1;
+  // The read pointer stays on this message until it is released,
+  // so the writer invalidates us if it starts overwriting it
+  PACK64(q->borrow_read_pointer, read_cycles, new_read_pointer);
 
+  msg->size = size;
+  msg->data = p + sizeof(int64_t);
   __sync_synchronize();
-  memcpy(msg->data, p + sizeof(int64_t), size);
+
+  return msg->size;
+}
+
+bool msgq_msg_borrow_valid(msgq_queue_t * q){
+  int id = q->reader_id;
+  assert(id >= 0);
+
   __sync_synchronize();
+  return q->read_uid_local == *q->read_uids[id] && *q->read_valids[id];
+}
 
-  // Update read pointer
-  PACK64(*q->read_pointers[id], read_cycles, new_read_pointer);
+bool msgq_msg_release(msgq_queue_t * q){
+  // Leave the read pointer alone if the data was overwritten,
+  // the next receive resets the reader
+  if (!msgq_msg_borrow_valid(q)){
+    return false;
+  }
+
+  *q->read_pointers[q->reader_id] = q->borrow_read_pointer;
+  return true;
+}
+
+int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
+  while (true) {
+    msgq_msg_t view;
+    if (msgq_msg_recv_borrow(&view, q) == 0){
+      msg->size = 0;
+      return 0;
+    }
+
+    // Copy message
+    if (msgq_msg_init_size(msg, view.size) < 0)
+      return -1;
+
+    memcpy(msg->data, view.data, view.size);
+
+    // Check if the actual data that was copied is valid
+    if (msgq_msg_release(q)){
+      return msg->size;
+    }
 
-  // Check if the actual data that was copied is valid
-  if (!*q->read_valids[id]){
     msgq_msg_close(msg);
-    msgq_reset_reader(q);
-    goto start;
   }
+}
 
 
-  return msg->size;
+
+static int msgq_poll_ready(msgq_pollitem_t * items, size_t nitems){
+  int num = 0;
+  for (size_t i = 0; i < nitems; i++) {
+    if (items[i].revents == 0 && msgq_msg_ready(items[i].q)){
+      items[i].revents = 1;
+    }
+    if (items[i].revents) num++;
+  }
+  return num;
 }
 
+#ifndef MSGQ_SIGNAL_WAKEUP
+static void msgq_set_waiting(msgq_pollitem_t * items, size_t nitems, bool waiting){
+  for (size_t i = 0; i < nitems; i++) {
+    msgq_queue_t *q = items[i].q;
+    int id = q->reader_id;
 
+    // Don't touch the slot if we were evicted and it belongs to someone else now
+    if (id >= 0 && q->read_uid_local == *q->read_uids[id]){
+      *q->read_waiting[id] = waiting;
+    }
+  }
+}
 
-int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout){
-  int num = 0;
+static int64_t msgq_monotonic_ms(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000LL + t.tv_nsec / 1000000LL;
+}
+#endif
 
+int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout){
   // Check if messages ready
   for (size_t i = 0; i < nitems; i++) {
-    items[i].revents = msgq_msg_ready(items[i].q);
-    if (items[i].revents) num++;
+    items[i].revents = 0;
   }
+  int num = msgq_poll_ready(items, nitems);
 
-  int ms = (timeout == -1) ? 100 : timeout;
+#ifdef MSGQ_SIGNAL_WAKEUP
+  int ms = (timeout == -1) ? MSGQ_POLL_SLICE_MS : timeout;
   struct timespec ts;
   ts.tv_sec = ms / 1000;
   ts.tv_nsec = (ms % 1000) * 1000 * 1000;
@@ -437,28 +598,69 @@ int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout){
     ret = nanosleep(&ts, &ts);
 
     // Check if messages ready
-    for (size_t i = 0; i < nitems; i++) {
-      if (items[i].revents == 0 && msgq_msg_ready(items[i].q)){
-        num += 1;
-        items[i].revents = 1;
-      }
-    }
+    num = msgq_poll_ready(items, nitems);
 
     // exit if we had a timeout and the sleep finished
     if (timeout != -1 && ret == 0){
       break;
     }
   }
+#else
+  if (num > 0 || timeout == 0){
+    return num;
+  }
+
+  std::atomic<uint32_t> *word = thread_wake_word(syscall(SYS_gettid));
+  int64_t deadline = msgq_monotonic_ms() + timeout;
+
+  while (num == 0) {
+    // Sleep in slices when waiting forever, so we recover from a missed wakeup (e.g. a publisher restart)
+    int64_t ms = MSGQ_POLL_SLICE_MS;
+    if (timeout != -1){
+      ms = std::min<int64_t>(deadline - msgq_monotonic_ms(), MSGQ_POLL_SLICE_MS);
+      if (ms <= 0){
+        break;
+      }
+    }
+
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000 * 1000;
+
+    if (word == NULL){
+      nanosleep(&ts, NULL);
+      num = msgq_poll_ready(items, nitems);
+      continue;
+    }
+
+    // Read the futex word before announcing we are waiting. Any send after this point
+    // either is seen by the ready check below, or bumps the word so the wait returns immediately.
+    uint32_t seq = *word;
+    msgq_set_waiting(items, nitems, true);
+
+    num = msgq_poll_ready(items, nitems);
+    if (num == 0){
+      syscall(SYS_futex, word, FUTEX_WAIT, seq, &ts, NULL, 0);
+      num = msgq_poll_ready(items, nitems);
+    }
+
+    msgq_set_waiting(items, nitems, false);
+  }
+#endif
 
   return num;
 }
 
 bool msgq_all_readers_updated(msgq_queue_t *q) {
   uint64_t num_readers = *q->num_readers;
+  uint64_t active_readers = 0;
   for (uint64_t i = 0; i < num_readers; i++) {
+    if (*q->read_uids[i] == 0) continue;
+
+    active_readers++;
     if (*q->read_valids[i] && *q->write_pointer != *q->read_pointers[i]) {
       return false;
     }
   }
-  return num_readers > 0;
+  return active_readers > 0;
 }
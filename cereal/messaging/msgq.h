@@ -5,7 +5,11 @@
 #include <atomic>
 
 #define DEFAULT_SEGMENT_SIZE (10 * 1024 * 1024)
-#define NUM_READERS 10
+// Size of the reader table in each segment header. Slots are claimed and released
+// individually, publishers only scan up to the highest slot in use (num_readers)
+#ifndef NUM_READERS
+#define NUM_READERS 64
+#endif
 #define ALIGN(n) ((n + (8 - 1)) & -8)
 
 #define UNPACK64(higher, lower, input) do {uint64_t tmp = input; higher = tmp >> 32; lower = tmp & 0xFFFFFFFF;} while (0)
@@ -18,6 +22,7 @@ struct  msgq_header_t {
   uint64_t read_pointers[NUM_READERS];
   uint64_t read_valids[NUM_READERS];
   uint64_t read_uids[NUM_READERS];
+  uint64_t read_waiting[NUM_READERS];
 };
 
 struct msgq_queue_t {
@@ -27,14 +32,17 @@ struct msgq_queue_t {
   std::atomic<uint64_t> *read_pointers[NUM_READERS];
   std::atomic<uint64_t> *read_valids[NUM_READERS];
   std::atomic<uint64_t> *read_uids[NUM_READERS];
+  std::atomic<uint64_t> *read_waiting[NUM_READERS];
   char * mmap_p;
   char * data;
   size_t size;
   int reader_id;
   uint64_t read_uid_local;
   uint64_t write_uid_local;
+  uint64_t borrow_read_pointer;
 
   bool read_conflate;
+  bool evicted; // eviction was reported, cleared once the reader is back
   std::string endpoint;
 };
 
@@ -58,10 +66,13 @@ int msgq_msg_close(msgq_msg_t *msg);
 int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size);
 void msgq_close_queue(msgq_queue_t *q);
 void msgq_init_publisher(msgq_queue_t * q);
-void msgq_init_subscriber(msgq_queue_t * q);
+int msgq_init_subscriber(msgq_queue_t * q);
 
 int msgq_msg_send(msgq_msg_t *msg, msgq_queue_t *q);
 int msgq_msg_recv(msgq_msg_t *msg, msgq_queue_t *q);
+int msgq_msg_recv_borrow(msgq_msg_t *msg, msgq_queue_t *q);
+bool msgq_msg_borrow_valid(msgq_queue_t *q);
+bool msgq_msg_release(msgq_queue_t *q);
 int msgq_msg_ready(msgq_queue_t * q);
 int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout);
 
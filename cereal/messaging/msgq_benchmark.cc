@@ -0,0 +1,111 @@
+// Measures publish-to-receive latency of msgq_poll + msgq_msg_recv.
+// Build with -DMSGQ_SIGNAL_WAKEUP (msgq_benchmark_signal) to compare against the SIGUSR2 wakeup path.
+//
+// usage: msgq_benchmark [num_subscribers] [num_messages] [period_us]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "msgq.h"
+
+#define ENDPOINT "msgq_benchmark"
+#define MSG_SIZE 1024
+
+static uint64_t nanos_monotonic() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void subscriber_thread(int num_messages, std::atomic<int> *ready, std::vector<uint64_t> *latencies) {
+  msgq_queue_t q;
+  msgq_new_queue(&q, ENDPOINT, DEFAULT_SEGMENT_SIZE);
+  msgq_init_subscriber(&q);
+  (*ready)++;
+
+  int received = 0;
+  while (received < num_messages) {
+    msgq_pollitem_t items[1];
+    items[0].q = &q;
+    if (msgq_poll(items, 1, 1000) == 0) {
+      break;
+    }
+
+    msgq_msg_t msg;
+    while (msgq_msg_recv(&msg, &q) > 0) {
+      uint64_t now = nanos_monotonic();
+      uint64_t sent = *(uint64_t *)msg.data;
+      latencies->push_back(now - sent);
+      msgq_msg_close(&msg);
+      received++;
+    }
+  }
+
+  msgq_close_queue(&q);
+}
+
+int main(int argc, char *argv[]) {
+  int num_subscribers = argc > 1 ? atoi(argv[1]) : 1;
+  int num_messages = argc > 2 ? atoi(argv[2]) : 10000;
+  int period_us = argc > 3 ? atoi(argv[3]) : 1000;
+  num_subscribers = std::min(std::max(num_subscribers, 1), NUM_READERS);
+
+  msgq_queue_t q;
+  msgq_new_queue(&q, ENDPOINT, DEFAULT_SEGMENT_SIZE);
+  msgq_init_publisher(&q);
+
+  std::atomic<int> ready = 0;
+  std::vector<std::vector<uint64_t>> latencies(num_subscribers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_subscribers; i++) {
+    threads.emplace_back(subscriber_thread, num_messages, &ready, &latencies[i]);
+  }
+  while (ready < num_subscribers) usleep(1000);
+
+  // Give the subscribers time to block in msgq_poll
+  usleep(100 * 1000);
+
+  char buf[MSG_SIZE] = {};
+  for (int i = 0; i < num_messages; i++) {
+    *(uint64_t *)buf = nanos_monotonic();
+
+    msgq_msg_t msg;
+    msg.data = buf;
+    msg.size = sizeof(buf);
+    msgq_msg_send(&msg, &q);
+    usleep(period_us);
+  }
+
+  for (auto &t : threads) t.join();
+  msgq_close_queue(&q);
+
+  std::vector<uint64_t> all;
+  for (auto &l : latencies) all.insert(all.end(), l.begin(), l.end());
+  if (all.empty()) {
+    printf("no messages received\n");
+    return 1;
+  }
+  std::sort(all.begin(), all.end());
+
+  uint64_t sum = 0;
+  for (uint64_t l : all) sum += l;
+
+  printf("%s wakeup, %d subscribers, %zu/%d messages received\n",
+#ifdef MSGQ_SIGNAL_WAKEUP
+         "signal",
+#else
+         "futex",
+#endif
+         num_subscribers, all.size(), num_messages * num_subscribers);
+  printf("latency us: mean %.1f  p50 %.1f  p99 %.1f  max %.1f\n",
+         sum / 1000.0 / all.size(), all[all.size() / 2] / 1000.0,
+         all[all.size() * 99 / 100] / 1000.0, all.back() / 1000.0);
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <cstdio>
+#include <cstring>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "catch2/catch.hpp"
+#include "msgq.h"
+
+static void new_queue(msgq_queue_t *q, const char *path, size_t size) {
+  std::string shm_path = std::string("/dev/shm/") + path;
+  remove(shm_path.c_str());
+  REQUIRE(msgq_new_queue(q, path, size) == 0);
+}
+
+static void send_msg(msgq_queue_t *q, const char *data, size_t size) {
+  msgq_msg_t msg;
+  msgq_msg_init_data(&msg, (char *)data, size);
+  REQUIRE(msgq_msg_send(&msg, q) == (int)size);
+  msgq_msg_close(&msg);
+}
+
+TEST_CASE("msgq_msg_recv_borrow points into the queue until released"){
+  msgq_queue_t pub, sub;
+  new_queue(&pub, "test_queue_borrow", 1024);
+  msgq_init_publisher(&pub);
+  REQUIRE(msgq_new_queue(&sub, "test_queue_borrow", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub) == 0);
+
+  send_msg(&pub, "hello", 5);
+  send_msg(&pub, "world!", 6);
+
+  msgq_msg_t view;
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 5);
+  REQUIRE(view.data > sub.data);
+  REQUIRE(view.data < sub.data + sub.size);
+  REQUIRE((uintptr_t)view.data % 8 == 0);
+  REQUIRE(memcmp(view.data, "hello", 5) == 0);
+
+  // borrowing again without a release returns the same message
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 5);
+  REQUIRE(msgq_msg_borrow_valid(&sub));
+  REQUIRE(msgq_msg_release(&sub));
+
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 6);
+  REQUIRE(memcmp(view.data, "world!", 6) == 0);
+  REQUIRE(msgq_msg_release(&sub));
+
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 0);
+  REQUIRE(msgq_msg_ready(&sub) == 0);
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq_msg_borrow_valid is false once the publisher overwrote the message"){
+  msgq_queue_t pub, sub;
+  new_queue(&pub, "test_queue_borrow_overwrite", 1024);
+  msgq_init_publisher(&pub);
+  REQUIRE(msgq_new_queue(&sub, "test_queue_borrow_overwrite", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub) == 0);
+
+  char data[128];
+  memset(data, 'a', sizeof(data));
+  send_msg(&pub, data, sizeof(data));
+
+  msgq_msg_t view;
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == sizeof(data));
+  REQUIRE(msgq_msg_borrow_valid(&sub));
+
+  // lap the reader, the first message gets overwritten
+  memset(data, 'b', sizeof(data));
+  for (int i = 0; i < 10; i++) {
+    send_msg(&pub, data, sizeof(data));
+  }
+  REQUIRE(!msgq_msg_borrow_valid(&sub));
+  REQUIRE(!msgq_msg_release(&sub));
+
+  // the next receive resets the reader to the write pointer
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 0);
+  send_msg(&pub, "c", 1);
+  REQUIRE(msgq_msg_recv_borrow(&view, &sub) == 1);
+  REQUIRE(view.data[0] == 'c');
+  REQUIRE(msgq_msg_release(&sub));
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq_msg_recv copies the message and moves on"){
+  msgq_queue_t pub, sub;
+  new_queue(&pub, "test_queue_recv", 1024);
+  msgq_init_publisher(&pub);
+  REQUIRE(msgq_new_queue(&sub, "test_queue_recv", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub) == 0);
+
+  send_msg(&pub, "hello", 5);
+
+  msgq_msg_t msg;
+  REQUIRE(msgq_msg_recv(&msg, &sub) == 5);
+  REQUIRE((msg.data < sub.data || msg.data >= sub.data + sub.size));
+  REQUIRE(memcmp(msg.data, "hello", 5) == 0);
+  msgq_msg_close(&msg);
+  REQUIRE(msgq_msg_recv(&msg, &sub) == 0);
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq_close_queue gives the reader slot back"){
+  msgq_queue_t pub, sub1, sub2;
+  new_queue(&pub, "test_queue_close", 1024);
+  msgq_init_publisher(&pub);
+
+  REQUIRE(msgq_new_queue(&sub1, "test_queue_close", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub1) == 0);
+  int id = sub1.reader_id;
+  REQUIRE(*pub.num_readers == (uint64_t)id + 1);
+  msgq_close_queue(&sub1);
+  REQUIRE(*pub.read_uids[id] == 0);
+
+  REQUIRE(msgq_new_queue(&sub2, "test_queue_close", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub2) == 0);
+  REQUIRE(sub2.reader_id == id);
+
+  msgq_close_queue(&sub2);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq_init_subscriber reclaims only the slots of dead readers"){
+  msgq_queue_t pub, sub;
+  new_queue(&pub, "test_queue_reclaim", 1024);
+  msgq_init_publisher(&pub);
+
+  // a process that is gone, its id stands in for the thread of a crashed reader
+  pid_t dead = fork();
+  if (dead == 0) _exit(0);
+  REQUIRE(waitpid(dead, nullptr, 0) == dead);
+
+  // every slot is taken, slot 1 by a live reader
+  const uint64_t live_uid = (1ULL << 32) | getpid();
+  for (int i = 0; i < NUM_READERS; i++) {
+    *pub.read_uids[i] = (i == 1) ? live_uid : ((uint64_t)(i + 1) << 32) | dead;
+    *pub.read_valids[i] = true;
+  }
+  *pub.num_readers = NUM_READERS;
+
+  REQUIRE(msgq_new_queue(&sub, "test_queue_reclaim", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub) == 0);
+  REQUIRE(sub.reader_id == 0);
+  REQUIRE(*pub.read_uids[0] == sub.read_uid_local);
+  REQUIRE(*pub.read_uids[1] == live_uid);
+  REQUIRE(*pub.read_valids[1]);
+  for (int i = 2; i < NUM_READERS; i++) {
+    REQUIRE(*pub.read_uids[i] == 0);
+    REQUIRE(!*pub.read_valids[i]);
+  }
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq_init_subscriber fails when every reader is alive"){
+  msgq_queue_t pub, sub;
+  new_queue(&pub, "test_queue_full", 1024);
+  msgq_init_publisher(&pub);
+
+  for (int i = 0; i < NUM_READERS; i++) {
+    *pub.read_uids[i] = ((uint64_t)(i + 1) << 32) | getpid();
+  }
+
+  REQUIRE(msgq_new_queue(&sub, "test_queue_full", 1024) == 0);
+  REQUIRE(msgq_init_subscriber(&sub) == -1);
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
@@ -52,7 +52,10 @@ struct SubMaster::SubMessage {
   uint64_t rcv_time = 0, rcv_frame = 0;
   void *allocated_msg_reader = nullptr;
   capnp::FlatArrayMessageReader *msg_reader = nullptr;
-  AlignedBuffer aligned_buf;
+  // event points into one buffer while the next message is copied into the other,
+  // so a message that is overwritten during the copy doesn't clobber the current event
+  AlignedBuffer aligned_buf[2];
+  int buf_idx = 0;
   cereal::Event::Reader event;
 };
 
@@ -86,16 +89,24 @@ void SubMaster::update(int timeout) {
   std::vector<std::pair<std::string, cereal::Event::Reader>> messages;
 
   for (auto s : sockets) {
-    Message *msg = s->receive(true);
-    if (msg == nullptr) continue;
-
     SubMessage *m = messages_.at(s);
 
+    // Copy straight out of the transport buffer, retry if the publisher overwrote it meanwhile
+    kj::ArrayPtr<const capnp::word> words;
+    bool received = false;
+    while (Message *msg = s->borrow(true)) {
+      words = m->aligned_buf[m->buf_idx ^ 1].align(msg);
+      received = msg->valid();
+      delete msg;
+      if (received) break;
+    }
+    if (!received) continue;
+
+    m->buf_idx ^= 1;
     m->msg_reader->~FlatArrayMessageReader();
     capnp::ReaderOptions options;
     options.traversalLimitInWords = kj::maxValue; // Don't limit
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(m->aligned_buf.align(msg), options);
-    delete msg;
+    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(words, options);
     messages.push_back({m->name, m->msg_reader->getRoot<cereal::Event>()});
   }
 
@@ -145,7 +156,7 @@ void SubMaster::drain() {
       break;
 
     for (auto sock : polls) {
-      Message *msg = sock->receive(true);
+      Message *msg = sock->borrow(true);
       delete msg;
     }
   }
@@ -31,6 +31,7 @@ void VisionBuf::init_rgb(size_t width, size_t height, size_t stride) {
 
 void VisionBuf::init_yuv(size_t width, size_t height){
   this->rgb = false;
+  this->nv12 = false;
   this->width = width;
   this->height = height;
 
@@ -38,3 +39,17 @@ void VisionBuf::init_yuv(size_t width, size_t height){
   this->u = this->y + (width * height);
   this->v = this->u + (width / 2 * height / 2);
 }
+
+void VisionBuf::init_nv12(size_t width, size_t height, size_t stride, size_t uv_offset){
+  this->rgb = false;
+  this->nv12 = true;
+  this->width = width;
+  this->height = height;
+  this->stride = stride;
+  this->uv_offset = uv_offset;
+
+  this->y = (uint8_t *)this->addr;
+  this->uv = this->y + uv_offset;
+  this->u = nullptr;
+  this->v = nullptr;
+}
@@ -18,6 +18,10 @@ enum VisionStreamType {
   VISION_STREAM_YUV_BACK,
   VISION_STREAM_YUV_FRONT,
   VISION_STREAM_YUV_WIDE,
+  VISION_STREAM_ENCODE_BACK,
+  VISION_STREAM_ENCODE_FRONT,
+  VISION_STREAM_ENCODE_WIDE,
+  VISION_STREAM_ENCODE_QCAMERA,
   VISION_STREAM_MAX,
 };
 
@@ -38,6 +42,11 @@ class VisionBuf {
   uint8_t * u = nullptr;
   uint8_t * v = nullptr;
 
+  // NV12, with the planes laid out for the video encoder
+  bool nv12 = false;
+  size_t uv_offset = 0;
+  uint8_t * uv = nullptr;
+
   // Visionipc
   uint64_t server_id = 0;
   size_t idx = 0;
@@ -55,6 +64,7 @@ class VisionBuf {
   void init_cl(cl_device_id device_id, cl_context ctx);
   void init_rgb(size_t width, size_t height, size_t stride);
   void init_yuv(size_t width, size_t height);
+  void init_nv12(size_t width, size_t height, size_t stride, size_t uv_offset);
   int sync(int dir);
   int free();
 };
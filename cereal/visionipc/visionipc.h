@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstddef>
 
 constexpr int VISIONIPC_MAX_FDS = 128;
+constexpr int VISIONIPC_MAX_CLIENTS = 64;
 
 struct VisionIpcBufExtra {
   uint32_t frame_id;
@@ -14,5 +16,21 @@ struct VisionIpcBufExtra {
 struct VisionIpcPacket {
   uint64_t server_id;
   size_t idx;
+  uint32_t seq;
   struct VisionIpcBufExtra extra;
 };
+
+// Lease table of a stream, shared with the clients as the fd after the buffer fds.
+// The server bumps seq before it checks held when reusing a buffer, a client sets its
+// bit in held before it checks that seq still matches the packet. So either the server
+// sees the lease and skips the buffer, or the client sees the new seq and drops the frame.
+struct VisionIpcLeases {
+  std::atomic<uint32_t> seq[VISIONIPC_MAX_FDS];
+  std::atomic<uint64_t> held[VISIONIPC_MAX_FDS]; // bit per client slot
+  std::atomic<int> client_pids[VISIONIPC_MAX_CLIENTS]; // 0 if free
+};
+
+struct VisionIpcServerStats {
+  uint64_t skipped; // leased buffers passed over by get_buffer
+  uint64_t overwritten; // buffers reused while leased, because all of them were
+};
@@ -1,8 +1,12 @@
 #include <chrono>
 #include <cassert>
+#include <cerrno>
 #include <iostream>
 #include <thread>
 
+#include <signal.h>
+#include <sys/mman.h>
+
 #include "visionipc/ipc.h"
 #include "visionipc/visionipc_client.h"
 #include "visionipc/visionipc_server.h"
@@ -21,6 +25,7 @@ bool VisionIpcClient::connect(bool blocking){
   connected = false;
 
   // Cleanup old buffers on reconnect
+  free_leases();
   for (size_t i = 0; i < num_buffers; i++){
     if (buffers[i].free() != 0) {
       LOGE("Failed to free buffer %zu", i);
@@ -52,12 +57,19 @@ bool VisionIpcClient::connect(bool blocking){
 
   // Get FDs
   int fds[VISIONIPC_MAX_FDS];
+  int num_fds = 0;
   VisionBuf bufs[VISIONIPC_MAX_FDS];
-  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS, &num_buffers);
+  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS, &num_fds);
 
+  num_buffers = r / sizeof(VisionBuf);
   assert(num_buffers > 0);
   assert(r == sizeof(VisionBuf) * num_buffers);
 
+  // lease table follows the buffer fds
+  if (num_fds > num_buffers) {
+    init_leases(fds[num_buffers]);
+  }
+
   // Import buffers
   for (size_t i = 0; i < num_buffers; i++){
     buffers[i] = bufs[i];
@@ -65,6 +77,8 @@ bool VisionIpcClient::connect(bool blocking){
     buffers[i].import();
     if (buffers[i].rgb) {
       buffers[i].init_rgb(buffers[i].width, buffers[i].height, buffers[i].stride);
+    } else if (buffers[i].nv12) {
+      buffers[i].init_nv12(buffers[i].width, buffers[i].height, buffers[i].stride, buffers[i].uv_offset);
     } else {
       buffers[i].init_yuv(buffers[i].width, buffers[i].height);
     }
@@ -76,6 +90,82 @@ bool VisionIpcClient::connect(bool blocking){
   return true;
 }
 
+void VisionIpcClient::init_leases(int fd) {
+  void *addr = mmap(NULL, sizeof(VisionIpcLeases), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  assert(addr != MAP_FAILED);
+  leases = (VisionIpcLeases *)addr;
+
+  // claim a free slot, or the one of a client that died
+  int pid = getpid();
+  for (int i = 0; i < VISIONIPC_MAX_CLIENTS && lease_slot < 0; i++) {
+    int cur = leases->client_pids[i];
+    bool dead = cur != 0 && kill(cur, 0) != 0 && errno == ESRCH;
+    if ((cur == 0 || dead) && leases->client_pids[i].compare_exchange_strong(cur, pid)) {
+      for (int j = 0; j < num_buffers; j++) {
+        leases->held[j].fetch_and(~(1ULL << i));
+      }
+      lease_slot = i;
+    }
+  }
+
+  if (lease_slot < 0) {
+    LOGW("visionipc %s: no free lease slot, received buffers can be overwritten", name.c_str());
+  }
+}
+
+void VisionIpcClient::free_leases() {
+  for (size_t i = 0; i < num_buffers; i++) {
+    release(&buffers[i]);
+  }
+  if (!leases) return;
+
+  release();
+  if (lease_slot >= 0) {
+    leases->client_pids[lease_slot] = 0;
+    lease_slot = -1;
+  }
+  munmap(leases, sizeof(VisionIpcLeases));
+  leases = nullptr;
+}
+
+bool VisionIpcClient::lease(size_t idx, uint32_t seq) {
+  if (lease_slot < 0) return true;
+
+  uint64_t bit = 1ULL << lease_slot;
+  leases->held[idx].fetch_or(bit);
+  if (leases->seq[idx] != seq) {
+    leases->held[idx].fetch_and(~bit);
+    return false;
+  }
+  return true;
+}
+
+void VisionIpcClient::release() {
+  if (leased_idx >= 0 && lease_slot >= 0) {
+    leases->held[leased_idx].fetch_and(~(1ULL << lease_slot));
+  }
+  leased_idx = -1;
+}
+
+void VisionIpcClient::hold() {
+  if (leased_idx >= 0) {
+    held[leased_idx] = true;
+  }
+  leased_idx = -1;
+}
+
+void VisionIpcClient::release(VisionBuf *buf) {
+  if (held[buf->idx].exchange(false) && lease_slot >= 0) {
+    leases->held[buf->idx].fetch_and(~(1ULL << lease_slot));
+  }
+}
+
+bool VisionIpcClient::lease_valid() {
+  if (leased_idx < 0) return false;
+  return lease_slot < 0 || leases->seq[leased_idx] == leased_seq;
+}
+
 VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_ms){
   auto p = poller->poll(timeout_ms);
 
@@ -101,6 +191,17 @@ VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_m
     return nullptr;
   }
 
+  // the server already reused the buffer, this frame is gone
+  if (!lease(packet->idx, packet->seq)) {
+    delete r;
+    return nullptr;
+  }
+  if (leased_idx != (int)packet->idx) {
+    release();
+  }
+  leased_idx = packet->idx;
+  leased_seq = packet->seq;
+
   if (extra) {
     *extra = packet->extra;
   }
@@ -116,6 +217,7 @@ VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_m
 
 
 VisionIpcClient::~VisionIpcClient(){
+  free_leases();
   for (size_t i = 0; i < num_buffers; i++){
     if (buffers[i].free() != 0) {
       LOGE("Failed to free buffer %zu", i);
@@ -19,7 +19,18 @@ private:
   cl_device_id device_id = nullptr;
   cl_context ctx = nullptr;
 
+  // lease on the buffer of the last received frame
+  VisionIpcLeases *leases = nullptr;
+  int lease_slot = -1;
+  int leased_idx = -1;
+  uint32_t leased_seq = 0;
+  // buffers kept leased past the next recv, see hold()
+  std::atomic<bool> held[VISIONIPC_MAX_FDS] = {};
+
   void init_msgq(bool conflate);
+  void init_leases(int fd);
+  void free_leases();
+  bool lease(size_t idx, uint32_t seq);
 
 public:
   bool connected = false;
@@ -27,6 +38,15 @@ public:
   VisionBuf buffers[VISIONIPC_MAX_FDS];
   VisionIpcClient(std::string name, VisionStreamType type, bool conflate, cl_device_id device_id=nullptr, cl_context ctx=nullptr);
   ~VisionIpcClient();
+  // The returned buffer stays leased until the next frame is received or release() is called,
+  // the server doesn't write to it in the meantime unless all its buffers are leased.
   VisionBuf * recv(VisionIpcBufExtra * extra=nullptr, const int timeout_ms=100);
+  void release();
+  // Keeps the lease on the buffer of the last received frame until release(buf), instead of
+  // dropping it with the next recv. release(buf) may be called from another thread.
+  void hold();
+  void release(VisionBuf *buf);
+  // false if the server had to reuse the buffer of the last received frame
+  bool lease_valid();
   bool connect(bool blocking=true);
 };
@@ -18,6 +18,10 @@ cpdef enum VisionStreamType:
   VISION_STREAM_YUV_BACK
   VISION_STREAM_YUV_FRONT
   VISION_STREAM_YUV_WIDE
+  VISION_STREAM_ENCODE_BACK
+  VISION_STREAM_ENCODE_FRONT
+  VISION_STREAM_ENCODE_WIDE
+  VISION_STREAM_ENCODE_QCAMERA
 
 cdef class VisionIpcServer:
   cdef cppVisionIpcServer * server
@@ -1,9 +1,15 @@
 #include <iostream>
 #include <chrono>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <random>
 
+#include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -21,6 +27,34 @@ std::string get_endpoint_name(std::string name, VisionStreamType type){
   }
 }
 
+static VisionIpcLeases *alloc_leases(int *fd) {
+  static std::atomic<int> offset = 0;
+  char full_path[0x100];
+#ifdef __APPLE__
+  snprintf(full_path, sizeof(full_path)-1, "/tmp/visionipc_leases_%d_%d", getpid(), offset++);
+#else
+  snprintf(full_path, sizeof(full_path)-1, "/dev/shm/visionipc_leases_%d_%d", getpid(), offset++);
+#endif
+
+  *fd = open(full_path, O_RDWR | O_CREAT, 0777);
+  assert(*fd >= 0);
+  unlink(full_path);
+
+  // zero filled by ftruncate
+  if (ftruncate(*fd, sizeof(VisionIpcLeases)) < 0) {
+    // no shared table, clients connect without leases and buffers are reused in order
+    LOGE("visionipc: could not size lease table %s: %s", full_path, strerror(errno));
+    close(*fd);
+    *fd = -1;
+    void *addr = mmap(NULL, sizeof(VisionIpcLeases), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(addr != MAP_FAILED);
+    return (VisionIpcLeases *)addr;
+  }
+  void *addr = mmap(NULL, sizeof(VisionIpcLeases), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  assert(addr != MAP_FAILED);
+  return (VisionIpcLeases *)addr;
+}
+
 VisionIpcServer::VisionIpcServer(std::string name, cl_device_id device_id, cl_context ctx) : name(name), device_id(device_id), ctx(ctx) {
   msg_ctx = Context::create();
 
@@ -45,7 +79,22 @@ void VisionIpcServer::create_buffers(VisionStreamType type, size_t num_buffers,
     size = width * height * 3 / 2;
   }
 
+  alloc_buffers(type, num_buffers, size, [&](VisionBuf *buf) {
+    rgb ? buf->init_rgb(width, height, stride) : buf->init_yuv(width, height);
+  });
+}
+
+void VisionIpcServer::create_buffers_nv12(VisionStreamType type, size_t num_buffers, size_t width, size_t height,
+                                          size_t size, size_t stride, size_t uv_offset){
+  assert(num_buffers < VISIONIPC_MAX_FDS);
+  assert(uv_offset + stride * height / 2 <= size);
 
+  alloc_buffers(type, num_buffers, size, [&](VisionBuf *buf) {
+    buf->init_nv12(width, height, stride, uv_offset);
+  });
+}
+
+void VisionIpcServer::alloc_buffers(VisionStreamType type, size_t num_buffers, size_t size, std::function<void(VisionBuf *)> init){
   // Create map + alloc requested buffers
   for (size_t i = 0; i < num_buffers; i++){
     VisionBuf* buf = new VisionBuf();
@@ -55,12 +104,14 @@ void VisionIpcServer::create_buffers(VisionStreamType type, size_t num_buffers,
 
     if (device_id) buf->init_cl(device_id, ctx);
 
-    rgb ? buf->init_rgb(width, height, stride) : buf->init_yuv(width, height);
+    init(buf);
 
     buffers[type].push_back(buf);
   }
 
   cur_idx[type] = 0;
+  leases[type] = alloc_leases(&lease_fds[type]);
+  stats[type] = {};
 
   // Create msgq publisher for each of the `name` + type combos
   // TODO: compute port number directly if using zmq
@@ -127,7 +178,14 @@ void VisionIpcServer::listener(){
       bufs[i].server_id = server_id;
     }
 
-    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_fds, fds, num_fds, nullptr);
+    // lease table goes after the buffers
+    int num_send_fds = num_fds;
+    if (lease_fds[type] >= 0) {
+      assert(num_fds < VISIONIPC_MAX_FDS);
+      fds[num_send_fds++] = lease_fds[type];
+    }
+
+    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_fds, fds, num_send_fds, nullptr);
 
     close(fd);
   }
@@ -138,11 +196,55 @@ void VisionIpcServer::listener(){
 
 
 
+bool VisionIpcServer::leased(VisionIpcLeases *l, size_t idx) {
+  uint64_t held = l->held[idx].load();
+  for (int slot = 0; held != 0 && slot < VISIONIPC_MAX_CLIENTS; slot++) {
+    uint64_t bit = 1ULL << slot;
+    if (!(held & bit)) continue;
+
+    // drop leases of clients that died while holding the buffer
+    int pid = l->client_pids[slot].load();
+    if (pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH)) {
+      l->held[idx].fetch_and(~bit);
+      held &= ~bit;
+      if (pid != 0 && l->client_pids[slot].compare_exchange_strong(pid, 0)) {
+        LOGW("visionipc %s: reclaimed lease slot %d of dead client %d", name.c_str(), slot, pid);
+      }
+    }
+  }
+  return held != 0;
+}
+
 VisionBuf * VisionIpcServer::get_buffer(VisionStreamType type){
-  // Do we want to keep track if the buffer has been sent out yet and warn user?
   assert(buffers.count(type));
-  auto b = buffers[type];
-  return b[cur_idx[type]++ % b.size()];
+  auto &b = buffers[type];
+  VisionIpcLeases *l = leases[type];
+
+  // next buffer in order that no client holds a lease on. seq is bumped first so a client
+  // can't lease it after the check, and put back if the buffer turns out to be leased
+  for (size_t i = 0; i < b.size(); i++) {
+    size_t idx = cur_idx[type]++ % b.size();
+    l->seq[idx]++;
+    if (!leased(l, idx)) {
+      return b[idx];
+    }
+    l->seq[idx]--;
+    stats[type].skipped++;
+  }
+
+  // all buffers are leased, the clients can't keep up. reuse the next one anyway,
+  // its clients see the bumped seq through VisionIpcClient::lease_valid
+  size_t idx = cur_idx[type]++ % b.size();
+  l->seq[idx]++;
+  if (stats[type].overwritten++ % 100 == 0) {
+    LOGW("visionipc %s: all %zu buffers of stream %d are leased", name.c_str(), b.size(), (int)type);
+  }
+  return b[idx];
+}
+
+VisionIpcServerStats VisionIpcServer::get_stats(VisionStreamType type) {
+  assert(stats.count(type));
+  return stats[type];
 }
 
 void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync){
@@ -158,6 +260,7 @@ void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync
   VisionIpcPacket packet = {0};
   packet.server_id = server_id;
   packet.idx = buf->idx;
+  packet.seq = leases[buf->type]->seq[buf->idx];
   packet.extra = *extra;
 
   sockets[buf->type]->send((char*)&packet, sizeof(packet));
@@ -177,6 +280,11 @@ VisionIpcServer::~VisionIpcServer(){
     }
   }
 
+  for (auto const& [type, l] : leases) {
+    munmap(l, sizeof(VisionIpcLeases));
+    if (lease_fds[type] >= 0) close(lease_fds[type]);
+  }
+
   // Messaging cleanup
   for( auto const& [type, sock] : sockets ) {
     delete sock;
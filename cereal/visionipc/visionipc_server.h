@@ -3,6 +3,7 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <functional>
 #include <map>
 
 #include "messaging/messaging.h"
@@ -25,18 +26,28 @@ class VisionIpcServer {
   std::map<VisionStreamType, std::vector<VisionBuf*> > buffers;
   std::map<VisionStreamType, std::map<VisionBuf*, size_t> > idxs;
 
+  std::map<VisionStreamType, VisionIpcLeases*> leases;
+  std::map<VisionStreamType, int> lease_fds;
+  std::map<VisionStreamType, VisionIpcServerStats> stats;
+  bool leased(VisionIpcLeases *l, size_t idx);
+
   Context * msg_ctx;
   std::map<VisionStreamType, PubSocket*> sockets;
 
   void listener(void);
+  void alloc_buffers(VisionStreamType type, size_t num_buffers, size_t size, std::function<void(VisionBuf *)> init);
 
  public:
   VisionIpcServer(std::string name, cl_device_id device_id=nullptr, cl_context ctx=nullptr);
   ~VisionIpcServer();
 
   VisionBuf * get_buffer(VisionStreamType type);
+  VisionIpcServerStats get_stats(VisionStreamType type);
 
   void create_buffers(VisionStreamType type, size_t num_buffers, bool rgb, size_t width, size_t height);
+  // NV12 in a caller defined layout, e.g. the one the hardware video encoder reads
+  void create_buffers_nv12(VisionStreamType type, size_t num_buffers, size_t width, size_t height,
+                           size_t size, size_t stride, size_t uv_offset);
   void send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync=true);
   void start_listener();
 };
@@ -52,6 +52,24 @@ TEST_CASE("Check yuv/rgb"){
   REQUIRE(client_yuv.buffers[0].rgb == false);
 }
 
+TEST_CASE("Check nv12"){
+  const size_t width = 100, height = 50, stride = 128, uv_offset = stride * 64;
+  VisionIpcServer server("camerad");
+  server.create_buffers_nv12(VISION_STREAM_ENCODE_BACK, 2, width, height, uv_offset + stride * 32, stride, uv_offset);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ENCODE_BACK, false);
+  REQUIRE(client.connect());
+
+  VisionBuf &buf = client.buffers[0];
+  REQUIRE(buf.nv12);
+  REQUIRE_FALSE(buf.rgb);
+  REQUIRE(buf.width == width);
+  REQUIRE(buf.stride == stride);
+  REQUIRE(buf.y == (uint8_t *)buf.addr);
+  REQUIRE(buf.uv == buf.y + uv_offset);
+}
+
 TEST_CASE("Send single buffer"){
   VisionIpcServer server("camerad");
   server.create_buffers(VISION_STREAM_YUV_BACK, 1, true, 100, 100);
@@ -133,3 +151,82 @@ TEST_CASE("Test conflate"){
   recv_buf = client.recv(&extra_recv);
   REQUIRE(recv_buf == nullptr);
 }
+
+TEST_CASE("Leased buffers are skipped"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_YUV_BACK, 3, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_YUV_BACK, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_YUV_BACK);
+  VisionIpcBufExtra extra = {0};
+  server.send(buf, &extra);
+
+  VisionBuf * recv_buf = client.recv(&extra);
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(client.lease_valid());
+
+  // the received buffer is never handed out again while it's leased
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(server.get_buffer(VISION_STREAM_YUV_BACK)->idx != recv_buf->idx);
+  }
+  REQUIRE(client.lease_valid());
+  REQUIRE(server.get_stats(VISION_STREAM_YUV_BACK).skipped == 1);
+
+  client.release();
+  REQUIRE(server.get_buffer(VISION_STREAM_YUV_BACK)->idx == recv_buf->idx);
+}
+
+TEST_CASE("Reused buffers invalidate the lease"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_YUV_BACK, 1, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_YUV_BACK, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_YUV_BACK);
+  VisionIpcBufExtra extra = {0};
+  server.send(buf, &extra);
+  REQUIRE(client.recv(&extra) != nullptr);
+  REQUIRE(client.lease_valid());
+
+  // only buffer is leased, the server has to take it anyway
+  REQUIRE(server.get_buffer(VISION_STREAM_YUV_BACK) == buf);
+  REQUIRE(!client.lease_valid());
+  REQUIRE(server.get_stats(VISION_STREAM_YUV_BACK).overwritten == 1);
+}
+
+TEST_CASE("Held buffers stay leased until released"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_YUV_BACK, 3, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_YUV_BACK, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionIpcBufExtra extra = {0};
+  server.send(server.get_buffer(VISION_STREAM_YUV_BACK), &extra);
+  VisionBuf * held_buf = client.recv(&extra);
+  REQUIRE(held_buf != nullptr);
+  client.hold();
+
+  // receiving the next frame doesn't drop the lease on the held one
+  server.send(server.get_buffer(VISION_STREAM_YUV_BACK), &extra);
+  VisionBuf * recv_buf = client.recv(&extra);
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(recv_buf != held_buf);
+  for (int i = 0; i < 4; i++) {
+    size_t idx = server.get_buffer(VISION_STREAM_YUV_BACK)->idx;
+    REQUIRE(idx != held_buf->idx);
+    REQUIRE(idx != recv_buf->idx);
+  }
+
+  client.release(held_buf);
+  REQUIRE(server.get_buffer(VISION_STREAM_YUV_BACK)->idx == held_buf->idx);
+}
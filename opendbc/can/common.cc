@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cassert>
+
 #include "common.h"
 
 unsigned int honda_checksum(unsigned int address, uint64_t d, int l) {
@@ -217,3 +220,22 @@ uint64_t read_u64_le(const uint8_t* v) {
           | ((uint64_t)v[6] << 48)
           | ((uint64_t)v[7] << 56));
 }
+
+SignalPlan signal_plan(const Signal &sig) {
+  // smallest 8 byte window ending at the last byte of the signal, classic frames always use byte 0.
+  // b1 is the lsb for little endian signals and the msb in big endian bit order otherwise
+  int last_byte = (sig.b1 + sig.b2 - 1) / 8;
+  int byte_offset = std::max(0, last_byte - 7);
+  int shift = sig.is_little_endian ? sig.b1 - 8 * byte_offset : 8 * (byte_offset + 8) - (sig.b1 + sig.b2);
+  assert(shift >= 0 && shift + sig.b2 <= 64);
+
+  return (SignalPlan){
+    .mask = (1ULL << sig.b2) - 1,
+    .sign_bit = sig.is_signed ? (1ULL << (sig.b2 - 1)) : 0,
+    .factor = sig.factor,
+    .offset = sig.offset,
+    .byte_offset = (uint8_t)byte_offset,
+    .shift = (uint8_t)shift,
+    .is_little_endian = sig.is_little_endian,
+  };
+}
@@ -13,6 +13,8 @@
 #endif
 
 #define MAX_BAD_COUNTER 5
+#define MAX_STD_ADDRESS 0x7FF
+#define CANFD_MAX_SIZE 64
 
 // Helper functions
 unsigned int honda_checksum(unsigned int address, uint64_t d, int l);
@@ -25,12 +27,27 @@ unsigned int pedal_checksum(uint64_t d, int l);
 uint64_t read_u64_be(const uint8_t* v);
 uint64_t read_u64_le(const uint8_t* v);
 
+typedef unsigned int (*ChecksumFunc)(uint32_t address, uint64_t d, int l);
+
+// Precompiled extraction of one signal from the 64 bit window of message data at byte_offset
+struct SignalPlan {
+  uint64_t mask;
+  uint64_t sign_bit; // 0 for unsigned signals
+  double factor, offset;
+  uint8_t byte_offset;
+  uint8_t shift;
+  bool is_little_endian;
+};
+
+SignalPlan signal_plan(const Signal &sig);
+
 class MessageState {
 public:
   uint32_t address;
   unsigned int size;
 
   std::vector<Signal> parse_sigs;
+  std::vector<SignalPlan> plan;
   std::vector<double> vals;
 
   uint16_t ts;
@@ -43,17 +60,34 @@ public:
   bool ignore_checksum = false;
   bool ignore_counter = false;
 
+  // validators resolved from parse_sigs by compile(), index -1 if unused
+  ChecksumFunc checksum_func = nullptr;
+  bool checksum_le = false;
+  int checksum_idx = -1;
+  int counter_idx = -1;
+  int counter_size = 0;
+
+  void compile();
+  // dat is zero padded to CANFD_MAX_SIZE
   bool parse(uint64_t sec, uint16_t ts_, uint8_t * dat);
+  bool check_counter(const uint8_t *dat);
   bool update_counter_generic(int64_t v, int cnt_size);
 };
 
 class CANParser {
 private:
+  friend class CANParserGroup;
+
   const int bus;
   kj::Array<capnp::word> aligned_buf;
 
   const DBC *dbc = NULL;
-  std::unordered_map<uint32_t, MessageState> message_states;
+  // sorted by address, with a dense index for standard 11 bit addresses
+  std::vector<MessageState> message_states;
+  std::vector<int16_t> std_lookup;
+
+  void set_message_states(std::map<uint32_t, MessageState> &states);
+  MessageState *lookup_state(uint32_t address);
 
 public:
   bool can_valid = false;
@@ -72,6 +106,20 @@ public:
   std::vector<SignalValue> query_latest();
 };
 
+// Updates several CANParsers from one decoded event, dispatching each frame to the parsers on its bus
+class CANParserGroup {
+private:
+  kj::Array<capnp::word> aligned_buf;
+  std::vector<CANParser *> parsers;
+  std::vector<std::vector<CANParser *>> bus_parsers;
+
+public:
+  void add(CANParser *parser);
+  #ifndef DYNAMIC_CAPNP
+  void update_string(const std::string &data, bool sendcan);
+  #endif
+};
+
 class CANPacker {
 private:
   const DBC *dbc = NULL;
@@ -80,6 +128,6 @@ private:
 
 public:
   CANPacker(const std::string& dbc_name);
-  uint64_t pack(uint32_t address, const std::vector<SignalPackValue> &values, int counter);
+  std::vector<uint8_t> pack(uint32_t address, const std::vector<SignalPackValue> &values, int counter);
   Msg* lookup_message(uint32_t address);
 };
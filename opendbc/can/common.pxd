@@ -1,7 +1,7 @@
 # distutils: language = c++
 #cython: language_level=3
 
-from libc.stdint cimport uint32_t, uint64_t, uint16_t
+from libc.stdint cimport uint8_t, uint32_t, uint64_t, uint16_t
 from libcpp.vector cimport vector
 from libcpp.map cimport map
 from libcpp.string cimport string
@@ -79,6 +79,10 @@ cdef extern from "common.h":
     void update_string(string, bool)
     vector[SignalValue] query_latest()
 
+  cdef cppclass CANParserGroup:
+    void add(CANParser *)
+    void update_string(string, bool)
+
   cdef cppclass CANPacker:
    CANPacker(string)
-   uint64_t pack(uint32_t, vector[SignalPackValue], int counter)
+   vector[uint8_t] pack(uint32_t, vector[SignalPackValue], int counter)
@@ -8,29 +8,18 @@
 
 #define WARN printf
 
-// this is the same as read_u64_le, but uses uint64_t as in/out
-uint64_t ReverseBytes(uint64_t x) {
-  return ((x & 0xff00000000000000ull) >> 56) |
-          ((x & 0x00ff000000000000ull) >> 40) |
-          ((x & 0x0000ff0000000000ull) >> 24) |
-          ((x & 0x000000ff00000000ull) >> 8) |
-          ((x & 0x00000000ff000000ull) << 8) |
-          ((x & 0x0000000000ff0000ull) << 24) |
-          ((x & 0x000000000000ff00ull) << 40) |
-          ((x & 0x00000000000000ffull) << 56);
-}
+static void set_value(std::vector<uint8_t> &dat, const Signal& sig, int64_t ival) {
+  SignalPlan p = signal_plan(sig);
+
+  // the 64 bit window at byte_offset, as it would be read by the parser
+  uint64_t v = p.is_little_endian ? read_u64_le(&dat[p.byte_offset]) : read_u64_be(&dat[p.byte_offset]);
+  v &= ~(p.mask << p.shift);
+  v |= (ival & p.mask) << p.shift;
 
-static uint64_t set_value(uint64_t ret, const Signal& sig, int64_t ival) {
-  int shift = sig.is_little_endian? sig.b1 : sig.bo;
-  uint64_t mask = ((1ULL << sig.b2)-1) << shift;
-  uint64_t dat = (ival & ((1ULL << sig.b2)-1)) << shift;
-  if (sig.is_little_endian) {
-    dat = ReverseBytes(dat);
-    mask = ReverseBytes(mask);
+  for (int i = 0; i < 8; i++) {
+    int byte = p.is_little_endian ? i : 7 - i;
+    dat[p.byte_offset + byte] = (v >> (8 * i)) & 0xFF;
   }
-  ret &= ~mask;
-  ret |= dat;
-  return ret;
 }
 
 CANPacker::CANPacker(const std::string& dbc_name) {
@@ -48,8 +37,16 @@ CANPacker::CANPacker(const std::string& dbc_name) {
   init_crc_lookup_tables();
 }
 
-uint64_t CANPacker::pack(uint32_t address, const std::vector<SignalPackValue> &signals, int counter) {
-  uint64_t ret = 0;
+std::vector<uint8_t> CANPacker::pack(uint32_t address, const std::vector<SignalPackValue> &signals, int counter) {
+  auto msg_it = message_lookup.find(address);
+  if (msg_it == message_lookup.end()) {
+    WARN("undefined address %d\n", address);
+    return {};
+  }
+  const unsigned int size = msg_it->second.size;
+
+  // padded so every signal window is in bounds, trimmed to the message size at the end
+  std::vector<uint8_t> ret(CANFD_MAX_SIZE, 0);
   for (const auto& sigval : signals) {
     std::string name = std::string(sigval.name);
     double value = sigval.value;
@@ -66,13 +63,14 @@ uint64_t CANPacker::pack(uint32_t address, const std::vector<SignalPackValue> &s
       ival = (1ULL << sig.b2) + ival;
     }
 
-    ret = set_value(ret, sig, ival);
+    set_value(ret, sig, ival);
   }
 
   if (counter >= 0){
     auto sig_it = signal_lookup.find(std::make_pair(address, "COUNTER"));
     if (sig_it == signal_lookup.end()) {
       WARN("COUNTER not defined\n");
+      ret.resize(size);
       return ret;
     }
     const auto& sig = sig_it->second;
@@ -81,35 +79,36 @@ uint64_t CANPacker::pack(uint32_t address, const std::vector<SignalPackValue> &s
       WARN("COUNTER signal type not valid\n");
     }
 
-    ret = set_value(ret, sig, counter);
+    set_value(ret, sig, counter);
   }
 
+  // checksums are only defined over the first 8 bytes of classic frames
   auto sig_it_checksum = signal_lookup.find(std::make_pair(address, "CHECKSUM"));
-  if (sig_it_checksum != signal_lookup.end()) {
+  if (sig_it_checksum != signal_lookup.end() && size <= 8) {
     const auto& sig = sig_it_checksum->second;
+    uint64_t dat_be = read_u64_be(ret.data());
+    uint64_t dat_le = read_u64_le(ret.data());
     if (sig.type == SignalType::HONDA_CHECKSUM) {
-      unsigned int chksm = honda_checksum(address, ret, message_lookup[address].size);
-      ret = set_value(ret, sig, chksm);
+      unsigned int chksm = honda_checksum(address, dat_be, size);
+      set_value(ret, sig, chksm);
     } else if (sig.type == SignalType::TOYOTA_CHECKSUM) {
-      unsigned int chksm = toyota_checksum(address, ret, message_lookup[address].size);
-      ret = set_value(ret, sig, chksm);
+      unsigned int chksm = toyota_checksum(address, dat_be, size);
+      set_value(ret, sig, chksm);
     } else if (sig.type == SignalType::VOLKSWAGEN_CHECKSUM) {
-      // FIXME: Hackish fix for an endianness issue. The message is in reverse byte order
-      // until later in the pack process. Checksums can be run backwards, CRCs not so much.
-      // The correct fix is unclear but this works for the moment.
-      unsigned int chksm = volkswagen_crc(address, ReverseBytes(ret), message_lookup[address].size);
-      ret = set_value(ret, sig, chksm);
+      unsigned int chksm = volkswagen_crc(address, dat_le, size);
+      set_value(ret, sig, chksm);
     } else if (sig.type == SignalType::SUBARU_CHECKSUM) {
-      unsigned int chksm = subaru_checksum(address, ret, message_lookup[address].size);
-      ret = set_value(ret, sig, chksm);
+      unsigned int chksm = subaru_checksum(address, dat_be, size);
+      set_value(ret, sig, chksm);
     } else if (sig.type == SignalType::CHRYSLER_CHECKSUM) {
-      unsigned int chksm = chrysler_checksum(address, ReverseBytes(ret), message_lookup[address].size);
-      ret = set_value(ret, sig, chksm);
+      unsigned int chksm = chrysler_checksum(address, dat_le, size);
+      set_value(ret, sig, chksm);
     } else {
       //WARN("CHECKSUM signal type not valid\n");
     }
   }
 
+  ret.resize(size);
   return ret;
 }
 
@@ -1,7 +1,7 @@
 # distutils: language = c++
 # cython: c_string_encoding=ascii, language_level=3
 
-from libc.stdint cimport uint32_t, uint64_t
+from libc.stdint cimport uint8_t, uint32_t, uint64_t
 from libcpp.vector cimport vector
 from libcpp.map cimport map
 from libcpp.string cimport string
@@ -31,7 +31,7 @@ cdef class CANPacker:
       self.name_to_address_and_size[string(msg.name)] = (msg.address, msg.size)
       self.address_to_size[msg.address] = msg.size
 
-  cdef uint64_t pack(self, addr, values, counter):
+  cdef vector[uint8_t] pack(self, addr, values, counter):
     cdef vector[SignalPackValue] values_thing
     cdef SignalPackValue spv
 
@@ -47,16 +47,6 @@ cdef class CANPacker:
 
     return self.packer.pack(addr, values_thing, counter)
 
-  cdef inline uint64_t ReverseBytes(self, uint64_t x):
-    return (((x & 0xff00000000000000ull) >> 56) |
-           ((x & 0x00ff000000000000ull) >> 40) |
-           ((x & 0x0000ff0000000000ull) >> 24) |
-           ((x & 0x000000ff00000000ull) >> 8) |
-           ((x & 0x00000000ff000000ull) << 8) |
-           ((x & 0x0000000000ff0000ull) << 24) |
-           ((x & 0x000000000000ff00ull) << 40) |
-           ((x & 0x00000000000000ffull) << 56))
-
   cpdef make_can_msg(self, name_or_addr, bus, values, counter=-1):
     cdef int addr, size
     if type(name_or_addr) == int:
@@ -64,6 +54,5 @@ cdef class CANPacker:
       size = self.address_to_size[name_or_addr]
     else:
       addr, size = self.name_to_address_and_size[name_or_addr.encode('utf8')]
-    cdef uint64_t val = self.pack(addr, values, counter)
-    val = self.ReverseBytes(val)
-    return [addr, 0, (<char *>&val)[:size], bus]
+    cdef vector[uint8_t] val = self.pack(addr, values, counter)
+    return [addr, 0, (<char *>&val[0])[:val.size()], bus]
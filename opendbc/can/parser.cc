@@ -13,76 +13,83 @@
 // #define DEBUG printf
 #define INFO printf
 
-bool MessageState::parse(uint64_t sec, uint16_t ts_, uint8_t * dat) {
-  uint64_t dat_le = read_u64_le(dat);
-  uint64_t dat_be = read_u64_be(dat);
-
-  for (int i=0; i < parse_sigs.size(); i++) {
-    auto& sig = parse_sigs[i];
-    int64_t tmp;
-
-    if (sig.is_little_endian){
-      tmp = (dat_le >> sig.b1) & ((1ULL << sig.b2)-1);
-    } else {
-      tmp = (dat_be >> sig.bo) & ((1ULL << sig.b2)-1);
-    }
+static unsigned int pedal_checksum_addr(uint32_t address, uint64_t d, int l) {
+  return pedal_checksum(d, l);
+}
 
-    if (sig.is_signed) {
-      tmp -= (tmp >> (sig.b2-1)) ? (1ULL << sig.b2) : 0; //signed
-    }
+static inline int64_t extract(const SignalPlan &p, const uint8_t *dat) {
+  // all supported platforms are little endian
+  uint64_t v;
+  memcpy(&v, dat + p.byte_offset, sizeof(v));
+  if (!p.is_little_endian) {
+    v = __builtin_bswap64(v);
+  }
 
-    DEBUG("parse 0x%X %s -> %lld\n", address, sig.name, tmp);
+  int64_t tmp = (v >> p.shift) & p.mask;
+  if (tmp & p.sign_bit) {
+    tmp -= p.sign_bit << 1; //signed
+  }
+  return tmp;
+}
 
-    if (!ignore_checksum) {
-      if (sig.type == SignalType::HONDA_CHECKSUM) {
-        if (honda_checksum(address, dat_be, size) != tmp) {
-          INFO("0x%X CHECKSUM FAIL\n", address);
-          return false;
-        }
-      } else if (sig.type == SignalType::TOYOTA_CHECKSUM) {
-        if (toyota_checksum(address, dat_be, size) != tmp) {
-          INFO("0x%X CHECKSUM FAIL\n", address);
-          return false;
-        }
-      } else if (sig.type == SignalType::VOLKSWAGEN_CHECKSUM) {
-        if (volkswagen_crc(address, dat_le, size) != tmp) {
-          INFO("0x%X CRC FAIL\n", address);
-          return false;
-        }
-      } else if (sig.type == SignalType::SUBARU_CHECKSUM) {
-        if (subaru_checksum(address, dat_be, size) != tmp) {
-          INFO("0x%X CHECKSUM FAIL\n", address);
-          return false;
+void MessageState::compile() {
+  plan.clear();
+  checksum_func = nullptr;
+  checksum_idx = counter_idx = -1;
+
+  for (int i = 0; i < parse_sigs.size(); i++) {
+    const Signal &sig = parse_sigs[i];
+    plan.push_back(signal_plan(sig));
+
+    ChecksumFunc func = nullptr;
+    bool le = false;
+    switch (sig.type) {
+      case SignalType::HONDA_CHECKSUM: func = honda_checksum; break;
+      case SignalType::TOYOTA_CHECKSUM: func = toyota_checksum; break;
+      case SignalType::VOLKSWAGEN_CHECKSUM: func = volkswagen_crc; le = true; break;
+      case SignalType::SUBARU_CHECKSUM: func = subaru_checksum; break;
+      case SignalType::CHRYSLER_CHECKSUM: func = chrysler_checksum; le = true; break;
+      case SignalType::PEDAL_CHECKSUM: func = pedal_checksum_addr; break;
+      case SignalType::HONDA_COUNTER:
+      case SignalType::VOLKSWAGEN_COUNTER:
+      case SignalType::PEDAL_COUNTER:
+        if (!ignore_counter && counter_idx < 0) {
+          counter_idx = i;
+          counter_size = sig.b2;
         }
-      } else if (sig.type == SignalType::CHRYSLER_CHECKSUM) {
-        if (chrysler_checksum(address, dat_le, size) != tmp) {
-          INFO("0x%X CHECKSUM FAIL\n", address);
-          return false;
-        }
-      } else if (sig.type == SignalType::PEDAL_CHECKSUM) {
-        if (pedal_checksum(dat_be, size) != tmp) {
-          INFO("0x%X PEDAL CHECKSUM FAIL\n", address);
-          return false;
-        }
-      }
+        break;
+      default: break;
     }
-    if (!ignore_counter) {
-      if (sig.type == SignalType::HONDA_COUNTER) {
-        if (!update_counter_generic(tmp, sig.b2)) {
-          return false;
-        }
-      } else if (sig.type == SignalType::VOLKSWAGEN_COUNTER) {
-          if (!update_counter_generic(tmp, sig.b2)) {
-          return false;
-        }
-      } else if (sig.type == SignalType::PEDAL_COUNTER) {
-        if (!update_counter_generic(tmp, sig.b2)) {
-          return false;
-        }
-      }
+    // checksums are only defined over the first 8 bytes of classic frames
+    if (func && !ignore_checksum && checksum_idx < 0 && size <= 8) {
+      checksum_func = func;
+      checksum_le = le;
+      checksum_idx = i;
     }
+  }
+}
 
-    vals[i] = tmp * sig.factor + sig.offset;
+bool MessageState::parse(uint64_t sec, uint16_t ts_, uint8_t * dat) {
+  // validate before touching vals, so a bad frame doesn't partially update the message.
+  // checks run in signal order, a counter ahead of the checksum is still tracked on a checksum failure
+  bool counter_first = counter_idx >= 0 && counter_idx < checksum_idx;
+  if (counter_first && !check_counter(dat)) {
+    return false;
+  }
+  if (checksum_idx >= 0) {
+    int64_t tmp = extract(plan[checksum_idx], dat);
+    if (checksum_func(address, checksum_le ? read_u64_le(dat) : read_u64_be(dat), size) != tmp) {
+      INFO("0x%X CHECKSUM FAIL\n", address);
+      return false;
+    }
+  }
+  if (!counter_first && counter_idx >= 0 && !check_counter(dat)) {
+    return false;
+  }
+
+  for (int i = 0; i < plan.size(); i++) {
+    const SignalPlan &p = plan[i];
+    vals[i] = extract(p, dat) * p.factor + p.offset;
   }
   ts = ts_;
   seen = sec;
@@ -90,6 +97,9 @@ bool MessageState::parse(uint64_t sec, uint16_t ts_, uint8_t * dat) {
   return true;
 }
 
+bool MessageState::check_counter(const uint8_t *dat) {
+  return update_counter_generic(extract(plan[counter_idx], dat), counter_size);
+}
 
 bool MessageState::update_counter_generic(int64_t v, int cnt_size) {
   uint8_t old_counter = counter;
@@ -118,8 +128,9 @@ CANParser::CANParser(int abus, const std::string& dbc_name,
   assert(dbc);
   init_crc_lookup_tables();
 
+  std::map<uint32_t, MessageState> states;
   for (const auto& op : options) {
-    MessageState &state = message_states[op.address];
+    MessageState &state = states[op.address];
     state.address = op.address;
     // state.check_frequency = op.check_frequency,
 
@@ -166,6 +177,7 @@ CANParser::CANParser(int abus, const std::string& dbc_name,
       }
     }
   }
+  set_message_states(states);
 }
 
 CANParser::CANParser(int abus, const std::string& dbc_name, bool ignore_checksum, bool ignore_counter)
@@ -176,6 +188,7 @@ CANParser::CANParser(int abus, const std::string& dbc_name, bool ignore_checksum
   assert(dbc);
   init_crc_lookup_tables();
 
+  std::map<uint32_t, MessageState> states;
   for (int i = 0; i < dbc->num_msgs; i++) {
     const Msg* msg = &dbc->msgs[i];
     MessageState state = {
@@ -191,8 +204,35 @@ CANParser::CANParser(int abus, const std::string& dbc_name, bool ignore_checksum
       state.vals.push_back(0);
     }
 
-    message_states[state.address] = state;
+    states[state.address] = state;
+  }
+  set_message_states(states);
+}
+
+void CANParser::set_message_states(std::map<uint32_t, MessageState> &states) {
+  message_states.clear();
+  message_states.reserve(states.size());
+  std_lookup.assign(MAX_STD_ADDRESS + 1, -1);
+
+  for (auto &kv : states) {
+    kv.second.compile();
+    if (kv.first <= MAX_STD_ADDRESS) {
+      std_lookup[kv.first] = message_states.size();
+    }
+    message_states.push_back(std::move(kv.second));
+  }
+}
+
+MessageState *CANParser::lookup_state(uint32_t address) {
+  if (address <= MAX_STD_ADDRESS) {
+    int16_t idx = std_lookup[address];
+    return idx < 0 ? nullptr : &message_states[idx];
   }
+
+  // extended addresses, binary search
+  auto it = std::lower_bound(message_states.begin(), message_states.end(), address,
+                             [](const MessageState &state, uint32_t addr) { return state.address < addr; });
+  return (it != message_states.end() && it->address == address) ? &(*it) : nullptr;
 }
 
 #ifndef DYNAMIC_CAPNP
@@ -228,17 +268,17 @@ void CANParser::UpdateCans(uint64_t sec, const capnp::List<cereal::CanData>::Rea
       // DEBUG("skip %d: wrong bus\n", cmsg.getAddress());
       continue;
     }
-    auto state_it = message_states.find(cmsg.getAddress());
-    if (state_it == message_states.end()) {
+    MessageState *state = lookup_state(cmsg.getAddress());
+    if (!state) {
       // DEBUG("skip %d: not specified\n", cmsg.getAddress());
       continue;
     }
 
-    if (cmsg.getDat().size() > 8) continue; //shouldn't ever happen
-    uint8_t dat[8] = {0};
+    if (cmsg.getDat().size() > CANFD_MAX_SIZE) continue; //shouldn't ever happen
+    uint8_t dat[CANFD_MAX_SIZE] = {0};
     memcpy(dat, cmsg.getDat().begin(), cmsg.getDat().size());
 
-    state_it->second.parse(sec, cmsg.getBusTime(), dat);
+    state->parse(sec, cmsg.getBusTime(), dat);
   }
 }
 #endif
@@ -252,23 +292,22 @@ void CANParser::UpdateCans(uint64_t sec, const capnp::DynamicStruct::Reader& cms
     return;
   }
 
-  auto state_it = message_states.find(cmsg.get("address").as<uint32_t>());
-  if (state_it == message_states.end()) {
+  MessageState *state = lookup_state(cmsg.get("address").as<uint32_t>());
+  if (!state) {
     DEBUG("skip %d: not specified\n", cmsg.get("address").as<uint32_t>());
     return;
   }
 
   auto dat = cmsg.get("dat").as<capnp::Data>();
-  if (dat.size() > 8) return; //shouldn't ever happen
-  uint8_t data[8] = {0};
+  if (dat.size() > CANFD_MAX_SIZE) return; //shouldn't ever happen
+  uint8_t data[CANFD_MAX_SIZE] = {0};
   memcpy(data, dat.begin(), dat.size());
-  state_it->second.parse(sec, cmsg.get("busTime").as<uint16_t>(), data);
+  state->parse(sec, cmsg.get("busTime").as<uint16_t>(), data);
 }
 
 void CANParser::UpdateValid(uint64_t sec) {
   can_valid = true;
-  for (const auto& kv : message_states) {
-    const auto& state = kv.second;
+  for (const auto& state : message_states) {
     if (state.check_threshold > 0 && (sec - state.seen) > state.check_threshold) {
       if (state.seen > 0) {
         DEBUG("0x%X TIMEOUT\n", state.address);
@@ -283,8 +322,7 @@ void CANParser::UpdateValid(uint64_t sec) {
 std::vector<SignalValue> CANParser::query_latest() {
   std::vector<SignalValue> ret;
 
-  for (const auto& kv : message_states) {
-    const auto& state = kv.second;
+  for (const auto& state : message_states) {
     if (last_sec != 0 && state.seen != last_sec) continue;
 
     for (int i=0; i<state.parse_sigs.size(); i++) {
@@ -300,3 +338,52 @@ std::vector<SignalValue> CANParser::query_latest() {
 
   return ret;
 }
+
+void CANParserGroup::add(CANParser *parser) {
+  parsers.push_back(parser);
+  if (parser->bus >= bus_parsers.size()) {
+    bus_parsers.resize(parser->bus + 1);
+  }
+  bus_parsers[parser->bus].push_back(parser);
+}
+
+#ifndef DYNAMIC_CAPNP
+void CANParserGroup::update_string(const std::string &data, bool sendcan) {
+  // format for board, make copy due to alignment issues.
+  const size_t buf_size = (data.length() / sizeof(capnp::word)) + 1;
+  if (aligned_buf.size() < buf_size) {
+    aligned_buf = kj::heapArray<capnp::word>(buf_size);
+  }
+  memcpy(aligned_buf.begin(), data.data(), data.length());
+
+  // extract the messages once for all parsers
+  capnp::FlatArrayMessageReader cmsg(aligned_buf.slice(0, buf_size));
+  cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
+  const uint64_t sec = event.getLogMonoTime();
+
+  auto cans = sendcan? event.getSendcan() : event.getCan();
+  uint8_t dat[CANFD_MAX_SIZE];
+  for (auto can : cans) {
+    if (can.getSrc() >= bus_parsers.size()) continue;
+
+    bool copied = false;
+    for (CANParser *parser : bus_parsers[can.getSrc()]) {
+      MessageState *state = parser->lookup_state(can.getAddress());
+      if (!state) continue;
+
+      if (!copied) {
+        if (can.getDat().size() > CANFD_MAX_SIZE) break; //shouldn't ever happen
+        memset(dat, 0, sizeof(dat));
+        memcpy(dat, can.getDat().begin(), can.getDat().size());
+        copied = true;
+      }
+      state->parse(sec, can.getBusTime(), dat);
+    }
+  }
+
+  for (CANParser *parser : parsers) {
+    parser->last_sec = sec;
+    parser->UpdateValid(sec);
+  }
+}
+#endif
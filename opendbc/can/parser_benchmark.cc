@@ -0,0 +1,87 @@
+// Measures CANParser::UpdateCans over the can events of a recorded log.
+//
+// usage: parser_benchmark <rlog or rlog.bz2> <dbc name> [bus] [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "selfdrive/common/bz2.h"
+
+static std::string read_file(const char *path) {
+  std::string ret;
+  FILE *f = fopen(path, "rb");
+  if (!f) return ret;
+
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    ret.append(buf, n);
+  }
+  fclose(f);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("usage: %s <rlog or rlog.bz2> <dbc name> [bus] [iterations]\n", argv[0]);
+    return 1;
+  }
+  const int bus = argc > 3 ? atoi(argv[3]) : 0;
+  const int iterations = argc > 4 ? atoi(argv[4]) : 10;
+
+  std::string raw = read_file(argv[1]);
+  std::string dat;
+  if (raw.size() >= 3 && raw.compare(0, 3, "BZh") == 0) {
+    if (!util::bz2_decompress(raw, dat)) {
+      printf("failed to decompress %s\n", argv[1]);
+      return 1;
+    }
+  } else {
+    dat = std::move(raw);
+  }
+
+  kj::Array<capnp::word> words = kj::heapArray<capnp::word>(dat.size() / sizeof(capnp::word));
+  memcpy(words.begin(), dat.data(), words.size() * sizeof(capnp::word));
+
+  // collect the can events
+  std::vector<kj::ArrayPtr<const capnp::word>> events;
+  size_t num_frames = 0;
+  kj::ArrayPtr<const capnp::word> remaining = words;
+  while (remaining.size() > 0) {
+    capnp::FlatArrayMessageReader cmsg(remaining);
+    auto event = cmsg.getRoot<cereal::Event>();
+    if (event.which() == cereal::Event::CAN) {
+      events.push_back(kj::arrayPtr(remaining.begin(), cmsg.getEnd()));
+      num_frames += event.getCan().size();
+    }
+    remaining = kj::arrayPtr(cmsg.getEnd(), remaining.end());
+  }
+  if (events.empty()) {
+    printf("no can events in %s\n", argv[1]);
+    return 1;
+  }
+
+  // all messages in the DBC, counters don't line up when the log is replayed more than once
+  CANParser parser(bus, argv[2], false, true);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    for (auto &e : events) {
+      capnp::FlatArrayMessageReader cmsg(e);
+      auto event = cmsg.getRoot<cereal::Event>();
+      parser.UpdateCans(event.getLogMonoTime(), event.getCan());
+      parser.UpdateValid(event.getLogMonoTime());
+    }
+  }
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%s bus %d: %zu can events, %zu frames, %d iterations\n", argv[2], bus, events.size(), num_frames, iterations);
+  printf("%.2f us per event, %.1f ns per frame\n",
+         dt * 1e6 / (events.size() * iterations), dt * 1e9 / (num_frames * iterations));
+  return 0;
+}
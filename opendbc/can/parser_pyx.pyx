@@ -9,6 +9,7 @@ from libcpp.map cimport map
 from libcpp cimport bool
 
 from .common cimport CANParser as cpp_CANParser
+from .common cimport CANParserGroup as cpp_CANParserGroup
 from .common cimport SignalParseOptions, MessageParseOptions, dbc_lookup, SignalValue, DBC
 
 import os
@@ -144,6 +145,34 @@ cdef class CANParser:
 
     return updated_vals
 
+cdef class CANParserGroup:
+  """Updates several CANParsers, decoding each can event only once"""
+  cdef:
+    cpp_CANParserGroup *group
+    list parsers
+
+  def __init__(self, parsers):
+    self.group = new cpp_CANParserGroup()
+    self.parsers = []
+    for p in parsers:
+      if p is not None:
+        self.add(p)
+
+  def add(self, CANParser parser not None):
+    self.parsers.append(parser)
+    self.group.add(parser.can)
+
+  def update_strings(self, strings, sendcan=False):
+    cdef CANParser p
+    updated_vals = [set() for _ in self.parsers]
+
+    for s in strings:
+      self.group.update_string(s, sendcan)
+      for i, p in enumerate(self.parsers):
+        updated_vals[i].update(p.update_vl())
+
+    return updated_vals
+
 cdef class CANDefine():
   cdef:
     const DBC *dbc
@@ -73,6 +73,15 @@ def process(in_fn, out_fn):
   for address, msg_name, _, sigs in msgs:
     dbc_msg_name = dbc_name + " " + msg_name
     for sig in sigs:
+      # the parser and packer read each signal from a single 64 bit window of the (up to 64 byte) message
+      if sig.is_little_endian:
+        first_bit = sig.start_bit
+      else:
+        first_bit = (sig.start_bit // 8) * 8 + (-sig.start_bit - 1) % 8
+      last_byte = (first_bit + sig.size - 1) // 8
+      if last_byte - first_bit // 8 >= 8:
+        sys.exit("%s: %s spans more than 8 bytes" % (dbc_msg_name, sig.name))
+
       if checksum_type is not None:
         # checksum rules
         if sig.name == "CHECKSUM":
@@ -97,11 +97,55 @@ uint32_t get_ts_elapsed(uint32_t ts, uint32_t ts_last) {
   return ts - ts_last;
 }
 
-int get_addr_check_index(CAN_FIFOMailBox_TypeDef *to_push, AddrCheckStruct addr_list[], const int len) {
-  int bus = GET_BUS(to_push);
-  int addr = GET_ADDR(to_push);
-  int length = GET_LEN(to_push);
+// every message of the addr check list in use, bucketed by a hash of (addr, bus) so the rx path
+// only compares the frame against the few checks that can match instead of scanning the whole list
+#define MAX_ADDR_CHECK_LOOKUP 32
+#define ADDR_CHECK_LOOKUP_BUCKETS 64U
+AddrCheckLookupEntry addr_check_lookup[MAX_ADDR_CHECK_LOOKUP];
+uint8_t addr_check_lookup_start[ADDR_CHECK_LOOKUP_BUCKETS + 1U];  // entries of bucket h are [start[h], start[h + 1])
+const AddrCheckStruct *addr_check_lookup_list = NULL;
+bool addr_check_lookup_valid = false;
+
+static uint32_t addr_check_lookup_hash(int addr, int bus) {
+  uint32_t a = (uint32_t)addr;
+  return (a ^ (a >> 6) ^ (a >> 12) ^ ((uint32_t)bus << 4)) % ADDR_CHECK_LOOKUP_BUCKETS;
+}
+
+// counting sort into the buckets. it's stable, so a bucket keeps the order of the list and the
+// first check to match still wins like in the scan
+void build_addr_check_lookup(AddrCheckStruct addr_list[], const int len) {
+  addr_check_lookup_list = addr_list;
+  addr_check_lookup_valid = true;
+
+  int n = 0;
+  uint8_t count[ADDR_CHECK_LOOKUP_BUCKETS] = {0};
+  for (int i = 0; i < len; i++) {
+    for (uint8_t j = 0U; addr_list[i].msg[j].addr != 0; j++) {
+      count[addr_check_lookup_hash(addr_list[i].msg[j].addr, addr_list[i].msg[j].bus)]++;
+      n++;
+    }
+  }
+  if (n > MAX_ADDR_CHECK_LOOKUP) {
+    // too many to index, fall back to scanning the list
+    addr_check_lookup_valid = false;
+  } else {
+    addr_check_lookup_start[0] = 0U;
+    for (uint32_t h = 0U; h < ADDR_CHECK_LOOKUP_BUCKETS; h++) {
+      addr_check_lookup_start[h + 1U] = addr_check_lookup_start[h] + count[h];
+      count[h] = addr_check_lookup_start[h];
+    }
+    for (int i = 0; i < len; i++) {
+      for (uint8_t j = 0U; addr_list[i].msg[j].addr != 0; j++) {
+        const CanMsgCheck *m = &addr_list[i].msg[j];
+        uint32_t h = addr_check_lookup_hash(m->addr, m->bus);
+        addr_check_lookup[count[h]] = (AddrCheckLookupEntry){.addr = m->addr, .bus = m->bus, .len = m->len, .check_index = i, .msg_index = j};
+        count[h]++;
+      }
+    }
+  }
+}
 
+static int get_addr_check_index_linear(int addr, int bus, int length, AddrCheckStruct addr_list[], const int len) {
   int index = -1;
   for (int i = 0; i < len; i++) {
     // if multiple msgs are allowed, determine which one is present on the bus
@@ -126,6 +170,37 @@ int get_addr_check_index(CAN_FIFOMailBox_TypeDef *to_push, AddrCheckStruct addr_
   return index;
 }
 
+int get_addr_check_index(CAN_FIFOMailBox_TypeDef *to_push, AddrCheckStruct addr_list[], const int len) {
+  int bus = GET_BUS(to_push);
+  int addr = GET_ADDR(to_push);
+  int length = GET_LEN(to_push);
+
+  // the index is built by set_safety_hooks and the init hooks, never here in the rx interrupt.
+  // a list that wasn't indexed is scanned
+  int index = -1;
+  if (!addr_check_lookup_valid || (addr_list != addr_check_lookup_list)) {
+    index = get_addr_check_index_linear(addr, bus, length, addr_list, len);
+  } else {
+    // same as the scan: the first check that either hasn't seen any of its msgs yet or has settled on this one
+    uint32_t h = addr_check_lookup_hash(addr, bus);
+    for (int k = addr_check_lookup_start[h]; k < addr_check_lookup_start[h + 1U]; k++) {
+      const AddrCheckLookupEntry *e = &addr_check_lookup[k];
+      if ((e->addr == addr) && (e->bus == bus) && (e->len == length)) {
+        AddrCheckStruct *check = &addr_list[e->check_index];
+        if (!check->msg_seen) {
+          check->index = e->msg_index;
+          check->msg_seen = true;
+        }
+        if (check->index == e->msg_index) {
+          index = e->check_index;
+          break;
+        }
+      }
+    }
+  }
+  return index;
+}
+
 // 1Hz safety function called by main. Now just a check for lagging safety messages
 void safety_tick(const safety_hooks *hooks) {
   uint32_t ts = microsecond_timer_get();
@@ -305,6 +380,7 @@ int set_safety_hooks(uint16_t mode, int16_t param) {
       safety_hook_registry[i].hooks->addr_check[j].msg_seen = false;
     }
   }
+  build_addr_check_lookup(current_hooks->addr_check, current_hooks->addr_check_len);
   if ((set_status == 0) && (current_hooks->init != NULL)) {
     current_hooks->init(param);
   }
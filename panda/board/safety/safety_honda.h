@@ -316,6 +316,7 @@ static void honda_nidec_init(int16_t param) {
   relay_malfunction_reset();
   gas_interceptor_detected = 0;
   honda_hw = HONDA_N_HW;
+  build_addr_check_lookup(honda_rx_checks, HONDA_RX_CHECKS_LEN);
   honda_alt_brake_msg = false;
   honda_bosch_long = false;
 }
@@ -324,6 +325,7 @@ static void honda_bosch_giraffe_init(int16_t param) {
   controls_allowed = false;
   relay_malfunction_reset();
   honda_hw = HONDA_BG_HW;
+  build_addr_check_lookup(honda_rx_checks, HONDA_RX_CHECKS_LEN);
   // Checking for alternate brake override from safety parameter
   honda_alt_brake_msg = GET_FLAG(param, HONDA_PARAM_ALT_BRAKE);
   // radar disabled so allow gas/brakes
@@ -334,6 +336,7 @@ static void honda_bosch_harness_init(int16_t param) {
   controls_allowed = false;
   relay_malfunction_reset();
   honda_hw = HONDA_BH_HW;
+  build_addr_check_lookup(honda_bh_rx_checks, HONDA_BH_RX_CHECKS_LEN);
   // Checking for alternate brake override from safety parameter
   honda_alt_brake_msg = GET_FLAG(param, HONDA_PARAM_ALT_BRAKE);
   // radar disabled so allow gas/brakes
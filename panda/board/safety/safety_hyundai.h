@@ -272,6 +272,7 @@ static void hyundai_init(int16_t param) {
   relay_malfunction_reset();
 
   hyundai_legacy = false;
+  build_addr_check_lookup(hyundai_rx_checks, HYUNDAI_RX_CHECK_LEN);
   hyundai_ev_gas_signal = GET_FLAG(param, HYUNDAI_PARAM_EV_GAS);
   hyundai_hybrid_gas_signal = !hyundai_ev_gas_signal && GET_FLAG(param, HYUNDAI_PARAM_HYBRID_GAS);
 }
@@ -281,6 +282,7 @@ static void hyundai_legacy_init(int16_t param) {
   relay_malfunction_reset();
 
   hyundai_legacy = true;
+  build_addr_check_lookup(hyundai_legacy_rx_checks, HYUNDAI_LEGACY_RX_CHECK_LEN);
   hyundai_ev_gas_signal = GET_FLAG(param, HYUNDAI_PARAM_EV_GAS);
   hyundai_hybrid_gas_signal = !hyundai_ev_gas_signal && GET_FLAG(param, HYUNDAI_PARAM_HYBRID_GAS);
 }
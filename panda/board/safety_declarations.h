@@ -43,6 +43,15 @@ typedef struct {
   bool lagging;                      // true if and only if the time between updates is excessive
 } AddrCheckStruct;
 
+// one (addr, bus, len) -> AddrCheckStruct entry of the addr check lookup
+typedef struct {
+  int addr;
+  int bus;
+  int len;
+  int check_index;                   // index in the addr check list
+  int msg_index;                     // index in its msg array
+} AddrCheckLookupEntry;
+
 int safety_rx_hook(CAN_FIFOMailBox_TypeDef *to_push);
 int safety_tx_hook(CAN_FIFOMailBox_TypeDef *to_send);
 int safety_tx_lin_hook(int lin_num, uint8_t *data, int len);
@@ -59,6 +68,7 @@ bool rt_rate_limit_check(int val, int val_last, const int MAX_RT_DELTA);
 float interpolate(struct lookup_t xy, float x);
 void gen_crc_lookup_table(uint8_t poly, uint8_t crc_lut[]);
 bool msg_allowed(CAN_FIFOMailBox_TypeDef *to_send, const CanMsg msg_list[], int len);
+void build_addr_check_lookup(AddrCheckStruct addr_list[], const int len);
 int get_addr_check_index(CAN_FIFOMailBox_TypeDef *to_push, AddrCheckStruct addr_list[], const int len);
 void update_counter(AddrCheckStruct addr_list[], int index, uint8_t counter);
 void update_addr_timestamp(AddrCheckStruct addr_list[], int index);
@@ -0,0 +1,69 @@
+// minimal stand-ins for the firmware the safety code uses, so it can be built natively on the host
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UNUSED(x) ((void)(x))
+
+#define MIN(a,b) \
+ ({ __typeof__ (a) _a = (a); \
+     __typeof__ (b) _b = (b); \
+   (_a < _b) ? _a : _b; })
+
+#define MAX(a,b) \
+ ({ __typeof__ (a) _a = (a); \
+     __typeof__ (b) _b = (b); \
+   (_a > _b) ? _a : _b; })
+
+#define ABS(a) \
+ ({ __typeof__ (a) _a = (a); \
+   (_a > 0) ? _a : (-_a); })
+
+typedef struct {
+  uint32_t RIR;
+  uint32_t RDTR;
+  uint32_t RDLR;
+  uint32_t RDHR;
+} CAN_FIFOMailBox_TypeDef;
+
+#define GET_BUS(msg) (((msg)->RDTR >> 4) & 0xFF)
+#define GET_LEN(msg) ((msg)->RDTR & 0xF)
+#define GET_ADDR(msg) ((((msg)->RIR & 4) != 0) ? ((msg)->RIR >> 3) : ((msg)->RIR >> 21))
+#define GET_BYTE(msg, b) (((int)(b) > 3) ? (((msg)->RDHR >> (8U * ((unsigned int)(b) % 4U))) & 0xFFU) : (((msg)->RDLR >> (8U * (unsigned int)(b))) & 0xFFU))
+#define GET_BYTES_04(msg) ((msg)->RDLR)
+#define GET_BYTES_48(msg) ((msg)->RDHR)
+#define GET_FLAG(value, mask) (((__typeof__(mask))(value) & (mask)) == (mask))
+
+// the firmware's uart puts, not libc's
+#define puts(a) UNUSED(a)
+#define puth(a) UNUSED(a)
+
+#define CAN_MODE_NORMAL 0U
+#define CAN_MODE_OBD_CAN2 3U
+
+#define FAULT_RELAY_MALFUNCTION (1U << 0)
+
+typedef struct {
+  bool has_obd;
+  void (*set_can_mode)(uint8_t mode);
+} board;
+
+static void fake_set_can_mode(uint8_t mode) {
+  UNUSED(mode);
+}
+
+const board fake_board = {.has_obd = false, .set_can_mode = fake_set_can_mode};
+const board *current_board = &fake_board;
+
+uint32_t timer_cnt = 0;
+uint32_t microsecond_timer_get(void) {
+  return timer_cnt;
+}
+
+void fault_occurred(uint32_t fault) {
+  UNUSED(fault);
+}
+
+void fault_recovered(uint32_t fault) {
+  UNUSED(fault);
+}
@@ -0,0 +1,159 @@
+/*
+gcc -O2 -I.. safety_benchmark.c -o safety_benchmark && ./safety_benchmark
+*/
+
+// Runs a stream of CAN frames through the rx address check of each safety model and compares the
+// hashed lookup against the linear scan it replaced, both in result and in cycles per frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "fake_stm.h"
+#include "safety.h"
+
+#define N_FRAMES 4096
+#define N_RUNS 50
+
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  // ns on other hosts
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void reset_checks(AddrCheckStruct addr_list[], const int len) {
+  for (int i = 0; i < len; i++) {
+    addr_list[i].index = 0;
+    addr_list[i].msg_seen = false;
+  }
+}
+
+static void make_frame(CAN_FIFOMailBox_TypeDef *f, int addr, int bus, int len) {
+  // extended ids have the IDE bit set
+  f->RIR = (addr > 0x7FF) ? (((uint32_t)addr << 3) | 4U) : ((uint32_t)addr << 21);
+  f->RDTR = ((uint32_t)bus << 4) | (uint32_t)len;
+  f->RDLR = 0U;
+  f->RDHR = 0U;
+}
+
+// about a third of the traffic is checked messages, the rest is everything else on a busy bus
+static int make_stream(CAN_FIFOMailBox_TypeDef frames[], AddrCheckStruct addr_list[], const int len) {
+  int n_checked = 0;
+  for (int i = 0; i < len; i++) {
+    for (int j = 0; addr_list[i].msg[j].addr != 0; j++) {
+      n_checked++;
+    }
+  }
+
+  for (int k = 0; k < N_FRAMES; k++) {
+    if ((rand() % 3) == 0) {
+      int c = rand() % n_checked;
+      for (int i = 0; i < len; i++) {
+        for (int j = 0; addr_list[i].msg[j].addr != 0; j++) {
+          if (c == 0) {
+            make_frame(&frames[k], addr_list[i].msg[j].addr, addr_list[i].msg[j].bus, addr_list[i].msg[j].len);
+          }
+          c--;
+        }
+      }
+    } else {
+      make_frame(&frames[k], rand() % 0x800, rand() % 3, 8);
+    }
+  }
+  return n_checked;
+}
+
+int main(void) {
+  typedef struct {
+    const char *name;
+    AddrCheckStruct *addr_check;
+    int len;
+  } model;
+  const model models[] = {
+    {"honda", honda_rx_checks, HONDA_RX_CHECKS_LEN},
+    {"honda bosch harness", honda_bh_rx_checks, HONDA_BH_RX_CHECKS_LEN},
+    {"toyota", toyota_rx_checks, TOYOTA_RX_CHECKS_LEN},
+    {"hyundai", hyundai_rx_checks, HYUNDAI_RX_CHECK_LEN},
+    {"hyundai legacy", hyundai_legacy_rx_checks, HYUNDAI_LEGACY_RX_CHECK_LEN},
+    {"volkswagen mqb", volkswagen_mqb_rx_checks, VOLKSWAGEN_MQB_RX_CHECKS_LEN},
+    {"volkswagen pq", volkswagen_pq_rx_checks, VOLKSWAGEN_PQ_RX_CHECKS_LEN},
+    {"gm", gm_rx_checks, GM_RX_CHECK_LEN},
+    {"chrysler", chrysler_rx_checks, CHRYSLER_RX_CHECK_LEN},
+    {"subaru", subaru_rx_checks, SUBARU_RX_CHECK_LEN},
+    {"nissan", nissan_rx_checks, NISSAN_RX_CHECK_LEN},
+    {"mazda", mazda_rx_checks, MAZDA_RX_CHECKS_LEN},
+  };
+  const int n_models = sizeof(models) / sizeof(models[0]);
+
+  static CAN_FIFOMailBox_TypeDef frames[N_FRAMES];
+  static int expected[N_FRAMES];
+  bool ok = true;
+  srand(0);
+
+  printf("%-20s %5s %10s %10s\n", "model", "msgs", "linear", "lookup");
+  for (int m = 0; m < n_models; m++) {
+    AddrCheckStruct *addr_list = models[m].addr_check;
+    const int len = models[m].len;
+    int n_checked = make_stream(frames, addr_list, len);
+
+    // same indexes, and the same msg picked for the checks with alternatives
+    reset_checks(addr_list, len);
+    for (int k = 0; k < N_FRAMES; k++) {
+      expected[k] = get_addr_check_index_linear(GET_ADDR(&frames[k]), GET_BUS(&frames[k]), GET_LEN(&frames[k]), addr_list, len);
+    }
+    int expected_index[16];
+    for (int i = 0; i < len; i++) {
+      expected_index[i] = addr_list[i].msg_seen ? addr_list[i].index : -1;
+    }
+    reset_checks(addr_list, len);
+    build_addr_check_lookup(addr_list, len);
+    for (int k = 0; k < N_FRAMES; k++) {
+      if (get_addr_check_index(&frames[k], addr_list, len) != expected[k]) {
+        printf("%s: frame %d mismatch\n", models[m].name, k);
+        ok = false;
+        break;
+      }
+    }
+    for (int i = 0; i < len; i++) {
+      if (expected_index[i] != (addr_list[i].msg_seen ? addr_list[i].index : -1)) {
+        printf("%s: check %d picked a different msg\n", models[m].name, i);
+        ok = false;
+      }
+    }
+
+    uint64_t best_linear = UINT64_MAX;
+    uint64_t best_lookup = UINT64_MAX;
+    volatile int sink = 0;
+    for (int r = 0; r < N_RUNS; r++) {
+      reset_checks(addr_list, len);
+      uint64_t start = cycles();
+      for (int k = 0; k < N_FRAMES; k++) {
+        sink += get_addr_check_index_linear(GET_ADDR(&frames[k]), GET_BUS(&frames[k]), GET_LEN(&frames[k]), addr_list, len);
+      }
+      uint64_t linear = cycles() - start;
+
+      reset_checks(addr_list, len);
+      start = cycles();
+      for (int k = 0; k < N_FRAMES; k++) {
+        sink += get_addr_check_index(&frames[k], addr_list, len);
+      }
+      uint64_t lookup = cycles() - start;
+
+      best_linear = (linear < best_linear) ? linear : best_linear;
+      best_lookup = (lookup < best_lookup) ? lookup : best_lookup;
+    }
+    printf("%-20s %5d %10.1f %10.1f\n", models[m].name, n_checked,
+           (double)best_linear / N_FRAMES, (double)best_lookup / N_FRAMES);
+  }
+  printf("cycles per frame, best of %d runs of %d frames\n", N_RUNS, N_FRAMES);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
+
+#include "common_ekf.h"
+
+#ifndef REWIND_TO_KEEP
+#define REWIND_TO_KEEP 512
+#endif
+
+namespace EKFS {
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXdr;
+
+// EKFSym with the state and error dimensions fixed at compile time. The state, the observations
+// and the rewind history live in storage allocated up front, so predict and update never touch
+// the heap. Observations are at most MAX_Z long with MAX_EXTRA extra args, and up to MAX_BATCH
+// of them are applied in one update. MSCKF augmentation isn't supported.
+template <int DIM_X, int DIM_ERR, int MAX_Z = 6, int MAX_BATCH = 4, int MAX_EXTRA = 4>
+class EKFFixed {
+  static_assert(DIM_ERR > 1 && MAX_Z > 1, "row major matrices need more than one column");
+
+public:
+  typedef Eigen::Matrix<double, DIM_X, 1> VectorX;
+  typedef Eigen::Matrix<double, DIM_ERR, DIM_ERR, Eigen::RowMajor> MatrixP;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_Z, 1> VectorZ;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, MAX_Z, MAX_Z> MatrixR;
+
+  struct Observation {
+    double t;
+    int kind;
+    int n = 0;
+    VectorZ z[MAX_BATCH];
+    MatrixR R[MAX_BATCH];
+    double extra_args[MAX_BATCH][MAX_EXTRA > 0 ? MAX_EXTRA : 1];
+
+    void reset(double t_, int kind_) {
+      t = t_;
+      kind = kind_;
+      n = 0;
+    }
+    template <typename Z, typename RM>
+    void add(const Eigen::MatrixBase<Z> &zi, const Eigen::MatrixBase<RM> &Ri, const double *extra = nullptr, int n_extra = 0) {
+      assert(n < MAX_BATCH && n_extra <= MAX_EXTRA);
+      assert(zi.rows() <= MAX_Z && Ri.rows() == zi.rows() && Ri.cols() == zi.rows());
+      z[n] = zi;
+      R[n] = Ri;
+      std::copy(extra, extra + n_extra, extra_args[n]);
+      n++;
+    }
+  };
+
+  EKFFixed(const std::string &name, const MatrixP &Q, const VectorX &x_initial, const MatrixP &P_initial,
+           std::vector<int> quaternion_idxs = std::vector<int>(), double max_rewind_age = 1.0)
+    : Q(Q), quaternion_idxs(quaternion_idxs), max_rewind_age(max_rewind_age),
+      rewind_states(REWIND_TO_KEEP), rewound(REWIND_TO_KEEP) {
+    ekf = ekf_lookup(name);
+    assert(ekf);
+    init_state(x_initial, P_initial, NAN);
+  }
+
+  void init_state(const VectorX &state, const MatrixP &covs, double t) {
+    x = state;
+    P = covs;
+    filter_time = t;
+    reset_rewind();
+  }
+
+  const VectorX &state() const { return x; }
+  const MatrixP &covs() const { return P; }
+  void set_filter_time(double t) { filter_time = t; }
+  double get_filter_time() const { return filter_time; }
+  void set_global(const std::string &global_var, double val) { ekf->sets.at(global_var)(val); }
+  extra_routine_t get_extra_routine(const std::string &routine) const { return ekf->extra_routines.at(routine); }
+
+  void reset_rewind() {
+    rewind_head = 0;
+    rewind_count = 0;
+  }
+
+  void predict(double t) {
+    // initialize time
+    if (std::isnan(filter_time)) {
+      filter_time = t;
+    }
+
+    double dt = t - filter_time;
+    assert(dt >= 0.0);
+
+    ekf->predict(x.data(), P.data(), Q.data(), dt);
+    normalize_quaternions();
+    filter_time = t;
+  }
+
+  // returns false when the observation is too old to rewind to
+  bool predict_and_update_batch(const Observation &obs) {
+    int num_rewound = 0;
+    if (!std::isnan(filter_time) && obs.t < filter_time) {
+      if (rewind_count == 0 || obs.t < checkpoint_at(0).t || obs.t < checkpoint_at(rewind_count - 1).t - max_rewind_age) {
+        std::cout << "observation too old at " << obs.t << " with filter at " << filter_time << ", ignoring" << std::endl;
+        return false;
+      }
+      num_rewound = rewind(obs.t);
+    }
+
+    update_batch(obs);
+
+    // fast forward
+    for (int i = 0; i < num_rewound; i++) {
+      update_batch(rewound[i]);
+    }
+    return true;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  struct Checkpoint {
+    double t;
+    VectorX x;
+    MatrixP P;
+    Observation obs;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  Checkpoint &checkpoint_at(int i) { return rewind_states[(rewind_head + i) % REWIND_TO_KEEP]; }
+
+  void normalize_quaternions() {
+    for (int idx : quaternion_idxs) {
+      x.template segment<4>(idx).normalize();
+    }
+  }
+
+  void update_batch(const Observation &obs) {
+    predict(obs.t);
+    for (int i = 0; i < obs.n; i++) {
+      ekf->updates.at(obs.kind)(x.data(), P.data(), (double *)obs.z[i].data(), (double *)obs.R[i].data(),
+                                (double *)obs.extra_args[i]);
+      normalize_quaternions();
+    }
+    checkpoint(obs);
+  }
+
+  // moves the observations after t to rewound and goes back to the state before them, returns how many
+  int rewind(double t) {
+    int n = 0;
+    while (checkpoint_at(rewind_count - 1).t > t) {
+      n++;
+      rewind_count--;
+    }
+    for (int i = 0; i < n; i++) {
+      rewound[i] = checkpoint_at(rewind_count + i).obs;
+    }
+
+    const Checkpoint &last = checkpoint_at(rewind_count - 1);
+    filter_time = last.t;
+    x = last.x;
+    P = last.P;
+    return n;
+  }
+
+  void checkpoint(const Observation &obs) {
+    // only keep a certain number around, the oldest one is overwritten
+    if (rewind_count == REWIND_TO_KEEP) {
+      rewind_head = (rewind_head + 1) % REWIND_TO_KEEP;
+      rewind_count--;
+    }
+    Checkpoint &c = checkpoint_at(rewind_count++);
+    c.t = filter_time;
+    c.x = x;
+    c.P = P;
+    c.obs = obs;
+  }
+
+  // struct with linked sympy generated functions
+  const EKF *ekf = nullptr;
+
+  VectorX x;  // state
+  MatrixP P;  // covs
+  MatrixP Q;  // process noise
+  double filter_time;
+
+  std::vector<int> quaternion_idxs;
+  double max_rewind_age;
+
+  // rewind ring buffer
+  std::vector<Checkpoint, Eigen::aligned_allocator<Checkpoint>> rewind_states;
+  int rewind_head = 0, rewind_count = 0;
+  std::vector<Observation, Eigen::aligned_allocator<Observation>> rewound;
+};
+
+}
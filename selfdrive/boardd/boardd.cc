@@ -35,23 +35,37 @@
 #define SATURATE_IL 1600
 #define NIBBLE_TO_HEX(n) ((n) < 10 ? (n) + '0' : ((n) - 10) + 'a')
 
+// main panda, and all connected pandas (main panda first)
 Panda * panda = nullptr;
+std::vector<Panda *> pandas;
 std::atomic<bool> safety_setter_thread_running(false);
 std::atomic<bool> ignition(false);
 
 ExitHandler do_exit;
 
+static bool pandas_connected() {
+  for (auto p : pandas) {
+    if (!p->connected) return false;
+  }
+  return panda != nullptr;
+}
+
+static void set_safety_model(cereal::CarParams::SafetyModel safety_model, int safety_param=0) {
+  for (auto p : pandas) {
+    p->set_safety_model(safety_model, safety_param);
+  }
+}
 
 void safety_setter_thread() {
   LOGD("Starting safety setter thread");
   // diagnostic only is the default, needed for VIN query
-  panda->set_safety_model(cereal::CarParams::SafetyModel::ELM327);
+  set_safety_model(cereal::CarParams::SafetyModel::ELM327);
 
   Params p = Params();
 
   // switch to SILENT when CarVin param is read
   while (true) {
-    if (do_exit || !panda->connected) {
+    if (do_exit || !pandas_connected()) {
       safety_setter_thread_running = false;
       return;
     };
@@ -67,12 +81,12 @@ void safety_setter_thread() {
   }
 
   // VIN query done, stop listening to OBDII
-  panda->set_safety_model(cereal::CarParams::SafetyModel::ELM327, 1);
+  set_safety_model(cereal::CarParams::SafetyModel::ELM327, 1);
 
   std::string params;
   LOGW("waiting for params to set safety model");
   while (true) {
-    if (do_exit || !panda->connected) {
+    if (do_exit || !pandas_connected()) {
       safety_setter_thread_running = false;
       return;
     };
@@ -93,27 +107,36 @@ void safety_setter_thread() {
   auto safety_param = car_params.getSafetyParam();
   LOGW("setting safety model: %d with param %d", (int)safety_model, safety_param);
 
-  panda->set_safety_model(safety_model, safety_param);
+  set_safety_model(safety_model, safety_param);
 
   safety_setter_thread_running = false;
 }
 
 
-bool usb_connect() {
+bool usb_connect(std::vector<std::string> serials) {
   static bool connected_once = false;
 
-  std::unique_ptr<Panda> tmp_panda;
+  if (serials.empty()) {
+    serials = Panda::list();
+    if (serials.empty()) return false;
+  }
+
+  // each panda after the main one gets the next PANDA_BUS_CNT bus numbers
+  std::vector<std::unique_ptr<Panda>> tmp_pandas;
   try {
     assert(panda == nullptr);
-    tmp_panda = std::make_unique<Panda>();
+    for (int i = 0; i < serials.size(); i++) {
+      tmp_pandas.push_back(std::make_unique<Panda>(serials[i], i * PANDA_BUS_CNT));
+    }
   } catch (std::exception &e) {
     return false;
   }
+  Panda *tmp_panda = tmp_pandas[0].get();
 
   Params params = Params();
 
   if (getenv("BOARDD_LOOPBACK")) {
-    tmp_panda->set_loopback(true);
+    for (auto &p : tmp_pandas) p->set_loopback(true);
   }
 
   if (auto fw_sig = tmp_panda->get_firmware_version(); fw_sig) {
@@ -163,23 +186,27 @@ bool usb_connect() {
   }
 
   connected_once = true;
-  panda = tmp_panda.release();
+  for (auto &p : tmp_pandas) {
+    pandas.push_back(p.release());
+  }
+  panda = pandas[0];
   return true;
 }
 
 // must be called before threads or with mutex
-static bool usb_retry_connect() {
+static bool usb_retry_connect(const std::vector<std::string> &serials) {
   LOGW("attempting to connect");
-  while (!do_exit && !usb_connect()) { util::sleep_for(100); }
+  while (!do_exit && !usb_connect(serials)) { util::sleep_for(100); }
   if (panda) {
-    LOGW("connected to board");
+    LOGW("connected to %d board(s)", (int)pandas.size());
   }
   return !do_exit;
 }
 
 void can_recv(PubMaster &pm) {
+  // one merged event for all pandas
   kj::Array<capnp::word> can_data;
-  panda->can_receive(can_data);
+  Panda::can_receive(pandas, can_data);
   auto bytes = can_data.asBytes();
   pm.send("can", bytes.begin(), bytes.size());
 }
@@ -194,7 +221,7 @@ void can_send_thread(bool fake_send) {
   subscriber->setTimeout(100);
 
   // run as fast as messages come in
-  while (!do_exit && panda->connected) {
+  while (!do_exit && pandas_connected()) {
     Message * msg = subscriber->receive();
 
     if (!msg) {
@@ -210,7 +237,10 @@ void can_send_thread(bool fake_send) {
     //Dont send if older than 1 second
     if (nanos_since_boot() - event.getLogMonoTime() < 1e9) {
       if (!fake_send) {
-        panda->can_send(event.getSendcan());
+        // each panda only sends the frames for its own buses
+        for (auto p : pandas) {
+          p->can_send(event.getSendcan());
+        }
       }
     }
 
@@ -231,7 +261,7 @@ void can_recv_thread() {
   const uint64_t dt = 10000000ULL;
   uint64_t next_frame_time = nanos_since_boot() + dt;
 
-  while (!do_exit && panda->connected) {
+  while (!do_exit && pandas_connected()) {
     can_recv(pm);
 
     uint64_t cur_time = nanos_since_boot();
@@ -268,7 +298,7 @@ void panda_state_thread(bool spoofing_started) {
   }
 
   // run at 2hz
-  while (!do_exit && panda->connected) {
+  while (!do_exit && pandas_connected()) {
     health_t pandaState = panda->get_state();
 
     if (spoofing_started) {
@@ -277,7 +307,7 @@ void panda_state_thread(bool spoofing_started) {
 
     // Make sure CAN buses are live: safety_setter_thread does not work if Panda CAN are silent and there is only one other CAN node
     if (pandaState.safety_model == (uint8_t)(cereal::CarParams::SafetyModel::SILENT)) {
-      panda->set_safety_model(cereal::CarParams::SafetyModel::NO_OUTPUT);
+      set_safety_model(cereal::CarParams::SafetyModel::NO_OUTPUT);
     }
 
     ignition = ((pandaState.ignition_line != 0) || (pandaState.ignition_can != 0));
@@ -296,7 +326,7 @@ void panda_state_thread(bool spoofing_started) {
 
     // set safety mode to NO_OUTPUT when car is off. ELM327 is an alternative if we want to leverage athenad/connect
     if (!ignition && (pandaState.safety_model != (uint8_t)(cereal::CarParams::SafetyModel::NO_OUTPUT))) {
-      panda->set_safety_model(cereal::CarParams::SafetyModel::NO_OUTPUT);
+      set_safety_model(cereal::CarParams::SafetyModel::NO_OUTPUT);
     }
 #endif
 
@@ -393,7 +423,9 @@ void panda_state_thread(bool spoofing_started) {
       }
     }
     pm.send("pandaState", msg);
-    panda->send_heartbeat();
+    for (auto p : pandas) {
+      p->send_heartbeat();
+    }
     util::sleep_for(500);
   }
 }
@@ -411,7 +443,7 @@ void hardware_control_thread() {
 
   FirstOrderFilter integ_lines_filter(0, 30.0, 0.05);
 
-  while (!do_exit && panda->connected) {
+  while (!do_exit && pandas_connected()) {
     cnt++;
     sm.update(1000); // TODO: what happens if EINTR is sent while in sm.update?
 
@@ -500,7 +532,7 @@ void pigeon_thread() {
     {(char)ublox::CLASS_RXM, int64_t(900000000ULL)}, // 0.9s
   };
 
-  while (!do_exit && panda->connected) {
+  while (!do_exit && pandas_connected()) {
     bool need_reset = false;
     std::string recv = pigeon->receive();
 
@@ -564,10 +596,13 @@ void pigeon_thread() {
 }
 
 
-int main() {
+int main(int argc, char *argv[]) {
   int err;
   LOGW("starting boardd");
 
+  // pandas to connect to by serial, main panda first. Without any, connect to all pandas found
+  std::vector<std::string> serials(argv + 1, argv + argc);
+
   // set process priority and affinity
   err = set_realtime_priority(54);
   LOG("set priority returns %d", err);
@@ -580,7 +615,7 @@ int main() {
     threads.push_back(std::thread(panda_state_thread, getenv("STARTED") != nullptr));
 
     // connect to the board
-    if (usb_retry_connect()) {
+    if (usb_retry_connect(serials)) {
       threads.push_back(std::thread(can_send_thread, getenv("FAKESEND") != nullptr));
       threads.push_back(std::thread(can_recv_thread));
       threads.push_back(std::thread(hardware_control_thread));
@@ -589,7 +624,8 @@ int main() {
 
     for (auto &t : threads) t.join();
 
-    delete panda;
+    for (auto p : pandas) delete p;
+    pandas.clear();
     panda = nullptr;
   }
 }
@@ -2,6 +2,7 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 #include <vector>
@@ -9,9 +10,51 @@
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/common/gpio.h"
 #include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 
-Panda::Panda() {
+static bool is_panda(libusb_device *dev, libusb_device_descriptor *desc) {
+  return libusb_get_device_descriptor(dev, desc) == 0 && desc->idVendor == 0xbbaa && desc->idProduct == 0xddcc;
+}
+
+static std::string usb_serial(libusb_device_handle *handle, const libusb_device_descriptor &desc) {
+  unsigned char serial[256] = {'\0'};
+  int len = libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, serial, sizeof(serial) - 1);
+  return len > 0 ? std::string((char *)serial, len) : "";
+}
+
+std::vector<std::string> Panda::list() {
+  libusb_context *context = NULL;
+  if (libusb_init(&context) != 0) return {};
+
+  // the internal panda is the main one, the others follow by serial
+  std::vector<std::pair<bool, std::string>> found;
+  libusb_device **dev_list = NULL;
+  ssize_t num_devices = libusb_get_device_list(context, &dev_list);
+  for (ssize_t i = 0; i < num_devices; i++) {
+    libusb_device_descriptor desc;
+    libusb_device_handle *handle = NULL;
+    if (is_panda(dev_list[i], &desc) && libusb_open(dev_list[i], &handle) == 0) {
+      std::string serial = usb_serial(handle, desc);
+      unsigned char hw_type = 0;
+      libusb_control_transfer(handle, LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+                              0xc1, 0, 0, &hw_type, 1, TIMEOUT);
+      const bool internal = hw_type == (unsigned char)cereal::PandaState::PandaType::UNO ||
+                            hw_type == (unsigned char)cereal::PandaState::PandaType::DOS;
+      if (!serial.empty()) found.push_back({!internal, serial});
+      libusb_close(handle);
+    }
+  }
+  if (dev_list) libusb_free_device_list(dev_list, 1);
+  libusb_exit(context);
+
+  std::sort(found.begin(), found.end());
+  std::vector<std::string> serials;
+  for (auto &[not_internal, serial] : found) serials.push_back(serial);
+  return serials;
+}
+
+Panda::Panda(std::string serial, uint32_t bus_offset) : bus_offset(bus_offset) {
   // init libusb
   int err = libusb_init(&ctx);
   if (err != 0) { goto fail; }
@@ -22,7 +65,23 @@ Panda::Panda() {
   libusb_set_debug(ctx, 3);
 #endif
 
-  dev_handle = libusb_open_device_with_vid_pid(ctx, 0xbbaa, 0xddcc);
+  if (serial.empty()) {
+    dev_handle = libusb_open_device_with_vid_pid(ctx, 0xbbaa, 0xddcc);
+  } else {
+    // find the panda with this serial
+    libusb_device **dev_list = NULL;
+    ssize_t num_devices = libusb_get_device_list(ctx, &dev_list);
+    for (ssize_t i = 0; i < num_devices && dev_handle == NULL; i++) {
+      libusb_device_descriptor desc;
+      if (is_panda(dev_list[i], &desc) && libusb_open(dev_list[i], &dev_handle) == 0) {
+        if (usb_serial(dev_handle, desc) != serial) {
+          libusb_close(dev_handle);
+          dev_handle = NULL;
+        }
+      }
+    }
+    if (dev_list) libusb_free_device_list(dev_list, 1);
+  }
   if (dev_handle == NULL) { goto fail; }
 
   if (libusb_kernel_driver_active(dev_handle, 0) == 1) {
@@ -46,6 +105,7 @@ Panda::Panda() {
 
   printf("hw_type: %d, is_pigeon=%d !!!!!\n", (int)hw_type, (int)is_pigeon);
 
+  start_can_transfers();
   return;
 
 fail:
@@ -60,6 +120,8 @@ Panda::~Panda() {
 }
 
 void Panda::cleanup() {
+  stop_can_transfers();
+
   if (dev_handle) {
     libusb_release_interface(dev_handle, 0);
     libusb_close(dev_handle);
@@ -264,60 +326,316 @@ void Panda::send_heartbeat() {
   usb_write(0xf3, 1, 0);
 }
 
-void Panda::can_send(capnp::List<cereal::CanData>::Reader can_data_list) {
-  static std::vector<uint32_t> send;
-  const int msg_count = can_data_list.size();
+static const uint8_t dlc_to_len[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
 
-  send.resize(msg_count*0x10);
+// smallest DLC that holds len bytes, CAN-FD frames are padded up to it
+static uint8_t len_to_dlc(size_t len) {
+  uint8_t dlc = 0;
+  while (dlc_to_len[dlc] < len) dlc++;
+  return dlc;
+}
+
+// size of a frame in 32 bit words, including the header
+static inline size_t frame_words(uint8_t dlc, bool can_fd) {
+  if (!can_fd) return (CANPACKET_HEAD_SIZE + 8) / sizeof(uint32_t);
+  size_t data_size = std::max<size_t>(8, (dlc_to_len[dlc] + 7) & ~7);
+  return (CANPACKET_HEAD_SIZE + data_size) / sizeof(uint32_t);
+}
+
+// number of data bytes in a frame, classic DLCs above 8 still mean 8 bytes
+static inline size_t frame_len(uint8_t dlc, bool can_fd) {
+  return can_fd ? dlc_to_len[dlc] : std::min<size_t>(dlc, 8);
+}
+
+void can_pack(capnp::List<cereal::CanData>::Reader can_data_list, std::vector<uint32_t> &send, uint32_t bus_offset, bool can_fd) {
+  send.resize(can_data_list.size() * frame_words(len_to_dlc(CANPACKET_DATA_SIZE_MAX), can_fd));
+
+  size_t pos = 0;
+  for (auto cmsg : can_data_list) {
+    // only send frames for the buses of this panda
+    if (cmsg.getSrc() < bus_offset || cmsg.getSrc() >= bus_offset + PANDA_BUS_CNT) {
+      continue;
+    }
+
+    auto can_data = cmsg.getDat();
+    if (can_data.size() > (can_fd ? CANPACKET_DATA_SIZE_MAX : 8)) {
+      LOGE("can_pack: dropping %zu byte frame to 0x%X", can_data.size(), cmsg.getAddress());
+      continue;
+    }
 
-  for (int i = 0; i < msg_count; i++) {
-    auto cmsg = can_data_list[i];
     if (cmsg.getAddress() >= 0x800) { // extended
-      send[i*4] = (cmsg.getAddress() << 3) | 5;
+      send[pos] = (cmsg.getAddress() << 3) | 5;
     } else { // normal
-      send[i*4] = (cmsg.getAddress() << 21) | 1;
+      send[pos] = (cmsg.getAddress() << 21) | 1;
     }
-    auto can_data = cmsg.getDat();
-    assert(can_data.size() <= 8);
-    send[i*4+1] = can_data.size() | (cmsg.getSrc() << 4);
-    memcpy(&send[i*4+2], can_data.begin(), can_data.size());
+    uint8_t dlc = len_to_dlc(can_data.size());
+    size_t words = frame_words(dlc, can_fd);
+    send[pos+1] = dlc | ((cmsg.getSrc() - bus_offset) << 4);
+    std::fill(&send[pos+2], &send[pos+words], 0);
+    memcpy(&send[pos+2], can_data.begin(), can_data.size());
+    pos += words;
   }
+  send.resize(pos);
+}
 
-  usb_bulk_write(3, (unsigned char*)send.data(), send.size(), 5);
+size_t can_frame_count(const uint32_t *data, int len, bool can_fd) {
+  // incomplete frames at the end are dropped, same as in can_unpack
+  size_t count = 0;
+  size_t num_words = len / sizeof(uint32_t);
+  for (size_t pos = 0; pos + 1 < num_words; count++) {
+    pos += frame_words(data[pos+1] & 0xF, can_fd);
+    if (pos > num_words) break;
+  }
+  return count;
+}
+
+size_t can_unpack(const uint32_t *data, int len, capnp::List<cereal::CanData>::Builder canData, size_t offset, uint32_t bus_offset, bool can_fd) {
+  size_t num_words = len / sizeof(uint32_t);
+  for (size_t pos = 0; pos + 1 < num_words; offset++) {
+    uint8_t dlc = data[pos+1] & 0xF;
+    size_t words = frame_words(dlc, can_fd);
+    if (pos + words > num_words) break;
+
+    if (data[pos] & 4) {
+      // extended
+      canData[offset].setAddress(data[pos] >> 3);
+      //printf("got extended: %x\n", data[pos] >> 3);
+    } else {
+      // normal
+      canData[offset].setAddress(data[pos] >> 21);
+    }
+    canData[offset].setBusTime(data[pos+1] >> 16);
+    canData[offset].setDat(kj::arrayPtr((uint8_t*)&data[pos+2], frame_len(dlc, can_fd)));
+    canData[offset].setSrc(((data[pos+1] >> 4) & 0xff) + bus_offset);
+    pos += words;
+  }
+  return offset;
+}
+
+void Panda::start_can_transfers() {
+  usb_events_running = true;
+  usb_event_thread = std::thread([=]() {
+    set_thread_name("boardd_usb");
+    while (usb_events_running) {
+      struct timeval tv = {0, recv_backoff_ms * 1000};
+      libusb_handle_events_timeout_completed(ctx, &tv, NULL);
+      resubmit_idle_transfers();
+    }
+  });
+
+  can_transfers_running = true;
+  for (int i = 0; i < CAN_TRANSFERS; i++) {
+    send_transfers[i] = libusb_alloc_transfer(0);
+
+    recv_transfers[i] = libusb_alloc_transfer(0);
+    libusb_fill_bulk_transfer(recv_transfers[i], dev_handle, 0x81, (unsigned char *)malloc(RECV_SIZE), RECV_SIZE,
+                              can_recv_callback, this, TIMEOUT);
+    recv_transfers[i]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+    transfers_pending++;
+    recv_busy[i] = true;
+    int err = libusb_submit_transfer(recv_transfers[i]);
+    if (err != 0) {
+      recv_busy[i] = false;
+      transfers_pending--;
+      handle_usb_issue(err, __func__);
+    }
+  }
+}
+
+void Panda::stop_can_transfers() {
+  if (!usb_event_thread.joinable()) return;
+
+  // a callback may resubmit right before it sees the flag, so keep cancelling until everything is back
+  can_transfers_running = false;
+  for (int tries = 0; transfers_pending > 0 && tries < 1000; tries++) {
+    // Never cancel a transfer that isn't submitted. A send transfer that was never used has no
+    // device handle yet, and libusb before 1.0.24 dereferences it when cancelling.
+    for (int i = 0; i < CAN_TRANSFERS; i++) {
+      if (recv_busy[i]) libusb_cancel_transfer(recv_transfers[i]);
+      if (send_busy[i]) libusb_cancel_transfer(send_transfers[i]);
+    }
+    util::sleep_for(1);
+  }
+
+  usb_events_running = false;
+  usb_event_thread.join();
+  recv_idle.clear();
+
+  for (int i = 0; i < CAN_TRANSFERS; i++) {
+    libusb_free_transfer(recv_transfers[i]);
+    libusb_free_transfer(send_transfers[i]);
+    recv_transfers[i] = send_transfers[i] = nullptr;
+  }
+}
+
+void Panda::set_recv_busy(libusb_transfer *transfer, bool busy) {
+  for (int i = 0; i < CAN_TRANSFERS; i++) {
+    if (recv_transfers[i] == transfer) {
+      recv_busy[i] = busy;
+    }
+  }
+}
+
+void Panda::resubmit_idle_transfers() {
+  double now = millis_since_boot();
+  for (auto it = recv_idle.begin(); it != recv_idle.end();) {
+    if (now < it->second) {
+      ++it;
+      continue;
+    }
+    libusb_transfer *transfer = it->first;
+    it = recv_idle.erase(it);
+
+    transfers_pending++;
+    set_recv_busy(transfer, true);
+    if (!can_transfers_running || !connected || libusb_submit_transfer(transfer) != 0) {
+      set_recv_busy(transfer, false);
+      transfers_pending--;
+    }
+  }
+}
+
+void LIBUSB_CALL Panda::can_recv_callback(libusb_transfer *transfer) {
+  Panda *p = (Panda *)transfer->user_data;
+
+  switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+      if (transfer->actual_length == 0) {
+        // nothing queued on the panda, don't spin on its empty packets
+        p->recv_idle.push_back({transfer, millis_since_boot() + p->recv_backoff_ms});
+        p->recv_backoff_ms = std::min(p->recv_backoff_ms * 2, CAN_RECV_BACKOFF_MAX_MS);
+        p->set_recv_busy(transfer, false);
+        p->transfers_pending--;
+        return;
+      }
+      // a full ring is counted in recv_ring.dropped and reported by can_receive
+      p->recv_ring.push(transfer->buffer, transfer->actual_length);
+      p->recv_backoff_ms = CAN_RECV_BACKOFF_MS;
+      break;
+    case LIBUSB_TRANSFER_OVERFLOW:
+      p->comms_healthy = false;
+      LOGE_100("overflow got 0x%x", transfer->actual_length);
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      LOGE("lost connection");
+      p->connected = false;
+      break;
+    case LIBUSB_TRANSFER_CANCELLED:
+      break;
+    default:
+      LOGE_100("can recv transfer failed, status %d", transfer->status);
+      break;
+  }
+
+  if (p->can_transfers_running && p->connected && transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+    if (libusb_submit_transfer(transfer) == 0) return;
+  }
+  p->set_recv_busy(transfer, false);
+  p->transfers_pending--;
+}
+
+void LIBUSB_CALL Panda::can_send_callback(libusb_transfer *transfer) {
+  Panda *p = (Panda *)transfer->user_data;
+
+  switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+    case LIBUSB_TRANSFER_CANCELLED:
+      break;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      // If the receive buffer on the panda is full it will NAK and we drop the messages
+      LOGW("Transmit buffer full");
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      LOGE("lost connection");
+      p->connected = false;
+      break;
+    default:
+      LOGE_100("can send transfer failed, status %d", transfer->status);
+      break;
+  }
+
+  for (int i = 0; i < CAN_TRANSFERS; i++) {
+    if (p->send_transfers[i] == transfer) {
+      p->send_busy[i] = false;
+    }
+  }
+  p->transfers_pending--;
+}
+
+void Panda::can_send(capnp::List<cereal::CanData>::Reader can_data_list) {
+  if (!connected || !can_transfers_running) return;
+
+  // take the first idle transfer, earlier ones are still in flight and are sent first
+  for (int i = 0; i < CAN_TRANSFERS; i++) {
+    bool busy = false;
+    if (!send_busy[i].compare_exchange_strong(busy, true)) continue;
+
+    can_pack(can_data_list, send_bufs[i], bus_offset, can_fd);
+    if (send_bufs[i].empty()) {
+      send_busy[i] = false;
+      return;
+    }
+
+    libusb_fill_bulk_transfer(send_transfers[i], dev_handle, 3, (unsigned char *)send_bufs[i].data(), send_bufs[i].size() * sizeof(uint32_t),
+                              can_send_callback, this, CAN_SEND_TIMEOUT);
+
+    transfers_pending++;
+    int err = libusb_submit_transfer(send_transfers[i]);
+    if (err != 0) {
+      transfers_pending--;
+      send_busy[i] = false;
+      handle_usb_issue(err, __func__);
+    }
+    return;
+  }
+
+  LOGW("Transmit buffer full");
 }
 
 int Panda::can_receive(kj::Array<capnp::word>& out_buf) {
-  uint32_t data[RECV_SIZE/4];
-  int recv = usb_bulk_read(0x81, (unsigned char*)data, RECV_SIZE);
+  return can_receive({this}, out_buf);
+}
 
-  // Not sure if this can happen
-  if (recv < 0) recv = 0;
+int Panda::can_receive(const std::vector<Panda *> &pandas, kj::Array<capnp::word>& out_buf) {
+  // merge everything the usb event threads received since the last call into one event
+  std::vector<size_t> num_chunks;
+  size_t num_msg = 0;
+  int recv = 0;
+  bool comms_healthy = true;
+  for (auto p : pandas) {
+    num_chunks.push_back(p->recv_ring.count());
+    for (size_t i = 0; i < num_chunks.back(); i++) {
+      const CanRecvRing::Chunk &chunk = p->recv_ring.front(i);
+      num_msg += can_frame_count((const uint32_t *)chunk.data, chunk.len, p->can_fd);
+      recv += chunk.len;
+    }
+    comms_healthy = comms_healthy && p->comms_healthy;
 
-  if (recv == RECV_SIZE) {
-    LOGW("Receive buffer full");
+    uint64_t dropped = p->recv_ring.dropped;
+    if (dropped != p->recv_dropped_seen) {
+      LOGE("Receive buffer full, dropped %llu chunks", (unsigned long long)(dropped - p->recv_dropped_seen));
+      p->recv_dropped_seen = dropped;
+      comms_healthy = false;
+    }
   }
 
-  size_t num_msg = recv / 0x10;
   MessageBuilder msg;
   auto evt = msg.initEvent();
   evt.setValid(comms_healthy);
 
   // populate message
   auto canData = evt.initCan(num_msg);
-  for (int i = 0; i < num_msg; i++) {
-    if (data[i*4] & 4) {
-      // extended
-      canData[i].setAddress(data[i*4] >> 3);
-      //printf("got extended: %x\n", data[i*4] >> 3);
-    } else {
-      // normal
-      canData[i].setAddress(data[i*4] >> 21);
+  size_t offset = 0;
+  for (int p = 0; p < pandas.size(); p++) {
+    CanRecvRing &ring = pandas[p]->recv_ring;
+    for (size_t i = 0; i < num_chunks[p]; i++) {
+      const CanRecvRing::Chunk &chunk = ring.front(i);
+      offset = can_unpack((const uint32_t *)chunk.data, chunk.len, canData, offset, pandas[p]->bus_offset, pandas[p]->can_fd);
     }
-    canData[i].setBusTime(data[i*4+1] >> 16);
-    int len = data[i*4+1]&0xF;
-    canData[i].setDat(kj::arrayPtr((uint8_t*)&data[i*4+2], len));
-    canData[i].setSrc((data[i*4+1] >> 4) & 0xff);
+    ring.pop(num_chunks[p]);
   }
+
   out_buf = capnp::messageToFlatArray(msg);
   return recv;
 }
@@ -2,9 +2,13 @@
 
 #include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <libusb-1.0/libusb.h>
@@ -16,6 +20,21 @@
 #define RECV_SIZE (0x1000)
 #define TIMEOUT 0
 
+// number of bulk transfers kept in flight per direction
+#define CAN_TRANSFERS 4
+// Drained at 100 Hz by the can publish thread. A saturated 500 kbit/s bus carries about 8000 frames/s and a
+// transfer can complete with a single frame, so this holds two drain periods of three busy buses.
+#define CAN_RECV_RING_SIZE 512
+#define CAN_SEND_TIMEOUT 5
+// the panda answers a bulk IN with a zero length packet when it has no frames queued,
+// the transfer is submitted again after a delay instead of right away. The delay doubles with
+// every empty packet in a row up to the max, so an idle bus costs a few hundred transfers per second.
+#define CAN_RECV_BACKOFF_MS 1
+#define CAN_RECV_BACKOFF_MAX_MS 10
+
+// CAN buses per panda. Extra pandas are mapped to bus numbers after the main one
+#define PANDA_BUS_CNT 4
+
 // copied from panda/board/main.c
 struct __attribute__((packed)) health_t {
   uint32_t uptime;
@@ -40,6 +59,53 @@ struct __attribute__((packed)) health_t {
 };
 
 
+// Single producer, single consumer ring of raw bulk IN chunks.
+// Filled from the libusb event thread and drained by the can publish thread without locking.
+class CanRecvRing {
+ public:
+  struct Chunk {
+    int len;
+    alignas(4) uint8_t data[RECV_SIZE];
+  };
+
+  bool push(const uint8_t *data, int len) {
+    const size_t w = write_idx.load(std::memory_order_relaxed);
+    if (w - read_idx.load(std::memory_order_acquire) == CAN_RECV_RING_SIZE) {
+      dropped++;
+      return false;
+    }
+    Chunk &c = chunks[w % CAN_RECV_RING_SIZE];
+    c.len = len;
+    memcpy(c.data, data, len);
+    write_idx.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // chunks available to the consumer: [front(0), front(count-1)]
+  size_t count() const { return write_idx.load(std::memory_order_acquire) - read_idx.load(std::memory_order_relaxed); }
+  const Chunk &front(size_t i) const { return chunks[(read_idx.load(std::memory_order_relaxed) + i) % CAN_RECV_RING_SIZE]; }
+  void pop(size_t n) { read_idx.store(read_idx.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  // chunks that didn't fit, since the ring was created
+  std::atomic<uint64_t> dropped = 0;
+
+ private:
+  Chunk chunks[CAN_RECV_RING_SIZE];
+  std::atomic<size_t> write_idx = 0, read_idx = 0;
+};
+
+// panda USB CAN framing: an 8 byte header followed by the data. Classic pandas use fixed 16 byte frames
+// with up to 8 data bytes, this is what usb_cb_ep3_out in the firmware parses. With can_fd the 4 bit length
+// field is a CAN-FD DLC and the data is padded to a multiple of 8, at least 8 bytes.
+// Frames never cross USB transfers.
+// bus_offset maps the panda's local bus numbers to global ones, can_pack only keeps frames for this panda's buses
+#define CANPACKET_HEAD_SIZE 8
+#define CANPACKET_DATA_SIZE_MAX 64
+
+void can_pack(capnp::List<cereal::CanData>::Reader can_data_list, std::vector<uint32_t> &out, uint32_t bus_offset=0, bool can_fd=false);
+size_t can_frame_count(const uint32_t *data, int len, bool can_fd=false);
+size_t can_unpack(const uint32_t *data, int len, capnp::List<cereal::CanData>::Builder can_data, size_t offset, uint32_t bus_offset=0, bool can_fd=false);
+
 class Panda {
  private:
   libusb_context *ctx = NULL;
@@ -48,15 +114,42 @@ class Panda {
   void handle_usb_issue(int err, const char func[]);
   void cleanup();
 
+  // async CAN transfers, serviced by usb_event_thread
+  std::thread usb_event_thread;
+  std::atomic<bool> usb_events_running = false, can_transfers_running = false;
+  libusb_transfer *recv_transfers[CAN_TRANSFERS] = {};
+  libusb_transfer *send_transfers[CAN_TRANSFERS] = {};
+  std::vector<uint32_t> send_bufs[CAN_TRANSFERS];
+  std::atomic<bool> send_busy[CAN_TRANSFERS] = {};
+  // submitted and not back yet, only these can be cancelled
+  std::atomic<bool> recv_busy[CAN_TRANSFERS] = {};
+  std::atomic<int> transfers_pending = 0;
+  CanRecvRing recv_ring;
+  uint64_t recv_dropped_seen = 0;
+  // receive transfers that came back empty and when to submit them again, only used on usb_event_thread
+  std::deque<std::pair<libusb_transfer *, double>> recv_idle;
+  int recv_backoff_ms = CAN_RECV_BACKOFF_MS;
+  void set_recv_busy(libusb_transfer *transfer, bool busy);
+  void start_can_transfers();
+  void stop_can_transfers();
+  void resubmit_idle_transfers();
+  static void LIBUSB_CALL can_recv_callback(libusb_transfer *transfer);
+  static void LIBUSB_CALL can_send_callback(libusb_transfer *transfer);
+
  public:
-  Panda();
+  Panda(std::string serial="", uint32_t bus_offset=0);
   ~Panda();
 
+  // serials of the connected pandas, the main panda first
+  static std::vector<std::string> list();
+
   std::atomic<bool> connected = true;
   std::atomic<bool> comms_healthy = true;
   cereal::PandaState::PandaType hw_type = cereal::PandaState::PandaType::UNKNOWN;
   bool is_pigeon = false;
   bool has_rtc = false;
+  bool can_fd = false;  // none of the current pandas have a CAN-FD controller, so the USB framing stays 16 bytes
+  const uint32_t bus_offset;
 
   // HW communication
   int usb_write(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned int timeout=TIMEOUT);
@@ -82,4 +175,5 @@ class Panda {
   void send_heartbeat();
   void can_send(capnp::List<cereal::CanData>::Reader can_data_list);
   int can_receive(kj::Array<capnp::word>& out_buf);
+  static int can_receive(const std::vector<Panda *> &pandas, kj::Array<capnp::word>& out_buf);
 };
@@ -0,0 +1,185 @@
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/messaging.h"
+#include "selfdrive/boardd/panda.h"
+
+// Stands in for the panda: packs random frames in the USB bulk format and
+// pushes them into the receive ring the way the libusb event thread does.
+struct SimulatedPanda {
+  std::vector<std::vector<uint32_t>> chunks;
+  std::vector<std::tuple<uint32_t, uint8_t, std::vector<uint8_t>>> frames;
+
+  SimulatedPanda(int num_chunks, int frames_per_chunk, bool can_fd = false) {
+    std::mt19937 rng(1234);
+    for (int c = 0; c < num_chunks; c++) {
+      MessageBuilder msg;
+      auto can_list = msg.initEvent().initSendcan(frames_per_chunk);
+      for (int i = 0; i < frames_per_chunk; i++) {
+        uint32_t address = rng() % 2 ? rng() % 0x800 : 0x800 + rng() % 0x1FFFF800;
+        uint8_t bus = rng() % 3;
+        // mostly classic frames, some CAN-FD
+        const size_t fd_lens[] = {12, 16, 20, 24, 32, 48, 64};
+        std::vector<uint8_t> dat(!can_fd || rng() % 4 ? rng() % 9 : fd_lens[rng() % 7]);
+        for (auto &b : dat) b = rng();
+
+        can_list[i].setAddress(address);
+        can_list[i].setSrc(bus);
+        can_list[i].setDat(kj::arrayPtr(dat.data(), dat.size()));
+        frames.push_back({address, bus, dat});
+      }
+      std::vector<uint32_t> packed;
+      can_pack(can_list.asReader(), packed, 0, can_fd);
+      chunks.push_back(packed);
+    }
+  }
+};
+
+TEST_CASE("can_unpack reads back can_pack") {
+  bool can_fd = GENERATE(false, true);
+  SimulatedPanda panda(1, 100, can_fd);
+
+  MessageBuilder msg;
+  auto can_data = msg.initEvent().initCan(100);
+  const auto &chunk = panda.chunks[0];
+  REQUIRE(can_frame_count(chunk.data(), chunk.size() * sizeof(uint32_t), can_fd) == 100);
+  REQUIRE(can_unpack(chunk.data(), chunk.size() * sizeof(uint32_t), can_data, 0, 0, can_fd) == 100);
+
+  for (int i = 0; i < 100; i++) {
+    auto &[address, bus, dat] = panda.frames[i];
+    REQUIRE(can_data[i].getAddress() == address);
+    REQUIRE(can_data[i].getSrc() == bus);
+    auto d = can_data[i].getDat();
+    REQUIRE(std::vector<uint8_t>(d.begin(), d.end()) == dat);
+  }
+}
+
+TEST_CASE("can_pack pads CAN-FD frames to the next DLC") {
+  MessageBuilder msg;
+  auto can_list = msg.initEvent().initSendcan(2);
+  std::vector<uint8_t> dat(10, 0xAB);
+  can_list[0].setAddress(0x123);
+  can_list[0].setDat(kj::arrayPtr(dat.data(), dat.size()));
+  can_list[1].setAddress(0x456);
+  can_list[1].setDat(kj::arrayPtr(dat.data(), 3));
+
+  std::vector<uint32_t> packed;
+  can_pack(can_list.asReader(), packed, 0, true);
+  REQUIRE(packed.size() * sizeof(uint32_t) == (CANPACKET_HEAD_SIZE + 16) + (CANPACKET_HEAD_SIZE + 8));
+
+  // a frame cut off at the end of a transfer is dropped
+  REQUIRE(can_frame_count(packed.data(), packed.size() * sizeof(uint32_t), true) == 2);
+  REQUIRE(can_frame_count(packed.data(), packed.size() * sizeof(uint32_t) - 4, true) == 1);
+
+  MessageBuilder out;
+  auto can_data = out.initEvent().initCan(2);
+  REQUIRE(can_unpack(packed.data(), packed.size() * sizeof(uint32_t), can_data, 0, 0, true) == 2);
+  auto d = can_data[0].getDat();
+  REQUIRE(d.size() == 12);
+  REQUIRE(std::vector<uint8_t>(d.begin(), d.begin() + 10) == dat);
+  REQUIRE(d[10] == 0);
+  REQUIRE(d[11] == 0);
+  REQUIRE(can_data[1].getAddress() == 0x456);
+  REQUIRE(can_data[1].getDat().size() == 3);
+}
+
+// parses a bulk transfer the way usb_cb_ep3_out in panda/board/main.c does
+struct FirmwareFrame {
+  uint32_t address;
+  uint8_t bus;
+  std::vector<uint8_t> dat;
+};
+static std::vector<FirmwareFrame> firmware_parse(const std::vector<uint32_t> &d32) {
+  std::vector<FirmwareFrame> frames;
+  for (size_t dpkt = 0; dpkt < d32.size(); dpkt += 4) {
+    uint32_t RIR = d32[dpkt], RDTR = d32[dpkt + 1], RDLR = d32[dpkt + 2], RDHR = d32[dpkt + 3];
+    uint8_t data[8];
+    memcpy(&data[0], &RDLR, 4);
+    memcpy(&data[4], &RDHR, 4);
+    uint32_t address = (RIR & 4) ? (RIR >> 3) : (RIR >> 21);
+    frames.push_back({address, uint8_t((RDTR >> 4) & 0x7F), std::vector<uint8_t>(data, data + (RDTR & 0xF))});
+  }
+  return frames;
+}
+
+TEST_CASE("can_pack matches the firmware's 16 byte frames") {
+  MessageBuilder msg;
+  auto can_list = msg.initEvent().initSendcan(11);
+  std::vector<uint8_t> dat(12);
+  for (size_t i = 0; i < dat.size(); i++) dat[i] = i + 1;
+  for (int i = 0; i < 9; i++) {
+    can_list[i].setAddress(i % 2 ? 0x100 + i : 0x18DAF100 + i);
+    can_list[i].setSrc(i % 3);
+    can_list[i].setDat(kj::arrayPtr(dat.data(), i));
+  }
+  // a frame that doesn't fit a classic panda is dropped, later frames keep their alignment
+  can_list[9].setAddress(0x200);
+  can_list[9].setDat(kj::arrayPtr(dat.data(), 12));
+  can_list[10].setAddress(0x201);
+  can_list[10].setSrc(2);
+  can_list[10].setDat(kj::arrayPtr(dat.data(), 8));
+
+  std::vector<uint32_t> packed;
+  can_pack(can_list.asReader(), packed);
+  REQUIRE(packed.size() * sizeof(uint32_t) == 10 * 16);
+
+  auto frames = firmware_parse(packed);
+  REQUIRE(frames.size() == 10);
+  for (int i = 0; i < 10; i++) {
+    int j = i < 9 ? i : 10;
+    REQUIRE(frames[i].address == can_list[j].getAddress());
+    REQUIRE(frames[i].bus == can_list[j].getSrc());
+    auto d = can_list[j].getDat();
+    REQUIRE(frames[i].dat == std::vector<uint8_t>(d.begin(), d.end()));
+  }
+}
+
+TEST_CASE("can_unpack keeps classic frames aligned for DLC codes above 8") {
+  std::vector<uint32_t> mailboxes;
+  for (uint32_t dlc = 0; dlc < 16; dlc++) {
+    mailboxes.insert(mailboxes.end(), {(0x300 + dlc) << 21 | 1, dlc | (1 << 4), 0x04030201, 0x08070605});
+  }
+
+  MessageBuilder msg;
+  auto can_data = msg.initEvent().initCan(16);
+  REQUIRE(can_frame_count(mailboxes.data(), mailboxes.size() * sizeof(uint32_t)) == 16);
+  REQUIRE(can_unpack(mailboxes.data(), mailboxes.size() * sizeof(uint32_t), can_data, 0) == 16);
+  for (uint32_t dlc = 0; dlc < 16; dlc++) {
+    REQUIRE(can_data[dlc].getAddress() == 0x300 + dlc);
+    REQUIRE(can_data[dlc].getSrc() == 1);
+    REQUIRE(can_data[dlc].getDat().size() == std::min<uint32_t>(dlc, 8));
+  }
+}
+
+TEST_CASE("CanRecvRing hands chunks over in order") {
+  const int num_chunks = 1000, frames_per_chunk = 8;
+  SimulatedPanda panda(num_chunks, frames_per_chunk);
+  auto ring = std::make_unique<CanRecvRing>();
+
+  std::thread producer([&]() {
+    for (auto &chunk : panda.chunks) {
+      while (!ring->push((uint8_t *)chunk.data(), chunk.size() * sizeof(uint32_t))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  size_t received = 0;
+  while (received < panda.frames.size()) {
+    size_t n = ring->count();
+    for (size_t i = 0; i < n; i++) {
+      MessageBuilder msg;
+      auto can_data = msg.initEvent().initCan(frames_per_chunk);
+      const auto &chunk = ring->front(i);
+      REQUIRE(can_unpack((const uint32_t *)chunk.data, chunk.len, can_data, 0) == frames_per_chunk);
+      for (int j = 0; j < frames_per_chunk; j++, received++) {
+        REQUIRE(can_data[j].getAddress() == std::get<0>(panda.frames[received]));
+      }
+    }
+    ring->pop(n);
+  }
+  producer.join();
+  REQUIRE(ring->count() == 0);
+}
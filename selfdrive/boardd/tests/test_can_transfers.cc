@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/messaging.h"
+#include "selfdrive/boardd/panda.h"
+#include "selfdrive/common/timing.h"
+
+// A single simulated panda behind the libusb calls panda.cc makes, these definitions take
+// precedence over the library's. Bulk IN transfers complete with the next queued packet, or with
+// a zero length packet when there is none, like usb_cb_ep1_in in the firmware does.
+static struct {
+  std::mutex lock;
+  std::deque<libusb_transfer *> submitted;
+  std::deque<std::vector<uint32_t>> packets;
+  int recv_submits = 0;
+  int unfilled_cancels = 0;
+} fake_usb;
+
+extern "C" {
+
+int libusb_init(libusb_context **ctx) {
+  *ctx = (libusb_context *)&fake_usb;
+  return 0;
+}
+void libusb_exit(libusb_context *ctx) {}
+int libusb_set_option(libusb_context *ctx, enum libusb_option option, ...) { return 0; }
+
+libusb_device_handle *libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id) {
+  return (libusb_device_handle *)&fake_usb;
+}
+void libusb_close(libusb_device_handle *dev_handle) {}
+int libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number) { return 0; }
+int libusb_set_configuration(libusb_device_handle *dev_handle, int configuration) { return 0; }
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number) { return 0; }
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number) { return 0; }
+
+int libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+                            uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout) {
+  if (data) memset(data, 0, wLength);
+  return wLength;
+}
+
+libusb_transfer *libusb_alloc_transfer(int iso_packets) {
+  return (libusb_transfer *)calloc(1, sizeof(libusb_transfer));
+}
+void libusb_free_transfer(libusb_transfer *transfer) {
+  if (transfer && (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER)) free(transfer->buffer);
+  free(transfer);
+}
+
+int libusb_submit_transfer(libusb_transfer *transfer) {
+  std::lock_guard lk(fake_usb.lock);
+  transfer->status = LIBUSB_TRANSFER_COMPLETED;
+  if (transfer->endpoint & LIBUSB_ENDPOINT_IN) fake_usb.recv_submits++;
+  fake_usb.submitted.push_back(transfer);
+  return 0;
+}
+int libusb_cancel_transfer(libusb_transfer *transfer) {
+  std::lock_guard lk(fake_usb.lock);
+  // libusb before 1.0.24 crashes on these
+  if (transfer->dev_handle == NULL) fake_usb.unfilled_cancels++;
+  auto &s = fake_usb.submitted;
+  if (std::find(s.begin(), s.end(), transfer) == s.end()) return LIBUSB_ERROR_NOT_FOUND;
+  transfer->status = LIBUSB_TRANSFER_CANCELLED;
+  return 0;
+}
+
+int libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv, int *completed) {
+  std::deque<libusb_transfer *> done;
+  {
+    std::lock_guard lk(fake_usb.lock);
+    done.swap(fake_usb.submitted);
+    for (auto t : done) {
+      t->actual_length = 0;
+      if (t->status != LIBUSB_TRANSFER_COMPLETED) continue;
+
+      if (!(t->endpoint & LIBUSB_ENDPOINT_IN)) {
+        t->actual_length = t->length;
+      } else if (!fake_usb.packets.empty()) {
+        auto &packet = fake_usb.packets.front();
+        t->actual_length = packet.size() * sizeof(uint32_t);
+        memcpy(t->buffer, packet.data(), t->actual_length);
+        fake_usb.packets.pop_front();
+      }
+    }
+  }
+
+  if (done.empty()) {
+    std::this_thread::sleep_for(std::chrono::seconds(tv->tv_sec) + std::chrono::microseconds(tv->tv_usec));
+  }
+  for (auto t : done) t->callback(t);
+  return 0;
+}
+
+}
+
+// queues packets of 16 byte frames, numbering the addresses from first_address
+static void queue_packets(int num_packets, int frames_per_packet, uint32_t first_address = 0) {
+  std::lock_guard lk(fake_usb.lock);
+  uint32_t address = first_address;
+  for (int i = 0; i < num_packets; i++) {
+    std::vector<uint32_t> packet;
+    for (int j = 0; j < frames_per_packet; j++, address++) {
+      packet.insert(packet.end(), {(address << 21) | 1, 8, 0x04030201, 0x08070605});
+    }
+    fake_usb.packets.push_back(packet);
+  }
+}
+
+static void wait_for_packets_sent() {
+  for (int i = 0; i < 1000; i++) {
+    {
+      std::lock_guard lk(fake_usb.lock);
+      if (fake_usb.packets.empty()) break;
+    }
+    util::sleep_for(1);
+  }
+  // let the callbacks of the last transfers run
+  util::sleep_for(20);
+}
+
+// returns the frames of the next can event, and whether it's valid
+static std::vector<uint32_t> receive(Panda &panda, bool &valid) {
+  kj::Array<capnp::word> buf;
+  panda.can_receive(buf);
+  capnp::FlatArrayMessageReader msg(buf);
+  auto event = msg.getRoot<cereal::Event>();
+  valid = event.getValid();
+
+  std::vector<uint32_t> addresses;
+  for (auto frame : event.getCan()) {
+    REQUIRE(frame.getDat().size() == 8);
+    addresses.push_back(frame.getAddress());
+  }
+  return addresses;
+}
+
+TEST_CASE("an idle panda is polled again after a backoff") {
+  auto panda = std::make_unique<Panda>();
+  // let the backoff reach its max
+  util::sleep_for(50);
+
+  int submits_before;
+  {
+    std::lock_guard lk(fake_usb.lock);
+    submits_before = fake_usb.recv_submits;
+  }
+  double start = millis_since_boot();
+  util::sleep_for(200);
+  double elapsed = millis_since_boot() - start;
+
+  std::lock_guard lk(fake_usb.lock);
+  int submits = fake_usb.recv_submits - submits_before;
+  REQUIRE(submits > 0);
+  REQUIRE(submits <= CAN_TRANSFERS * (elapsed / CAN_RECV_BACKOFF_MAX_MS + 2));
+}
+
+TEST_CASE("stopping only cancels submitted transfers") {
+  {
+    auto panda = std::make_unique<Panda>();
+    queue_packets(10, 1);
+    wait_for_packets_sent();
+  }
+  std::lock_guard lk(fake_usb.lock);
+  REQUIRE(fake_usb.unfilled_cancels == 0);
+}
+
+TEST_CASE("received packets reach can_receive in order") {
+  auto panda = std::make_unique<Panda>();
+  queue_packets(100, 4, 0x100);
+  wait_for_packets_sent();
+
+  bool valid = false;
+  auto addresses = receive(*panda, valid);
+  REQUIRE(valid);
+  REQUIRE(addresses.size() == 400);
+  for (size_t i = 0; i < addresses.size(); i++) {
+    REQUIRE(addresses[i] == 0x100 + i);
+  }
+}
+
+TEST_CASE("chunks that don't fit the receive ring are reported") {
+  auto panda = std::make_unique<Panda>();
+  queue_packets(CAN_RECV_RING_SIZE + 10, 1);
+  wait_for_packets_sent();
+
+  bool valid = true;
+  REQUIRE(receive(*panda, valid).size() == CAN_RECV_RING_SIZE);
+  REQUIRE(!valid);
+
+  // the drops are only reported once
+  queue_packets(1, 1);
+  wait_for_packets_sent();
+  REQUIRE(receive(*panda, valid).size() == 1);
+  REQUIRE(valid);
+}
@@ -2,14 +2,17 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <chrono>
 #include <thread>
+#include <vector>
 
 #include "libyuv.h"
 #include <jpeglib.h>
 
+#include "selfdrive/camerad/imgproc/image_stats.h"
 #include "selfdrive/camerad/imgproc/utils.h"
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/modeldata.h"
@@ -17,6 +20,7 @@
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/hardware/hw.h"
+#include "selfdrive/loggerd/include/msm_media_info.h"
 
 #ifdef QCOM
 #include "selfdrive/camerad/cameras/camera_qcom.h"
@@ -44,6 +48,30 @@ static cl_program build_debayer_program(cl_device_id device_id, cl_context conte
   return cl_program_from_file(context, device_id, cl_file, args);
 }
 
+// the stream loggerd's hardware encoder reads in place, only on the devices
+static VisionStreamType encode_stream(VisionStreamType yuv_type) {
+#if defined(QCOM) || defined(QCOM2)
+  switch (yuv_type) {
+    case VISION_STREAM_YUV_BACK: return VISION_STREAM_ENCODE_BACK;
+    // loggerd only records the driver camera when it's enabled
+    case VISION_STREAM_YUV_FRONT: return Params().getBool("RecordFront") ? VISION_STREAM_ENCODE_FRONT : VISION_STREAM_MAX;
+    case VISION_STREAM_YUV_WIDE: return VISION_STREAM_ENCODE_WIDE;
+    default: break;
+  }
+#endif
+  return VISION_STREAM_MAX;
+}
+
+// Venus NV12 buffers, the layout the encoder takes without a copy
+static std::unique_ptr<Yuv2Nv12> create_nv12_buffers(VisionIpcServer *v, cl_device_id device_id, cl_context context, VisionStreamType type,
+                                                     int in_width, int in_height, int width, int height) {
+  const int y_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, width);
+  const int uv_stride = VENUS_UV_STRIDE(COLOR_FMT_NV12, width);
+  const int uv_offset = y_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, height);
+  v->create_buffers_nv12(type, ENCODE_BUF_COUNT, width, height, VENUS_BUFFER_SIZE(COLOR_FMT_NV12, width, height), y_stride, uv_offset);
+  return std::make_unique<Yuv2Nv12>(context, device_id, in_width, in_height, width, height, y_stride, uv_stride, uv_offset);
+}
+
 void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType rgb_type, VisionStreamType yuv_type, release_cb release_callback) {
   vipc_server = v;
   this->rgb_type = rgb_type;
@@ -54,6 +82,12 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
   camera_state = s;
   frame_buf_count = frame_cnt;
 
+  // one raw buffer is held by the frame being processed, and one has to stay with the sensor
+  pipeline_depth = std::clamp(frame_buf_count - 2, 1, CAMERA_PIPELINE_DEPTH);
+  for (auto &f : pipeline) {
+    f.owner = this;
+  }
+
   // RAW frame
   const int frame_size = ci->frame_height * ci->frame_stride;
   camera_bufs = std::make_unique<VisionBuf[]>(frame_buf_count);
@@ -88,6 +122,16 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 
   rgb2yuv = std::make_unique<Rgb2Yuv>(context, device_id, rgb_width, rgb_height, rgb_stride);
 
+  encode_type = encode_stream(yuv_type);
+  if (encode_type != VISION_STREAM_MAX) {
+    yuv2encode = create_nv12_buffers(vipc_server, device_id, context, encode_type, rgb_width, rgb_height, rgb_width, rgb_height);
+    if (yuv_type == VISION_STREAM_YUV_BACK) {
+      // qcamera.ts is scaled down on the gpu as well
+      qcamera_type = VISION_STREAM_ENCODE_QCAMERA;
+      yuv2qcamera = create_nv12_buffers(vipc_server, device_id, context, qcamera_type, rgb_width, rgb_height, QCAMERA_WIDTH, QCAMERA_HEIGHT);
+    }
+  }
+
 #ifdef __APPLE__
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
 #else
@@ -97,6 +141,19 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 }
 
 CameraBuf::~CameraBuf() {
+  if (q) CL_CHECK(clFinish(q));
+  while (pipeline_count > 0) {
+    CameraPipelineFrame &f = pipeline[pipeline_head];
+    {
+      // the completion callback can run after clFinish returns
+      std::unique_lock lk(pipeline_lock);
+      pipeline_cv.wait(lk, [&f] { return f.done; });
+    }
+    CL_CHECK(clReleaseEvent(f.event));
+    pipeline_head = (pipeline_head + 1) % pipeline_depth;
+    pipeline_count--;
+  }
+
   for (int i = 0; i < frame_buf_count; i++) {
     camera_bufs[i].free();
   }
@@ -105,23 +162,33 @@ CameraBuf::~CameraBuf() {
   if (q) CL_CHECK(clReleaseCommandQueue(q));
 }
 
-bool CameraBuf::acquire() {
-  if (!safe_queue.try_pop(cur_buf_idx, 1)) return false;
-
-  if (camera_bufs_metadata[cur_buf_idx].frame_id == -1) {
-    LOGE("no frame data? wtf");
-    release();
-    return false;
+void CL_CALLBACK CameraBuf::frame_done(cl_event event, cl_int status, void *user_data) {
+  CameraPipelineFrame *f = (CameraPipelineFrame *)user_data;
+  CameraBuf *b = f->owner;
+  if (status != CL_COMPLETE) {
+    LOGE("frame %d failed on the gpu: %d", f->frame_data.frame_id, status);
   }
+  // notify under the lock, once done is seen the destructor can free b
+  std::lock_guard lk(b->pipeline_lock);
+  f->done = true;
+  b->pipeline_cv.notify_one();
+}
 
-  cur_frame_data = camera_bufs_metadata[cur_buf_idx];
-  cur_rgb_buf = vipc_server->get_buffer(rgb_type);
+void CameraBuf::enqueue_frame(int buf_idx) {
+  CameraPipelineFrame &f = pipeline[(pipeline_head + pipeline_count) % pipeline_depth];
+  f.buf_idx = buf_idx;
+  f.frame_data = camera_bufs_metadata[buf_idx];
+  f.rgb_buf = vipc_server->get_buffer(rgb_type);
+  f.yuv_buf = vipc_server->get_buffer(yuv_type);
+  f.encode_buf = yuv2encode ? vipc_server->get_buffer(encode_type) : nullptr;
+  f.qcamera_buf = yuv2qcamera ? vipc_server->get_buffer(qcamera_type) : nullptr;
+  f.done = false;
 
   cl_event debayer_event;
-  cl_mem camrabuf_cl = camera_bufs[cur_buf_idx].buf_cl;
+  cl_mem camrabuf_cl = camera_bufs[buf_idx].buf_cl;
   if (camera_state->ci.bayer) {
     CL_CHECK(clSetKernelArg(krnl_debayer, 0, sizeof(cl_mem), &camrabuf_cl));
-    CL_CHECK(clSetKernelArg(krnl_debayer, 1, sizeof(cl_mem), &cur_rgb_buf->buf_cl));
+    CL_CHECK(clSetKernelArg(krnl_debayer, 1, sizeof(cl_mem), &f.rgb_buf->buf_cl));
 #ifdef QCOM2
     constexpr int localMemSize = (DEBAYER_LOCAL_WORKSIZE + 2 * (3 / 2)) * (DEBAYER_LOCAL_WORKSIZE + 2 * (3 / 2)) * sizeof(short int);
     const size_t globalWorkSize[] = {size_t(camera_state->ci.frame_width), size_t(camera_state->ci.frame_height)};
@@ -141,15 +208,60 @@ bool CameraBuf::acquire() {
 #endif
   } else {
     assert(rgb_stride == camera_state->ci.frame_stride);
-    CL_CHECK(clEnqueueCopyBuffer(q, camrabuf_cl, cur_rgb_buf->buf_cl, 0, 0,
-                               cur_rgb_buf->len, 0, 0, &debayer_event));
+    CL_CHECK(clEnqueueCopyBuffer(q, camrabuf_cl, f.rgb_buf->buf_cl, 0, 0,
+                               f.rgb_buf->len, 0, 0, &debayer_event));
   }
 
-  clWaitForEvents(1, &debayer_event);
+  rgb2yuv->queue(q, f.rgb_buf->buf_cl, f.yuv_buf->buf_cl, 1, &debayer_event, &f.event);
   CL_CHECK(clReleaseEvent(debayer_event));
 
-  cur_yuv_buf = vipc_server->get_buffer(yuv_type);
-  rgb2yuv->queue(q, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl);
+  // the encoder copies run off the yuv frame, f.event ends up being the last kernel
+  if (yuv2encode) {
+    cl_event yuv_event = f.event;
+    yuv2encode->queue(q, f.yuv_buf->buf_cl, f.encode_buf->buf_cl, 1, &yuv_event, &f.event);
+    CL_CHECK(clReleaseEvent(yuv_event));
+  }
+  if (yuv2qcamera) {
+    cl_event encode_event = f.event;
+    yuv2qcamera->queue(q, f.yuv_buf->buf_cl, f.qcamera_buf->buf_cl, 1, &encode_event, &f.event);
+    CL_CHECK(clReleaseEvent(encode_event));
+  }
+  CL_CHECK(clSetEventCallback(f.event, CL_COMPLETE, frame_done, &f));
+  CL_CHECK(clFlush(q));
+  pipeline_count++;
+}
+
+bool CameraBuf::acquire() {
+  auto frame_ready = [this] { return pipeline_count > 0 && pipeline[pipeline_head].done; };
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+
+  while (true) {
+    // keep the gpu busy with the next frames while the oldest one finishes
+    int buf_idx;
+    while (pipeline_count < pipeline_depth && safe_queue.try_pop(buf_idx)) {
+      if (camera_bufs_metadata[buf_idx].frame_id == -1) {
+        LOGE("no frame data? wtf");
+        if (release_callback) release_callback((void*)camera_state, buf_idx);
+        continue;
+      }
+      enqueue_frame(buf_idx);
+    }
+
+    std::unique_lock lk(pipeline_lock);
+    auto ready = [&] { return frame_ready() || (pipeline_count < pipeline_depth && !safe_queue.empty()); };
+    if (!pipeline_cv.wait_until(lk, deadline, ready)) return false;
+    if (frame_ready()) break;
+  }
+
+  CameraPipelineFrame &f = pipeline[pipeline_head];
+  CL_CHECK(clReleaseEvent(f.event));
+  pipeline_head = (pipeline_head + 1) % pipeline_depth;
+  pipeline_count--;
+
+  cur_buf_idx = f.buf_idx;
+  cur_frame_data = f.frame_data;
+  cur_rgb_buf = f.rgb_buf;
+  cur_yuv_buf = f.yuv_buf;
 
   VisionIpcBufExtra extra = {
                         cur_frame_data.frame_id,
@@ -158,6 +270,8 @@ bool CameraBuf::acquire() {
   };
   vipc_server->send(cur_rgb_buf, &extra);
   vipc_server->send(cur_yuv_buf, &extra);
+  if (f.encode_buf) vipc_server->send(f.encode_buf, &extra);
+  if (f.qcamera_buf) vipc_server->send(f.qcamera_buf, &extra);
 
   return true;
 }
@@ -170,6 +284,11 @@ void CameraBuf::release() {
 
 void CameraBuf::queue(size_t buf_idx) {
   safe_queue.push(buf_idx);
+  {
+    // wakes up acquire() so the frame goes to the gpu right away
+    std::lock_guard lk(pipeline_lock);
+  }
+  pipeline_cv.notify_one();
 }
 
 // common functions
@@ -220,7 +339,9 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
   uint8_t* thumbnail_buffer = NULL;
   unsigned long thumbnail_len = 0;
 
-  unsigned char *row = (unsigned char *)malloc(b->rgb_width/4*3);
+  const int width = b->rgb_width / 4, height = b->rgb_height / 4;
+  std::vector<uint8_t> thumbnail(width * height * 3);
+  downscale_bgr_4x((const uint8_t *)b->cur_rgb_buf->addr, b->rgb_width, b->rgb_height, b->rgb_stride, thumbnail.data());
 
   struct jpeg_compress_struct cinfo;
   struct jpeg_error_mgr jerr;
@@ -229,8 +350,8 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
   jpeg_create_compress(&cinfo);
   jpeg_mem_dest(&cinfo, &thumbnail_buffer, &thumbnail_len);
 
-  cinfo.image_width = b->rgb_width / 4;
-  cinfo.image_height = b->rgb_height / 4;
+  cinfo.image_width = width;
+  cinfo.image_height = height;
   cinfo.input_components = 3;
   cinfo.in_color_space = JCS_RGB;
 
@@ -244,29 +365,12 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
 #endif
 
   JSAMPROW row_pointer[1];
-  const uint8_t *bgr_ptr = (const uint8_t *)b->cur_rgb_buf->addr;
-  for (int ii = 0; ii < b->rgb_height/4; ii+=1) {
-    for (int j = 0; j < b->rgb_width*3; j+=12) {
-      for (int k = 0; k < 3; k++) {
-        uint16_t dat = 0;
-        int i = ii * 4;
-        dat += bgr_ptr[b->rgb_stride*i + j + k];
-        dat += bgr_ptr[b->rgb_stride*i + j+3 + k];
-        dat += bgr_ptr[b->rgb_stride*(i+1) + j + k];
-        dat += bgr_ptr[b->rgb_stride*(i+1) + j+3 + k];
-        dat += bgr_ptr[b->rgb_stride*(i+2) + j + k];
-        dat += bgr_ptr[b->rgb_stride*(i+2) + j+3 + k];
-        dat += bgr_ptr[b->rgb_stride*(i+3) + j + k];
-        dat += bgr_ptr[b->rgb_stride*(i+3) + j+3 + k];
-        row[(j/4) + (2-k)] = dat/8;
-      }
-    }
-    row_pointer[0] = row;
+  for (int i = 0; i < height; i++) {
+    row_pointer[0] = &thumbnail[i * width * 3];
     jpeg_write_scanlines(&cinfo, row_pointer, 1);
   }
   jpeg_finish_compress(&cinfo);
   jpeg_destroy_compress(&cinfo);
-  free(row);
 
   MessageBuilder msg;
   auto thumbnaild = msg.initEvent().initThumbnail();
@@ -281,17 +385,8 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
 float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
   int lum_med;
   uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
-
-  unsigned int lum_total = 0;
-  for (int y = y_start; y < y_end; y += y_skip) {
-    for (int x = x_start; x < x_end; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
-  }
-
+  unsigned int lum_total = luma_histogram(b->cur_yuv_buf->y, b->rgb_width, x_start, x_end, x_skip,
+                                          y_start, y_end, y_skip, lum_binning);
 
   // Find mean lumimance value
   unsigned int lum_cur = 0;
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include "cereal/messaging/messaging.h"
@@ -10,10 +13,12 @@
 #include "cereal/visionipc/visionipc.h"
 #include "cereal/visionipc/visionipc_server.h"
 #include "selfdrive/camerad/transforms/rgb_to_yuv.h"
+#include "selfdrive/camerad/transforms/yuv_to_nv12.h"
 #include "selfdrive/common/mat.h"
 #include "selfdrive/common/queue.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/visionimg.h"
+#include "selfdrive/hardware/hw.h"
 
 #define CAMERA_ID_IMX298 0
 #define CAMERA_ID_IMX179 1
@@ -27,6 +32,13 @@
 #define CAMERA_ID_MAX 9
 
 #define UI_BUF_COUNT 4
+// NV12 frames for loggerd's encoder, which reads them in place with one OMX input header per
+// frame. The Venus encoders' input port needs at least VENUS_ENC_IN_BUF_MIN (its nBufferCountMin),
+// on top of that camerad writes one frame and loggerd has received one it didn't submit yet.
+#define VENUS_ENC_IN_BUF_MIN 5
+#define ENCODE_BUF_COUNT (VENUS_ENC_IN_BUF_MIN + 2)
+// frames being debayered/converted on the GPU while the previous one is processed
+#define CAMERA_PIPELINE_DEPTH 2
 
 #define LOG_CAMERA_ID_FCAMERA 0
 #define LOG_CAMERA_ID_DCAMERA 1
@@ -34,6 +46,10 @@
 #define LOG_CAMERA_ID_QCAMERA 3
 #define LOG_CAMERA_ID_MAX 4
 
+// size of qcamera.ts
+#define QCAMERA_WIDTH (Hardware::TICI() ? 526 : 480)
+#define QCAMERA_HEIGHT (Hardware::TICI() ? 330 : 360)
+
 const bool env_send_driver = getenv("SEND_DRIVER") != NULL;
 const bool env_send_road = getenv("SEND_ROAD") != NULL;
 const bool env_send_wide_road = getenv("SEND_WIDE_ROAD") != NULL;
@@ -92,6 +108,20 @@ typedef struct CameraExpInfo {
 struct MultiCameraState;
 struct CameraState;
 
+class CameraBuf;
+
+struct CameraPipelineFrame {
+  CameraBuf *owner;
+  int buf_idx;
+  FrameMetadata frame_data;
+  VisionBuf *rgb_buf;
+  VisionBuf *yuv_buf;
+  VisionBuf *encode_buf;
+  VisionBuf *qcamera_buf;
+  cl_event event;
+  std::atomic<bool> done;
+};
+
 class CameraBuf {
 private:
   VisionIpcServer *vipc_server;
@@ -99,8 +129,10 @@ private:
   cl_kernel krnl_debayer;
 
   std::unique_ptr<Rgb2Yuv> rgb2yuv;
+  std::unique_ptr<Yuv2Nv12> yuv2encode, yuv2qcamera;
 
   VisionStreamType rgb_type, yuv_type;
+  VisionStreamType encode_type = VISION_STREAM_MAX, qcamera_type = VISION_STREAM_MAX;
 
   int cur_buf_idx;
 
@@ -109,6 +141,17 @@ private:
   int frame_buf_count;
   release_cb release_callback;
 
+  // frames in flight on the GPU, completed in order
+  CameraPipelineFrame pipeline[CAMERA_PIPELINE_DEPTH] = {};
+  int pipeline_depth = 1;
+  int pipeline_head = 0;
+  int pipeline_count = 0;
+  std::mutex pipeline_lock;
+  std::condition_variable pipeline_cv;
+
+  void enqueue_frame(int buf_idx);
+  static void CL_CALLBACK frame_done(cl_event event, cl_int status, void *user_data);
+
 public:
   cl_command_queue q;
   FrameMetadata cur_frame_data;
@@ -0,0 +1,88 @@
+#include "selfdrive/camerad/imgproc/image_stats.h"
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// sums four rows of len bytes into 16 bit columns
+static void sum_rows_4(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2, const uint8_t *r3,
+                       int len, uint16_t *sum) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t a = vld1q_u8(r0 + i), b = vld1q_u8(r1 + i), c = vld1q_u8(r2 + i), d = vld1q_u8(r3 + i);
+    vst1q_u16(sum + i, vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)), vaddl_u8(vget_low_u8(c), vget_low_u8(d))));
+    vst1q_u16(sum + i + 8, vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)), vaddl_u8(vget_high_u8(c), vget_high_u8(d))));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(r0 + i)), b = _mm_loadu_si128((const __m128i *)(r1 + i));
+    __m128i c = _mm_loadu_si128((const __m128i *)(r2 + i)), d = _mm_loadu_si128((const __m128i *)(r3 + i));
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                               _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                               _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+    _mm_storeu_si128((__m128i *)(sum + i), lo);
+    _mm_storeu_si128((__m128i *)(sum + i + 8), hi);
+  }
+#endif
+  for (; i < len; i++) {
+    sum[i] = r0[i] + r1[i] + r2[i] + r3[i];
+  }
+}
+
+void downscale_bgr_4x(const uint8_t *bgr, int width, int height, int stride, uint8_t *out) {
+  const int out_width = width / 4, out_height = height / 4;
+  const int len = out_width * 4 * 3;
+  std::vector<uint16_t> sum(len);
+
+  for (int r = 0; r < out_height; r++) {
+    const uint8_t *row = bgr + (size_t)r * 4 * stride;
+    sum_rows_4(row, row + stride, row + 2 * stride, row + 3 * stride, len, sum.data());
+
+    uint8_t *out_row = out + (size_t)r * out_width * 3;
+    for (int x = 0; x < out_width; x++) {
+      const uint16_t *s = &sum[x * 12];
+      // BGR -> RGB
+      out_row[x * 3 + 0] = (s[2] + s[5] + s[8] + s[11] + 8) / 16;
+      out_row[x * 3 + 1] = (s[1] + s[4] + s[7] + s[10] + 8) / 16;
+      out_row[x * 3 + 2] = (s[0] + s[3] + s[6] + s[9] + 8) / 16;
+    }
+  }
+}
+
+uint32_t luma_histogram(const uint8_t *y, int stride, int x_start, int x_end, int x_skip,
+                        int y_start, int y_end, int y_skip, uint32_t hist[256]) {
+  // four interleaved histograms so consecutive samples with the same value
+  // don't serialize on a single counter
+  uint32_t banks[4][256] = {};
+  uint32_t total = 0;
+
+  for (int r = y_start; r < y_end; r += y_skip) {
+    const uint8_t *row = y + (size_t)r * stride;
+    int x = x_start;
+    for (; x + 3 * x_skip < x_end; x += 4 * x_skip) {
+      banks[0][row[x]]++;
+      banks[1][row[x + x_skip]]++;
+      banks[2][row[x + 2 * x_skip]]++;
+      banks[3][row[x + 3 * x_skip]]++;
+    }
+    for (; x < x_end; x += x_skip) {
+      banks[0][row[x]]++;
+    }
+    if (x_end > x_start) {
+      total += (x_end - x_start + x_skip - 1) / x_skip;
+    }
+  }
+
+  for (int i = 0; i < 256; i++) {
+    hist[i] += banks[0][i] + banks[1][i] + banks[2][i] + banks[3][i];
+  }
+  return total;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// Downscales a packed BGR image 4x in both directions by averaging each 4x4 block,
+// writing (width / 4) * (height / 4) packed RGB pixels to out.
+void downscale_bgr_4x(const uint8_t *bgr, int width, int height, int stride, uint8_t *out);
+
+// Adds the luminance samples in [x_start, x_end) x [y_start, y_end) to hist,
+// returns the number of samples.
+uint32_t luma_histogram(const uint8_t *y, int stride, int x_start, int x_end, int x_skip,
+                        int y_start, int y_end, int y_skip, uint32_t hist[256]);
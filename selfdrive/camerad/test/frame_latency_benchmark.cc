@@ -0,0 +1,95 @@
+// Measures the latency from a frame being handed to camerad until it is published on vipc.
+// Replays recorded frames through camera_frame_stream, run it next to a PC build of camerad:
+//
+//   ffmpeg -i fcamera.hevc -f rawvideo -pix_fmt rgb24 -s 1164x874 frames.rgb
+//   ./camerad &
+//   ./test/frame_latency_benchmark frames.rgb [num_frames] [fps]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "cereal/visionipc/visionipc_client.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+
+#define FRAME_WIDTH 1164
+#define FRAME_HEIGHT 874
+#define FRAME_SIZE (FRAME_WIDTH * FRAME_HEIGHT * 3)
+
+static void receiver_thread(std::atomic<bool> *done, std::vector<uint64_t> *latencies) {
+  VisionIpcClient vipc_client("camerad", VISION_STREAM_YUV_BACK, false);
+  while (!*done && !vipc_client.connect(false)) {
+    util::sleep_for(10);
+  }
+
+  while (!*done) {
+    VisionIpcBufExtra extra;
+    if (vipc_client.recv(&extra) == nullptr) continue;
+    latencies->push_back(nanos_since_boot() - extra.timestamp_eof);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("usage: %s <rgb24 frames> [num_frames] [fps]\n", argv[0]);
+    return 1;
+  }
+  const int num_frames = argc > 2 ? atoi(argv[2]) : 1200;
+  const int fps = argc > 3 ? atoi(argv[3]) : 20;
+
+  std::string frames = util::read_file(argv[1]);
+  const int frame_cnt = frames.size() / FRAME_SIZE;
+  if (frame_cnt == 0) {
+    printf("no %dx%d frames in %s\n", FRAME_WIDTH, FRAME_HEIGHT, argv[1]);
+    return 1;
+  }
+
+  std::atomic<bool> done = false;
+  std::vector<uint64_t> latencies;
+  std::thread receiver(receiver_thread, &done, &latencies);
+
+  PubMaster pm({"roadCameraState"});
+  // give camerad and the receiver time to connect
+  util::sleep_for(1000);
+
+  for (int i = 0; i < num_frames; i++) {
+    const uint64_t start = nanos_since_boot();
+
+    MessageBuilder msg;
+    auto framed = msg.initEvent().initRoadCameraState();
+    framed.setFrameId(i);
+    framed.setImage(kj::arrayPtr((const uint8_t *)frames.data() + (i % frame_cnt) * FRAME_SIZE, FRAME_SIZE));
+    // the latency is measured from here, camerad passes the timestamp through to vipc
+    framed.setTimestampEof(nanos_since_boot());
+    pm.send("roadCameraState", msg);
+
+    const uint64_t dt = (nanos_since_boot() - start) / 1000;
+    const uint64_t period = 1000000 / fps;
+    if (dt < period) usleep(period - dt);
+  }
+
+  util::sleep_for(500);
+  done = true;
+  receiver.join();
+
+  if (latencies.empty()) {
+    printf("no frames received, is camerad running?\n");
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  uint64_t sum = 0;
+  for (uint64_t l : latencies) sum += l;
+
+  printf("%zu/%d frames received at %d fps\n", latencies.size(), num_frames, fps);
+  printf("frame to vipc latency ms: mean %.2f  p50 %.2f  p99 %.2f  max %.2f\n",
+         sum / 1e6 / latencies.size(), latencies[latencies.size() / 2] / 1e6,
+         latencies[latencies.size() * 99 / 100] / 1e6, latencies.back() / 1e6);
+  return 0;
+}
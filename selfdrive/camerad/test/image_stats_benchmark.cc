@@ -0,0 +1,122 @@
+// Compares the thumbnail downscale and auto-exposure histogram against the per-pixel loops they replaced.
+//
+// usage: image_stats_benchmark [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "selfdrive/camerad/imgproc/image_stats.h"
+
+#define WIDTH 1164
+#define HEIGHT 874
+#define STRIDE (WIDTH * 3 + 64)
+
+// the loop publish_thumbnail had, it samples 2 of the 4 columns of each block
+static void downscale_original(const uint8_t *bgr_ptr, int width, int height, int stride, uint8_t *out) {
+  for (int ii = 0; ii < height / 4; ii += 1) {
+    uint8_t *row = out + ii * (width / 4) * 3;
+    for (int j = 0; j < width * 3; j += 12) {
+      for (int k = 0; k < 3; k++) {
+        uint16_t dat = 0;
+        int i = ii * 4;
+        dat += bgr_ptr[stride*i + j + k];
+        dat += bgr_ptr[stride*i + j+3 + k];
+        dat += bgr_ptr[stride*(i+1) + j + k];
+        dat += bgr_ptr[stride*(i+1) + j+3 + k];
+        dat += bgr_ptr[stride*(i+2) + j + k];
+        dat += bgr_ptr[stride*(i+2) + j+3 + k];
+        dat += bgr_ptr[stride*(i+3) + j + k];
+        dat += bgr_ptr[stride*(i+3) + j+3 + k];
+        row[(j/4) + (2-k)] = dat/8;
+      }
+    }
+  }
+}
+
+// full 4x4 box filter, what downscale_bgr_4x has to match
+static void downscale_reference(const uint8_t *bgr_ptr, int width, int height, int stride, uint8_t *out) {
+  for (int ii = 0; ii < height / 4; ii++) {
+    uint8_t *row = out + ii * (width / 4) * 3;
+    for (int j = 0; j < (width / 4) * 12; j += 12) {
+      for (int k = 0; k < 3; k++) {
+        uint16_t dat = 0;
+        int i = ii * 4;
+        for (int di = 0; di < 4; di++) {
+          for (int dj = 0; dj < 12; dj += 3) {
+            dat += bgr_ptr[stride * (i + di) + j + dj + k];
+          }
+        }
+        row[(j / 4) + (2 - k)] = (dat + 8) / 16;
+      }
+    }
+  }
+}
+
+static uint32_t histogram_scalar(const uint8_t *pix_ptr, int stride, int x_start, int x_end, int x_skip,
+                                 int y_start, int y_end, int y_skip, uint32_t hist[256]) {
+  uint32_t total = 0;
+  for (int y = y_start; y < y_end; y += y_skip) {
+    for (int x = x_start; x < x_end; x += x_skip) {
+      hist[pix_ptr[y * stride + x]]++;
+      total++;
+    }
+  }
+  return total;
+}
+
+template <typename F>
+static double time_us(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 100;
+
+  // smooth gradients with some noise, so the histogram isn't uniform
+  std::mt19937 gen(0);
+  std::vector<uint8_t> bgr(STRIDE * HEIGHT), y(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; r++) {
+    for (int c = 0; c < WIDTH * 3; c++) {
+      bgr[r * STRIDE + c] = (r + c / 3 + (gen() & 15)) & 0xff;
+    }
+    for (int c = 0; c < WIDTH; c++) {
+      y[r * WIDTH + c] = (r / 4 + (gen() & 31)) & 0xff;
+    }
+  }
+
+  const int out_size = (WIDTH / 4) * (HEIGHT / 4) * 3;
+  std::vector<uint8_t> out_scalar(out_size), out_simd(out_size);
+  downscale_reference(bgr.data(), WIDTH, HEIGHT, STRIDE, out_scalar.data());
+  double t_scalar = time_us(iterations, [&] { downscale_original(bgr.data(), WIDTH, HEIGHT, STRIDE, out_simd.data()); });
+  double t_simd = time_us(iterations, [&] { downscale_bgr_4x(bgr.data(), WIDTH, HEIGHT, STRIDE, out_simd.data()); });
+  bool match = out_scalar == out_simd;
+  printf("thumbnail downscale: original %.1f us, image_stats %.1f us%s\n", t_scalar, t_simd, match ? "" : "  MISMATCH");
+
+  struct { int x1, x2, x_skip, y1, y2, y_skip; } rects[] = {
+    {0, WIDTH, 1, 0, HEIGHT, 1},
+    {WIDTH * 3 / 5, WIDTH, 2, HEIGHT / 3, HEIGHT, 1},
+    {96, WIDTH - 96, 2, 242, HEIGHT, 4},
+  };
+  for (auto &r : rects) {
+    uint32_t hist_scalar[256] = {}, hist_simd[256] = {};
+    uint32_t n_scalar = 0, n_simd = 0;
+    t_scalar = time_us(iterations, [&] {
+      memset(hist_scalar, 0, sizeof(hist_scalar));
+      n_scalar = histogram_scalar(y.data(), WIDTH, r.x1, r.x2, r.x_skip, r.y1, r.y2, r.y_skip, hist_scalar);
+    });
+    t_simd = time_us(iterations, [&] {
+      memset(hist_simd, 0, sizeof(hist_simd));
+      n_simd = luma_histogram(y.data(), WIDTH, r.x1, r.x2, r.x_skip, r.y1, r.y2, r.y_skip, hist_simd);
+    });
+    match = n_scalar == n_simd && memcmp(hist_scalar, hist_simd, sizeof(hist_scalar)) == 0;
+    printf("histogram %dx%d skip %d,%d: scalar %.1f us, image_stats %.1f us%s\n", r.x2 - r.x1, r.y2 - r.y1,
+           r.x_skip, r.y_skip, t_scalar, t_simd, match ? "" : "  MISMATCH");
+  }
+  return 0;
+}
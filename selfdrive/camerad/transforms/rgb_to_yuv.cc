@@ -26,11 +26,16 @@ Rgb2Yuv::~Rgb2Yuv() {
   CL_CHECK(clReleaseKernel(krnl));
 }
 
-void Rgb2Yuv::queue(cl_command_queue q, cl_mem rgb_cl, cl_mem yuv_cl) {
+void Rgb2Yuv::queue(cl_command_queue q, cl_mem rgb_cl, cl_mem yuv_cl,
+                    cl_uint num_wait_events, const cl_event *wait_events, cl_event *event) {
   CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &rgb_cl));
   CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_mem), &yuv_cl));
-  cl_event event;
-  CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, &work_size[0], NULL, 0, 0, &event));
-  CL_CHECK(clWaitForEvents(1, &event));
-  CL_CHECK(clReleaseEvent(event));
+  if (event) {
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, &work_size[0], NULL, num_wait_events, wait_events, event));
+  } else {
+    cl_event e;
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, &work_size[0], NULL, num_wait_events, wait_events, &e));
+    CL_CHECK(clWaitForEvents(1, &e));
+    CL_CHECK(clReleaseEvent(e));
+  }
 }
@@ -0,0 +1,41 @@
+#include "selfdrive/camerad/transforms/yuv_to_nv12.h"
+
+#include <cassert>
+#include <cstdio>
+
+Yuv2Nv12::Yuv2Nv12(cl_context ctx, cl_device_id device_id, int in_width, int in_height,
+                   int out_width, int out_height, int y_stride, int uv_stride, int uv_offset) {
+  assert(in_width % 2 == 0 && in_height % 2 == 0 && out_width % 2 == 0 && out_height % 2 == 0);
+  assert(out_width <= in_width && out_height <= in_height);
+  char args[1024];
+  snprintf(args, sizeof(args),
+           "-cl-fast-relaxed-math -cl-denorms-are-zero "
+           "-DIN_WIDTH=%d -DIN_HEIGHT=%d -DOUT_WIDTH=%d -DOUT_HEIGHT=%d "
+           "-DY_STRIDE=%d -DUV_STRIDE=%d -DUV_OFFSET=%d",
+           in_width, in_height, out_width, out_height, y_stride, uv_stride, uv_offset);
+
+  cl_program prg = cl_program_from_file(ctx, device_id, "transforms/yuv_to_nv12.cl", args);
+  krnl = CL_CHECK_ERR(clCreateKernel(prg, "yuv_to_nv12", &err));
+  CL_CHECK(clReleaseProgram(prg));
+
+  work_size[0] = out_width / 2;
+  work_size[1] = out_height / 2;
+}
+
+Yuv2Nv12::~Yuv2Nv12() {
+  CL_CHECK(clReleaseKernel(krnl));
+}
+
+void Yuv2Nv12::queue(cl_command_queue q, cl_mem yuv_cl, cl_mem nv12_cl,
+                     cl_uint num_wait_events, const cl_event *wait_events, cl_event *event) {
+  CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &yuv_cl));
+  CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_mem), &nv12_cl));
+  if (event) {
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, &work_size[0], NULL, num_wait_events, wait_events, event));
+  } else {
+    cl_event e;
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, &work_size[0], NULL, num_wait_events, wait_events, &e));
+    CL_CHECK(clWaitForEvents(1, &e));
+    CL_CHECK(clReleaseEvent(e));
+  }
+}
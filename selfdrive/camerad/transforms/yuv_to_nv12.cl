@@ -0,0 +1,25 @@
+// I420 to NV12 with the output planes at Y_STRIDE and UV_STRIDE / UV_OFFSET, scaled to the
+// output size by nearest neighbour. Each work item writes a 2x2 block of Y and one UV pair.
+
+__kernel void yuv_to_nv12(__global uchar const * const in_yuv,
+                          __global uchar * out_nv12)
+{
+  const int x = mul24((int)get_global_id(0), 2);
+  const int y = mul24((int)get_global_id(1), 2);
+  if (x >= OUT_WIDTH || y >= OUT_HEIGHT) return;
+
+  const int sx0 = x * IN_WIDTH / OUT_WIDTH;
+  const int sx1 = (x + 1) * IN_WIDTH / OUT_WIDTH;
+  for (int dy = 0; dy < 2; dy++) {
+    const int sy = (y + dy) * IN_HEIGHT / OUT_HEIGHT;
+    const int row = mul24(sy, IN_WIDTH);
+    vstore2((uchar2)(in_yuv[row + sx0], in_yuv[row + sx1]), 0, out_nv12 + mad24(y + dy, Y_STRIDE, x));
+  }
+
+  const int su = (x / 2) * (IN_WIDTH / 2) / (OUT_WIDTH / 2);
+  const int sv = (y / 2) * (IN_HEIGHT / 2) / (OUT_HEIGHT / 2);
+  const int uvi = mad24(sv, IN_WIDTH / 2, su);
+  const int in_size = mul24(IN_WIDTH, IN_HEIGHT);
+  vstore2((uchar2)(in_yuv[in_size + uvi], in_yuv[in_size + in_size / 4 + uvi]), 0,
+          out_nv12 + UV_OFFSET + mad24(y / 2, UV_STRIDE, x));
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "selfdrive/common/clutil.h"
+
+// I420 to the NV12 layout of the video encoder, optionally scaled down, on the GPU
+class Yuv2Nv12 {
+public:
+  Yuv2Nv12(cl_context ctx, cl_device_id device_id, int in_width, int in_height,
+           int out_width, int out_height, int y_stride, int uv_stride, int uv_offset);
+  ~Yuv2Nv12();
+  // blocks until the conversion is done unless an output event is passed
+  void queue(cl_command_queue q, cl_mem yuv_cl, cl_mem nv12_cl,
+             cl_uint num_wait_events = 0, const cl_event *wait_events = nullptr, cl_event *event = nullptr);
+private:
+  size_t work_size[2];
+  cl_kernel krnl;
+};
@@ -5,6 +5,7 @@ from typing import Dict
 from cereal import car
 from common.kalman.simple_kalman import KF1D
 from common.realtime import DT_CTRL
+from opendbc.can.parser import CANParserGroup
 from selfdrive.car import gen_empty_fingerprint
 from selfdrive.config import Conversions as CV
 from selfdrive.controls.lib.drive_helpers import V_CRUISE_MAX
@@ -36,6 +37,8 @@ class CarInterfaceBase():
       self.cp = self.CS.get_can_parser(CP)
       self.cp_cam = self.CS.get_cam_can_parser(CP)
       self.cp_body = self.CS.get_body_can_parser(CP)
+      # decodes each can event once for all parsers
+      self.can_parsers = CANParserGroup([self.cp, self.cp_cam, self.cp_body])
 
     self.CC = None
     if CarController is not None:
@@ -0,0 +1,43 @@
+#include "selfdrive/common/bz2.h"
+
+#include <bzlib.h>
+
+namespace util {
+
+bool bz2_decompress(const std::string &in, std::string &out) {
+  bz_stream strm = {};
+  if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return false;
+
+  strm.next_in = (char *)in.data();
+  strm.avail_in = in.size();
+
+  char buf[1 << 16];
+  int ret = BZ_OK;
+  while (true) {
+    strm.next_out = buf;
+    strm.avail_out = sizeof(buf);
+    ret = BZ2_bzDecompress(&strm);
+    out.append(buf, sizeof(buf) - strm.avail_out);
+
+    if (ret == BZ_STREAM_END) {
+      if (strm.avail_in == 0) break;
+      // next stream
+      char *next_in = strm.next_in;
+      unsigned int avail_in = strm.avail_in;
+      BZ2_bzDecompressEnd(&strm);
+      strm = {};
+      if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return false;
+      strm.next_in = next_in;
+      strm.avail_in = avail_in;
+    } else if (ret != BZ_OK) {
+      break;
+    } else if (strm.avail_in == 0 && strm.avail_out == sizeof(buf)) {
+      // input ran out in the middle of a stream
+      break;
+    }
+  }
+  BZ2_bzDecompressEnd(&strm);
+  return ret == BZ_STREAM_END;
+}
+
+}  // namespace util
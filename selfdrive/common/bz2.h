@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+namespace util {
+
+// decompresses one or more concatenated bzip2 streams, as rlogs are written
+bool bz2_decompress(const std::string &in, std::string &out);
+
+}  // namespace util
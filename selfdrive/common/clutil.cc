@@ -1,14 +1,19 @@
 #include "selfdrive/common/clutil.h"
 
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <memory>
 #include <vector>
 
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
+#include "selfdrive/hardware/hw.h"
 
 namespace {  // helper functions
 
@@ -56,6 +61,85 @@ void cl_print_build_errors(cl_program program, cl_device_id device) {
   std::cout << "build failed; status=" << status << ", log:" << std::endl << log << std::endl; 
 }
 
+// Compiled programs are cached in Path::cl_cache(), one file per program. The file is named after a
+// hash of everything the build depends on: the source, the build args and the device and driver.
+// It holds that whole key followed by the binary, so a hash collision is a cache miss too.
+std::string program_cache_key(cl_device_id device_id, const std::string &src, const char *args) {
+  cl_platform_id platform;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL));
+  return get_platform_info(platform, CL_PLATFORM_VERSION) + "\n" +
+         get_device_info(device_id, CL_DEVICE_NAME) + "\n" +
+         get_device_info(device_id, CL_DEVICE_VERSION) + "\n" +
+         get_device_info(device_id, CL_DRIVER_VERSION) + "\n" +
+         args + "\n" + src;
+}
+
+std::string program_cache_path(const std::string &key) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : key) {
+    hash = (hash ^ c) * 0x100000001b3ULL;
+  }
+  return util::string_format("%s/%016llx.bin", Path::cl_cache().c_str(), (unsigned long long)hash);
+}
+
+// returns the cached binary for the key, empty if there isn't one
+std::string read_program_cache(const std::string &path, const std::string &key) {
+  std::string cached = util::read_file(path);
+  uint64_t key_size = 0;
+  if (cached.size() < sizeof(key_size)) return "";
+
+  memcpy(&key_size, cached.data(), sizeof(key_size));
+  if (cached.size() - sizeof(key_size) <= key_size || cached.compare(sizeof(key_size), key_size, key) != 0) return "";
+  return cached.substr(sizeof(key_size) + key_size);
+}
+
+void write_program_cache(const std::string &path, const std::string &key, cl_program prg) {
+  size_t binary_size = 0;
+  CL_CHECK(clGetProgramInfo(prg, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL));
+  if (binary_size == 0) return;
+
+  const uint64_t key_size = key.size();
+  std::string data(sizeof(key_size) + key_size + binary_size, '\0');
+  memcpy(data.data(), &key_size, sizeof(key_size));
+  memcpy(data.data() + sizeof(key_size), key.data(), key_size);
+  unsigned char *binary = (unsigned char *)data.data() + sizeof(key_size) + key_size;
+  CL_CHECK(clGetProgramInfo(prg, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL));
+
+  // written to a temporary file first so a power cut can't leave a truncated binary behind
+  mkdir(Path::cl_cache().c_str(), 0775);
+  // with a unique name, so processes building the same program at once don't write into each other's file
+  std::string tmp_path = path + ".tmp_XXXXXX";
+  int tmp_fd = mkstemp((char *)tmp_path.c_str());
+  if (tmp_fd < 0) {
+    LOGW("failed to create cl program cache %s", path.c_str());
+    return;
+  }
+  const bool created = fchmod(tmp_fd, 0664) == 0;
+  close(tmp_fd);
+  if (!created || util::write_file(tmp_path.c_str(), data.data(), data.size(), O_WRONLY | O_TRUNC) != 0 ||
+      rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOGW("failed to write cl program cache %s", path.c_str());
+    unlink(tmp_path.c_str());
+  }
+}
+
+cl_program program_from_binary(cl_context ctx, cl_device_id device_id, const std::string &binary, const char *args) {
+  const size_t binary_size = binary.size();
+  const unsigned char *binary_data = (const unsigned char *)binary.data();
+  cl_int binary_status = CL_SUCCESS, err = CL_SUCCESS;
+  cl_program prg = clCreateProgramWithBinary(ctx, 1, &device_id, &binary_size, &binary_data, &binary_status, &err);
+  if (prg == NULL || err != CL_SUCCESS || binary_status != CL_SUCCESS) {
+    if (prg) clReleaseProgram(prg);
+    return NULL;
+  }
+  if (clBuildProgram(prg, 1, &device_id, args, NULL, NULL) != CL_SUCCESS) {
+    clReleaseProgram(prg);
+    return NULL;
+  }
+  return prg;
+}
+
 }  // namespace
 
 cl_device_id cl_get_device_id(cl_device_type device_type) {
@@ -78,13 +162,28 @@ cl_device_id cl_get_device_id(cl_device_type device_type) {
 }
 
 cl_program cl_program_from_file(cl_context ctx, cl_device_id device_id, const char* path, const char* args) {
+  const double start = millis_since_boot();
   std::string src = util::read_file(path);
   assert(src.length() > 0);
+
+  const std::string key = program_cache_key(device_id, src, args);
+  const std::string cache_path = program_cache_path(key);
+  if (std::string binary = read_program_cache(cache_path, key); !binary.empty()) {
+    if (cl_program prg = program_from_binary(ctx, device_id, binary, args)) {
+      LOG("cl program %s loaded from cache in %.1f ms", path, millis_since_boot() - start);
+      return prg;
+    }
+    LOGW("cl program cache %s for %s was rejected by the driver, rebuilding", cache_path.c_str(), path);
+  }
+
   cl_program prg = CL_CHECK_ERR(clCreateProgramWithSource(ctx, 1, (const char*[]){src.c_str()}, NULL, &err));
   if (int err = clBuildProgram(prg, 1, &device_id, args, NULL, NULL); err != 0) {
     cl_print_build_errors(prg, device_id);
     assert(0);
   }
+  const double build_ms = millis_since_boot() - start;
+  write_program_cache(cache_path, key, prg);
+  LOG("cl program %s built from source in %.1f ms", path, build_ms);
   return prg;
 }
 
@@ -30,3 +30,23 @@ int gpio_set(int pin_nr, bool high){
   }
   return util::write_file(pin_val_path, (void*)(high ? "1" : "0"), 1);
 }
+
+int gpio_set_edge(int pin_nr, const char *edge){
+  char pin_edge_path[50];
+  int pin_edge_path_len = snprintf(pin_edge_path, sizeof(pin_edge_path),
+                           "/sys/class/gpio/gpio%d/edge", pin_nr);
+  if(pin_edge_path_len <= 0){
+    return -1;
+  }
+  return util::write_file(pin_edge_path, (void*)edge, strlen(edge));
+}
+
+int gpio_get_value_fd(int pin_nr){
+  char pin_val_path[50];
+  int pin_val_path_len = snprintf(pin_val_path, sizeof(pin_val_path),
+                           "/sys/class/gpio/gpio%d/value", pin_nr);
+  if(pin_val_path_len <= 0){
+    return -1;
+  }
+  return open(pin_val_path, O_RDONLY);
+}
@@ -8,6 +8,7 @@
   #define GPIO_UBLOX_PWR_EN     34
   #define GPIO_STM_RST_N        124
   #define GPIO_STM_BOOT0        134
+  #define GPIO_LSM_INT          84
 #else
   #define GPIO_HUB_RST_N        0
   #define GPIO_UBLOX_RST_N      0
@@ -15,7 +16,13 @@
   #define GPIO_UBLOX_PWR_EN     0
   #define GPIO_STM_RST_N        0
   #define GPIO_STM_BOOT0        0
+  #define GPIO_LSM_INT          0
 #endif
 
 int gpio_init(int pin_nr, bool output);
 int gpio_set(int pin_nr, bool high);
+
+// Interrupts on an input: edge is "rising", "falling", "both" or "none". The fd of the
+// pin value is then readable with POLLPRI after an edge, read it again to clear that.
+int gpio_set_edge(int pin_nr, const char *edge);
+int gpio_get_value_fd(int pin_nr);
@@ -8,10 +8,14 @@ class I2CBus {
   private:
     int i2c_fd;
 
+  protected:
+    // for buses that aren't an i2c device, like the mocks in tests
+    I2CBus() : i2c_fd(-1) {}
+
   public:
     I2CBus(uint8_t bus_id);
-    ~I2CBus();
+    virtual ~I2CBus();
 
-    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
-    int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    virtual int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
+    virtual int set_register(uint8_t device_address, uint register_address, uint8_t data);
 };
@@ -29,6 +29,9 @@ inline std::string log_root() {
 inline std::string params() {
   return Hardware::PC() ? HOME + "/.comma/params" : "/data/params";
 }
+inline std::string cl_cache() {
+  return Hardware::PC() ? HOME + "/.comma/cl_cache" : "/data/cl_cache";
+}
 inline std::string rsa_file() {
   return Hardware::PC() ? HOME + "/.comma/persist/comma/id_rsa" : "/persist/comma/id_rsa";
 }
@@ -215,7 +215,7 @@ void Localizer::handle_sensors(double current_time, const capnp::List<cereal::Se
       auto v = sensor_reading.getGyroUncalibrated().getV();
       auto meas = Vector3d(-v[2], -v[1], -v[0]);
       if (meas.norm() < ROTATION_SANITY_CHECK) {
-        this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, { meas });
+        this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, meas);
       }
     }
 
@@ -229,7 +229,7 @@ void Localizer::handle_sensors(double current_time, const capnp::List<cereal::Se
 
       auto meas = Vector3d(-v[2], -v[1], -v[0]);
       if (meas.norm() < ACCEL_SANITY_CHECK) {
-        this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, { meas });
+        this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, meas);
       }
     }
   }
@@ -283,20 +283,20 @@ void Localizer::handle_gps(double current_time, const cereal::GpsLocationData::R
   if (ecef_vel.norm() > 5.0 && orientation_error.norm() > 1.0) {
     LOGE("Locationd vs ubloxLocation orientation difference too large, kalman reset");
     this->reset_kalman(NAN, initial_pose_ecef_quat, ecef_pos);
-    this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, { initial_pose_ecef_quat });
+    this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, initial_pose_ecef_quat);
   } else if (gps_est_error > 100.0) {
     LOGE("Locationd vs ubloxLocation position difference too large, kalman reset");
     this->reset_kalman(NAN, initial_pose_ecef_quat, ecef_pos);
   }
 
-  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_POS, { ecef_pos }, { ecef_pos_R });
-  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_VEL, { ecef_vel }, { ecef_vel_R });
+  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_POS, ecef_pos, ecef_pos_R);
+  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_VEL, ecef_vel, ecef_vel_R);
 }
 
 void Localizer::handle_car_state(double current_time, const cereal::CarState::Reader& log) {
   this->car_speed = std::abs(log.getVEgo());
   if (log.getStandstill()) {
-    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, { Vector3d(0.0, 0.0, 0.0) });
+    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, Vector3d(0.0, 0.0, 0.0));
   }
 }
 
@@ -329,9 +329,9 @@ void Localizer::handle_cam_odo(double current_time, const cereal::CameraOdometry
   VectorXd trans_device_std = rotate_std(this->device_from_calib, trans_calib_std);
 
   this->kf->predict_and_observe(current_time, OBSERVATION_CAMERA_ODO_ROTATION,
-    { (VectorXd(rot_device.rows() + rot_device_std.rows()) << rot_device, rot_device_std).finished() });
+    (VectorXd(rot_device.rows() + rot_device_std.rows()) << rot_device, rot_device_std).finished());
   this->kf->predict_and_observe(current_time, OBSERVATION_CAMERA_ODO_TRANSLATION,
-    { (VectorXd(trans_device.rows() + trans_device_std.rows()) << trans_device, trans_device_std).finished() });
+    (VectorXd(trans_device.rows() + trans_device_std.rows()) << trans_device, trans_device_std).finished());
 }
 
 void Localizer::handle_live_calib(double current_time, const cereal::LiveCalibrationData::Reader& log) {
@@ -3,39 +3,38 @@
 #include <string>
 #include <cmath>
 #include <memory>
+#include <unordered_map>
 
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Dense>
 
 #include "generated/live_kf_constants.h"
-#include "rednose/helpers/ekf_sym.h"
+#include "rednose/helpers/ekf_fixed.h"
 
 #define EARTH_GM 3.986005e14  // m^3/s^2 (gravitational constant * mass of earth)
 
 using namespace EKFS;
 
-Eigen::Map<Eigen::VectorXd> get_mapvec(Eigen::VectorXd& vec);
-Eigen::Map<MatrixXdr> get_mapmat(MatrixXdr& mat);
-std::vector<Eigen::Map<Eigen::VectorXd>> get_vec_mapvec(std::vector<Eigen::VectorXd>& vec_vec);
-std::vector<Eigen::Map<MatrixXdr>> get_vec_mapmat(std::vector<MatrixXdr>& mat_vec);
+typedef EKFFixed<DIM_STATE, DIM_STATE_ERR, MAX_OBS_DIM, 1, 0> LiveFilter;
 
 class LiveKalman {
 public:
   LiveKalman();
 
-  void init_state(Eigen::VectorXd& state, Eigen::VectorXd& covs_diag, double filter_time);
-  void init_state(Eigen::VectorXd& state, MatrixXdr& covs, double filter_time);
-  void init_state(Eigen::VectorXd& state, double filter_time);
+  void init_state(const Eigen::VectorXd& state, const Eigen::VectorXd& covs_diag, double filter_time);
+  void init_state(const Eigen::VectorXd& state, const MatrixXdr& covs, double filter_time);
+  void init_state(const Eigen::VectorXd& state, double filter_time);
 
-  Eigen::VectorXd get_x();
-  MatrixXdr get_P();
+  const LiveFilter::VectorX& get_x();
+  const LiveFilter::MatrixP& get_P();
   double get_filter_time();
-  std::vector<MatrixXdr> get_R(int kind, int n);
 
-  std::optional<Estimate> predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
-  std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
-  std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
-  std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
+  // these run at IMU rate and don't allocate, false if the observation was too old to use
+  bool predict_and_observe(double t, int kind, const Eigen::Ref<const Eigen::VectorXd>& meas);
+  bool predict_and_observe(double t, int kind, const Eigen::Ref<const Eigen::VectorXd>& meas, const Eigen::Ref<const MatrixXdr>& R);
+  bool predict_and_update_odo_speed(const Eigen::Ref<const Eigen::VectorXd>& speed, double t, int kind);
+  bool predict_and_update_odo_trans(const Eigen::Ref<const Eigen::VectorXd>& trans, double t, int kind);
+  bool predict_and_update_odo_rot(const Eigen::Ref<const Eigen::VectorXd>& rot, double t, int kind);
 
   Eigen::VectorXd get_initial_x();
   MatrixXdr get_initial_P();
@@ -45,13 +44,12 @@ public:
 private:
   std::string name = "live";
 
-  std::shared_ptr<EKFSym> filter;
+  std::unique_ptr<LiveFilter> filter;
 
-  int dim_state;
-  int dim_state_err;
-
-  Eigen::VectorXd initial_x;
-  MatrixXdr initial_P;
-  MatrixXdr Q;  // process noise
+  LiveFilter::VectorX initial_x;
+  LiveFilter::MatrixP initial_P;
   std::unordered_map<int, MatrixXdr> obs_noise;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
@@ -218,6 +218,10 @@ class LiveKalman():
     live_kf_header = "#pragma once\n\n"
     live_kf_header += "#include <unordered_map>\n"
     live_kf_header += "#include <eigen3/Eigen/Dense>\n\n"
+    live_kf_header += f'#define DIM_STATE {dim_state}\n'
+    live_kf_header += f'#define DIM_STATE_ERR {dim_state_err}\n'
+    live_kf_header += f'#define MAX_OBS_DIM {max(eq[0].shape[0] for eq in obs_eqs)}\n'
+    live_kf_header += "\n"
     for state, slc in inspect.getmembers(States, lambda x: type(x) == slice):
       assert(slc.step is None)  # unsupported
       live_kf_header += f'#define STATE_{state}_START {slc.start}\n'
@@ -0,0 +1,122 @@
+// Compares the dynamically sized EKFSym with the EKFFixed locationd uses, on the live filter.
+// Both get the same stream: gyro and accelerometer at 100Hz, camera odometry at 20Hz and GPS
+// at 1Hz. Every 10th camera odometry arrives 50ms late, so both filters rewind. Eigen is told
+// to assert on any allocation while EKFFixed runs.
+//
+//   ./test/ekf_benchmark [seconds]
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#define EIGEN_RUNTIME_NO_MALLOC
+#include "rednose/helpers/ekf_sym.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/locationd/models/live_kf.h"
+
+using namespace Eigen;
+
+// Eigen allocates with malloc, this counts the containers around it
+static std::atomic<size_t> allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+struct Measurement {
+  double t;
+  int kind;
+  VectorXd z;
+  MatrixXdr R;
+};
+
+// readings around what the observation functions give for the initial state
+static std::vector<Measurement> make_measurements(double seconds) {
+  const EKF *ekf = ekf_lookup("live");
+  VectorXd x0 = live_initial_x;
+
+  std::vector<std::pair<double, Measurement>> arrivals;  // (arrival time, measurement)
+  auto add = [&](double arrival, double t, int kind, int dim, double noise) {
+    Measurement m = {t, kind, VectorXd(dim), live_obs_noise_diag.at(kind).asDiagonal()};
+    ekf->hs.at(kind)(x0.data(), nullptr, m.z.data());
+    for (int i = 0; i < dim; i++) {
+      m.z(i) += noise * std::sin(t * (7 + i));
+    }
+    arrivals.push_back({arrival, m});
+  };
+
+  for (int i = 0; i < seconds * 100; i++) {
+    const double t = i * 0.01;
+    add(t, t, OBSERVATION_PHONE_GYRO, 3, 1e-3);
+    add(t + 0.001, t + 0.001, OBSERVATION_PHONE_ACCEL, 3, 1e-2);
+    if (i % 5 == 0) {
+      const double late = (i / 5) % 10 == 9 ? 0.05 : 0.0;
+      add(t + 0.002 + late, t + 0.002, OBSERVATION_CAMERA_ODO_ROTATION, 3, 1e-3);
+    }
+    if (i % 100 == 0) {
+      add(t + 0.003, t + 0.003, OBSERVATION_ECEF_POS, 3, 1.0);
+    }
+  }
+  std::stable_sort(arrivals.begin(), arrivals.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+  std::vector<Measurement> measurements;
+  for (auto &[arrival, m] : arrivals) measurements.push_back(m);
+  return measurements;
+}
+
+int main(int argc, char *argv[]) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+  std::vector<Measurement> measurements = make_measurements(seconds);
+
+  VectorXd x0 = live_initial_x;
+  MatrixXdr P0 = live_initial_P_diag.asDiagonal();
+  MatrixXdr Q = live_Q_diag.asDiagonal();
+
+  // EKFSym, called the way LiveKalman used to
+  EKFSym dynamic("live", Map<MatrixXdr>(Q.data(), Q.rows(), Q.cols()), Map<VectorXd>(x0.data(), x0.size()),
+                 Map<MatrixXdr>(P0.data(), P0.rows(), P0.cols()), DIM_STATE, DIM_STATE_ERR, 0, 0, 0,
+                 std::vector<int>(), std::vector<int>{3}, std::vector<std::string>(), 0.2);
+  size_t alloc_start = allocations;
+  double t1 = millis_since_boot();
+  for (auto &m : measurements) {
+    dynamic.predict_and_update_batch(m.t, m.kind, {Map<VectorXd>(m.z.data(), m.z.size())},
+                                     {Map<MatrixXdr>(m.R.data(), m.R.rows(), m.R.cols())});
+  }
+  const double dynamic_ms = millis_since_boot() - t1;
+  const size_t dynamic_allocs = allocations - alloc_start;
+
+  LiveFilter fixed("live", live_Q_diag.asDiagonal(), x0, P0, std::vector<int>{3}, 0.2);
+  LiveFilter::Observation obs;
+  alloc_start = allocations;
+  t1 = millis_since_boot();
+  internal::set_is_malloc_allowed(false);
+  for (auto &m : measurements) {
+    obs.reset(m.t, m.kind);
+    obs.add(m.z, m.R);
+    fixed.predict_and_update_batch(obs);
+  }
+  internal::set_is_malloc_allowed(true);
+  const double fixed_ms = millis_since_boot() - t1;
+  const size_t fixed_allocs = allocations - alloc_start;
+
+  const size_t n = measurements.size();
+  printf("%zu observations\n", n);
+  printf("EKFSym:   %.2f us/obs  %.1f operator new/obs\n", dynamic_ms * 1000 / n, (double)dynamic_allocs / n);
+  printf("EKFFixed: %.2f us/obs  %.1f operator new/obs\n", fixed_ms * 1000 / n, (double)fixed_allocs / n);
+  printf("speedup %.2fx\n", dynamic_ms / fixed_ms);
+
+  const double x_diff = (dynamic.state() - VectorXd(fixed.state())).cwiseAbs().maxCoeff();
+  const double P_diff = (dynamic.covs() - MatrixXdr(fixed.covs())).cwiseAbs().maxCoeff();
+  printf("max difference: state %g, covs %g\n", x_diff, P_diff);
+  return x_diff < 1e-6 && P_diff < 1e-6 ? 0 : 1;
+}
@@ -9,4 +9,6 @@ public:
                            int in_width, int in_height, uint64_t ts) = 0;
   virtual void encoder_open(const char* path) = 0;
   virtual void encoder_close() = 0;
+  // encode_frame reads the VisionIpc buffers in place, they must outlive the encoder
+  virtual bool uses_vision_bufs() const { return false; }
 };
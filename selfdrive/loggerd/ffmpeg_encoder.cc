@@ -0,0 +1,241 @@
+#include "selfdrive/loggerd/ffmpeg_encoder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#define __STDC_CONSTANT_MACROS
+
+#include "libyuv.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+
+// frames waiting to be encoded, per encoder
+const int FRAME_POOL_SIZE = 8;
+
+FfmpegEncoder::FfmpegEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale)
+  : filename(filename), width(width), height(height), fps(fps), bitrate(bitrate) {
+  // LOGGERD_CODEC=h264 or hevc overrides the camera's codec
+  const std::string codec_name = util::getenv("LOGGERD_CODEC", h265 ? "hevc" : "h264");
+  h265 = codec_name == "hevc";
+  codec = avcodec_find_encoder_by_name(h265 ? "libx265" : "libx264");
+  if (!codec) {
+    codec = avcodec_find_encoder(h265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+  }
+  assert(codec);
+
+  for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int err = av_frame_get_buffer(frame, 32);
+    assert(err == 0);
+    free_frames.push(frame);
+  }
+
+  pkt = av_packet_alloc();
+  assert(pkt);
+
+  thread = std::thread(&FfmpegEncoder::encode_thread, this);
+}
+
+FfmpegEncoder::~FfmpegEncoder() {
+  encoder_close();
+  to_encode.push({.type = EncodeJob::STOP});
+  thread.join();
+
+  AVFrame *frame = NULL;
+  while (free_frames.try_pop(frame)) {
+    av_frame_free(&frame);
+  }
+  av_packet_free(&pkt);
+}
+
+void FfmpegEncoder::encoder_open(const char* path) {
+  vid_path = util::string_format("%s/%s.mkv", path, filename);
+
+  // create camera lock file
+  lock_path = util::string_format("%s/%s.lock", path, filename);
+
+  LOG("open %s\n", lock_path.c_str());
+
+  int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0777);
+  assert(lock_fd >= 0);
+  close(lock_fd);
+
+  codec_ctx = avcodec_alloc_context3(codec);
+  assert(codec_ctx);
+  codec_ctx->width = width;
+  codec_ctx->height = height;
+  codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  codec_ctx->time_base = (AVRational){ 1, fps };
+  codec_ctx->framerate = (AVRational){ fps, 1 };
+  codec_ctx->bit_rate = bitrate;
+  codec_ctx->gop_size = fps;
+  codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  // 0 lets the codec pick from the number of cores
+  codec_ctx->thread_count = util::getenv("LOGGERD_ENCODER_THREADS", 0);
+  codec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "preset", util::getenv("LOGGERD_ENCODER_PRESET", "veryfast").c_str(), 0);
+  av_dict_set(&opts, "x265-params", "log-level=error", 0);
+  int err = avcodec_open2(codec_ctx, codec, &opts);
+  av_dict_free(&opts);
+  assert(err >= 0);
+
+  format_ctx = NULL;
+  avformat_alloc_output_context2(&format_ctx, NULL, NULL, vid_path.c_str());
+  assert(format_ctx);
+
+  stream = avformat_new_stream(format_ctx, codec);
+  assert(stream);
+  stream->id = 0;
+  stream->time_base = (AVRational){ 1, fps };
+
+  err = avcodec_parameters_from_context(stream->codecpar, codec_ctx);
+  assert(err >= 0);
+
+  err = avio_open(&format_ctx->pb, vid_path.c_str(), AVIO_FLAG_WRITE);
+  assert(err >= 0);
+
+  err = avformat_write_header(format_ctx, NULL);
+  assert(err >= 0);
+
+  is_open = true;
+  counter = 0;
+  dropped = 0;
+}
+
+void FfmpegEncoder::encoder_close() {
+  if (!is_open) return;
+
+  // the encode thread drains the queued frames and the encoder before it writes the trailer
+  to_encode.push({.type = EncodeJob::CLOSE});
+  closed.pop();
+
+  unlink(lock_path.c_str());
+  is_open = false;
+}
+
+int FfmpegEncoder::encode_frame(const uint8_t *y_ptr, const uint8_t *u_ptr, const uint8_t *v_ptr,
+                                int in_width, int in_height, uint64_t ts) {
+  if (!is_open) return -1;
+
+  AVFrame *frame = NULL;
+  if (!free_frames.try_pop(frame)) {
+    // the encoder is behind, don't hold up the camera
+    dropped++;
+    return -1;
+  }
+
+  // the encoder may still hold a reference to the last frame in this buffer
+  int err = av_frame_make_writable(frame);
+  assert(err == 0);
+
+  if (in_width != width || in_height != height) {
+    libyuv::I420Scale(y_ptr, in_width,
+                      u_ptr, in_width/2,
+                      v_ptr, in_width/2,
+                      in_width, in_height,
+                      frame->data[0], frame->linesize[0],
+                      frame->data[1], frame->linesize[1],
+                      frame->data[2], frame->linesize[2],
+                      width, height,
+                      libyuv::kFilterNone);
+  } else {
+    av_image_copy_plane(frame->data[0], frame->linesize[0], y_ptr, width, width, height);
+    av_image_copy_plane(frame->data[1], frame->linesize[1], u_ptr, width/2, width/2, height/2);
+    av_image_copy_plane(frame->data[2], frame->linesize[2], v_ptr, width/2, width/2, height/2);
+  }
+  frame->pts = counter;
+
+  to_encode.push({.type = EncodeJob::FRAME, .frame = frame, .submit_tms = millis_since_boot()});
+  return counter++;
+}
+
+void FfmpegEncoder::encode_thread() {
+  set_thread_name(filename);
+
+  while (true) {
+    EncodeJob job = to_encode.pop();
+    if (job.type == EncodeJob::STOP) {
+      break;
+    } else if (job.type == EncodeJob::CLOSE) {
+      close_segment();
+      closed.push(true);
+      continue;
+    }
+
+    pending_tms[job.frame->pts] = job.submit_tms;
+    int err = avcodec_send_frame(codec_ctx, job.frame);
+    free_frames.push(job.frame);
+    if (err < 0) {
+      LOGE("%s: encoding error %d", filename, err);
+      pending_tms.erase(job.frame->pts);
+      continue;
+    }
+    write_packets();
+  }
+}
+
+void FfmpegEncoder::write_packets() {
+  while (avcodec_receive_packet(codec_ctx, pkt) == 0) {
+    if (auto it = pending_tms.find(pkt->pts); it != pending_tms.end()) {
+      const double latency_ms = millis_since_boot() - it->second;
+      latency_sum_ms += latency_ms;
+      latency_max_ms = std::max(latency_max_ms, latency_ms);
+      pending_tms.erase(it);
+    }
+    segment_bytes += pkt->size;
+    segment_packets++;
+
+    av_packet_rescale_ts(pkt, codec_ctx->time_base, stream->time_base);
+    pkt->stream_index = 0;
+    int err = av_interleaved_write_frame(format_ctx, pkt);
+    if (err < 0) {
+      LOGE("%s: encoder writer error %d", filename, err);
+    }
+    av_packet_unref(pkt);
+  }
+}
+
+void FfmpegEncoder::close_segment() {
+  // flush the frames still in the encoder
+  avcodec_send_frame(codec_ctx, NULL);
+  write_packets();
+
+  int err = av_write_trailer(format_ctx);
+  assert(err == 0);
+
+  err = avio_closep(&format_ctx->pb);
+  assert(err == 0);
+
+  avformat_free_context(format_ctx);
+  format_ctx = NULL;
+  stream = NULL;
+  avcodec_free_context(&codec_ctx);
+
+  if (segment_packets > 0) {
+    LOG("%s: %d frames, %d dropped, %.0f kbit/s, encode latency %.1f ms avg %.1f ms max", filename,
+        segment_packets, dropped.load(), segment_bytes * 8. / 1000. / (segment_packets / (double)fps),
+        latency_sum_ms / segment_packets, latency_max_ms);
+  }
+  pending_tms.clear();
+  segment_bytes = 0;
+  segment_packets = 0;
+  latency_sum_ms = latency_max_ms = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "selfdrive/common/queue.h"
+#include "selfdrive/loggerd/encoder.h"
+
+// FfmpegEncoder, H.264/HEVC through libavcodec for the PC. encode_frame copies the frame into a
+// small pool and returns, the encoding and muxing happen on a thread per encoder. Frames are
+// dropped when the pool is empty rather than holding up the VisionIpc receive.
+class FfmpegEncoder : public VideoEncoder {
+public:
+  FfmpegEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale);
+  ~FfmpegEncoder();
+  int encode_frame(const uint8_t *y_ptr, const uint8_t *u_ptr, const uint8_t *v_ptr,
+                   int in_width, int in_height, uint64_t ts);
+  void encoder_open(const char* path);
+  void encoder_close();
+
+private:
+  struct EncodeJob {
+    enum Type { FRAME, CLOSE, STOP } type;
+    AVFrame *frame = nullptr;
+    double submit_tms = 0;
+  };
+
+  void encode_thread();
+  void write_packets();
+  void close_segment();
+
+  const char* filename;
+  int width, height, fps, bitrate;
+  AVCodec *codec = NULL;
+  bool is_open = false;
+  int counter = 0;
+  std::atomic<int> dropped = 0;  // counted by encode_frame, logged by the encode thread
+
+  std::string vid_path, lock_path;
+
+  // per segment, a fresh encoder so every segment starts with a key frame
+  AVCodecContext *codec_ctx = NULL;
+  AVFormatContext *format_ctx = NULL;
+  AVStream *stream = NULL;
+  AVPacket *pkt = NULL;
+
+  std::thread thread;
+  SafeQueue<AVFrame *> free_frames;
+  SafeQueue<EncodeJob> to_encode;
+  SafeQueue<bool> closed;
+
+  // encode thread stats for the segment
+  std::map<int64_t, double> pending_tms;  // pts -> submit time
+  uint64_t segment_bytes = 0;
+  int segment_packets = 0;
+  double latency_sum_ms = 0, latency_max_ms = 0;
+};
@@ -3,6 +3,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstdint>
@@ -13,13 +14,16 @@
 #include <fstream>
 #include <iostream>
 #include <streambuf>
+#include <thread>
 #ifdef QCOM
 #include <cutils/properties.h>
 #endif
 
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/common/params.h"
+#include "selfdrive/common/queue.h"
 #include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/version.h"
 
 // ***** logging helpers *****
@@ -47,6 +51,153 @@ int logger_mkpath(char* file_path) {
   return 0;
 }
 
+// ***** block-parallel bzip2 *****
+
+namespace {
+
+std::atomic<uint64_t> bz_pending_bytes = 0, bz_written_bytes = 0, bz_dropped_bytes = 0;
+
+class BZCompressPool {
+public:
+  BZCompressPool() {
+    // leave half of the cores to the rest of openpilot
+    const int num_threads = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    for (int i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread(&BZCompressPool::compress_thread, this));
+    }
+  }
+  ~BZCompressPool() {
+    for (int i = 0; i < threads.size(); i++) jobs.push(nullptr);
+    for (auto &t : threads) t.join();
+  }
+  inline void push(BZFile::Block *b) { jobs.push(b); }
+
+private:
+  void compress_thread() {
+    set_thread_name("loggerd_bzip2");
+    while (BZFile::Block *b = jobs.pop()) {
+      // worst case output size from the bzip2 docs
+      unsigned int out_len = b->data.size() + b->data.size() / 100 + 600;
+      b->out.resize(out_len);
+      char empty = 0;  // bzip2 rejects a null source, even when empty
+      char *src = b->data.empty() ? &empty : b->data.data();
+      int bzerror = BZ2_bzBuffToBuffCompress(b->out.data(), &out_len, src, b->data.size(), 9, 0, 30);
+      if (bzerror != BZ_OK) {
+        LOGE("BZ2_bzBuffToBuffCompress error, bzerror=%d", bzerror);
+        out_len = 0;
+      }
+      b->out.resize(out_len);
+
+      bz_pending_bytes -= b->data.size();
+      b->data = std::vector<char>();
+      b->file->block_done(b);
+    }
+  }
+
+  SafeQueue<BZFile::Block *> jobs;
+  std::vector<std::thread> threads;
+};
+
+BZCompressPool &compress_pool() {
+  static BZCompressPool pool;
+  return pool;
+}
+
+} // namespace
+
+BZFile::BZFile(const char* path) {
+  file = fopen(path, "wb");
+  assert(file != nullptr);
+  block = std::make_unique<Block>();
+  block->file = this;
+}
+
+BZFile::~BZFile() {
+  // an empty file still gets one (empty) stream
+  if (block->data.size() > 0 || blocks_queued == 0) {
+    flush_block();
+  }
+
+  {
+    std::unique_lock lk(lock);
+    cv.wait(lk, [this] { return in_flight == 0; });
+  }
+  int err = fclose(file);
+  assert(err == 0);
+}
+
+void BZFile::write(void* data, size_t size) {
+  block->data.insert(block->data.end(), (char *)data, (char *)data + size);
+  if (block->data.size() >= BZ_BLOCK_SIZE) {
+    flush_block();
+  }
+}
+
+void BZFile::flush_block() {
+  const size_t size = block->data.size();
+  uint64_t queued = bz_pending_bytes;
+  do {
+    if (queued > 0 && queued + size > BZ_MAX_PENDING_BYTES) {
+      // compression can't keep up, drop the block rather than holding up the caller
+      bz_dropped_bytes += size;
+      LOGE_100("bzip2 queue full, dropped %zu bytes, %lu in total", size, bz_dropped_bytes.load());
+      block->data.clear();
+      return;
+    }
+  } while (!bz_pending_bytes.compare_exchange_weak(queued, queued + size));
+
+  Block *b = block.get();
+  {
+    std::unique_lock lk(lock);
+    pending.push_back(std::move(block));
+    in_flight++;
+  }
+  blocks_queued++;
+
+  block = std::make_unique<Block>();
+  block->file = this;
+  block->data.reserve(BZ_BLOCK_SIZE);
+  compress_pool().push(b);
+}
+
+void BZFile::block_done(Block *b) {
+  {
+    // write_lock keeps the file in block order when several workers finish at once
+    std::unique_lock wlk(write_lock);
+    std::vector<Block *> ready;
+    {
+      std::unique_lock lk(lock);
+      b->done = true;
+      for (int i = 0; i < pending.size() && pending[i]->done; i++) {
+        ready.push_back(pending[i].get());
+      }
+    }
+
+    for (auto r : ready) {
+      if (fwrite(r->out.data(), 1, r->out.size(), file) != r->out.size() && !error_logged) {
+        LOGE("bzip2 block write error, errno=%d", errno);
+        error_logged = true;
+      }
+      bz_written_bytes += r->out.size();
+    }
+
+    if (!ready.empty()) {
+      std::unique_lock lk(lock);
+      pending.erase(pending.begin(), pending.begin() + ready.size());
+    }
+  }
+
+  // The last one to touch the file, the destructor can run as soon as lock is released. The
+  // last block_done to return has written out every block, they are all done by then.
+  std::unique_lock lk(lock);
+  in_flight--;
+  cv.notify_all();
+}
+
+BZStats BZFile::stats() {
+  return {bz_pending_bytes, bz_written_bytes, bz_dropped_bytes};
+}
+
 // ***** log metadata *****
 kj::Array<capnp::word> logger_build_init_data() {
   MessageBuilder msg;
@@ -247,6 +398,14 @@ void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog) {
   pthread_mutex_unlock(&s->lock);
 }
 
+void logger_log_batch(LoggerState *s, uint8_t* data, size_t data_size, uint8_t* qlog_data, size_t qlog_data_size) {
+  pthread_mutex_lock(&s->lock);
+  if (s->cur_handle) {
+    lh_log_batch(s->cur_handle, data, data_size, qlog_data, qlog_data_size);
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
 void logger_close(LoggerState *s, ExitHandler *exit_handler) {
   int signal = exit_handler == nullptr ? 0 : exit_handler->signal.load();
   log_sentinel(s, cereal::Sentinel::SentinelType::END_OF_ROUTE, signal);
@@ -268,6 +427,17 @@ void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog) {
   pthread_mutex_unlock(&h->lock);
 }
 
+// data and qlog_data are already concatenated serialized messages
+void lh_log_batch(LoggerHandle* h, uint8_t* data, size_t data_size, uint8_t* qlog_data, size_t qlog_data_size) {
+  pthread_mutex_lock(&h->lock);
+  assert(h->refcnt > 0);
+  h->log->write(data, data_size);
+  if (qlog_data_size > 0 && h->q_log) {
+    h->q_log->write(qlog_data, qlog_data_size);
+  }
+  pthread_mutex_unlock(&h->lock);
+}
+
 void lh_close(LoggerHandle* h) {
   pthread_mutex_lock(&h->lock);
   assert(h->refcnt > 0);
@@ -3,9 +3,13 @@
 #include <cassert>
 #include <pthread.h>
 
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <bzlib.h>
 #include <capnp/serialize.h>
@@ -19,41 +23,50 @@ const std::string LOG_ROOT = Path::log_root();
 
 #define LOGGER_MAX_HANDLES 16
 
+// Messages are collected into blocks of whole messages, and each block is compressed into
+// its own bzip2 stream by a shared pool of worker threads, one per two cores. Concatenated
+// streams are a valid .bz2 file. write() only copies into the current block and never waits
+// on compression. When more than BZ_MAX_PENDING_BYTES are queued the block is dropped and
+// counted instead, the file stays valid without its messages.
+#define BZ_BLOCK_SIZE (900 * 1024)
+#define BZ_MAX_PENDING_BYTES (32 * 1024 * 1024)
+
+typedef struct BZStats {
+  uint64_t pending_bytes;  // uncompressed bytes waiting for a worker
+  uint64_t written_bytes;  // compressed bytes written to disk
+  uint64_t dropped_bytes;  // uncompressed bytes dropped because the queue was full
+} BZStats;
+
 class BZFile {
  public:
-  BZFile(const char* path) {
-    file = fopen(path, "wb");
-    assert(file != nullptr);
-    int bzerror;
-    bz_file = BZ2_bzWriteOpen(&bzerror, file, 9, 0, 30);
-    assert(bzerror == BZ_OK);
-  }
-  ~BZFile() {
-    int bzerror;
-    BZ2_bzWriteClose(&bzerror, bz_file, 0, nullptr, nullptr);
-    if (bzerror != BZ_OK) {
-      LOGE("BZ2_bzWriteClose error, bzerror=%d", bzerror);
-    }
-    int err = fclose(file);
-    assert(err == 0);
-  }
-  inline void write(void* data, size_t size) {
-    int bzerror;
-    do {
-      BZ2_bzWrite(&bzerror, bz_file, data, size);
-    } while (bzerror == BZ_IO_ERROR && errno == EINTR);
-
-    if (bzerror != BZ_OK && !error_logged) {
-      LOGE("BZ2_bzWrite error, bzerror=%d", bzerror);
-      error_logged = true;
-    }
-  }
+  BZFile(const char* path);
+  ~BZFile();
+  void write(void* data, size_t size);
   inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
+  static BZStats stats();
+
+  struct Block {
+    BZFile *file;
+    std::vector<char> data;
+    std::vector<char> out;
+    bool done = false;
+  };
+  void block_done(Block *b);
 
  private:
+  void flush_block();
+
   bool error_logged = false;
   FILE* file = nullptr;
-  BZFILE* bz_file = nullptr;
+  std::unique_ptr<Block> block;
+  size_t blocks_queued = 0;
+
+  // blocks in file order, written out by the workers as they complete
+  std::mutex lock, write_lock;
+  std::condition_variable cv;
+  std::deque<std::unique_ptr<Block>> pending;
+  // block_done calls still running, the destructor waits for them to return
+  int in_flight = 0;
 };
 
 typedef struct LoggerHandle {
@@ -88,6 +101,8 @@ int logger_next(LoggerState *s, const char* root_path,
 LoggerHandle* logger_get_handle(LoggerState *s);
 void logger_close(LoggerState *s, ExitHandler *exit_handler=nullptr);
 void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog);
+void logger_log_batch(LoggerState *s, uint8_t* data, size_t data_size, uint8_t* qlog_data, size_t qlog_data_size);
 
 void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog);
+void lh_log_batch(LoggerHandle* h, uint8_t* data, size_t data_size, uint8_t* qlog_data, size_t qlog_data_size);
 void lh_close(LoggerHandle* h);
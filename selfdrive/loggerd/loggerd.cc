@@ -3,6 +3,7 @@
 #include <sys/resource.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cerrno>
@@ -33,9 +34,12 @@
 #if defined(QCOM) || defined(QCOM2)
 #include "selfdrive/loggerd/omx_encoder.h"
 #define Encoder OmxEncoder
+// camerad renders the encoder input, qcamera included, on the GPU
+constexpr bool ENCODE_STREAMS = true;
 #else
-#include "selfdrive/loggerd/raw_logger.h"
-#define Encoder RawLogger
+#include "selfdrive/loggerd/ffmpeg_encoder.h"
+#define Encoder FfmpegEncoder
+constexpr bool ENCODE_STREAMS = false;
 #endif
 
 namespace {
@@ -49,22 +53,26 @@ const int DCAM_BITRATE = Hardware::TICI() ? MAIN_BITRATE : 2500000;
 
 const int SEGMENT_LENGTH = getenv("LOGGERD_TEST") ? atoi(getenv("LOGGERD_SEGMENT_LENGTH")) : 60;
 
+// logged services are split across this many ingest threads
+const int NUM_LOGGER_THREADS = getenv("LOGGERD_THREADS") ? atoi(getenv("LOGGERD_THREADS")) : 2;
+constexpr size_t MAX_BATCH_SIZE = 1024 * 1024;
+
 ExitHandler do_exit;
 
 LogCameraInfo cameras_logged[LOG_CAMERA_ID_MAX] = {
   [LOG_CAMERA_ID_FCAMERA] = {
-    .stream_type = VISION_STREAM_YUV_BACK,
+    .stream_type = ENCODE_STREAMS ? VISION_STREAM_ENCODE_BACK : VISION_STREAM_YUV_BACK,
     .filename = "fcamera.hevc",
     .frame_packet_name = "roadCameraState",
     .fps = MAIN_FPS,
     .bitrate = MAIN_BITRATE,
     .is_h265 = true,
     .downscale = false,
-    .has_qcamera = true,
+    .has_qcamera = !ENCODE_STREAMS,
     .trigger_rotate = true
   },
   [LOG_CAMERA_ID_DCAMERA] = {
-    .stream_type = VISION_STREAM_YUV_FRONT,
+    .stream_type = ENCODE_STREAMS ? VISION_STREAM_ENCODE_FRONT : VISION_STREAM_YUV_FRONT,
     .filename = "dcamera.hevc",
     .frame_packet_name = "driverCameraState",
     .fps = MAIN_FPS, // on EONs, more compressed this way
@@ -75,7 +83,7 @@ LogCameraInfo cameras_logged[LOG_CAMERA_ID_MAX] = {
     .trigger_rotate = Hardware::TICI(),
   },
   [LOG_CAMERA_ID_ECAMERA] = {
-    .stream_type = VISION_STREAM_YUV_WIDE,
+    .stream_type = ENCODE_STREAMS ? VISION_STREAM_ENCODE_WIDE : VISION_STREAM_YUV_WIDE,
     .filename = "ecamera.hevc",
     .frame_packet_name = "wideRoadCameraState",
     .fps = MAIN_FPS,
@@ -86,13 +94,14 @@ LogCameraInfo cameras_logged[LOG_CAMERA_ID_MAX] = {
     .trigger_rotate = true
   },
   [LOG_CAMERA_ID_QCAMERA] = {
+    .stream_type = VISION_STREAM_ENCODE_QCAMERA,
     .filename = "qcamera.ts",
     .fps = MAIN_FPS,
     .bitrate = 256000,
     .is_h265 = false,
-    .downscale = true,
-    .frame_width = Hardware::TICI() ? 526 : 480,
-    .frame_height = Hardware::TICI() ? 330 : 360 // keep pixel count the same?
+    .downscale = !ENCODE_STREAMS,
+    .frame_width = QCAMERA_WIDTH,
+    .frame_height = QCAMERA_HEIGHT // keep pixel count the same?
   },
 };
 
@@ -103,15 +112,32 @@ struct LoggerdState {
   std::mutex rotate_lock;
   std::condition_variable rotate_cv;
   std::atomic<int> rotate_segment;
+  // held shared by the ingest threads while they collect and flush a batch, rotation takes it
+  // exclusively so a batch always lands in the segment it was collected for
+  pthread_rwlock_t batch_lock;
   std::atomic<double> last_camera_seen_tms;
   std::atomic<int> waiting_rotate;
   int max_waiting = 0;
   double last_rotate_tms = 0.;
+  std::mutex rotate_check_lock;
+  std::atomic<uint64_t> msg_count, bytes_count;
 };
 LoggerdState s;
 
+Encoder *create_encoder(const LogCameraInfo &cam_info, int width, int height, VisionIpcClient &vipc_client) {
+#if defined(QCOM) || defined(QCOM2)
+  // the encoder reads the VisionIpc buffers in place
+  return new Encoder(cam_info.filename, width, height, cam_info.fps, cam_info.bitrate, cam_info.is_h265, cam_info.downscale,
+                     &vipc_client);
+#else
+  return new Encoder(cam_info.filename, width, height, cam_info.fps, cam_info.bitrate, cam_info.is_h265, cam_info.downscale);
+#endif
+}
+
+void logger_rotate();
+
 void encoder_thread(int cam_idx) {
-  assert(cam_idx < LOG_CAMERA_ID_MAX-1);
+  assert(cam_idx < LOG_CAMERA_ID_MAX);
   const LogCameraInfo &cam_info = cameras_logged[cam_idx];
   set_thread_name(cam_info.filename);
 
@@ -121,7 +147,19 @@ void encoder_thread(int cam_idx) {
   std::vector<Encoder *> encoders;
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
 
+  bool reconnect = false;
   while (!do_exit) {
+    // connect() frees the buffers of the last connection, encoders that read them in place are recreated
+    if (std::any_of(encoders.begin(), encoders.end(), [](auto e) { return e->uses_vision_bufs(); })) {
+      LOGW("camera %d reconnecting, closing encoders", cam_idx);
+      for (auto &e : encoders) {
+        e->encoder_close();
+        delete e;
+      }
+      encoders.clear();
+      reconnect = true;
+    }
+
     if (!vipc_client.connect(false)) {
       util::sleep_for(100);
       continue;
@@ -133,8 +171,7 @@ void encoder_thread(int cam_idx) {
       LOGD("encoder init %dx%d", buf_info.width, buf_info.height);
 
       // main encoder
-      encoders.push_back(new Encoder(cam_info.filename, buf_info.width, buf_info.height,
-                                     cam_info.fps, cam_info.bitrate, cam_info.is_h265, cam_info.downscale));
+      encoders.push_back(create_encoder(cam_info, buf_info.width, buf_info.height, vipc_client));
 
       // qcamera encoder
       if (cam_info.has_qcamera) {
@@ -143,11 +180,20 @@ void encoder_thread(int cam_idx) {
                                        qcam_info.frame_width, qcam_info.frame_height,
                                        qcam_info.fps, qcam_info.bitrate, qcam_info.is_h265, qcam_info.downscale));
       }
+
+      // Reopening the current segment would overwrite what was recorded before the reconnect,
+      // start a new one for all cameras instead. The encoders are opened with the next frame.
+      if (reconnect) {
+        std::unique_lock lk(s.rotate_check_lock);
+        logger_rotate();
+        reconnect = false;
+      }
     }
 
     while (!do_exit) {
       VisionIpcBufExtra extra;
       VisionBuf* buf = vipc_client.recv(&extra);
+      if (!vipc_client.connected) break;
       if (buf == nullptr) continue;
 
       if (cam_info.trigger_rotate) {
@@ -188,7 +234,7 @@ void encoder_thread(int cam_idx) {
         }
 
         // publish encode index
-        if (i == 0 && out_id != -1) {
+        if (i == 0 && out_id != -1 && cam_idx != LOG_CAMERA_ID_QCAMERA) {
           MessageBuilder msg;
           // this is really ugly
           auto eidx = cam_idx == LOG_CAMERA_ID_DCAMERA ? msg.initEvent().initDriverEncodeIdx() :
@@ -242,6 +288,7 @@ void clear_locks() {
 }
 
 void logger_rotate() {
+  pthread_rwlock_wrlock(&s.batch_lock);
   {
     std::unique_lock lk(s.rotate_lock);
     int segment = -1;
@@ -251,11 +298,16 @@ void logger_rotate() {
     s.waiting_rotate = 0;
     s.last_rotate_tms = millis_since_boot();
   }
+  pthread_rwlock_unlock(&s.batch_lock);
   s.rotate_cv.notify_all();
   LOGW((s.logger.part == 0) ? "logging to %s" : "rotated to %s", s.segment_path);
 }
 
 void rotate_if_needed() {
+  // called by every ingest thread after each batch, one check at a time is enough
+  std::unique_lock lk(s.rotate_check_lock, std::try_to_lock);
+  if (!lk.owns_lock()) return;
+
   if (s.waiting_rotate == s.max_waiting) {
     logger_rotate();
   }
@@ -268,6 +320,84 @@ void rotate_if_needed() {
   }
 }
 
+void logger_thread(int thread_idx, std::vector<const service *> thread_services) {
+  set_thread_name(("loggerd_" + std::to_string(thread_idx)).c_str());
+
+  typedef struct QlogState {
+    int counter, freq;
+  } QlogState;
+  std::unordered_map<SubSocket*, QlogState> qlog_states;
+
+  // sockets are created on this thread, so msgq wakes it up directly
+  Poller * poller = Poller::create();
+  for (auto it : thread_services) {
+    SubSocket * sock = SubSocket::create(s.ctx, it->name);
+    assert(sock != NULL);
+    poller->registerSocket(sock);
+    qlog_states[sock] = {.counter = 0, .freq = it->decimation};
+  }
+
+  std::vector<uint8_t> batch, qlog_batch;
+  batch.reserve(MAX_BATCH_SIZE);
+  qlog_batch.reserve(MAX_BATCH_SIZE);
+
+  double start_ts = millis_since_boot();
+  while (!do_exit) {
+    // poll for new messages on all sockets, short timeout so rotation isn't held up by an idle thread
+    std::vector<SubSocket *> ready = poller->poll(100);
+
+    pthread_rwlock_rdlock(&s.batch_lock);
+    const int batch_segment = s.rotate_segment;
+    for (auto sock : ready) {
+      // drain socket
+      QlogState &qs = qlog_states[sock];
+      Message *msg = nullptr;
+      while (!do_exit && batch.size() < MAX_BATCH_SIZE && (msg = sock->borrow(true))) {
+        // Copy straight from the msgq buffer into the batch. The borrowed data is only used
+        // through this copy, which is dropped again if the publisher overwrote it meanwhile.
+        // Nothing reaches the log before valid() is checked.
+        const size_t batch_size = batch.size(), qlog_batch_size = qlog_batch.size();
+        const bool in_qlog = qs.freq != -1 && (qs.counter % qs.freq == 0);
+        const uint8_t *data = (uint8_t *)msg->getData();
+        batch.insert(batch.end(), data, data + msg->getSize());
+        if (in_qlog) {
+          qlog_batch.insert(qlog_batch.end(), data, data + msg->getSize());
+        }
+
+        if (!msg->valid()) {
+          LOGE("message overwritten while logging");
+          batch.resize(batch_size);
+          qlog_batch.resize(qlog_batch_size);
+        } else {
+          qs.counter++;
+          s.bytes_count += msg->getSize();
+          if ((++s.msg_count % 1000) == 0) {
+            double seconds = (millis_since_boot() - start_ts) / 1000.0;
+            BZStats bz = BZFile::stats();
+            LOGD("%lu messages, %.2f msg/sec, %.2f KB/sec, bzip2 pending %.2f KB, written %.2f KB, dropped %.2f KB",
+                 s.msg_count.load(), s.msg_count / seconds, s.bytes_count * 0.001 / seconds,
+                 bz.pending_bytes * 0.001, bz.written_bytes * 0.001, bz.dropped_bytes * 0.001);
+          }
+        }
+        delete msg;
+      }
+    }
+
+    if (!batch.empty()) {
+      assert(batch_segment == s.rotate_segment);
+      logger_log_batch(&s.logger, batch.data(), batch.size(), qlog_batch.data(), qlog_batch.size());
+      batch.clear();
+      qlog_batch.clear();
+    }
+    pthread_rwlock_unlock(&s.batch_lock);
+
+    rotate_if_needed();
+  }
+
+  for (auto &[sock, qs] : qlog_states) delete sock;
+  delete poller;
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -276,27 +406,32 @@ int main(int argc, char** argv) {
   clear_locks();
 
   // setup messaging
-  typedef struct QlogState {
-    int counter, freq;
-  } QlogState;
-  std::unordered_map<SubSocket*, QlogState> qlog_states;
-
   s.ctx = Context::create();
-  Poller * poller = Poller::create();
 
-  // subscribe to all socks
+  // spread the logged services over the ingest threads, balanced by message rate
+  std::vector<const service *> logged_services;
   for (const auto& it : services) {
-    if (!it.should_log) continue;
-
-    SubSocket * sock = SubSocket::create(s.ctx, it.name);
-    assert(sock != NULL);
-    poller->registerSocket(sock);
-    qlog_states[sock] = {.counter = 0, .freq = it.decimation};
+    if (it.should_log) logged_services.push_back(&it);
+  }
+  std::sort(logged_services.begin(), logged_services.end(), [](auto a, auto b) { return a->frequency > b->frequency; });
+
+  const int num_threads = std::max(1, NUM_LOGGER_THREADS);
+  std::vector<std::vector<const service *>> thread_services(num_threads);
+  std::vector<int> thread_freq(num_threads, 0);
+  for (auto it : logged_services) {
+    int idx = std::min_element(thread_freq.begin(), thread_freq.end()) - thread_freq.begin();
+    thread_services[idx].push_back(it);
+    thread_freq[idx] += std::max(it->frequency, 1);
   }
 
   Params params;
 
-  // init logger
+  // init logger, rotation is preferred over new batches so busy ingest threads can't hold it off
+  pthread_rwlockattr_t batch_lock_attr;
+  pthread_rwlockattr_init(&batch_lock_attr);
+  pthread_rwlockattr_setkind_np(&batch_lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&s.batch_lock, &batch_lock_attr);
+  pthread_rwlockattr_destroy(&batch_lock_attr);
   logger_init(&s.logger, "rlog", true);
   logger_rotate();
   params.put("CurrentRoute", s.logger.route_name);
@@ -316,6 +451,9 @@ int main(int argc, char** argv) {
       s.max_waiting += 1;
     }
   }
+  if (ENCODE_STREAMS) {
+    encoder_threads.push_back(std::thread(encoder_thread, LOG_CAMERA_ID_QCAMERA));
+  }
   if (Hardware::TICI()) {
     encoder_threads.push_back(std::thread(encoder_thread, LOG_CAMERA_ID_ECAMERA));
     if (cameras_logged[LOG_CAMERA_ID_ECAMERA].trigger_rotate) {
@@ -323,29 +461,11 @@ int main(int argc, char** argv) {
     }
   }
 
-  uint64_t msg_count = 0, bytes_count = 0;
-  double start_ts = millis_since_boot();
-  while (!do_exit) {
-    // poll for new messages on all sockets
-    for (auto sock : poller->poll(1000)) {
-      // drain socket
-      QlogState &qs = qlog_states[sock];
-      Message *msg = nullptr;
-      while (!do_exit && (msg = sock->receive(true))) {
-        const bool in_qlog = qs.freq != -1 && (qs.counter++ % qs.freq == 0);
-        logger_log(&s.logger, (uint8_t *)msg->getData(), msg->getSize(), in_qlog);
-        bytes_count += msg->getSize();
-        delete msg;
-
-        rotate_if_needed();
-
-        if ((++msg_count % 1000) == 0) {
-          double seconds = (millis_since_boot() - start_ts) / 1000.0;
-          LOGD("%lu messages, %.2f msg/sec, %.2f KB/sec", msg_count, msg_count / seconds, bytes_count * 0.001 / seconds);
-        }
-      }
-    }
+  std::vector<std::thread> logger_threads;
+  for (int i = 0; i < num_threads; i++) {
+    logger_threads.push_back(std::thread(logger_thread, i, thread_services[i]));
   }
+  for (auto &t : logger_threads) t.join();
 
   LOGW("closing encoders");
   s.rotate_cv.notify_all();
@@ -361,8 +481,6 @@ int main(int argc, char** argv) {
   }
 
   // messaging cleanup
-  for (auto &[sock, qs] : qlog_states) delete sock;
-  delete poller;
   delete s.ctx;
 
   return 0;
@@ -8,6 +8,7 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <cstdio>
 
 #include <OMX_Component.h>
@@ -68,6 +69,10 @@ OMX_ERRORTYPE OmxEncoder::empty_buffer_done(OMX_HANDLETYPE component, OMX_PTR ap
                                                    OMX_BUFFERHEADERTYPE *buffer) {
   // printf("empty_buffer_done\n");
   OmxEncoder *e = (OmxEncoder*)app_data;
+  if (e->zero_copy) {
+    // camerad can write to the frame again
+    e->vipc_client->release(e->in_vision_bufs.at(buffer));
+  }
   e->free_in.push(buffer);
   return OMX_ErrorNone;
 }
@@ -156,14 +161,18 @@ static const char* omx_color_fomat_name(uint32_t format) {
 
 // ***** encoder functions *****
 
-OmxEncoder::OmxEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale) {
+OmxEncoder::OmxEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale,
+                       VisionIpcClient *vipc_client) {
+  VisionBuf *in_bufs = vipc_client ? vipc_client->buffers : nullptr;
+  int in_buf_count = vipc_client ? vipc_client->num_buffers : 0;
+  this->vipc_client = vipc_client;
   this->filename = filename;
   this->width = width;
   this->height = height;
   this->fps = fps;
   this->remuxing = !h265;
 
-  this->downscale = downscale;
+  this->downscale = downscale && in_bufs == nullptr;
   if (this->downscale) {
     this->y_ptr2 = (uint8_t *)malloc(this->width*this->height);
     this->u_ptr2 = (uint8_t *)malloc(this->width*this->height/4);
@@ -198,6 +207,18 @@ OmxEncoder::OmxEncoder(const char* filename, int width, int height, int fps, int
 
   OMX_CHECK(OMX_SetParameter(this->handle, OMX_IndexParamPortDefinition, (OMX_PTR) &in_port));
   OMX_CHECK(OMX_GetParameter(this->handle, OMX_IndexParamPortDefinition, (OMX_PTR) &in_port));
+
+  if (in_bufs != nullptr) {
+    // camerad has to have laid out the frames the way the encoder reads them
+    const size_t y_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, this->width);
+    for (int i = 0; i < in_buf_count; i++) {
+      assert(in_bufs[i].nv12 && in_bufs[i].width == this->width && in_bufs[i].height == this->height);
+      assert(in_bufs[i].stride == y_stride && in_bufs[i].uv_offset == y_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, this->height));
+    }
+    this->nv12_input = true;
+    this->zero_copy = this->use_vision_bufs(in_bufs, in_buf_count, in_port);
+    LOGW("%s: %s input buffers", this->filename, this->zero_copy ? "using the camera" : "falling back to copying into the encoder's");
+  }
   this->in_buf_headers.resize(in_port.nBufferCountActual);
 
   // setup output port
@@ -298,9 +319,26 @@ OmxEncoder::OmxEncoder(const char* filename, int width, int height, int fps, int
 
   OMX_CHECK(OMX_SendCommand(this->handle, OMX_CommandStateSet, OMX_StateIdle, NULL));
 
-  for (auto &buf : this->in_buf_headers) {
-    OMX_CHECK(OMX_AllocateBuffer(this->handle, &buf, PORT_INDEX_IN, this,
-                             in_port.nBufferSize));
+  if (this->zero_copy) {
+    // the encoder maps the ion buffers through their fds
+    this->in_pmem.resize(this->in_buf_headers.size());
+    for (int i = 0; i < this->in_buf_headers.size(); i++) {
+      this->in_pmem[i] = {
+        .pmem_fd = (unsigned long)in_bufs[i].fd,
+        .offset = 0,
+        .size = (OMX_U32)in_bufs[i].len,
+        .mapped_size = (OMX_U32)in_bufs[i].mmap_len,
+        .buffer = in_bufs[i].addr,
+      };
+      OMX_CHECK(OMX_UseBuffer(this->handle, &this->in_buf_headers[i], PORT_INDEX_IN, &this->in_pmem[i],
+                              in_port.nBufferSize, (OMX_U8 *)in_bufs[i].addr));
+      this->in_vision_bufs[this->in_buf_headers[i]] = &in_bufs[i];
+    }
+  } else {
+    for (auto &buf : this->in_buf_headers) {
+      OMX_CHECK(OMX_AllocateBuffer(this->handle, &buf, PORT_INDEX_IN, this,
+                               in_port.nBufferSize));
+    }
   }
 
   for (auto &buf : this->out_buf_headers) {
@@ -326,6 +364,59 @@ OmxEncoder::OmxEncoder(const char* filename, int width, int height, int fps, int
   }
 }
 
+bool OmxEncoder::use_vision_bufs(VisionBuf *bufs, int count, OMX_PARAM_PORTDEFINITIONTYPE &in_port) {
+  if (count < in_port.nBufferCountMin) {
+    LOGE("%s: %d camera buffers, the encoder needs %d", this->filename, count, (int)in_port.nBufferCountMin);
+    return false;
+  }
+  for (int i = 0; i < count; i++) {
+    if (bufs[i].mmap_len < in_port.nBufferSize) return false;
+  }
+
+  OMX_QCOM_PARAM_PORTDEFINITIONTYPE qcom_port = {0};
+  qcom_port.nSize = sizeof(qcom_port);
+  qcom_port.nPortIndex = (OMX_U32) PORT_INDEX_IN;
+  qcom_port.nMemRegion = OMX_QCOM_MemRegionSMI;
+  if (OMX_SetParameter(this->handle, (OMX_INDEXTYPE)OMX_QcomIndexPortDefn, (OMX_PTR) &qcom_port) != OMX_ErrorNone) {
+    return false;
+  }
+
+  // one header per VisionIpc buffer
+  in_port.nBufferCountActual = count;
+  OMX_CHECK(OMX_SetParameter(this->handle, OMX_IndexParamPortDefinition, (OMX_PTR) &in_port));
+  OMX_CHECK(OMX_GetParameter(this->handle, OMX_IndexParamPortDefinition, (OMX_PTR) &in_port));
+  return in_port.nBufferCountActual == count;
+}
+
+OMX_BUFFERHEADERTYPE *OmxEncoder::get_in_buf(const uint8_t *y_ptr) {
+  OMX_BUFFERHEADERTYPE *buf = nullptr;
+  while (this->free_in.try_pop(buf)) {
+    this->in_free.insert(buf);
+  }
+
+  if (y_ptr == nullptr) {
+    // any header will do, e.g. for the EOS
+    if (this->in_free.empty()) return this->free_in.pop();
+    buf = *this->in_free.begin();
+    this->in_free.erase(this->in_free.begin());
+    return buf;
+  }
+
+  for (auto it = this->in_free.begin(); it != this->in_free.end(); ++it) {
+    if ((*it)->pBuffer == y_ptr) {
+      buf = *it;
+      this->in_free.erase(it);
+      return buf;
+    }
+  }
+
+  // the encoder is still reading the frame that was in this buffer before
+  if ((this->dropped++ % 20) == 0) {
+    LOGW("%s: input buffer %p busy, %d frames dropped", this->filename, y_ptr, this->dropped);
+  }
+  return nullptr;
+}
+
 void OmxEncoder::handle_out_buf(OmxEncoder *e, OMX_BUFFERHEADERTYPE *out_buf) {
   int err;
   uint8_t *buf_data = out_buf->pBuffer + out_buf->nOffset;
@@ -405,46 +496,60 @@ int OmxEncoder::encode_frame(const uint8_t *y_ptr, const uint8_t *u_ptr, const u
   // THIS IS A REALLY BAD IDEA, but apparently the race has to happen 30 times to trigger this
   //pthread_mutex_unlock(&this->lock);
   OMX_BUFFERHEADERTYPE* in_buf = nullptr;
-  while (!this->free_in.try_pop(in_buf, 20)) {
-    if (do_exit) {
+  if (this->zero_copy) {
+    // camerad already wrote the frame in the encoder's format
+    in_buf = this->get_in_buf(y_ptr);
+    if (in_buf == nullptr) {
       return -1;
     }
+    // keep the frame leased until the encoder is done reading it, see empty_buffer_done
+    this->vipc_client->hold();
+  } else {
+    while (!this->free_in.try_pop(in_buf, 20)) {
+      if (do_exit) {
+        return -1;
+      }
+    }
   }
 
   //pthread_mutex_lock(&this->lock);
 
   int ret = this->counter;
 
-  uint8_t *in_buf_ptr = in_buf->pBuffer;
-  // printf("in_buf ptr %p\n", in_buf_ptr);
-
-  uint8_t *in_y_ptr = in_buf_ptr;
-  int in_y_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, this->width);
-  int in_uv_stride = VENUS_UV_STRIDE(COLOR_FMT_NV12, this->width);
-  // uint8_t *in_uv_ptr = in_buf_ptr + (this->width * this->height);
-  uint8_t *in_uv_ptr = in_buf_ptr + (in_y_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, this->height));
-
-  if (this->downscale) {
-    I420Scale(y_ptr, in_width,
-              u_ptr, in_width/2,
-              v_ptr, in_width/2,
-              in_width, in_height,
-              this->y_ptr2, this->width,
-              this->u_ptr2, this->width/2,
-              this->v_ptr2, this->width/2,
-              this->width, this->height,
-              libyuv::kFilterNone);
-    y_ptr = this->y_ptr2;
-    u_ptr = this->u_ptr2;
-    v_ptr = this->v_ptr2;
-  }
-  err = libyuv::I420ToNV12(y_ptr, this->width,
-                   u_ptr, this->width/2,
-                   v_ptr, this->width/2,
-                   in_y_ptr, in_y_stride,
-                   in_uv_ptr, in_uv_stride,
-                   this->width, this->height);
-  assert(err == 0);
+  if (this->nv12_input && !this->zero_copy) {
+    memcpy(in_buf->pBuffer, y_ptr, VENUS_BUFFER_SIZE(COLOR_FMT_NV12, this->width, this->height));
+  } else if (!this->zero_copy) {
+    uint8_t *in_buf_ptr = in_buf->pBuffer;
+    // printf("in_buf ptr %p\n", in_buf_ptr);
+
+    uint8_t *in_y_ptr = in_buf_ptr;
+    int in_y_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, this->width);
+    int in_uv_stride = VENUS_UV_STRIDE(COLOR_FMT_NV12, this->width);
+    // uint8_t *in_uv_ptr = in_buf_ptr + (this->width * this->height);
+    uint8_t *in_uv_ptr = in_buf_ptr + (in_y_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, this->height));
+
+    if (this->downscale) {
+      I420Scale(y_ptr, in_width,
+                u_ptr, in_width/2,
+                v_ptr, in_width/2,
+                in_width, in_height,
+                this->y_ptr2, this->width,
+                this->u_ptr2, this->width/2,
+                this->v_ptr2, this->width/2,
+                this->width, this->height,
+                libyuv::kFilterNone);
+      y_ptr = this->y_ptr2;
+      u_ptr = this->u_ptr2;
+      v_ptr = this->v_ptr2;
+    }
+    err = libyuv::I420ToNV12(y_ptr, this->width,
+                     u_ptr, this->width/2,
+                     v_ptr, this->width/2,
+                     in_y_ptr, in_y_stride,
+                     in_uv_ptr, in_uv_stride,
+                     this->width, this->height);
+    assert(err == 0);
+  }
 
   // in_buf->nFilledLen = (this->width*this->height) + (this->width*this->height/2);
   in_buf->nFilledLen = VENUS_BUFFER_SIZE(COLOR_FMT_NV12, this->width, this->height);
@@ -527,7 +632,7 @@ void OmxEncoder::encoder_close() {
     if (this->dirty) {
       // drain output only if there could be frames in the encoder
 
-      OMX_BUFFERHEADERTYPE* in_buf = this->free_in.pop();
+      OMX_BUFFERHEADERTYPE* in_buf = this->zero_copy ? this->get_in_buf(nullptr) : this->free_in.pop();
       in_buf->nFilledLen = 0;
       in_buf->nOffset = 0;
       in_buf->nFlags = OMX_BUFFERFLAG_EOS;
@@ -2,25 +2,34 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <map>
+#include <set>
 #include <vector>
 
 #include <OMX_Component.h>
+#include <OMX_QCOMExtns.h>
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
+#include "cereal/visionipc/visionipc_client.h"
 #include "selfdrive/common/queue.h"
 #include "selfdrive/loggerd/encoder.h"
 
 // OmxEncoder, lossey codec using hardware hevc
 class OmxEncoder : public VideoEncoder {
 public:
-  OmxEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale);
+  // With vipc_client, the input port uses its NV12 buffers directly and encode_frame takes the
+  // y_ptr of the frame it last received. That buffer stays leased until the encoder has read it.
+  // Otherwise I420 frames are copied into the encoder's buffers.
+  OmxEncoder(const char* filename, int width, int height, int fps, int bitrate, bool h265, bool downscale,
+             VisionIpcClient *vipc_client = nullptr);
   ~OmxEncoder();
   int encode_frame(const uint8_t *y_ptr, const uint8_t *u_ptr, const uint8_t *v_ptr,
                    int in_width, int in_height, uint64_t ts);
   void encoder_open(const char* path);
   void encoder_close();
+  bool uses_vision_bufs() const { return zero_copy; }
 
   // OMX callbacks
   static OMX_ERRORTYPE event_handler(OMX_HANDLETYPE component, OMX_PTR app_data, OMX_EVENTTYPE event,
@@ -33,6 +42,8 @@ public:
 private:
   void wait_for_state(OMX_STATETYPE state);
   static void handle_out_buf(OmxEncoder *e, OMX_BUFFERHEADERTYPE *out_buf);
+  bool use_vision_bufs(VisionBuf *bufs, int count, OMX_PARAM_PORTDEFINITIONTYPE &in_port);
+  OMX_BUFFERHEADERTYPE *get_in_buf(const uint8_t *y_ptr);
 
   int width, height, fps;
   char vid_path[1024];
@@ -62,6 +73,15 @@ private:
   SafeQueue<OMX_BUFFERHEADERTYPE *> free_in;
   SafeQueue<OMX_BUFFERHEADERTYPE *> done_out;
 
+  // NV12 VisionIpc frames as input, zero copy if the headers point at the buffers
+  bool nv12_input = false;
+  bool zero_copy = false;
+  VisionIpcClient *vipc_client = nullptr;
+  std::vector<OMX_QCOM_PLATFORM_PRIVATE_PMEM_INFO> in_pmem;
+  std::map<OMX_BUFFERHEADERTYPE *, VisionBuf *> in_vision_bufs;
+  std::set<OMX_BUFFERHEADERTYPE *> in_free;
+  int dropped = 0;
+
   AVFormatContext *ofmt_ctx;
   AVCodecContext *codec_ctx;
   AVStream *out_stream;
@@ -1,8 +1,8 @@
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <mutex>
-
-#include <eigen3/Eigen/Dense>
+#include <thread>
 
 #include "cereal/messaging/messaging.h"
 #include "cereal/visionipc/visionipc_client.h"
@@ -25,42 +25,16 @@ void calibration_thread(bool wide_camera) {
 
   SubMaster sm({"liveCalibration"});
 
-  /*
-     import numpy as np
-     from common.transformations.model import medmodel_frame_from_road_frame
-     medmodel_frame_from_ground = medmodel_frame_from_road_frame[:, (0, 1, 3)]
-     ground_from_medmodel_frame = np.linalg.inv(medmodel_frame_from_ground)
-  */
-  Eigen::Matrix<float, 3, 3> ground_from_medmodel_frame;
-  ground_from_medmodel_frame <<
-    0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
-    -1.09890110e-03, 0.00000000e+00, 2.81318681e-01,
-    -1.84808520e-20, 9.00738606e-04,-4.28751576e-02;
-
-  Eigen::Matrix<float, 3, 3> cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
-  const mat3 yuv_transform = get_model_yuv_transform();
-
   while (!do_exit) {
     sm.update(100);
     if(sm.updated("liveCalibration")){
       auto extrinsic_matrix = sm["liveCalibration"].getLiveCalibration().getExtrinsicMatrix();
-      Eigen::Matrix<float, 3, 4> extrinsic_matrix_eigen;
+      float extrinsic[3*4];
       for (int i = 0; i < 4*3; i++){
-        extrinsic_matrix_eigen(i / 4, i % 4) = extrinsic_matrix[i];
+        extrinsic[i] = extrinsic_matrix[i];
       }
 
-      auto camera_frame_from_road_frame = cam_intrinsics * extrinsic_matrix_eigen;
-      Eigen::Matrix<float, 3, 3> camera_frame_from_ground;
-      camera_frame_from_ground.col(0) = camera_frame_from_road_frame.col(0);
-      camera_frame_from_ground.col(1) = camera_frame_from_road_frame.col(1);
-      camera_frame_from_ground.col(2) = camera_frame_from_road_frame.col(3);
-
-      auto warp_matrix = camera_frame_from_ground * ground_from_medmodel_frame;
-      mat3 transform = {};
-      for (int i=0; i<3*3; i++) {
-        transform.v[i] = warp_matrix(i / 3, i % 3);
-      }
-      mat3 model_transform = matmul3(yuv_transform, transform);
+      mat3 model_transform = model_transform_from_extrinsic(extrinsic, wide_camera);
       std::lock_guard lk(transform_lock);
       cur_transform = model_transform;
       live_calib_seen = true;
@@ -68,7 +42,20 @@ void calibration_thread(bool wide_camera) {
   }
 }
 
-void run_model(ModelState &model, VisionIpcClient &vipc_client) {
+// Frames are warped into one input buffer while the model runs on the other one.
+struct ModelInput {
+  std::mutex lock;
+  std::condition_variable cv;
+  bool pending = false;   // prepared, waiting for the model
+  bool executed = false;  // the first run is done
+  uint32_t prepared = 0;
+  float *net_input_buf = nullptr;
+  VisionIpcBufExtra extra = {};
+};
+
+void model_thread(ModelState &model, ModelInput &input) {
+  set_thread_name("model");
+
   // messaging
   PubMaster pm({"modelV2", "cameraOdometry"});
   SubMaster sm({"lateralPlan", "roadCameraState"});
@@ -81,53 +68,97 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client) {
   uint32_t run_count = 0;
 
   while (!do_exit) {
-    VisionIpcBufExtra extra = {};
-    VisionBuf *buf = vipc_client.recv(&extra);
-    if (buf == nullptr) continue;
-
-    transform_lock.lock();
-    mat3 model_transform = cur_transform;
-    const bool run_model_this_iter = live_calib_seen;
-    transform_lock.unlock();
+    float *net_input_buf;
+    VisionIpcBufExtra extra;
+    {
+      std::unique_lock lk(input.lock);
+      if (!input.cv.wait_for(lk, std::chrono::milliseconds(100), [&] { return input.pending; })) continue;
+      net_input_buf = input.net_input_buf;
+      extra = input.extra;
+      input.pending = false;
+    }
+    input.cv.notify_all();
 
     // TODO: path planner timeout?
     sm.update(0);
     int desire = ((int)sm["lateralPlan"].getLateralPlan().getDesire());
     frame_id = sm["roadCameraState"].getRoadCameraState().getFrameId();
 
-    if (run_model_this_iter) {
-      run_count++;
+    run_count++;
 
-      float vec_desire[DESIRE_LEN] = {0};
-      if (desire >= 0 && desire < DESIRE_LEN) {
-        vec_desire[desire] = 1.0;
-      }
+    float vec_desire[DESIRE_LEN] = {0};
+    if (desire >= 0 && desire < DESIRE_LEN) {
+      vec_desire[desire] = 1.0;
+    }
 
-      double mt1 = millis_since_boot();
-      ModelDataRaw model_buf = model_eval_frame(&model, buf->buf_cl, buf->width, buf->height,
-                                                model_transform, vec_desire);
-      double mt2 = millis_since_boot();
-      float model_execution_time = (mt2 - mt1) / 1000.0;
-
-      // tracked dropped frames
-      uint32_t vipc_dropped_frames = extra.frame_id - last_vipc_frame_id - 1;
-      float frames_dropped = frame_dropped_filter.update((float)std::min(vipc_dropped_frames, 10U));
-      if (run_count < 10) { // let frame drops warm up
-        frame_dropped_filter.reset(0);
-        frames_dropped = 0.;
+    double mt1 = millis_since_boot();
+    ModelDataRaw model_buf = model_eval_input(&model, net_input_buf, vec_desire);
+    double mt2 = millis_since_boot();
+    float model_execution_time = (mt2 - mt1) / 1000.0;
+
+    if (run_count == 1) {
+      {
+        std::lock_guard lk(input.lock);
+        input.executed = true;
       }
+      input.cv.notify_all();
+    }
 
-      float frame_drop_ratio = frames_dropped / (1 + frames_dropped);
+    // tracked dropped frames
+    uint32_t vipc_dropped_frames = extra.frame_id - last_vipc_frame_id - 1;
+    float frames_dropped = frame_dropped_filter.update((float)std::min(vipc_dropped_frames, 10U));
+    if (run_count < 10) { // let frame drops warm up
+      frame_dropped_filter.reset(0);
+      frames_dropped = 0.;
+    }
+
+    float frame_drop_ratio = frames_dropped / (1 + frames_dropped);
+
+    model_publish(pm, extra.frame_id, frame_id, frame_drop_ratio, model_buf, extra.timestamp_eof, model_execution_time,
+                  kj::ArrayPtr<const float>(model.output.data(), model.output.size()));
+    posenet_publish(pm, extra.frame_id, vipc_dropped_frames, model_buf, extra.timestamp_eof);
 
-      model_publish(pm, extra.frame_id, frame_id, frame_drop_ratio, model_buf, extra.timestamp_eof, model_execution_time,
-                    kj::ArrayPtr<const float>(model.output.data(), model.output.size()));
-      posenet_publish(pm, extra.frame_id, vipc_dropped_frames, model_buf, extra.timestamp_eof);
+    //printf("model process: %.2fms, from last %.2fms, vipc_frame_id %u, frame_id, %u, frame_drop %.3f\n", mt2 - mt1, mt1 - last, extra.frame_id, frame_id, frame_drop_ratio);
+    last = mt1;
+    last_vipc_frame_id = extra.frame_id;
+  }
+}
 
-      //printf("model process: %.2fms, from last %.2fms, vipc_frame_id %u, frame_id, %u, frame_drop %.3f\n", mt2 - mt1, mt1 - last, extra.frame_id, frame_id, frame_drop_ratio);
-      last = mt1;
-      last_vipc_frame_id = extra.frame_id;
+void run_model(ModelState &model, VisionIpcClient &vipc_client) {
+  ModelInput input;
+  std::thread t(model_thread, std::ref(model), std::ref(input));
+
+  while (!do_exit) {
+    {
+      // wait until the model took the last frame, the buffer it runs on isn't touched.
+      // thneed records every gpu command during the first run, so nothing can overlap that
+      std::unique_lock lk(input.lock);
+      auto ready = [&] { return !input.pending && (input.prepared == 0 || input.executed); };
+      if (!input.cv.wait_for(lk, std::chrono::milliseconds(100), ready)) continue;
+    }
+
+    VisionIpcBufExtra extra = {};
+    VisionBuf *buf = vipc_client.recv(&extra);
+    if (buf == nullptr) continue;
+
+    transform_lock.lock();
+    mat3 model_transform = cur_transform;
+    const bool run_model_this_iter = live_calib_seen;
+    transform_lock.unlock();
+
+    if (run_model_this_iter) {
+      float *net_input_buf = model_prepare_frame(&model, buf->buf_cl, buf->width, buf->height, model_transform);
+      {
+        std::lock_guard lk(input.lock);
+        input.net_input_buf = net_input_buf;
+        input.extra = extra;
+        input.pending = true;
+        input.prepared++;
+      }
+      input.cv.notify_all();
     }
   }
+  t.join();
 }
 
 int main(int argc, char **argv) {
@@ -10,13 +10,23 @@
 #include "selfdrive/common/timing.h"
 
 ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
-  input_frames = std::make_unique<float[]>(buf_size);
-
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
   y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
   u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
   v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
-  net_input_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_FRAME_SIZE * sizeof(float), NULL, &err));
+
+  // host accessible, so mapping the input doesn't copy it on devices with shared memory
+  const cl_buffer_region frame_region = {MODEL_FRAME_SIZE * sizeof(float), MODEL_FRAME_SIZE * sizeof(float)};
+  for (int i = 0; i < 2; i++) {
+    input_cl[i] = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, buf_size * sizeof(float), NULL, &err));
+    frame_cl[i] = CL_CHECK_ERR(clCreateSubBuffer(input_cl[i], CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &frame_region, &err));
+
+    // the first frame has no history
+    const float zero = 0;
+    CL_CHECK(clEnqueueFillBuffer(q, input_cl[i], &zero, sizeof(zero), 0, buf_size * sizeof(float), 0, nullptr, nullptr));
+    input_frames[i] = (float *)CL_CHECK_ERR(clEnqueueMapBuffer(q, input_cl[i], CL_TRUE, CL_MAP_READ,
+                                                               0, buf_size * sizeof(float), 0, nullptr, nullptr, &err));
+  }
 
   transform_init(&transform, context, device_id);
   loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
@@ -26,18 +36,29 @@ float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, con
   transform_queue(&this->transform, q,
                   yuv_cl, frame_width, frame_height,
                   y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, transform);
-  loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, net_input_cl);
+  const int prev = cur;
+  cur = (cur + 1) % 2;
 
-  std::memmove(&input_frames[0], &input_frames[MODEL_FRAME_SIZE], sizeof(float) * MODEL_FRAME_SIZE);
-  clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr);
-  clFinish(q);
-  return &input_frames[0];
+  CL_CHECK(clEnqueueUnmapMemObject(q, input_cl[cur], input_frames[cur], 0, nullptr, nullptr));
+  loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, frame_cl[cur]);
+  CL_CHECK(clEnqueueCopyBuffer(q, input_cl[prev], input_cl[cur], MODEL_FRAME_SIZE * sizeof(float), 0,
+                               MODEL_FRAME_SIZE * sizeof(float), 0, nullptr, nullptr));
+  input_frames[cur] = (float *)CL_CHECK_ERR(clEnqueueMapBuffer(q, input_cl[cur], CL_TRUE, CL_MAP_READ,
+                                                               0, buf_size * sizeof(float), 0, nullptr, nullptr, &err));
+  return input_frames[cur];
 }
 
 ModelFrame::~ModelFrame() {
   transform_destroy(&transform);
   loadyuv_destroy(&loadyuv);
-  CL_CHECK(clReleaseMemObject(net_input_cl));
+  for (int i = 0; i < 2; i++) {
+    CL_CHECK(clEnqueueUnmapMemObject(q, input_cl[i], input_frames[i], 0, nullptr, nullptr));
+  }
+  CL_CHECK(clFinish(q));
+  for (int i = 0; i < 2; i++) {
+    CL_CHECK(clReleaseMemObject(frame_cl[i]));
+    CL_CHECK(clReleaseMemObject(input_cl[i]));
+  }
   CL_CHECK(clReleaseMemObject(v_cl));
   CL_CHECK(clReleaseMemObject(u_cl));
   CL_CHECK(clReleaseMemObject(y_cl));
@@ -30,6 +30,8 @@ class ModelFrame {
  public:
   ModelFrame(cl_device_id device_id, cl_context context);
   ~ModelFrame();
+  // Returns the previous and the current frame. The input is double-buffered,
+  // the returned buffer stays valid while the next frame is prepared.
   float* prepare(cl_mem yuv_cl, int width, int height, const mat3& transform);
 
   const int buf_size = MODEL_FRAME_SIZE * 2;
@@ -38,6 +40,11 @@ class ModelFrame {
   Transform transform;
   LoadYUVState loadyuv;
   cl_command_queue q;
-  cl_mem y_cl, u_cl, v_cl, net_input_cl;
-  std::unique_ptr<float[]> input_frames;
+  cl_mem y_cl, u_cl, v_cl;
+
+  // The frame history stays on the device, each input buffer holds the previous and the
+  // current frame and the previous one is copied over from the other buffer.
+  cl_mem input_cl[2], frame_cl[2];
+  float *input_frames[2];
+  int cur = 0;
 };
@@ -52,22 +52,23 @@ constexpr float FCW_THRESHOLD_5MS2_HIGH = 0.15;
 constexpr float FCW_THRESHOLD_5MS2_LOW = 0.05;
 constexpr float FCW_THRESHOLD_3MS2 = 0.7;
 
-float prev_brake_5ms2_probs[5] = {0,0,0,0,0};
-float prev_brake_3ms2_probs[3] = {0,0,0};
-
 // #define DUMP_YUV
 
-void model_init(ModelState* s, cl_device_id device_id, cl_context context) {
+void model_init(ModelState* s, cl_device_id device_id, cl_context context, CreateModelFn create_model) {
   s->frame = new ModelFrame(device_id, context);
 
   constexpr int output_size = OUTPUT_SIZE + TEMPORAL_SIZE;
   s->output.resize(output_size);
 
+  if (create_model) {
+    s->m = create_model(&s->output[0], output_size);
+  } else {
 #if (defined(QCOM) || defined(QCOM2)) && defined(USE_THNEED)
-  s->m = std::make_unique<ThneedModel>("../../models/supercombo.thneed", &s->output[0], output_size, USE_GPU_RUNTIME);
+    s->m = std::make_unique<ThneedModel>("../../models/supercombo.thneed", &s->output[0], output_size, USE_GPU_RUNTIME);
 #else
-  s->m = std::make_unique<DefaultRunModel>("../../models/supercombo.dlc", &s->output[0], output_size, USE_GPU_RUNTIME);
+    s->m = std::make_unique<DefaultRunModel>("../../models/supercombo.dlc", &s->output[0], output_size, USE_GPU_RUNTIME);
 #endif
+  }
 
 #ifdef TEMPORAL
   s->m->addRecurrent(&s->output[OUTPUT_SIZE], TEMPORAL_SIZE);
@@ -86,6 +87,14 @@ void model_init(ModelState* s, cl_device_id device_id, cl_context context) {
 
 ModelDataRaw model_eval_frame(ModelState* s, cl_mem yuv_cl, int width, int height,
                            const mat3 &transform, float *desire_in) {
+  return model_eval_input(s, model_prepare_frame(s, yuv_cl, width, height, transform), desire_in);
+}
+
+float* model_prepare_frame(ModelState* s, cl_mem yuv_cl, int width, int height, const mat3 &transform) {
+  return s->frame->prepare(yuv_cl, width, height, transform);
+}
+
+ModelDataRaw model_eval_input(ModelState* s, float *net_input_buf, float *desire_in) {
 #ifdef DESIRE
   if (desire_in != NULL) {
     for (int i = 1; i < DESIRE_LEN; i++) {
@@ -103,7 +112,6 @@ ModelDataRaw model_eval_frame(ModelState* s, cl_mem yuv_cl, int width, int heigh
 
   //for (int i = 0; i < OUTPUT_SIZE + TEMPORAL_SIZE; i++) { printf("%f ", s->output[i]); } printf("\n");
 
-  auto net_input_buf = s->frame->prepare(yuv_cl, width, height, transform);
   s->m->execute(net_input_buf, s->frame->buf_size);
 
   // net outputs
@@ -116,6 +124,8 @@ ModelDataRaw model_eval_frame(ModelState* s, cl_mem yuv_cl, int width, int heigh
   net_outputs.lead_prob = &s->output[LEAD_PROB_IDX];
   net_outputs.meta = &s->output[DESIRE_STATE_IDX];
   net_outputs.pose = &s->output[POSE_IDX];
+  net_outputs.prev_brake_5ms2_probs = s->prev_brake_5ms2_probs;
+  net_outputs.prev_brake_3ms2_probs = s->prev_brake_3ms2_probs;
   return net_outputs;
 }
 
@@ -123,6 +133,39 @@ void model_free(ModelState* s) {
   delete s->frame;
 }
 
+mat3 model_transform_from_extrinsic(const float extrinsic_matrix[3 * 4], bool wide_camera) {
+  /*
+     import numpy as np
+     from common.transformations.model import medmodel_frame_from_road_frame
+     medmodel_frame_from_ground = medmodel_frame_from_road_frame[:, (0, 1, 3)]
+     ground_from_medmodel_frame = np.linalg.inv(medmodel_frame_from_ground)
+  */
+  Eigen::Matrix<float, 3, 3> ground_from_medmodel_frame;
+  ground_from_medmodel_frame <<
+    0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
+    -1.09890110e-03, 0.00000000e+00, 2.81318681e-01,
+    -1.84808520e-20, 9.00738606e-04,-4.28751576e-02;
+
+  Eigen::Matrix<float, 3, 3> cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
+  Eigen::Matrix<float, 3, 4> extrinsic_matrix_eigen;
+  for (int i = 0; i < 4*3; i++){
+    extrinsic_matrix_eigen(i / 4, i % 4) = extrinsic_matrix[i];
+  }
+
+  auto camera_frame_from_road_frame = cam_intrinsics * extrinsic_matrix_eigen;
+  Eigen::Matrix<float, 3, 3> camera_frame_from_ground;
+  camera_frame_from_ground.col(0) = camera_frame_from_road_frame.col(0);
+  camera_frame_from_ground.col(1) = camera_frame_from_road_frame.col(1);
+  camera_frame_from_ground.col(2) = camera_frame_from_road_frame.col(3);
+
+  auto warp_matrix = camera_frame_from_ground * ground_from_medmodel_frame;
+  mat3 transform = {};
+  for (int i=0; i<3*3; i++) {
+    transform.v[i] = warp_matrix(i / 3, i % 3);
+  }
+  return matmul3(get_model_yuv_transform(), transform);
+}
+
 static const float *get_best_data(const float *data, int size, int group_size, int offset) {
   int max_idx = 0;
   for (int i = 1; i < size; i++) {
@@ -183,7 +226,8 @@ void fill_lead_v3(cereal::ModelDataV2::LeadDataV3::Builder lead, const float *le
   lead.setAStd(a_stds_arr);
 }
 
-void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const float *meta_data) {
+void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const float *meta_data,
+               float *prev_brake_5ms2_probs, float *prev_brake_3ms2_probs) {
   float desire_state_softmax[DESIRE_LEN];
   float desire_pred_softmax[4*DESIRE_LEN];
   softmax(&meta_data[0], desire_state_softmax, DESIRE_LEN);
@@ -322,7 +366,7 @@ void fill_model(cereal::ModelDataV2::Builder &framed, const ModelDataRaw &net_ou
   framed.setRoadEdgeStds(road_edge_stds_arr);
 
   // meta
-  fill_meta(framed.initMeta(), net_outputs.meta);
+  fill_meta(framed.initMeta(), net_outputs.meta, net_outputs.prev_brake_5ms2_probs, net_outputs.prev_brake_3ms2_probs);
 
   // leads
   auto leads = framed.initLeadsV3(LEAD_MHP_SELECTION);
@@ -332,11 +376,10 @@ void fill_model(cereal::ModelDataV2::Builder &framed, const ModelDataRaw &net_ou
   }
 }
 
-void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
-                   const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
-                   float model_execution_time, kj::ArrayPtr<const float> raw_pred) {
+void fill_model_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
+                    const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
+                    float model_execution_time, kj::ArrayPtr<const float> raw_pred) {
   const uint32_t frame_age = (frame_id > vipc_frame_id) ? (frame_id - vipc_frame_id) : 0;
-  MessageBuilder msg;
   auto framed = msg.initEvent().initModelV2();
   framed.setFrameId(vipc_frame_id);
   framed.setFrameAge(frame_age);
@@ -347,11 +390,18 @@ void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t frame_id, flo
     framed.setRawPredictions(raw_pred.asBytes());
   }
   fill_model(framed, net_outputs);
+}
+
+void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
+                   const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
+                   float model_execution_time, kj::ArrayPtr<const float> raw_pred) {
+  MessageBuilder msg;
+  fill_model_msg(msg, vipc_frame_id, frame_id, frame_drop, net_outputs, timestamp_eof, model_execution_time, raw_pred);
   pm.send("modelV2", msg);
 }
 
-void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
-                     const ModelDataRaw &net_outputs, uint64_t timestamp_eof) {
+void fill_posenet_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
+                      const ModelDataRaw &net_outputs, uint64_t timestamp_eof) {
   float trans_arr[3];
   float trans_std_arr[3];
   float rot_arr[3];
@@ -365,7 +415,6 @@ void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_droppe
     rot_std_arr[i] = exp(net_outputs.pose[9 + i]);
   }
 
-  MessageBuilder msg;
   auto posenetd = msg.initEvent(vipc_dropped_frames < 1).initCameraOdometry();
   posenetd.setTrans(trans_arr);
   posenetd.setRot(rot_arr);
@@ -374,6 +423,11 @@ void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_droppe
 
   posenetd.setTimestampEof(timestamp_eof);
   posenetd.setFrameId(vipc_frame_id);
+}
 
+void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
+                     const ModelDataRaw &net_outputs, uint64_t timestamp_eof) {
+  MessageBuilder msg;
+  fill_posenet_msg(msg, vipc_frame_id, vipc_dropped_frames, net_outputs, timestamp_eof);
   pm.send("cameraOdometry", msg);
 }
@@ -5,6 +5,7 @@
 #define DESIRE
 #define TRAFFIC_CONVENTION
 
+#include <functional>
 #include <memory>
 
 #include "cereal/messaging/messaging.h"
@@ -29,6 +30,9 @@ struct ModelDataRaw {
   float *meta;
   float *desire_pred;
   float *pose;
+  // hard brake probabilities of the last frames, for the FCW
+  float *prev_brake_5ms2_probs;
+  float *prev_brake_3ms2_probs;
 };
 
 typedef struct ModelState {
@@ -42,13 +46,27 @@ typedef struct ModelState {
 #ifdef TRAFFIC_CONVENTION
   float traffic_convention[TRAFFIC_CONVENTION_LEN] = {};
 #endif
+  float prev_brake_5ms2_probs[5] = {};
+  float prev_brake_3ms2_probs[3] = {};
 } ModelState;
 
-void model_init(ModelState* s, cl_device_id device_id, cl_context context);
+// create_model overrides the default runner, it gets the output buffer the runner writes to
+typedef std::function<std::unique_ptr<RunModel>(float *output, size_t output_size)> CreateModelFn;
+void model_init(ModelState* s, cl_device_id device_id, cl_context context, CreateModelFn create_model = nullptr);
 ModelDataRaw model_eval_frame(ModelState* s, cl_mem yuv_cl, int width, int height,
                            const mat3 &transform, float *desire_in);
+// model_eval_frame in two steps, so the next frame can be prepared while the model runs
+float* model_prepare_frame(ModelState* s, cl_mem yuv_cl, int width, int height, const mat3 &transform);
+ModelDataRaw model_eval_input(ModelState* s, float *net_input_buf, float *desire_in);
 void model_free(ModelState* s);
 void poly_fit(float *in_pts, float *in_stds, float *out);
+// the warp from the camera frame to the model input, for a liveCalibration extrinsic matrix
+mat3 model_transform_from_extrinsic(const float extrinsic_matrix[3 * 4], bool wide_camera);
+void fill_model_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
+                    const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
+                    float model_execution_time, kj::ArrayPtr<const float> raw_pred);
+void fill_posenet_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
+                      const ModelDataRaw &net_outputs, uint64_t timestamp_eof);
 void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
                    const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
                    float model_execution_time, kj::ArrayPtr<const float> raw_pred);
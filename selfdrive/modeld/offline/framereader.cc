@@ -0,0 +1,90 @@
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+#include "selfdrive/modeld/offline/framereader.h"
+
+#include <cstdio>
+#include <cstring>
+
+FrameReader::FrameReader(const std::string &path) {
+  av_register_all();
+  av_init_packet(&pkt);
+
+  if (avformat_open_input(&format_ctx, path.c_str(), NULL, NULL) != 0) {
+    printf("failed to open %s\n", path.c_str());
+    return;
+  }
+  if (avformat_find_stream_info(format_ctx, NULL) < 0) {
+    printf("no stream info in %s\n", path.c_str());
+    return;
+  }
+
+  stream_idx = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (stream_idx < 0) {
+    printf("no video stream in %s\n", path.c_str());
+    return;
+  }
+
+  AVCodecParameters *par = format_ctx->streams[stream_idx]->codecpar;
+  AVCodec *codec = avcodec_find_decoder(par->codec_id);
+  if (!codec) {
+    printf("no decoder for %s\n", path.c_str());
+    return;
+  }
+
+  AVCodecContext *ctx = avcodec_alloc_context3(codec);
+  // segments are decoded in parallel, one thread per decoder
+  ctx->thread_count = 1;
+  if (avcodec_parameters_to_context(ctx, par) < 0 || avcodec_open2(ctx, codec, NULL) < 0) {
+    printf("failed to open the decoder for %s\n", path.c_str());
+    avcodec_free_context(&ctx);
+    return;
+  }
+
+  codec_ctx = ctx;
+  width = codec_ctx->width;
+  height = codec_ctx->height;
+  frame = av_frame_alloc();
+}
+
+FrameReader::~FrameReader() {
+  av_frame_free(&frame);
+  avcodec_free_context(&codec_ctx);
+  avformat_close_input(&format_ctx);
+}
+
+bool FrameReader::next(std::vector<uint8_t> &yuv) {
+  if (!valid()) return false;
+
+  while (true) {
+    const int ret = avcodec_receive_frame(codec_ctx, frame);
+    if (ret == 0) break;
+    if (ret != AVERROR(EAGAIN) || flushed) return false;
+
+    if (av_read_frame(format_ctx, &pkt) < 0) {
+      // drain the frames the decoder still holds
+      avcodec_send_packet(codec_ctx, NULL);
+      flushed = true;
+      continue;
+    }
+    if (pkt.stream_index == stream_idx) {
+      avcodec_send_packet(codec_ctx, &pkt);
+    }
+    av_packet_unref(&pkt);
+  }
+
+  if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P) {
+    printf("unsupported pixel format %d\n", frame->format);
+    return false;
+  }
+
+  yuv.resize(width * height * 3 / 2);
+  uint8_t *dst = yuv.data();
+  for (int plane = 0; plane < 3; plane++) {
+    const int w = plane == 0 ? width : width / 2, h = plane == 0 ? height : height / 2;
+    for (int y = 0; y < h; y++) {
+      memcpy(dst, frame->data[plane] + y * frame->linesize[plane], w);
+      dst += w;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+// Decodes a camera file (fcamera.hevc) frame by frame in presentation order.
+class FrameReader {
+public:
+  FrameReader(const std::string &path);
+  ~FrameReader();
+  bool valid() const { return codec_ctx != nullptr; }
+  // the next frame as contiguous yuv420p, false at the end of the file
+  bool next(std::vector<uint8_t> &yuv);
+
+  int width = 0, height = 0;
+
+private:
+  AVFormatContext *format_ctx = nullptr;
+  AVCodecContext *codec_ctx = nullptr;
+  AVFrame *frame = nullptr;
+  AVPacket pkt;
+  int stream_idx = -1;
+  bool flushed = false;
+};
@@ -0,0 +1,210 @@
+// Runs the driving model over recorded segments as fast as the machine allows, and writes
+// the modelV2 and cameraOdometry messages of every segment to <output dir>/<segment>/rlog.bz2.
+//
+//   ./offline/offline_modeld [-j jobs] [-t threads per job] [-n max frames] <output dir> <segment dir>...
+//   ./offline/offline_modeld -s [-j max jobs] [-t threads per job] [-n max frames] <segment dir>...
+//
+// A segment dir has fcamera.hevc, and rlog.bz2 or rlog for the frame ids, calibration and
+// desire. Segments run in parallel, each one with its own model state, and all of them share
+// the model weights. With -s nothing is written, the segments are run with 1, 2, 4.. jobs
+// up to -j to show how the frame rate scales with cores.
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "selfdrive/modeld/offline/framereader.h"
+#include "selfdrive/modeld/offline/segmentlog.h"
+#include "selfdrive/modeld/runners/onnxmodel.h"
+
+// used until the first liveCalibration, or when the segment has no log
+static const float default_extrinsic[3 * 4] = {
+  0, 1, 0, 0,
+  0, 0, 1, 1.22,
+  1, 0, 0, 0,
+};
+
+struct OfflineContext {
+  cl_device_id device_id;
+  cl_context context;
+  std::shared_ptr<const OnnxGraph> graph;
+  int threads;
+  int max_frames;
+  std::string out_dir;  // empty to not write logs
+};
+
+static std::string segment_name(const std::string &path) {
+  std::string p = path;
+  while (p.size() > 1 && p.back() == '/') p.pop_back();
+  const size_t slash = p.rfind('/');
+  return slash == std::string::npos ? p : p.substr(slash + 1);
+}
+
+// returns the number of frames run
+static int run_segment(const OfflineContext &ctx, const std::string &path) {
+  FrameReader reader(path + "/fcamera.hevc");
+  if (!reader.valid()) return 0;
+
+  SegmentLog log;
+  if (!log.load(path + "/rlog.bz2") && !log.load(path + "/rlog")) {
+    printf("%s: no rlog, using the default calibration\n", path.c_str());
+  }
+
+  std::unique_ptr<LogWriter> writer;
+  if (!ctx.out_dir.empty()) {
+    const std::string dir = ctx.out_dir + "/" + segment_name(path);
+    mkdir(dir.c_str(), 0775);
+    writer = std::make_unique<LogWriter>(dir + "/rlog.bz2");
+    if (!writer->valid()) return 0;
+  }
+
+  // a fresh model state per segment, the recurrent state doesn't carry over
+  ModelState model;
+  model_init(&model, ctx.device_id, ctx.context, [&](float *output, size_t output_size) {
+    return std::make_unique<ONNXModel>(ctx.graph, output, output_size, ctx.threads);
+  });
+
+  const size_t frame_size = reader.width * reader.height * 3 / 2;
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(ctx.context, ctx.device_id, 0, &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, frame_size, NULL, &err));
+
+  float extrinsic[3 * 4];
+  std::copy(default_extrinsic, default_extrinsic + 3 * 4, extrinsic);
+
+  std::vector<uint8_t> yuv;
+  uint32_t last_frame_id = 0;
+  int frame_cnt = 0;
+  for (; (ctx.max_frames <= 0 || frame_cnt < ctx.max_frames) && reader.next(yuv); frame_cnt++) {
+    SegmentFrame f = {(uint32_t)frame_cnt, frame_cnt * 50000000ULL, frame_cnt * 50000000ULL};
+    if (frame_cnt < (int)log.frames.size()) f = log.frames[frame_cnt];
+
+    log.calibration(f.log_mono_time, extrinsic);
+    const mat3 transform = model_transform_from_extrinsic(extrinsic, false);
+
+    float vec_desire[DESIRE_LEN] = {0};
+    const int desire = log.desire(f.log_mono_time);
+    if (desire >= 0 && desire < DESIRE_LEN) {
+      vec_desire[desire] = 1.0;
+    }
+
+    CL_CHECK(clEnqueueWriteBuffer(q, yuv_cl, CL_TRUE, 0, frame_size, yuv.data(), 0, NULL, NULL));
+    const double t1 = millis_since_boot();
+    ModelDataRaw model_buf = model_eval_frame(&model, yuv_cl, reader.width, reader.height, transform, vec_desire);
+    const double t2 = millis_since_boot();
+
+    if (writer) {
+      const uint32_t dropped_frames = frame_cnt > 0 && f.frame_id > last_frame_id ? f.frame_id - last_frame_id - 1 : 0;
+
+      // the messages are stamped with the time of the frame, so the log lines up with the rlog
+      MessageBuilder model_msg;
+      fill_model_msg(model_msg, f.frame_id, f.frame_id, 0, model_buf, f.timestamp_eof, (t2 - t1) / 1000.0,
+                     kj::ArrayPtr<const float>(model.output.data(), model.output.size()));
+      model_msg.getRoot<cereal::Event>().setLogMonoTime(f.log_mono_time);
+      writer->write(model_msg);
+
+      MessageBuilder posenet_msg;
+      fill_posenet_msg(posenet_msg, f.frame_id, dropped_frames, model_buf, f.timestamp_eof);
+      posenet_msg.getRoot<cereal::Event>().setLogMonoTime(f.log_mono_time);
+      writer->write(posenet_msg);
+    }
+    last_frame_id = f.frame_id;
+  }
+
+  model_free(&model);
+  CL_CHECK(clReleaseMemObject(yuv_cl));
+  CL_CHECK(clReleaseCommandQueue(q));
+  return frame_cnt;
+}
+
+// runs all segments with the given number of jobs, returns frames/s
+static double run_segments(const OfflineContext &ctx, const std::vector<std::string> &segments, int jobs, bool verbose) {
+  std::atomic<int> next_segment = 0;
+  std::atomic<int> total_frames = 0;
+  std::mutex print_lock;
+
+  const double start = millis_since_boot();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < jobs; i++) {
+    workers.emplace_back([&]() {
+      for (int s = next_segment++; s < (int)segments.size(); s = next_segment++) {
+        const double t1 = millis_since_boot();
+        const int frames = run_segment(ctx, segments[s]);
+        const double t2 = millis_since_boot();
+        total_frames += frames;
+        if (verbose) {
+          std::lock_guard lk(print_lock);
+          printf("%s: %d frames, %.2f frames/s\n", segments[s].c_str(), frames, frames * 1000. / (t2 - t1));
+        }
+      }
+    });
+  }
+  for (auto &t : workers) t.join();
+
+  const double elapsed = millis_since_boot() - start;
+  return total_frames * 1000. / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  int jobs = std::max(1U, std::thread::hardware_concurrency() / 2);
+  int threads = 2;
+  int max_frames = 0;
+  bool sweep = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:t:n:s")) != -1) {
+    switch (opt) {
+      case 'j': jobs = std::max(1, atoi(optarg)); break;
+      case 't': threads = std::max(1, atoi(optarg)); break;
+      case 'n': max_frames = atoi(optarg); break;
+      case 's': sweep = true; break;
+      default: return 1;
+    }
+  }
+  if (argc - optind < (sweep ? 1 : 2)) {
+    printf("usage: %s [-j jobs] [-t threads per job] [-n max frames] <output dir> <segment dir>...\n", argv[0]);
+    printf("       %s -s [-j max jobs] [-t threads per job] [-n max frames] <segment dir>...\n", argv[0]);
+    return 1;
+  }
+
+  OfflineContext ctx;
+  ctx.device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  ctx.context = CL_CHECK_ERR(clCreateContext(NULL, 1, &ctx.device_id, NULL, NULL, &err));
+  ctx.graph = ONNXModel::load("../../models/supercombo.dlc");
+  ctx.threads = threads;
+  ctx.max_frames = max_frames;
+  if (!sweep) {
+    ctx.out_dir = argv[optind++];
+    mkdir(ctx.out_dir.c_str(), 0775);
+  }
+  const std::vector<std::string> segments(argv + optind, argv + argc);
+
+  if (sweep) {
+    printf("jobs  threads  frames/s  speedup\n");
+    double base = 0;
+    for (int j = 1; j <= jobs; j = j < jobs && j * 2 > jobs ? jobs : j * 2) {
+      const double fps = run_segments(ctx, segments, j, false);
+      if (j == 1) base = fps;
+      printf("%4d  %7d  %8.2f  %6.2fx\n", j, threads, fps, fps / base);
+      if (j == jobs) break;
+    }
+  } else {
+    const double fps = run_segments(ctx, segments, jobs, true);
+    printf("%zu segments, %d jobs x %d threads: %.2f frames/s\n", segments.size(), jobs, threads, fps);
+  }
+
+  CL_CHECK(clReleaseContext(ctx.context));
+  return 0;
+}
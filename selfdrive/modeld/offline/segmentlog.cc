@@ -0,0 +1,114 @@
+#include "selfdrive/modeld/offline/segmentlog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "selfdrive/common/bz2.h"
+#include "selfdrive/common/util.h"
+
+bool SegmentLog::load(const std::string &path) {
+  std::string raw = util::read_file(path);
+  if (raw.empty()) return false;
+
+  std::string dat;
+  if (raw.compare(0, 3, "BZh") == 0) {
+    if (!util::bz2_decompress(raw, dat)) {
+      printf("failed to decompress %s\n", path.c_str());
+      return false;
+    }
+  } else {
+    dat = std::move(raw);
+  }
+
+  kj::Array<capnp::word> words = kj::heapArray<capnp::word>(dat.size() / sizeof(capnp::word));
+  memcpy(words.begin(), dat.data(), words.size() * sizeof(capnp::word));
+
+  std::vector<std::pair<uint32_t, SegmentFrame>> encode_idx;
+  kj::ArrayPtr<const capnp::word> remaining = words;
+  while (remaining.size() > 0) {
+    capnp::FlatArrayMessageReader cmsg(remaining);
+    auto event = cmsg.getRoot<cereal::Event>();
+    const uint64_t t = event.getLogMonoTime();
+    switch (event.which()) {
+      case cereal::Event::ROAD_ENCODE_IDX: {
+        auto idx = event.getRoadEncodeIdx();
+        if (idx.getType() == cereal::EncodeIndex::Type::FULL_H_E_V_C) {
+          encode_idx.push_back({idx.getSegmentId(), {idx.getFrameId(), idx.getTimestampEof(), t}});
+        }
+        break;
+      }
+      case cereal::Event::LIVE_CALIBRATION: {
+        auto extrinsic_matrix = event.getLiveCalibration().getExtrinsicMatrix();
+        if (extrinsic_matrix.size() == 3 * 4) {
+          std::array<float, 3 * 4> m;
+          for (int i = 0; i < 3 * 4; i++) m[i] = extrinsic_matrix[i];
+          calibrations.push_back({t, m});
+        }
+        break;
+      }
+      case cereal::Event::LATERAL_PLAN:
+        desires.push_back({t, (int)event.getLateralPlan().getDesire()});
+        break;
+      default:
+        break;
+    }
+    remaining = kj::arrayPtr(cmsg.getEnd(), remaining.end());
+  }
+
+  // rlogs are only roughly in time order
+  std::sort(encode_idx.begin(), encode_idx.end(), [](auto &a, auto &b) { return a.first < b.first; });
+  std::stable_sort(calibrations.begin(), calibrations.end(), [](auto &a, auto &b) { return a.first < b.first; });
+  std::stable_sort(desires.begin(), desires.end(), [](auto &a, auto &b) { return a.first < b.first; });
+  for (auto &[segment_id, frame] : encode_idx) {
+    frames.push_back(frame);
+  }
+  return true;
+}
+
+template <typename T>
+static const T *latest(const std::vector<std::pair<uint64_t, T>> &v, uint64_t t) {
+  auto it = std::upper_bound(v.begin(), v.end(), t, [](uint64_t time, auto &e) { return time < e.first; });
+  return it == v.begin() ? nullptr : &std::prev(it)->second;
+}
+
+bool SegmentLog::calibration(uint64_t t, float extrinsic_matrix[3 * 4]) const {
+  auto m = latest(calibrations, t);
+  if (m) std::copy(m->begin(), m->end(), extrinsic_matrix);
+  return m != nullptr;
+}
+
+int SegmentLog::desire(uint64_t t) const {
+  auto d = latest(desires, t);
+  return d ? *d : 0;
+}
+
+LogWriter::LogWriter(const std::string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    printf("failed to open %s\n", path.c_str());
+    return;
+  }
+
+  int bzerror;
+  bz_file = BZ2_bzWriteOpen(&bzerror, file, 9, 0, 30);
+  if (bzerror != BZ_OK) {
+    bz_file = nullptr;
+  }
+}
+
+LogWriter::~LogWriter() {
+  if (bz_file) {
+    int bzerror;
+    BZ2_bzWriteClose(&bzerror, bz_file, 0, NULL, NULL);
+  }
+  if (file) fclose(file);
+}
+
+void LogWriter::write(MessageBuilder &msg) {
+  if (!bz_file) return;
+
+  auto bytes = msg.toBytes();
+  int bzerror;
+  BZ2_bzWrite(&bzerror, bz_file, bytes.begin(), bytes.size());
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <bzlib.h>
+
+#include "cereal/messaging/messaging.h"
+
+struct SegmentFrame {
+  uint32_t frame_id;
+  uint64_t timestamp_eof;
+  uint64_t log_mono_time;
+};
+
+// What modeld would have seen while a segment was recorded, from its rlog.
+class SegmentLog {
+public:
+  // rlog or rlog.bz2
+  bool load(const std::string &path);
+
+  // one per frame of fcamera.hevc, from roadEncodeIdx
+  std::vector<SegmentFrame> frames;
+
+  // the latest liveCalibration at time t, false before the first one
+  bool calibration(uint64_t t, float extrinsic_matrix[3 * 4]) const;
+  // the latest lateralPlan desire at time t
+  int desire(uint64_t t) const;
+
+private:
+  std::vector<std::pair<uint64_t, std::array<float, 3 * 4>>> calibrations;
+  std::vector<std::pair<uint64_t, int>> desires;
+};
+
+// Writes messages to a bzip2 compressed log, in the rlog format.
+class LogWriter {
+public:
+  LogWriter(const std::string &path);
+  ~LogWriter();
+  bool valid() const { return bz_file != nullptr; }
+  void write(MessageBuilder &msg);
+
+private:
+  FILE *file = nullptr;
+  BZFILE *bz_file = nullptr;
+};
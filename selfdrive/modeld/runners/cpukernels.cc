@@ -0,0 +1,366 @@
+#include "selfdrive/modeld/runners/cpukernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace cpu {
+
+// ThreadPool
+
+ThreadPool::ThreadPool(int num_threads) {
+  for (int i = 1; i < num_threads; i++) {
+    threads.emplace_back(&ThreadPool::worker, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lk(lock);
+    stop = true;
+  }
+  cv.notify_all();
+  for (auto &t : threads) t.join();
+}
+
+bool ThreadPool::run_chunk(std::unique_lock<std::mutex> &lk) {
+  if (job == nullptr || next_chunk >= chunks) return false;
+
+  const int c = next_chunk++;
+  const auto *fn = job;
+  const int64_t n = job_n, cnt = chunks;
+  lk.unlock();
+  (*fn)(c * n / cnt, (c + 1) * n / cnt);
+  lk.lock();
+
+  if (++chunks_done == chunks) done_cv.notify_all();
+  return true;
+}
+
+void ThreadPool::worker() {
+  std::unique_lock lk(lock);
+  while (true) {
+    cv.wait(lk, [this] { return stop || (job != nullptr && next_chunk < chunks); });
+    if (stop) return;
+    run_chunk(lk);
+  }
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int, int)> &fn) {
+  if (n <= 0) return;
+  if (threads.empty() || n == 1) {
+    fn(0, n);
+    return;
+  }
+
+  std::unique_lock lk(lock);
+  job = &fn;
+  job_n = n;
+  // a few chunks per thread to even out the load
+  chunks = std::min(n, size() * 4);
+  next_chunk = 0;
+  chunks_done = 0;
+  cv.notify_all();
+
+  while (run_chunk(lk)) {}
+  done_cv.wait(lk, [this] { return chunks_done == chunks; });
+  job = nullptr;
+}
+
+// GEMM
+
+typedef float v4f __attribute__((vector_size(16)));
+
+static inline v4f load4(const float *p) {
+  v4f v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline void store4(float *p, v4f v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+// writes a tile with rows of nr computed in tmp to C, only the m x n valid part
+static inline void store_tile(const float *tmp, int nr, float *C, int ldc, int m, int n, bool accumulate) {
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      C[i * ldc + j] = tmp[i * nr + j] + (accumulate ? C[i * ldc + j] : 0.f);
+    }
+  }
+}
+
+// Micro-kernels compute an MR x NR tile of C from MR rows of A and a K x NR panel of packed B.
+// Rows past m repeat the last valid row so A is never read out of bounds.
+typedef void (*gemm_kernel_t)(int K, const float *A, int lda, const float *Bp, float *C, int ldc,
+                              int m, int n, bool accumulate);
+
+static void kernel_6x8(int K, const float *A, int lda, const float *Bp, float *C, int ldc,
+                       int m, int n, bool accumulate) {
+  const float *a0 = A, *a1 = A + std::min(1, m - 1) * lda, *a2 = A + std::min(2, m - 1) * lda;
+  const float *a3 = A + std::min(3, m - 1) * lda, *a4 = A + std::min(4, m - 1) * lda, *a5 = A + std::min(5, m - 1) * lda;
+
+  v4f c00 = {}, c01 = {}, c10 = {}, c11 = {}, c20 = {}, c21 = {};
+  v4f c30 = {}, c31 = {}, c40 = {}, c41 = {}, c50 = {}, c51 = {};
+  for (int k = 0; k < K; k++) {
+    const v4f b0 = load4(Bp + k * 8), b1 = load4(Bp + k * 8 + 4);
+    v4f a;
+    a = (v4f){a0[k], a0[k], a0[k], a0[k]}; c00 += a * b0; c01 += a * b1;
+    a = (v4f){a1[k], a1[k], a1[k], a1[k]}; c10 += a * b0; c11 += a * b1;
+    a = (v4f){a2[k], a2[k], a2[k], a2[k]}; c20 += a * b0; c21 += a * b1;
+    a = (v4f){a3[k], a3[k], a3[k], a3[k]}; c30 += a * b0; c31 += a * b1;
+    a = (v4f){a4[k], a4[k], a4[k], a4[k]}; c40 += a * b0; c41 += a * b1;
+    a = (v4f){a5[k], a5[k], a5[k], a5[k]}; c50 += a * b0; c51 += a * b1;
+  }
+
+  const v4f c[6][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+  if (m == 6 && n == 8) {
+    for (int i = 0; i < 6; i++) {
+      float *row = C + i * ldc;
+      store4(row, accumulate ? load4(row) + c[i][0] : c[i][0]);
+      store4(row + 4, accumulate ? load4(row + 4) + c[i][1] : c[i][1]);
+    }
+  } else {
+    float tmp[6 * 8];
+    for (int i = 0; i < 6; i++) {
+      store4(&tmp[i * 8], c[i][0]);
+      store4(&tmp[i * 8 + 4], c[i][1]);
+    }
+    store_tile(tmp, 8, C, ldc, m, n, accumulate);
+  }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma")))
+static void kernel_6x16_avx2(int K, const float *A, int lda, const float *Bp, float *C, int ldc,
+                             int m, int n, bool accumulate) {
+  const float *a[6];
+  for (int i = 0; i < 6; i++) a[i] = A + std::min(i, m - 1) * lda;
+
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps(), c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps(), c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps(), c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+  for (int k = 0; k < K; k++) {
+    const __m256 b0 = _mm256_loadu_ps(Bp + k * 16), b1 = _mm256_loadu_ps(Bp + k * 16 + 8);
+    __m256 av;
+    av = _mm256_broadcast_ss(a[0] + k); c00 = _mm256_fmadd_ps(av, b0, c00); c01 = _mm256_fmadd_ps(av, b1, c01);
+    av = _mm256_broadcast_ss(a[1] + k); c10 = _mm256_fmadd_ps(av, b0, c10); c11 = _mm256_fmadd_ps(av, b1, c11);
+    av = _mm256_broadcast_ss(a[2] + k); c20 = _mm256_fmadd_ps(av, b0, c20); c21 = _mm256_fmadd_ps(av, b1, c21);
+    av = _mm256_broadcast_ss(a[3] + k); c30 = _mm256_fmadd_ps(av, b0, c30); c31 = _mm256_fmadd_ps(av, b1, c31);
+    av = _mm256_broadcast_ss(a[4] + k); c40 = _mm256_fmadd_ps(av, b0, c40); c41 = _mm256_fmadd_ps(av, b1, c41);
+    av = _mm256_broadcast_ss(a[5] + k); c50 = _mm256_fmadd_ps(av, b0, c50); c51 = _mm256_fmadd_ps(av, b1, c51);
+  }
+
+  const __m256 c[6][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+  if (m == 6 && n == 16) {
+    for (int i = 0; i < 6; i++) {
+      float *row = C + i * ldc;
+      _mm256_storeu_ps(row, accumulate ? _mm256_add_ps(_mm256_loadu_ps(row), c[i][0]) : c[i][0]);
+      _mm256_storeu_ps(row + 8, accumulate ? _mm256_add_ps(_mm256_loadu_ps(row + 8), c[i][1]) : c[i][1]);
+    }
+  } else {
+    float tmp[6 * 16];
+    for (int i = 0; i < 6; i++) {
+      _mm256_storeu_ps(&tmp[i * 16], c[i][0]);
+      _mm256_storeu_ps(&tmp[i * 16 + 8], c[i][1]);
+    }
+    store_tile(tmp, 16, C, ldc, m, n, accumulate);
+  }
+}
+#endif
+
+struct GemmKernel {
+  gemm_kernel_t fn;
+  int mr, nr;
+};
+
+static GemmKernel get_kernel() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {kernel_6x16_avx2, 6, 16};
+  }
+#endif
+  return {kernel_6x8, 6, 8};
+}
+
+// C[m x N] = A[m x K] * B[K x N] for a few rows, streams B once per row
+static void gemv(ThreadPool &pool, int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+                 float *C, int ldc, bool accumulate) {
+  // split the columns in multiples of 64 floats
+  const int blocks = (N + 63) / 64;
+  pool.parallel_for(blocks, [&](int begin, int end) {
+    const int n0 = begin * 64, n1 = std::min(N, end * 64);
+    for (int i = 0; i < M; i++) {
+      float *c = C + (size_t)i * ldc;
+      if (!accumulate) std::fill(c + n0, c + n1, 0.f);
+      const float *a = A + (size_t)i * lda;
+      for (int k = 0; k < K; k++) {
+        const float av = a[k];
+        const float *b = B + (size_t)k * ldb;
+        for (int j = n0; j < n1; j++) {
+          c[j] += av * b[j];
+        }
+      }
+    }
+  });
+}
+
+void sgemm(ThreadPool &pool, int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+           float *C, int ldc, bool accumulate) {
+  if (M <= 0 || N <= 0) return;
+  if (K <= 0) {
+    if (!accumulate) {
+      for (int i = 0; i < M; i++) std::fill(C + (size_t)i * ldc, C + (size_t)i * ldc + N, 0.f);
+    }
+    return;
+  }
+  if (M < 4) {
+    gemv(pool, M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+    return;
+  }
+
+  static const GemmKernel kernel = get_kernel();
+  const int mr = kernel.mr, nr = kernel.nr;
+
+  // blocks of C are independent tasks, B is packed per block into panels of nr columns
+  constexpr int KC = 256;
+  const int MC = mr * 16, NC = nr * 16;
+  const int m_blocks = (M + MC - 1) / MC, n_blocks = (N + NC - 1) / NC;
+
+  pool.parallel_for(m_blocks * n_blocks, [&](int begin, int end) {
+    thread_local std::vector<float> packed;
+    packed.resize(KC * NC);
+
+    for (int t = begin; t < end; t++) {
+      const int m0 = (t % m_blocks) * MC, m1 = std::min(M, m0 + MC);
+      const int n0 = (t / m_blocks) * NC, n1 = std::min(N, n0 + NC);
+
+      for (int k0 = 0; k0 < K; k0 += KC) {
+        const int kc = std::min(KC, K - k0);
+        for (int j = n0; j < n1; j += nr) {
+          float *dst = &packed[(j - n0) * kc];
+          const int nn = std::min(nr, n1 - j);
+          for (int k = 0; k < kc; k++) {
+            const float *src = B + (size_t)(k0 + k) * ldb + j;
+            int q = 0;
+            for (; q < nn; q++) dst[k * nr + q] = src[q];
+            for (; q < nr; q++) dst[k * nr + q] = 0.f;
+          }
+        }
+
+        const bool acc = accumulate || k0 > 0;
+        for (int j = n0; j < n1; j += nr) {
+          for (int i = m0; i < m1; i += mr) {
+            kernel.fn(kc, A + (size_t)i * lda + k0, lda, &packed[(j - n0) * kc], C + (size_t)i * ldc + j, ldc,
+                      std::min(mr, m1 - i), std::min(nr, n1 - j), acc);
+          }
+        }
+      }
+    }
+  });
+}
+
+// Convolution
+
+static void depthwise_conv2d(ThreadPool &pool, const ConvParams &p, const float *in, const float *weight,
+                             const float *bias, float *out) {
+  pool.parallel_for(p.C, [&](int begin, int end) {
+    for (int c = begin; c < end; c++) {
+      const float *src = in + (size_t)c * p.H * p.W;
+      const float *w = weight + (size_t)c * p.kh * p.kw;
+      float *dst = out + (size_t)c * p.OH * p.OW;
+      std::fill(dst, dst + p.OH * p.OW, bias ? bias[c] : 0.f);
+
+      for (int ki = 0; ki < p.kh; ki++) {
+        for (int kj = 0; kj < p.kw; kj++) {
+          const float wv = w[ki * p.kw + kj];
+          // output columns whose input column is inside the image
+          const int off = kj * p.dilation_w - p.pad_w;
+          const int last = p.W - 1 - off;
+          const int ox0 = off >= 0 ? 0 : (-off + p.stride_w - 1) / p.stride_w;
+          const int ox1 = last < 0 ? 0 : std::min(p.OW, last / p.stride_w + 1);
+
+          for (int oy = 0; oy < p.OH; oy++) {
+            const int iy = oy * p.stride_h - p.pad_h + ki * p.dilation_h;
+            if (iy < 0 || iy >= p.H) continue;
+            const float *src_row = src + (size_t)iy * p.W + off;
+            float *dst_row = dst + (size_t)oy * p.OW;
+            if (p.stride_w == 1) {
+              for (int ox = ox0; ox < ox1; ox++) dst_row[ox] += wv * src_row[ox];
+            } else {
+              for (int ox = ox0; ox < ox1; ox++) dst_row[ox] += wv * src_row[ox * p.stride_w];
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+// rows of the im2col matrix are (channel, ki, kj), columns are output pixels
+static void im2col(ThreadPool &pool, const ConvParams &p, const float *in, int channels, float *col) {
+  const int rows = channels * p.kh * p.kw;
+  pool.parallel_for(rows, [&](int begin, int end) {
+    for (int r = begin; r < end; r++) {
+      const int c = r / (p.kh * p.kw), ki = (r / p.kw) % p.kh, kj = r % p.kw;
+      const float *src = in + (size_t)c * p.H * p.W;
+      float *dst = col + (size_t)r * p.OH * p.OW;
+
+      const int off = kj * p.dilation_w - p.pad_w;
+      const int last = p.W - 1 - off;
+      const int ox0 = off >= 0 ? 0 : std::min(p.OW, (-off + p.stride_w - 1) / p.stride_w);
+      const int ox1 = last < 0 ? ox0 : std::max(ox0, std::min(p.OW, last / p.stride_w + 1));
+      for (int oy = 0; oy < p.OH; oy++) {
+        float *dst_row = dst + (size_t)oy * p.OW;
+        const int iy = oy * p.stride_h - p.pad_h + ki * p.dilation_h;
+        if (iy < 0 || iy >= p.H) {
+          std::fill(dst_row, dst_row + p.OW, 0.f);
+          continue;
+        }
+        const float *src_row = src + (size_t)iy * p.W + off;
+        std::fill(dst_row, dst_row + ox0, 0.f);
+        if (p.stride_w == 1) {
+          memcpy(dst_row + ox0, src_row + ox0, (ox1 - ox0) * sizeof(float));
+        } else {
+          for (int ox = ox0; ox < ox1; ox++) dst_row[ox] = src_row[ox * p.stride_w];
+        }
+        std::fill(dst_row + ox1, dst_row + p.OW, 0.f);
+      }
+    }
+  });
+}
+
+void conv2d(ThreadPool &pool, const ConvParams &p, const float *in, const float *weight, const float *bias,
+            float *out, std::vector<float> &scratch) {
+  if (p.group == p.C && p.M == p.C) {
+    depthwise_conv2d(pool, p, in, weight, bias, out);
+    return;
+  }
+
+  const int Cg = p.C / p.group, Mg = p.M / p.group;
+  const int K = Cg * p.kh * p.kw;
+  const int spatial = p.OH * p.OW;
+  const bool pointwise = p.kh == 1 && p.kw == 1 && p.stride_h == 1 && p.stride_w == 1 && p.pad_h == 0 && p.pad_w == 0 &&
+                         p.OH == p.H && p.OW == p.W;
+
+  for (int m = 0; m < p.M; m++) {
+    std::fill(out + (size_t)m * spatial, out + (size_t)(m + 1) * spatial, bias ? bias[m] : 0.f);
+  }
+
+  for (int g = 0; g < p.group; g++) {
+    const float *group_in = in + (size_t)g * Cg * p.H * p.W;
+    const float *B = group_in;
+    if (!pointwise) {
+      scratch.resize((size_t)K * spatial);
+      im2col(pool, p, group_in, Cg, scratch.data());
+      B = scratch.data();
+    }
+    sgemm(pool, Mg, spatial, K, weight + (size_t)g * Mg * K, K, B, spatial, out + (size_t)g * Mg * spatial, spatial, true);
+  }
+}
+
+}  // namespace cpu
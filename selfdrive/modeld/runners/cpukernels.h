@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu {
+
+class ThreadPool {
+public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+  int size() const { return threads.size() + 1; }
+  // Calls fn(begin, end) on contiguous chunks of [0, n), the calling thread takes part.
+  void parallel_for(int n, const std::function<void(int, int)> &fn);
+
+private:
+  void worker();
+  bool run_chunk(std::unique_lock<std::mutex> &lk);
+
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable cv, done_cv;
+  bool stop = false;
+
+  // current job
+  const std::function<void(int, int)> *job = nullptr;
+  int job_n = 0, chunks = 0, next_chunk = 0, chunks_done = 0;
+};
+
+// C[M x N] = A[M x K] * B[K x N] (+ C if accumulate), all row major
+void sgemm(ThreadPool &pool, int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+           float *C, int ldc, bool accumulate);
+
+struct ConvParams {
+  int C, H, W;           // input
+  int M, OH, OW;         // output
+  int kh, kw;
+  int stride_h, stride_w;
+  int pad_h, pad_w;      // top and left padding
+  int dilation_h, dilation_w;
+  int group;
+};
+
+// One image in NCHW. weight is M x C/group x kh x kw, bias can be null.
+// scratch is resized as needed for the im2col matrix.
+void conv2d(ThreadPool &pool, const ConvParams &p, const float *in, const float *weight, const float *bias,
+            float *out, std::vector<float> &scratch);
+
+}  // namespace cpu
@@ -0,0 +1,1098 @@
+#include "selfdrive/modeld/runners/onnxexec.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+using Op = OnnxExecutor::Op;
+using Shape = std::vector<int64_t>;
+
+void check(bool cond, const Op &op, const char *msg) {
+  if (!cond) {
+    fprintf(stderr, "onnx: %s (%s): %s\n", op.node->op_type.c_str(), op.node->name.c_str(), msg);
+    abort();
+  }
+}
+
+int64_t product(const Shape &s, size_t begin = 0, size_t end = SIZE_MAX) {
+  int64_t n = 1;
+  for (size_t d = begin; d < std::min(end, s.size()); d++) n *= s[d];
+  return n;
+}
+
+int64_t norm_axis(int64_t axis, size_t rank) {
+  return axis < 0 ? axis + (int64_t)rank : axis;
+}
+
+Shape strides_of(const Shape &shape) {
+  Shape s(shape.size());
+  int64_t stride = 1;
+  for (int d = (int)shape.size() - 1; d >= 0; d--) {
+    s[d] = stride;
+    stride *= shape[d];
+  }
+  return s;
+}
+
+// strides to read a tensor broadcast to a larger shape, 0 along broadcast dimensions
+Shape broadcast_strides(const Shape &shape, const Shape &out_shape) {
+  const Shape s = strides_of(shape);
+  Shape ret(out_shape.size(), 0);
+  const size_t offset = out_shape.size() - shape.size();
+  for (size_t d = 0; d < shape.size(); d++) {
+    ret[offset + d] = shape[d] == 1 ? 0 : s[d];
+  }
+  return ret;
+}
+
+Shape broadcast_shape(const Shape &a, const Shape &b) {
+  Shape out(std::max(a.size(), b.size()), 1);
+  for (size_t d = 0; d < out.size(); d++) {
+    const int64_t da = d + a.size() >= out.size() ? a[d + a.size() - out.size()] : 1;
+    const int64_t db = d + b.size() >= out.size() ? b[d + b.size() - out.size()] : 1;
+    out[d] = da == 1 ? db : da;
+  }
+  return out;
+}
+
+template <typename T>
+std::vector<T> &data(Tensor &t);
+template <>
+std::vector<float> &data(Tensor &t) { return t.f; }
+template <>
+std::vector<int64_t> &data(Tensor &t) { return t.i; }
+
+template <typename T>
+const std::vector<T> &data(const Tensor &t) { return data<T>(const_cast<Tensor &>(t)); }
+
+// dst = src read at base + sum(index * strides) for every index of shape
+template <typename T>
+void strided_copy(const T *src, int64_t base, const Shape &shape, const Shape &strides, T *dst) {
+  const int64_t total = product(shape);
+  if (total == 0) return;
+  const int rank = shape.size();
+  if (rank == 0) {
+    dst[0] = src[base];
+    return;
+  }
+
+  const int64_t inner = shape[rank - 1], inner_stride = strides[rank - 1];
+  Shape idx(rank, 0);
+  int64_t off = base;
+  for (int64_t k = 0; k < total; k += inner) {
+    const T *s = src + off;
+    if (inner_stride == 1) {
+      std::copy(s, s + inner, dst + k);
+    } else {
+      for (int64_t j = 0; j < inner; j++) dst[k + j] = s[j * inner_stride];
+    }
+    for (int d = rank - 2; d >= 0; d--) {
+      off += strides[d];
+      if (++idx[d] < shape[d]) break;
+      off -= strides[d] * shape[d];
+      idx[d] = 0;
+    }
+  }
+}
+
+template <typename T>
+void copy_tensor(const Tensor &x, Tensor &y, const Shape &shape) {
+  y.reshape(shape, x.is_int);
+  const auto &src = data<T>(x);
+  std::copy(src.begin(), src.end(), data<T>(y).begin());
+}
+
+void copy_tensor(const Tensor &x, Tensor &y, const Shape &shape) {
+  if (x.is_int) {
+    copy_tensor<int64_t>(x, y, shape);
+  } else {
+    copy_tensor<float>(x, y, shape);
+  }
+}
+
+std::vector<int64_t> ints_input(OnnxExecutor &e, const Op &op, size_t idx) {
+  const Tensor &t = e.in(op, idx);
+  check(t.is_int, op, "expected an integer tensor");
+  return t.i;
+}
+
+// elementwise
+
+template <typename F>
+void unary(OnnxExecutor &e, Op &op, F f) {
+  const Tensor &x = e.in(op, 0);
+  Tensor &y = e.out(op, 0);
+  check(!x.is_int, op, "expected a float tensor");
+  y.reshape(x.shape, false);
+
+  const float *src = x.f.data();
+  float *dst = y.f.data();
+  const int64_t n = x.size();
+  constexpr int64_t block = 16384;
+  e.pool.parallel_for((n + block - 1) / block, [&](int b0, int b1) {
+    const int64_t end = std::min(n, b1 * block);
+    for (int64_t k = b0 * block; k < end; k++) dst[k] = f(src[k]);
+  });
+}
+
+template <typename T, typename F>
+void binary(OnnxExecutor &e, const Tensor &a, const Tensor &b, Tensor &y, F f) {
+  const Shape shape = broadcast_shape(a.shape, b.shape);
+  y.reshape(shape, a.is_int);
+  const T *pa = data<T>(a).data(), *pb = data<T>(b).data();
+  T *dst = data<T>(y).data();
+  const int64_t n = y.size();
+  if (n == 0) return;
+
+  if (a.shape == b.shape) {
+    constexpr int64_t block = 16384;
+    e.pool.parallel_for((n + block - 1) / block, [&](int b0, int b1) {
+      const int64_t end = std::min(n, b1 * block);
+      for (int64_t k = b0 * block; k < end; k++) dst[k] = f(pa[k], pb[k]);
+    });
+    return;
+  }
+  if (b.size() == 1) {
+    const T bv = pb[0];
+    for (int64_t k = 0; k < n; k++) dst[k] = f(pa[k], bv);
+    return;
+  }
+
+  // walk rows of the innermost dimension
+  const Shape sa = broadcast_strides(a.shape, shape), sb = broadcast_strides(b.shape, shape);
+  const int rank = shape.size();
+  const int64_t inner = shape[rank - 1];
+  const int64_t ia = sa[rank - 1], ib = sb[rank - 1];
+  Shape idx(rank, 0);
+  int64_t oa = 0, ob = 0;
+  for (int64_t k = 0; k < n; k += inner) {
+    const T *ra = pa + oa, *rb = pb + ob;
+    T *rd = dst + k;
+    if (ia == 1 && ib == 1) {
+      for (int64_t j = 0; j < inner; j++) rd[j] = f(ra[j], rb[j]);
+    } else if (ia == 1 && ib == 0) {
+      const T bv = rb[0];
+      for (int64_t j = 0; j < inner; j++) rd[j] = f(ra[j], bv);
+    } else if (ia == 0 && ib == 1) {
+      const T av = ra[0];
+      for (int64_t j = 0; j < inner; j++) rd[j] = f(av, rb[j]);
+    } else {
+      for (int64_t j = 0; j < inner; j++) rd[j] = f(ra[j * ia], rb[j * ib]);
+    }
+    for (int d = rank - 2; d >= 0; d--) {
+      oa += sa[d];
+      ob += sb[d];
+      if (++idx[d] < shape[d]) break;
+      oa -= sa[d] * shape[d];
+      ob -= sb[d] * shape[d];
+      idx[d] = 0;
+    }
+  }
+}
+
+template <typename F>
+void binary_op(OnnxExecutor &e, Op &op, F f) {
+  const Tensor &a = e.in(op, 0), &b = e.in(op, 1);
+  check(a.is_int == b.is_int, op, "mixed integer and float inputs");
+  if (a.is_int) {
+    binary<int64_t>(e, a, b, e.out(op, 0), f);
+  } else {
+    binary<float>(e, a, b, e.out(op, 0), f);
+  }
+}
+
+// variadic, folds the inputs pairwise
+template <typename F>
+void variadic_op(OnnxExecutor &e, Op &op, F f) {
+  if (op.in.size() == 1) {
+    copy_tensor(e.in(op, 0), e.out(op, 0), e.in(op, 0).shape);
+    return;
+  }
+  binary_op(e, op, f);
+  for (size_t k = 2; k < op.in.size(); k++) {
+    Tensor acc = e.out(op, 0);
+    if (acc.is_int) {
+      binary<int64_t>(e, acc, e.in(op, k), e.out(op, 0), f);
+    } else {
+      binary<float>(e, acc, e.in(op, k), e.out(op, 0), f);
+    }
+  }
+}
+
+void op_add(OnnxExecutor &e, Op &op) { binary_op(e, op, [](auto a, auto b) { return a + b; }); }
+void op_sub(OnnxExecutor &e, Op &op) { binary_op(e, op, [](auto a, auto b) { return a - b; }); }
+void op_mul(OnnxExecutor &e, Op &op) { binary_op(e, op, [](auto a, auto b) { return a * b; }); }
+void op_div(OnnxExecutor &e, Op &op) { binary_op(e, op, [](auto a, auto b) { return a / b; }); }
+void op_pow(OnnxExecutor &e, Op &op) {
+  check(!e.in(op, 0).is_int && !e.in(op, 1).is_int, op, "expected float tensors");
+  binary<float>(e, e.in(op, 0), e.in(op, 1), e.out(op, 0), [](float a, float b) { return powf(a, b); });
+}
+void op_max(OnnxExecutor &e, Op &op) { variadic_op(e, op, [](auto a, auto b) { return std::max(a, b); }); }
+void op_min(OnnxExecutor &e, Op &op) { variadic_op(e, op, [](auto a, auto b) { return std::min(a, b); }); }
+void op_sum(OnnxExecutor &e, Op &op) { variadic_op(e, op, [](auto a, auto b) { return a + b; }); }
+
+void op_relu(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return std::max(x, 0.f); }); }
+void op_sigmoid(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return 1.f / (1.f + expf(-x)); }); }
+void op_tanh(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return tanhf(x); }); }
+void op_exp(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return expf(x); }); }
+void op_log(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return logf(x); }); }
+void op_sqrt(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return sqrtf(x); }); }
+void op_abs(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return fabsf(x); }); }
+void op_floor(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return floorf(x); }); }
+void op_ceil(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return ceilf(x); }); }
+void op_erf(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return erff(x); }); }
+void op_reciprocal(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return 1.f / x; }); }
+void op_softplus(OnnxExecutor &e, Op &op) { unary(e, op, [](float x) { return log1pf(expf(x)); }); }
+
+void op_neg(OnnxExecutor &e, Op &op) {
+  if (e.in(op, 0).is_int) {
+    const Tensor &x = e.in(op, 0);
+    Tensor &y = e.out(op, 0);
+    y.reshape(x.shape, true);
+    for (size_t k = 0; k < x.i.size(); k++) y.i[k] = -x.i[k];
+  } else {
+    unary(e, op, [](float x) { return -x; });
+  }
+}
+
+void op_elu(OnnxExecutor &e, Op &op) {
+  const float alpha = op.node->get_float("alpha", 1.f);
+  unary(e, op, [=](float x) { return x >= 0.f ? x : alpha * (expf(x) - 1.f); });
+}
+
+void op_leaky_relu(OnnxExecutor &e, Op &op) {
+  const float alpha = op.node->get_float("alpha", 0.01f);
+  unary(e, op, [=](float x) { return x >= 0.f ? x : alpha * x; });
+}
+
+void op_hard_sigmoid(OnnxExecutor &e, Op &op) {
+  const float alpha = op.node->get_float("alpha", 0.2f), beta = op.node->get_float("beta", 0.5f);
+  unary(e, op, [=](float x) { return std::clamp(alpha * x + beta, 0.f, 1.f); });
+}
+
+void op_hard_swish(OnnxExecutor &e, Op &op) {
+  unary(e, op, [](float x) { return x * std::clamp(x / 6.f + 0.5f, 0.f, 1.f); });
+}
+
+void op_clip(OnnxExecutor &e, Op &op) {
+  float lo = op.node->get_float("min", -INFINITY), hi = op.node->get_float("max", INFINITY);
+  if (e.has(op, 1)) lo = e.in(op, 1).f[0];
+  if (e.has(op, 2)) hi = e.in(op, 2).f[0];
+  unary(e, op, [=](float x) { return std::clamp(x, lo, hi); });
+}
+
+// convolution and pooling
+
+struct Window {
+  int kh, kw, stride_h, stride_w, dilation_h, dilation_w;
+  int pad_h, pad_w;  // top, left
+  int OH, OW;
+};
+
+Window window(const Op &op, int H, int W, int kh, int kw, bool ceil_mode) {
+  const OnnxNode &n = *op.node;
+  Window w = {kh, kw, 1, 1, 1, 1, 0, 0, 0, 0};
+  const Shape strides = n.get_ints("strides"), dilations = n.get_ints("dilations"), pads = n.get_ints("pads");
+  if (strides.size() == 2) {
+    w.stride_h = strides[0];
+    w.stride_w = strides[1];
+  }
+  if (dilations.size() == 2) {
+    w.dilation_h = dilations[0];
+    w.dilation_w = dilations[1];
+  }
+
+  const int ekh = w.dilation_h * (kh - 1) + 1, ekw = w.dilation_w * (kw - 1) + 1;
+  const std::string auto_pad = n.get_string("auto_pad", "NOTSET");
+  if (auto_pad == "SAME_UPPER" || auto_pad == "SAME_LOWER") {
+    w.OH = (H + w.stride_h - 1) / w.stride_h;
+    w.OW = (W + w.stride_w - 1) / w.stride_w;
+    const int pad_h = std::max(0, (w.OH - 1) * w.stride_h + ekh - H);
+    const int pad_w = std::max(0, (w.OW - 1) * w.stride_w + ekw - W);
+    w.pad_h = auto_pad == "SAME_UPPER" ? pad_h / 2 : (pad_h + 1) / 2;
+    w.pad_w = auto_pad == "SAME_UPPER" ? pad_w / 2 : (pad_w + 1) / 2;
+    return w;
+  }
+
+  int pad_h = 0, pad_w = 0;
+  if (auto_pad != "VALID" && pads.size() == 4) {
+    w.pad_h = pads[0];
+    w.pad_w = pads[1];
+    pad_h = pads[0] + pads[2];
+    pad_w = pads[1] + pads[3];
+  }
+  if (ceil_mode) {
+    w.OH = (H + pad_h - ekh + w.stride_h - 1) / w.stride_h + 1;
+    w.OW = (W + pad_w - ekw + w.stride_w - 1) / w.stride_w + 1;
+    // the last window has to start inside the image or the top/left padding
+    if ((w.OH - 1) * w.stride_h >= H + w.pad_h) w.OH--;
+    if ((w.OW - 1) * w.stride_w >= W + w.pad_w) w.OW--;
+  } else {
+    w.OH = (H + pad_h - ekh) / w.stride_h + 1;
+    w.OW = (W + pad_w - ekw) / w.stride_w + 1;
+  }
+  return w;
+}
+
+void op_conv(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0), &weight = e.in(op, 1);
+  check(x.shape.size() == 4 && weight.shape.size() == 4, op, "only 2D convolutions are supported");
+  const float *bias = e.has(op, 2) ? e.in(op, 2).f.data() : nullptr;
+
+  const Window w = window(op, x.shape[2], x.shape[3], weight.shape[2], weight.shape[3], false);
+  cpu::ConvParams p;
+  p.C = x.shape[1];
+  p.H = x.shape[2];
+  p.W = x.shape[3];
+  p.M = weight.shape[0];
+  p.OH = w.OH;
+  p.OW = w.OW;
+  p.kh = w.kh;
+  p.kw = w.kw;
+  p.stride_h = w.stride_h;
+  p.stride_w = w.stride_w;
+  p.pad_h = w.pad_h;
+  p.pad_w = w.pad_w;
+  p.dilation_h = w.dilation_h;
+  p.dilation_w = w.dilation_w;
+  p.group = op.node->get_int("group", 1);
+  check(p.C == weight.shape[1] * p.group, op, "input channels don't match the weights");
+
+  const int64_t N = x.shape[0];
+  Tensor &y = e.out(op, 0);
+  y.reshape({N, p.M, p.OH, p.OW}, false);
+  for (int64_t n = 0; n < N; n++) {
+    cpu::conv2d(e.pool, p, x.f.data() + n * p.C * p.H * p.W, weight.f.data(), bias,
+                y.f.data() + n * p.M * p.OH * p.OW, e.scratch);
+  }
+}
+
+void pool2d(OnnxExecutor &e, Op &op, bool is_max) {
+  const Tensor &x = e.in(op, 0);
+  check(x.shape.size() == 4, op, "only 2D pooling is supported");
+  const Shape kernel = op.node->get_ints("kernel_shape");
+  check(kernel.size() == 2, op, "expected a 2D kernel_shape");
+
+  const int H = x.shape[2], W = x.shape[3];
+  const Window w = window(op, H, W, kernel[0], kernel[1], op.node->get_int("ceil_mode", 0));
+  const bool count_include_pad = op.node->get_int("count_include_pad", 0);
+
+  const int64_t planes = x.shape[0] * x.shape[1];
+  Tensor &y = e.out(op, 0);
+  y.reshape({x.shape[0], x.shape[1], w.OH, w.OW}, false);
+  e.pool.parallel_for(planes, [&](int begin, int end) {
+    for (int c = begin; c < end; c++) {
+      const float *src = x.f.data() + (int64_t)c * H * W;
+      float *dst = y.f.data() + (int64_t)c * w.OH * w.OW;
+      for (int oy = 0; oy < w.OH; oy++) {
+        for (int ox = 0; ox < w.OW; ox++) {
+          float acc = is_max ? -INFINITY : 0.f;
+          int count = 0, padded_count = 0;
+          for (int ki = 0; ki < w.kh; ki++) {
+            const int iy = oy * w.stride_h - w.pad_h + ki * w.dilation_h;
+            for (int kj = 0; kj < w.kw; kj++) {
+              const int ix = ox * w.stride_w - w.pad_w + kj * w.dilation_w;
+              // windows can stick out past the bottom/right padding with ceil_mode
+              if (iy < H + w.pad_h && ix < W + w.pad_w) padded_count++;
+              if (iy < 0 || iy >= H || ix < 0 || ix >= W) continue;
+              const float v = src[iy * W + ix];
+              acc = is_max ? std::max(acc, v) : acc + v;
+              count++;
+            }
+          }
+          if (!is_max) acc /= std::max(1, count_include_pad ? padded_count : count);
+          dst[oy * w.OW + ox] = acc;
+        }
+      }
+    }
+  });
+}
+
+void op_max_pool(OnnxExecutor &e, Op &op) { pool2d(e, op, true); }
+void op_average_pool(OnnxExecutor &e, Op &op) { pool2d(e, op, false); }
+
+void global_pool(OnnxExecutor &e, Op &op, bool is_max) {
+  const Tensor &x = e.in(op, 0);
+  check(x.shape.size() >= 3, op, "expected an NC... tensor");
+  const int64_t planes = x.shape[0] * x.shape[1], spatial = product(x.shape, 2);
+  Shape shape(x.shape.size(), 1);
+  shape[0] = x.shape[0];
+  shape[1] = x.shape[1];
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, false);
+  for (int64_t c = 0; c < planes; c++) {
+    const float *src = x.f.data() + c * spatial;
+    float acc = is_max ? -INFINITY : 0.f;
+    for (int64_t k = 0; k < spatial; k++) acc = is_max ? std::max(acc, src[k]) : acc + src[k];
+    y.f[c] = is_max ? acc : acc / spatial;
+  }
+}
+
+void op_global_average_pool(OnnxExecutor &e, Op &op) { global_pool(e, op, false); }
+void op_global_max_pool(OnnxExecutor &e, Op &op) { global_pool(e, op, true); }
+
+void op_batch_norm(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0), &scale = e.in(op, 1), &bias = e.in(op, 2), &mean = e.in(op, 3), &var = e.in(op, 4);
+  const float eps = op.node->get_float("epsilon", 1e-5f);
+  const int64_t N = x.shape[0], C = x.shape.size() > 1 ? x.shape[1] : 1, spatial = product(x.shape, 2);
+  Tensor &y = e.out(op, 0);
+  y.reshape(x.shape, false);
+  for (int64_t n = 0; n < N; n++) {
+    for (int64_t c = 0; c < C; c++) {
+      const float a = scale.f[c] / sqrtf(var.f[c] + eps), b = bias.f[c] - mean.f[c] * a;
+      const float *src = x.f.data() + (n * C + c) * spatial;
+      float *dst = y.f.data() + (n * C + c) * spatial;
+      for (int64_t k = 0; k < spatial; k++) dst[k] = src[k] * a + b;
+    }
+  }
+}
+
+// matrix products
+
+void transpose_2d(const float *src, int rows, int cols, float *dst) {
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) dst[(int64_t)c * rows + r] = src[(int64_t)r * cols + c];
+  }
+}
+
+void op_gemm(OnnxExecutor &e, Op &op) {
+  const Tensor &a = e.in(op, 0), &b = e.in(op, 1);
+  check(a.shape.size() == 2 && b.shape.size() == 2, op, "expected 2D inputs");
+  const bool trans_a = op.node->get_int("transA", 0), trans_b = op.node->get_int("transB", 0);
+  const float alpha = op.node->get_float("alpha", 1.f), beta = op.node->get_float("beta", 1.f);
+
+  const int M = trans_a ? a.shape[1] : a.shape[0], K = trans_a ? a.shape[0] : a.shape[1];
+  const int N = trans_b ? b.shape[0] : b.shape[1];
+  check((trans_b ? b.shape[1] : b.shape[0]) == K, op, "inner dimensions don't match");
+
+  std::vector<float> a_t;
+  const float *pa = a.f.data();
+  if (trans_a) {
+    a_t.resize((size_t)M * K);
+    transpose_2d(a.f.data(), K, M, a_t.data());
+    pa = a_t.data();
+  }
+
+  const float *pb = b.f.data();
+  std::vector<float> b_t;
+  if (trans_b) {
+    // weights are usually constant, transpose them once
+    std::vector<float> &dst = e.is_const(op, 1) ? op.cache.f : b_t;
+    if (dst.size() != (size_t)K * N) {
+      dst.resize((size_t)K * N);
+      transpose_2d(b.f.data(), N, K, dst.data());
+    }
+    pb = dst.data();
+  }
+
+  Tensor &y = e.out(op, 0);
+  y.reshape({M, N}, false);
+  bool accumulate = false;
+  if (e.has(op, 2) && beta != 0.f) {
+    const Tensor &c = e.in(op, 2);
+    strided_copy(c.f.data(), 0, y.shape, broadcast_strides(c.shape, y.shape), y.f.data());
+    if (beta != 1.f) {
+      for (float &v : y.f) v *= beta;
+    }
+    accumulate = true;
+  }
+
+  if (alpha == 1.f) {
+    cpu::sgemm(e.pool, M, N, K, pa, K, pb, N, y.f.data(), N, accumulate);
+  } else {
+    std::vector<float> tmp((size_t)M * N);
+    cpu::sgemm(e.pool, M, N, K, pa, K, pb, N, tmp.data(), N, false);
+    for (size_t k = 0; k < tmp.size(); k++) y.f[k] = (accumulate ? y.f[k] : 0.f) + alpha * tmp[k];
+  }
+}
+
+void op_matmul(OnnxExecutor &e, Op &op) {
+  const Tensor &a = e.in(op, 0), &b = e.in(op, 1);
+  Shape sa = a.shape, sb = b.shape;
+  const bool a_vec = sa.size() == 1, b_vec = sb.size() == 1;
+  if (a_vec) sa.insert(sa.begin(), 1);
+  if (b_vec) sb.push_back(1);
+
+  const int M = sa[sa.size() - 2], K = sa.back(), N = sb.back();
+  check(sb[sb.size() - 2] == K, op, "inner dimensions don't match");
+
+  const Shape batch_a(sa.begin(), sa.end() - 2), batch_b(sb.begin(), sb.end() - 2);
+  const Shape batch = broadcast_shape(batch_a, batch_b);
+  Shape shape = batch;
+  if (!a_vec) shape.push_back(M);
+  if (!b_vec) shape.push_back(N);
+
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, false);
+
+  if (batch_b.empty() || product(batch_b) == 1) {
+    // all of the batch against the same matrix
+    cpu::sgemm(e.pool, product(batch_a) * M, N, K, a.f.data(), K, b.f.data(), N, y.f.data(), N, false);
+    return;
+  }
+
+  const Shape stride_a = broadcast_strides(batch_a, batch), stride_b = broadcast_strides(batch_b, batch);
+  const Shape idx_strides = strides_of(batch);
+  const int64_t count = product(batch);
+  for (int64_t k = 0; k < count; k++) {
+    int64_t oa = 0, ob = 0;
+    for (size_t d = 0; d < batch.size(); d++) {
+      const int64_t i = (k / idx_strides[d]) % batch[d];
+      oa += i * stride_a[d];
+      ob += i * stride_b[d];
+    }
+    cpu::sgemm(e.pool, M, N, K, a.f.data() + oa * M * K, K, b.f.data() + ob * K * N, N,
+               y.f.data() + k * M * N, N, false);
+  }
+}
+
+// shapes and data movement
+
+void op_identity(OnnxExecutor &e, Op &op) {
+  copy_tensor(e.in(op, 0), e.out(op, 0), e.in(op, 0).shape);
+}
+
+void op_reshape(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Shape shape = e.has(op, 1) ? ints_input(e, op, 1) : op.node->get_ints("shape");
+  const bool allow_zero = op.node->get_int("allowzero", 0);
+
+  int infer = -1;
+  int64_t known = 1;
+  for (size_t d = 0; d < shape.size(); d++) {
+    if (shape[d] == 0 && !allow_zero) shape[d] = x.shape[d];
+    if (shape[d] == -1) {
+      infer = d;
+    } else {
+      known *= shape[d];
+    }
+  }
+  if (infer >= 0) shape[infer] = known == 0 ? 0 : x.size() / known;
+  check(product(shape) == (int64_t)x.size(), op, "reshape changes the number of elements");
+  copy_tensor(x, e.out(op, 0), shape);
+}
+
+void op_flatten(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  const int64_t axis = norm_axis(op.node->get_int("axis", 1), x.shape.size());
+  copy_tensor(x, e.out(op, 0), {product(x.shape, 0, axis), product(x.shape, axis)});
+}
+
+Shape axes_of(OnnxExecutor &e, Op &op, size_t input) {
+  return e.has(op, input) ? ints_input(e, op, input) : op.node->get_ints("axes");
+}
+
+void op_squeeze(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Shape axes = axes_of(e, op, 1);
+  for (auto &a : axes) a = norm_axis(a, x.shape.size());
+
+  Shape shape;
+  for (size_t d = 0; d < x.shape.size(); d++) {
+    const bool squeeze = axes.empty() ? x.shape[d] == 1 : std::find(axes.begin(), axes.end(), d) != axes.end();
+    if (!squeeze) shape.push_back(x.shape[d]);
+  }
+  copy_tensor(x, e.out(op, 0), shape);
+}
+
+void op_unsqueeze(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Shape axes = axes_of(e, op, 1);
+  const size_t rank = x.shape.size() + axes.size();
+  for (auto &a : axes) a = norm_axis(a, rank);
+
+  Shape shape;
+  size_t src = 0;
+  for (size_t d = 0; d < rank; d++) {
+    if (std::find(axes.begin(), axes.end(), d) != axes.end()) {
+      shape.push_back(1);
+    } else {
+      shape.push_back(x.shape[src++]);
+    }
+  }
+  copy_tensor(x, e.out(op, 0), shape);
+}
+
+template <typename T>
+void transpose(const Tensor &x, const Shape &perm, Tensor &y) {
+  const Shape in_strides = strides_of(x.shape);
+  Shape shape(perm.size()), strides(perm.size());
+  for (size_t d = 0; d < perm.size(); d++) {
+    shape[d] = x.shape[perm[d]];
+    strides[d] = in_strides[perm[d]];
+  }
+  y.reshape(shape, x.is_int);
+  strided_copy(data<T>(x).data(), 0, shape, strides, data<T>(y).data());
+}
+
+void op_transpose(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Shape perm = op.node->get_ints("perm");
+  if (perm.empty()) {
+    for (int d = x.shape.size() - 1; d >= 0; d--) perm.push_back(d);
+  }
+  if (x.is_int) {
+    transpose<int64_t>(x, perm, e.out(op, 0));
+  } else {
+    transpose<float>(x, perm, e.out(op, 0));
+  }
+}
+
+template <typename T>
+void concat(OnnxExecutor &e, Op &op, int64_t axis, Tensor &y) {
+  const int64_t outer = product(y.shape, 0, axis);
+  T *dst = data<T>(y).data();
+  for (int64_t o = 0; o < outer; o++) {
+    for (size_t k = 0; k < op.in.size(); k++) {
+      const Tensor &x = e.in(op, k);
+      const int64_t chunk = product(x.shape, axis);
+      const T *src = data<T>(x).data() + o * chunk;
+      dst = std::copy(src, src + chunk, dst);
+    }
+  }
+}
+
+void op_concat(OnnxExecutor &e, Op &op) {
+  const Tensor &first = e.in(op, 0);
+  const int64_t axis = norm_axis(op.node->get_int("axis", 0), first.shape.size());
+  Shape shape = first.shape;
+  shape[axis] = 0;
+  for (size_t k = 0; k < op.in.size(); k++) {
+    check(e.in(op, k).is_int == first.is_int, op, "mixed integer and float inputs");
+    shape[axis] += e.in(op, k).shape[axis];
+  }
+
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, first.is_int);
+  if (first.is_int) {
+    concat<int64_t>(e, op, axis, y);
+  } else {
+    concat<float>(e, op, axis, y);
+  }
+}
+
+void copy_region(const Tensor &x, int64_t base, const Shape &shape, const Shape &strides, Tensor &y) {
+  y.reshape(shape, x.is_int);
+  if (x.is_int) {
+    strided_copy(x.i.data(), base, shape, strides, y.i.data());
+  } else {
+    strided_copy(x.f.data(), base, shape, strides, y.f.data());
+  }
+}
+
+void op_slice(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Shape starts, ends, axes, steps;
+  if (e.graph->opset >= 10) {
+    starts = ints_input(e, op, 1);
+    ends = ints_input(e, op, 2);
+    if (e.has(op, 3)) axes = ints_input(e, op, 3);
+    if (e.has(op, 4)) steps = ints_input(e, op, 4);
+  } else {
+    starts = op.node->get_ints("starts");
+    ends = op.node->get_ints("ends");
+    axes = op.node->get_ints("axes");
+  }
+  if (axes.empty()) {
+    for (size_t d = 0; d < starts.size(); d++) axes.push_back(d);
+  }
+  if (steps.empty()) steps.assign(starts.size(), 1);
+
+  Shape shape = x.shape, strides = strides_of(x.shape);
+  int64_t base = 0;
+  for (size_t k = 0; k < axes.size(); k++) {
+    const int64_t a = norm_axis(axes[k], x.shape.size()), dim = x.shape[a], step = steps[k];
+    check(step != 0, op, "zero step");
+    int64_t start = starts[k] < 0 ? starts[k] + dim : starts[k];
+    int64_t end = ends[k] < 0 ? ends[k] + dim : ends[k];
+    int64_t count;
+    if (step > 0) {
+      start = std::clamp<int64_t>(start, 0, dim);
+      end = std::clamp<int64_t>(end, 0, dim);
+      count = std::max<int64_t>(0, (end - start + step - 1) / step);
+    } else {
+      start = std::clamp<int64_t>(start, 0, dim - 1);
+      end = std::clamp<int64_t>(end, -1, dim - 1);
+      count = std::max<int64_t>(0, (start - end - step - 1) / -step);
+    }
+    base += start * strides[a];
+    strides[a] *= step;
+    shape[a] = count;
+  }
+  copy_region(x, base, shape, strides, e.out(op, 0));
+}
+
+void op_split(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  const int64_t axis = norm_axis(op.node->get_int("axis", 0), x.shape.size());
+  Shape split = e.has(op, 1) ? ints_input(e, op, 1) : op.node->get_ints("split");
+  if (split.empty()) {
+    split.assign(op.out.size(), x.shape[axis] / op.out.size());
+  }
+  check(split.size() == op.out.size(), op, "split sizes don't match the outputs");
+
+  const Shape strides = strides_of(x.shape);
+  int64_t offset = 0;
+  for (size_t k = 0; k < op.out.size(); k++) {
+    Shape shape = x.shape;
+    shape[axis] = split[k];
+    copy_region(x, offset * strides[axis], shape, strides, e.out(op, k));
+    offset += split[k];
+  }
+}
+
+template <typename T>
+void gather(const Tensor &x, const Tensor &indices, int64_t axis, Tensor &y) {
+  const int64_t outer = product(x.shape, 0, axis), inner = product(x.shape, axis + 1), dim = x.shape[axis];
+  const T *src = data<T>(x).data();
+  T *dst = data<T>(y).data();
+  for (int64_t o = 0; o < outer; o++) {
+    for (int64_t idx : indices.i) {
+      if (idx < 0) idx += dim;
+      const T *s = src + (o * dim + idx) * inner;
+      dst = std::copy(s, s + inner, dst);
+    }
+  }
+}
+
+void op_gather(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0), &indices = e.in(op, 1);
+  check(indices.is_int, op, "expected integer indices");
+  const int64_t axis = norm_axis(op.node->get_int("axis", 0), x.shape.size());
+
+  Shape shape(x.shape.begin(), x.shape.begin() + axis);
+  shape.insert(shape.end(), indices.shape.begin(), indices.shape.end());
+  shape.insert(shape.end(), x.shape.begin() + axis + 1, x.shape.end());
+
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, x.is_int);
+  if (x.is_int) {
+    gather<int64_t>(x, indices, axis, y);
+  } else {
+    gather<float>(x, indices, axis, y);
+  }
+}
+
+void op_shape(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  Tensor &y = e.out(op, 0);
+  y.reshape({(int64_t)x.shape.size()}, true);
+  y.i = x.shape;
+}
+
+void op_constant(OnnxExecutor &e, Op &op) {
+  const OnnxNode &n = *op.node;
+  Tensor &y = e.out(op, 0);
+  if (n.has("value")) {
+    y = n.attrs.at("value").t;
+  } else if (n.has("value_float")) {
+    y.reshape({}, false);
+    y.f[0] = n.attrs.at("value_float").f;
+  } else if (n.has("value_floats")) {
+    y.shape = {(int64_t)n.attrs.at("value_floats").floats.size()};
+    y.is_int = false;
+    y.f = n.attrs.at("value_floats").floats;
+  } else if (n.has("value_int")) {
+    y.reshape({}, true);
+    y.i[0] = n.attrs.at("value_int").i;
+  } else if (n.has("value_ints")) {
+    y.shape = {(int64_t)n.attrs.at("value_ints").ints.size()};
+    y.is_int = true;
+    y.i = n.attrs.at("value_ints").ints;
+  } else {
+    check(false, op, "unsupported constant");
+  }
+}
+
+void op_constant_of_shape(OnnxExecutor &e, Op &op) {
+  const Shape shape = ints_input(e, op, 0);
+  Tensor &y = e.out(op, 0);
+  if (op.node->has("value")) {
+    const Tensor &v = op.node->attrs.at("value").t;
+    y.reshape(shape, v.is_int);
+    if (v.is_int) {
+      std::fill(y.i.begin(), y.i.end(), v.i[0]);
+    } else {
+      std::fill(y.f.begin(), y.f.end(), v.f[0]);
+    }
+  } else {
+    y.reshape(shape, false);
+    std::fill(y.f.begin(), y.f.end(), 0.f);
+  }
+}
+
+void op_cast(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  const int64_t to = op.node->get_int("to", 1);
+  const bool to_float = to == 1 || to == 10 || to == 11;
+  Tensor &y = e.out(op, 0);
+  y.reshape(x.shape, !to_float);
+  if (to_float) {
+    if (x.is_int) {
+      std::copy(x.i.begin(), x.i.end(), y.f.begin());
+    } else {
+      y.f = x.f;
+    }
+  } else if (to == 9) {
+    for (size_t k = 0; k < y.i.size(); k++) y.i[k] = x.is_int ? x.i[k] != 0 : x.f[k] != 0.f;
+  } else if (x.is_int) {
+    y.i = x.i;
+  } else {
+    for (size_t k = 0; k < y.i.size(); k++) y.i[k] = (int64_t)x.f[k];
+  }
+}
+
+void op_pad(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  check(!x.is_int, op, "expected a float tensor");
+  const Shape pads = e.has(op, 1) ? ints_input(e, op, 1) : op.node->get_ints("pads");
+  const float value = e.has(op, 2) ? e.in(op, 2).f[0] : op.node->get_float("value", 0.f);
+  const std::string mode = op.node->get_string("mode", "constant");
+  const size_t rank = x.shape.size();
+  check(pads.size() == 2 * rank, op, "expected begin and end pads for every axis");
+
+  Shape shape(rank);
+  for (size_t d = 0; d < rank; d++) shape[d] = x.shape[d] + pads[d] + pads[d + rank];
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, false);
+  if (y.size() == 0) return;
+
+  // maps an output coordinate to the input, -1 when it's padding
+  auto source = [&](size_t d, int64_t o) -> int64_t {
+    int64_t i = o - pads[d];
+    const int64_t dim = x.shape[d];
+    if (i >= 0 && i < dim) return i;
+    if (mode == "edge") return std::clamp<int64_t>(i, 0, dim - 1);
+    if (mode == "reflect" && dim > 1) {
+      const int64_t period = 2 * (dim - 1);
+      i = ((i % period) + period) % period;
+      return i < dim ? i : period - i;
+    }
+    return -1;
+  };
+
+  const Shape in_strides = strides_of(x.shape);
+  const int64_t inner = shape[rank - 1];
+  std::vector<int64_t> inner_src(inner);
+  for (int64_t o = 0; o < inner; o++) inner_src[o] = source(rank - 1, o);
+
+  Shape idx(rank, 0);
+  for (int64_t k = 0; k < (int64_t)y.size(); k += inner) {
+    int64_t base = 0;
+    bool pad_row = false;
+    for (size_t d = 0; d + 1 < rank; d++) {
+      const int64_t i = source(d, idx[d]);
+      if (i < 0) pad_row = true;
+      base += i * in_strides[d];
+    }
+    float *dst = y.f.data() + k;
+    for (int64_t o = 0; o < inner; o++) {
+      dst[o] = (pad_row || inner_src[o] < 0) ? value : x.f[base + inner_src[o]];
+    }
+    for (int d = rank - 2; d >= 0; d--) {
+      if (++idx[d] < shape[d]) break;
+      idx[d] = 0;
+    }
+  }
+}
+
+void op_softmax(OnnxExecutor &e, Op &op) {
+  const Tensor &x = e.in(op, 0);
+  const bool legacy = e.graph->opset < 13;
+  const int64_t axis = norm_axis(op.node->get_int("axis", legacy ? 1 : -1), x.shape.size());
+  // before opset 13 the input is flattened to 2D at the axis
+  const int64_t outer = product(x.shape, 0, axis);
+  const int64_t dim = legacy ? product(x.shape, axis) : x.shape[axis];
+  const int64_t inner = legacy ? 1 : product(x.shape, axis + 1);
+
+  Tensor &y = e.out(op, 0);
+  y.reshape(x.shape, false);
+  for (int64_t o = 0; o < outer; o++) {
+    for (int64_t i = 0; i < inner; i++) {
+      const float *src = x.f.data() + o * dim * inner + i;
+      float *dst = y.f.data() + o * dim * inner + i;
+      float max_val = -INFINITY;
+      for (int64_t k = 0; k < dim; k++) max_val = std::max(max_val, src[k * inner]);
+      float sum = 0.f;
+      for (int64_t k = 0; k < dim; k++) {
+        dst[k * inner] = expf(src[k * inner] - max_val);
+        sum += dst[k * inner];
+      }
+      for (int64_t k = 0; k < dim; k++) dst[k * inner] /= sum;
+    }
+  }
+}
+
+enum ReduceType { REDUCE_SUM, REDUCE_MEAN, REDUCE_MAX, REDUCE_MIN };
+
+void reduce(OnnxExecutor &e, Op &op, ReduceType type) {
+  const Tensor &x = e.in(op, 0);
+  check(!x.is_int, op, "expected a float tensor");
+  const size_t rank = x.shape.size();
+  Shape axes = axes_of(e, op, 1);
+  const bool keepdims = op.node->get_int("keepdims", 1);
+  if (axes.empty() && op.node->get_int("noop_with_empty_axes", 0)) {
+    copy_tensor(x, e.out(op, 0), x.shape);
+    return;
+  }
+
+  std::vector<bool> reduced(rank, axes.empty());
+  for (int64_t a : axes) reduced[norm_axis(a, rank)] = true;
+
+  Shape kept(rank), shape;
+  int64_t count = 1;
+  for (size_t d = 0; d < rank; d++) {
+    kept[d] = reduced[d] ? 1 : x.shape[d];
+    if (reduced[d]) count *= x.shape[d];
+    if (!reduced[d] || keepdims) shape.push_back(kept[d]);
+  }
+
+  Tensor &y = e.out(op, 0);
+  y.reshape(shape, false);
+  const float init = type == REDUCE_MAX ? -INFINITY : (type == REDUCE_MIN ? INFINITY : 0.f);
+  std::fill(y.f.begin(), y.f.end(), init);
+
+  // output offset of every input element, 0 stride along reduced axes
+  const Shape out_strides = broadcast_strides(kept, x.shape);
+  Shape idx(rank, 0);
+  int64_t off = 0;
+  for (size_t k = 0; k < x.size(); k++) {
+    float &acc = y.f[off];
+    const float v = x.f[k];
+    acc = type == REDUCE_MAX ? std::max(acc, v) : (type == REDUCE_MIN ? std::min(acc, v) : acc + v);
+    for (int d = rank - 1; d >= 0; d--) {
+      off += out_strides[d];
+      if (++idx[d] < x.shape[d]) break;
+      off -= out_strides[d] * x.shape[d];
+      idx[d] = 0;
+    }
+  }
+  if (type == REDUCE_MEAN) {
+    for (float &v : y.f) v /= count;
+  }
+}
+
+void op_reduce_sum(OnnxExecutor &e, Op &op) { reduce(e, op, REDUCE_SUM); }
+void op_reduce_mean(OnnxExecutor &e, Op &op) { reduce(e, op, REDUCE_MEAN); }
+void op_reduce_max(OnnxExecutor &e, Op &op) { reduce(e, op, REDUCE_MAX); }
+void op_reduce_min(OnnxExecutor &e, Op &op) { reduce(e, op, REDUCE_MIN); }
+
+const std::map<std::string, OnnxExecutor::OpFn> op_table = {
+  {"Abs", op_abs},
+  {"Add", op_add},
+  {"AveragePool", op_average_pool},
+  {"BatchNormalization", op_batch_norm},
+  {"Cast", op_cast},
+  {"Ceil", op_ceil},
+  {"Clip", op_clip},
+  {"Concat", op_concat},
+  {"Constant", op_constant},
+  {"ConstantOfShape", op_constant_of_shape},
+  {"Conv", op_conv},
+  {"Div", op_div},
+  {"Dropout", op_identity},
+  {"Elu", op_elu},
+  {"Erf", op_erf},
+  {"Exp", op_exp},
+  {"Flatten", op_flatten},
+  {"Floor", op_floor},
+  {"Gather", op_gather},
+  {"Gemm", op_gemm},
+  {"GlobalAveragePool", op_global_average_pool},
+  {"GlobalMaxPool", op_global_max_pool},
+  {"HardSigmoid", op_hard_sigmoid},
+  {"HardSwish", op_hard_swish},
+  {"Identity", op_identity},
+  {"LeakyRelu", op_leaky_relu},
+  {"Log", op_log},
+  {"MatMul", op_matmul},
+  {"Max", op_max},
+  {"MaxPool", op_max_pool},
+  {"Min", op_min},
+  {"Mul", op_mul},
+  {"Neg", op_neg},
+  {"Pad", op_pad},
+  {"Pow", op_pow},
+  {"Reciprocal", op_reciprocal},
+  {"ReduceMax", op_reduce_max},
+  {"ReduceMean", op_reduce_mean},
+  {"ReduceMin", op_reduce_min},
+  {"ReduceSum", op_reduce_sum},
+  {"Relu", op_relu},
+  {"Reshape", op_reshape},
+  {"Shape", op_shape},
+  {"Sigmoid", op_sigmoid},
+  {"Slice", op_slice},
+  {"Softmax", op_softmax},
+  {"Softplus", op_softplus},
+  {"Split", op_split},
+  {"Sqrt", op_sqrt},
+  {"Squeeze", op_squeeze},
+  {"Sub", op_sub},
+  {"Sum", op_sum},
+  {"Tanh", op_tanh},
+  {"Transpose", op_transpose},
+  {"Unsqueeze", op_unsqueeze},
+};
+
+}  // namespace
+
+OnnxExecutor::OnnxExecutor(std::shared_ptr<const OnnxGraph> g, int num_threads) : graph(g), pool(num_threads) {
+  for (auto &[name, t] : graph->initializers) {
+    consts[id(name)] = &t;
+  }
+
+  for (auto &v : graph->inputs) {
+    Tensor &t = values[id(v.name)];
+    Shape shape = v.shape;
+    // symbolic dimensions are the batch size
+    for (auto &d : shape) d = std::max<int64_t>(d, 1);
+    t.reshape(shape, false);
+  }
+
+  bool supported = true;
+  for (auto &n : graph->nodes) {
+    auto it = op_table.find(n.op_type);
+    if (it == op_table.end()) {
+      fprintf(stderr, "onnx: unsupported op %s (%s)\n", n.op_type.c_str(), n.name.c_str());
+      supported = false;
+      continue;
+    }
+
+    Op op = {&n, it->second};
+    for (auto &name : n.inputs) op.in.push_back(name.empty() ? -1 : id(name));
+    for (auto &name : n.outputs) op.out.push_back(id(name));
+    ops.push_back(std::move(op));
+  }
+  assert(supported);
+
+  for (auto &v : graph->outputs) {
+    output_ids.push_back(id(v.name));
+  }
+}
+
+int OnnxExecutor::id(const std::string &name) {
+  auto it = ids.find(name);
+  if (it != ids.end()) return it->second;
+
+  const int ret = values.size();
+  ids[name] = ret;
+  values.emplace_back();
+  consts.push_back(nullptr);
+  return ret;
+}
+
+Tensor &OnnxExecutor::input(const std::string &name) {
+  return values[ids.at(name)];
+}
+
+void OnnxExecutor::run() {
+  for (auto &op : ops) {
+    op.fn(*this, op);
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "selfdrive/modeld/runners/cpukernels.h"
+#include "selfdrive/modeld/runners/onnxgraph.h"
+
+// Runs an OnnxGraph on the CPU. The graph holds the weights and can be shared
+// by several executors, each has its own activations and threads.
+class OnnxExecutor {
+public:
+  OnnxExecutor(std::shared_ptr<const OnnxGraph> graph, int num_threads);
+
+  // set the graph inputs before run(), the shape comes from the graph
+  Tensor &input(const std::string &name);
+  void run();
+  const Tensor &output(int idx) const { return value(output_ids[idx]); }
+
+  struct Op;
+  typedef void (*OpFn)(OnnxExecutor &e, Op &op);
+  struct Op {
+    const OnnxNode *node;
+    OpFn fn;
+    std::vector<int> in, out;  // -1 for missing optional inputs
+    Tensor cache;               // op specific preprocessed weights
+  };
+
+  const Tensor &value(int id) const { return consts[id] ? *consts[id] : values[id]; }
+  bool has(const Op &op, size_t idx) const { return idx < op.in.size() && op.in[idx] >= 0; }
+  const Tensor &in(const Op &op, size_t idx) const { return value(op.in[idx]); }
+  bool is_const(const Op &op, size_t idx) const { return has(op, idx) && consts[op.in[idx]] != nullptr; }
+  Tensor &out(const Op &op, size_t idx) { return values[op.out[idx]]; }
+
+  std::shared_ptr<const OnnxGraph> graph;
+  cpu::ThreadPool pool;
+  std::vector<float> scratch;
+
+private:
+  int id(const std::string &name);
+
+  std::vector<Op> ops;
+  std::map<std::string, int> ids;
+  std::vector<Tensor> values;
+  std::vector<const Tensor *> consts;
+  std::vector<int> output_ids;
+};
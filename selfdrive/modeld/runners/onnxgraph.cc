@@ -0,0 +1,350 @@
+#include "selfdrive/modeld/runners/onnxgraph.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+enum WireType {
+  WIRE_VARINT = 0,
+  WIRE_FIXED64 = 1,
+  WIRE_BYTES = 2,
+  WIRE_FIXED32 = 5,
+};
+
+enum DataType {
+  FLOAT = 1,
+  UINT8 = 2,
+  INT8 = 3,
+  UINT16 = 4,
+  INT16 = 5,
+  INT32 = 6,
+  INT64 = 7,
+  BOOL = 9,
+  DOUBLE = 11,
+};
+
+class PbReader {
+public:
+  PbReader(const char *data, size_t len) : p((const uint8_t *)data), end((const uint8_t *)data + len) {}
+  PbReader(const std::string &s) : PbReader(s.data(), s.size()) {}
+
+  bool ok = true;
+
+  bool next(int &field, int &wire) {
+    if (!ok || p >= end) return false;
+    const uint64_t key = varint();
+    field = key >> 3;
+    wire = key & 7;
+    return ok;
+  }
+
+  uint64_t varint() {
+    uint64_t ret = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) break;
+      const uint8_t b = *p++;
+      ret |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) return ret;
+    }
+    ok = false;
+    return 0;
+  }
+
+  uint32_t fixed32() {
+    uint32_t ret = 0;
+    if (end - p < 4) {
+      ok = false;
+      return 0;
+    }
+    memcpy(&ret, p, 4);
+    p += 4;
+    return ret;
+  }
+
+  uint64_t fixed64() {
+    uint64_t ret = 0;
+    if (end - p < 8) {
+      ok = false;
+      return 0;
+    }
+    memcpy(&ret, p, 8);
+    p += 8;
+    return ret;
+  }
+
+  PbReader bytes() {
+    const uint64_t len = varint();
+    if (!ok || len > uint64_t(end - p)) {
+      ok = false;
+      return PbReader(nullptr, 0);
+    }
+    PbReader ret((const char *)p, len);
+    p += len;
+    return ret;
+  }
+
+  std::string string() {
+    PbReader b = bytes();
+    return std::string((const char *)b.p, b.end - b.p);
+  }
+
+  void skip(int wire) {
+    switch (wire) {
+      case WIRE_VARINT: varint(); break;
+      case WIRE_FIXED64: fixed64(); break;
+      case WIRE_BYTES: bytes(); break;
+      case WIRE_FIXED32: fixed32(); break;
+      default: ok = false;
+    }
+  }
+
+  // repeated scalars can be packed or one per field
+  template <typename F>
+  void repeated(int wire, F read) {
+    if (wire == WIRE_BYTES) {
+      PbReader packed = bytes();
+      while (packed.ok && packed.p < packed.end) read(packed);
+      ok = ok && packed.ok;
+    } else {
+      read(*this);
+    }
+  }
+
+  const uint8_t *p, *end;
+};
+
+float read_float(PbReader &r) {
+  const uint32_t v = r.fixed32();
+  float f;
+  memcpy(&f, &v, sizeof(f));
+  return f;
+}
+
+double read_double(PbReader &r) {
+  const uint64_t v = r.fixed64();
+  double d;
+  memcpy(&d, &v, sizeof(d));
+  return d;
+}
+
+bool is_int_type(int64_t data_type) {
+  return data_type == UINT8 || data_type == INT8 || data_type == UINT16 || data_type == INT16 ||
+         data_type == INT32 || data_type == INT64 || data_type == BOOL;
+}
+
+template <typename T>
+void raw_to(const std::string &raw, std::vector<int64_t> &out) {
+  out.resize(raw.size() / sizeof(T));
+  for (size_t i = 0; i < out.size(); i++) {
+    T v;
+    memcpy(&v, raw.data() + i * sizeof(T), sizeof(T));
+    out[i] = v;
+  }
+}
+
+bool parse_tensor(PbReader r, Tensor &t, std::string *name) {
+  int64_t data_type = FLOAT;
+  std::string raw;
+  std::vector<double> doubles;
+  int field, wire;
+  while (r.next(field, wire)) {
+    switch (field) {
+      case 1: r.repeated(wire, [&](PbReader &v) { t.shape.push_back(v.varint()); }); break;
+      case 2: data_type = r.varint(); break;
+      case 4: r.repeated(wire, [&](PbReader &v) { t.f.push_back(read_float(v)); }); break;
+      case 5: r.repeated(wire, [&](PbReader &v) { t.i.push_back((int32_t)v.varint()); }); break;
+      case 7: r.repeated(wire, [&](PbReader &v) { t.i.push_back((int64_t)v.varint()); }); break;
+      case 8: if (name) *name = r.string(); else r.skip(wire); break;
+      case 9: raw = r.string(); break;
+      case 10: r.repeated(wire, [&](PbReader &v) { doubles.push_back(read_double(v)); }); break;
+      case 14:
+        if (r.varint() != 0) {
+          printf("onnx: tensors with external data are not supported\n");
+          return false;
+        }
+        break;
+      default: r.skip(wire);
+    }
+  }
+  if (!r.ok) return false;
+
+  t.is_int = is_int_type(data_type);
+  if (data_type == FLOAT) {
+    if (!raw.empty()) {
+      t.f.resize(raw.size() / sizeof(float));
+      memcpy(t.f.data(), raw.data(), t.f.size() * sizeof(float));
+    }
+  } else if (data_type == DOUBLE) {
+    if (!raw.empty()) {
+      doubles.resize(raw.size() / sizeof(double));
+      memcpy(doubles.data(), raw.data(), doubles.size() * sizeof(double));
+    }
+    t.f.assign(doubles.begin(), doubles.end());
+  } else if (t.is_int) {
+    if (!raw.empty()) {
+      switch (data_type) {
+        case INT64: raw_to<int64_t>(raw, t.i); break;
+        case INT32: raw_to<int32_t>(raw, t.i); break;
+        case INT16: raw_to<int16_t>(raw, t.i); break;
+        case UINT16: raw_to<uint16_t>(raw, t.i); break;
+        case INT8: raw_to<int8_t>(raw, t.i); break;
+        default: raw_to<uint8_t>(raw, t.i); break;
+      }
+    }
+  } else {
+    printf("onnx: unsupported tensor data type %d\n", (int)data_type);
+    return false;
+  }
+
+  if (t.size() != (t.is_int ? t.i.size() : t.f.size())) {
+    printf("onnx: tensor %s has %zu values for %zu elements\n", name ? name->c_str() : "",
+           t.is_int ? t.i.size() : t.f.size(), t.size());
+    return false;
+  }
+  return true;
+}
+
+bool parse_attribute(PbReader r, std::string &name, OnnxAttribute &a) {
+  int field, wire;
+  while (r.next(field, wire)) {
+    switch (field) {
+      case 1: name = r.string(); break;
+      case 2: a.f = read_float(r); break;
+      case 3: a.i = (int64_t)r.varint(); break;
+      case 4: a.s = r.string(); break;
+      case 5: if (!parse_tensor(r.bytes(), a.t, nullptr)) return false; break;
+      case 7: r.repeated(wire, [&](PbReader &v) { a.floats.push_back(read_float(v)); }); break;
+      case 8: r.repeated(wire, [&](PbReader &v) { a.ints.push_back((int64_t)v.varint()); }); break;
+      default: r.skip(wire);
+    }
+  }
+  return r.ok;
+}
+
+bool parse_node(PbReader r, OnnxNode &n) {
+  int field, wire;
+  while (r.next(field, wire)) {
+    switch (field) {
+      case 1: n.inputs.push_back(r.string()); break;
+      case 2: n.outputs.push_back(r.string()); break;
+      case 3: n.name = r.string(); break;
+      case 4: n.op_type = r.string(); break;
+      case 5: {
+        std::string name;
+        OnnxAttribute a;
+        if (!parse_attribute(r.bytes(), name, a)) return false;
+        n.attrs[name] = std::move(a);
+        break;
+      }
+      default: r.skip(wire);
+    }
+  }
+  return r.ok;
+}
+
+bool parse_value_info(PbReader r, OnnxValueInfo &v) {
+  int field, wire;
+  while (r.next(field, wire)) {
+    if (field == 1) {
+      v.name = r.string();
+    } else if (field == 2) {
+      // TypeProto.tensor_type.shape.dim.dim_value
+      PbReader type = r.bytes();
+      while (type.next(field, wire)) {
+        if (field != 1) { type.skip(wire); continue; }
+        PbReader tensor = type.bytes();
+        while (tensor.next(field, wire)) {
+          if (field != 2) { tensor.skip(wire); continue; }
+          PbReader shape = tensor.bytes();
+          while (shape.next(field, wire)) {
+            if (field != 1) { shape.skip(wire); continue; }
+            PbReader dim = shape.bytes();
+            int64_t dim_value = 0;
+            while (dim.next(field, wire)) {
+              if (field == 1) {
+                dim_value = dim.varint();
+              } else {
+                dim.skip(wire);
+              }
+            }
+            v.shape.push_back(dim_value);
+          }
+        }
+      }
+    } else {
+      r.skip(wire);
+    }
+  }
+  return r.ok;
+}
+
+bool parse_graph(PbReader r, OnnxGraph &g) {
+  std::vector<OnnxValueInfo> inputs;
+  int field, wire;
+  while (r.next(field, wire)) {
+    switch (field) {
+      case 1: {
+        g.nodes.emplace_back();
+        if (!parse_node(r.bytes(), g.nodes.back())) return false;
+        break;
+      }
+      case 5: {
+        std::string name;
+        Tensor t;
+        if (!parse_tensor(r.bytes(), t, &name)) return false;
+        g.initializers[name] = std::move(t);
+        break;
+      }
+      case 11: {
+        inputs.emplace_back();
+        if (!parse_value_info(r.bytes(), inputs.back())) return false;
+        break;
+      }
+      case 12: {
+        g.outputs.emplace_back();
+        if (!parse_value_info(r.bytes(), g.outputs.back())) return false;
+        break;
+      }
+      default: r.skip(wire);
+    }
+  }
+
+  // older exporters list the weights as inputs too
+  for (auto &v : inputs) {
+    if (g.initializers.count(v.name) == 0) g.inputs.push_back(v);
+  }
+  return r.ok;
+}
+
+}  // namespace
+
+bool OnnxGraph::load(const std::string &data) {
+  PbReader r(data);
+  bool has_graph = false;
+  int field, wire;
+  while (r.next(field, wire)) {
+    if (field == 7) {
+      if (!parse_graph(r.bytes(), *this)) return false;
+      has_graph = true;
+    } else if (field == 8) {
+      // OperatorSetIdProto, the default domain is empty
+      PbReader op_set = r.bytes();
+      std::string domain;
+      int64_t version = 0;
+      while (op_set.next(field, wire)) {
+        if (field == 1) {
+          domain = op_set.string();
+        } else if (field == 2) {
+          version = op_set.varint();
+        } else {
+          op_set.skip(wire);
+        }
+      }
+      if (domain.empty() || domain == "ai.onnx") opset = version;
+    } else {
+      r.skip(wire);
+    }
+  }
+  return r.ok && has_graph;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Tensors are either float or integer, integer types are widened to int64.
+struct Tensor {
+  std::vector<int64_t> shape;
+  bool is_int = false;
+  std::vector<float> f;
+  std::vector<int64_t> i;
+
+  size_t size() const {
+    size_t n = 1;
+    for (int64_t d : shape) n *= d;
+    return n;
+  }
+  void reshape(const std::vector<int64_t> &s, bool integer) {
+    shape = s;
+    is_int = integer;
+    if (integer) {
+      i.resize(size());
+    } else {
+      f.resize(size());
+    }
+  }
+};
+
+struct OnnxAttribute {
+  float f = 0;
+  int64_t i = 0;
+  std::string s;
+  std::vector<float> floats;
+  std::vector<int64_t> ints;
+  Tensor t;
+};
+
+struct OnnxNode {
+  std::string name, op_type;
+  std::vector<std::string> inputs, outputs;
+  std::map<std::string, OnnxAttribute> attrs;
+
+  bool has(const std::string &attr) const { return attrs.count(attr) > 0; }
+  int64_t get_int(const std::string &attr, int64_t def) const { return has(attr) ? attrs.at(attr).i : def; }
+  float get_float(const std::string &attr, float def) const { return has(attr) ? attrs.at(attr).f : def; }
+  std::string get_string(const std::string &attr, const std::string &def) const { return has(attr) ? attrs.at(attr).s : def; }
+  std::vector<int64_t> get_ints(const std::string &attr) const { return has(attr) ? attrs.at(attr).ints : std::vector<int64_t>(); }
+};
+
+struct OnnxValueInfo {
+  std::string name;
+  std::vector<int64_t> shape;  // symbolic dimensions are 0
+};
+
+// The parts of an ONNX ModelProto needed to run it. Reads the protobuf wire format
+// directly, so there is no dependency on protobuf or onnx.
+struct OnnxGraph {
+  int64_t opset = 0;
+  std::vector<OnnxNode> nodes;
+  std::map<std::string, Tensor> initializers;
+  std::vector<OnnxValueInfo> inputs;  // without the initializers
+  std::vector<OnnxValueInfo> outputs;
+
+  bool load(const std::string &data);
+};
@@ -0,0 +1,79 @@
+#include "selfdrive/modeld/runners/onnxmodel.h"
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/util.h"
+
+std::shared_ptr<const OnnxGraph> ONNXModel::load(const char *path) {
+  // callers pass the SNPE model, the onnx export sits next to it
+  std::string onnx_path = path;
+  const size_t ext = onnx_path.rfind(".dlc");
+  if (ext != std::string::npos) onnx_path.replace(ext, std::string::npos, ".onnx");
+
+  const std::string data = util::read_file(onnx_path);
+  assert(data.size() > 0);
+
+  auto graph = std::make_shared<OnnxGraph>();
+  bool ret = graph->load(data);
+  assert(ret);
+  LOGD("loaded %s with %zu nodes, opset %lld", onnx_path.c_str(), graph->nodes.size(), (long long)graph->opset);
+  return graph;
+}
+
+ONNXModel::ONNXModel(const char *path, float *output, size_t output_size, int runtime)
+    : ONNXModel(load(path), output, output_size, util::getenv("MODEL_THREADS", (int)std::thread::hardware_concurrency())) {}
+
+ONNXModel::ONNXModel(std::shared_ptr<const OnnxGraph> graph, float *_output, size_t _output_size, int num_threads)
+    : exec(std::make_unique<OnnxExecutor>(graph, num_threads)), output(_output), output_size(_output_size) {
+  assert(!graph->inputs.empty() && !graph->outputs.empty());
+  extra.assign(graph->inputs.size() - 1, nullptr);
+  extra_size.assign(graph->inputs.size() - 1, 0);
+  LOGD("model: %s -> %s, %d threads", graph->inputs[0].name.c_str(), graph->outputs[0].name.c_str(), exec->pool.size());
+}
+
+void ONNXModel::addInput(int idx, float *state, int state_size) {
+  assert(idx >= 1 && idx <= (int)extra.size());
+  Tensor &t = exec->input(exec->graph->inputs[idx].name);
+  assert(t.size() == (size_t)state_size);
+  extra[idx - 1] = state;
+  extra_size[idx - 1] = state_size;
+}
+
+void ONNXModel::addDesire(float *state, int state_size) {
+  addInput(1, state, state_size);
+}
+
+void ONNXModel::addTrafficConvention(float *state, int state_size) {
+  addInput(2, state, state_size);
+}
+
+void ONNXModel::addRecurrent(float *state, int state_size) {
+  addInput(3, state, state_size);
+}
+
+void ONNXModel::execute(float *net_input_buf, int buf_size) {
+  const auto &inputs = exec->graph->inputs;
+  Tensor &image = exec->input(inputs[0].name);
+  assert(image.size() == (size_t)buf_size);
+  memcpy(image.f.data(), net_input_buf, buf_size * sizeof(float));
+  for (size_t i = 0; i < extra.size(); i++) {
+    if (extra[i] == nullptr) continue;
+    memcpy(exec->input(inputs[i + 1].name).f.data(), extra[i], extra_size[i] * sizeof(float));
+  }
+
+  exec->run();
+
+  // outputs are concatenated in graph order
+  size_t offset = 0;
+  for (size_t i = 0; i < exec->graph->outputs.size(); i++) {
+    const Tensor &t = exec->output(i);
+    assert(offset + t.size() <= output_size);
+    memcpy(output + offset, t.f.data(), t.size() * sizeof(float));
+    offset += t.size();
+  }
+  assert(offset == output_size);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "selfdrive/modeld/runners/onnxexec.h"
+#include "runmodel.h"
+
+// Runs the .onnx next to the given model path on the CPU.
+// Inputs are in the same order as the SNPE models: image, desire, traffic convention, recurrent state.
+class ONNXModel : public RunModel {
+public:
+  ONNXModel(const char *path, float *output, size_t output_size, int runtime);
+  ONNXModel(std::shared_ptr<const OnnxGraph> graph, float *output, size_t output_size, int num_threads);
+  void addRecurrent(float *state, int state_size);
+  void addDesire(float *state, int state_size);
+  void addTrafficConvention(float *state, int state_size);
+  void execute(float *net_input_buf, int buf_size);
+
+  static std::shared_ptr<const OnnxGraph> load(const char *path);
+
+private:
+  void addInput(int idx, float *state, int state_size);
+
+  std::unique_ptr<OnnxExecutor> exec;
+  float *output;
+  size_t output_size;
+
+  // graph inputs after the image and the buffers that feed them
+  std::vector<float *> extra;
+  std::vector<int> extra_size;
+};
@@ -0,0 +1,91 @@
+// Measures modeld throughput and latency on recorded frames, without camerad or vipc.
+// Warps every frame and runs the driving model on it back to back:
+//
+//   ffmpeg -i fcamera.hevc -f rawvideo -pix_fmt yuv420p frames.yuv
+//   MODEL_THREADS=8 ./test/model_benchmark frames.yuv [num_frames]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+#include "selfdrive/modeld/models/driving.h"
+
+#define FRAME_WIDTH 1164
+#define FRAME_HEIGHT 874
+#define FRAME_SIZE (FRAME_WIDTH * FRAME_HEIGHT * 3 / 2)
+
+// the timing doesn't depend on the calibration, warp as if the camera was level at 1.22m
+static const float default_extrinsic[3 * 4] = {
+  0, 1, 0, 0,
+  0, 0, 1, 1.22,
+  1, 0, 0, 0,
+};
+
+static void print_stats(const char *name, std::vector<double> &times) {
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (double t : times) sum += t;
+  printf("%-8s ms: mean %.2f  p50 %.2f  p99 %.2f  max %.2f\n", name, sum / times.size(),
+         times[times.size() / 2], times[times.size() * 99 / 100], times.back());
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("usage: %s <yuv420p frames> [num_frames]\n", argv[0]);
+    return 1;
+  }
+  const int num_frames = argc > 2 ? atoi(argv[2]) : 200;
+
+  std::string frames = util::read_file(argv[1]);
+  const int frame_cnt = frames.size() / FRAME_SIZE;
+  if (frame_cnt == 0) {
+    printf("no %dx%d frames in %s\n", FRAME_WIDTH, FRAME_HEIGHT, argv[1]);
+    return 1;
+  }
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, FRAME_SIZE, NULL, &err));
+
+  ModelState model;
+  model_init(&model, device_id, context);
+  const mat3 transform = model_transform_from_extrinsic(default_extrinsic, false);
+  float desire[DESIRE_LEN] = {};
+
+  std::vector<double> prepare_times, execute_times;
+  const double start = millis_since_boot();
+  for (int i = 0; i < num_frames; i++) {
+    CL_CHECK(clEnqueueWriteBuffer(q, yuv_cl, CL_TRUE, 0, FRAME_SIZE, frames.data() + (i % frame_cnt) * FRAME_SIZE, 0, NULL, NULL));
+
+    const double t1 = millis_since_boot();
+    float *net_input_buf = model_prepare_frame(&model, yuv_cl, FRAME_WIDTH, FRAME_HEIGHT, transform);
+    const double t2 = millis_since_boot();
+    model_eval_input(&model, net_input_buf, desire);
+    const double t3 = millis_since_boot();
+
+    // the first runs warm up caches and the runtime
+    if (i >= 2) {
+      prepare_times.push_back(t2 - t1);
+      execute_times.push_back(t3 - t2);
+    }
+  }
+  const double elapsed = millis_since_boot() - start;
+
+  printf("%d frames in %.2fs, %.2f frames/s\n", num_frames, elapsed / 1000., num_frames * 1000. / elapsed);
+  if (!execute_times.empty()) {
+    print_stats("prepare", prepare_times);
+    print_stats("execute", execute_times);
+  }
+
+  model_free(&model);
+  CL_CHECK(clReleaseMemObject(yuv_cl));
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseContext(context));
+  return 0;
+}
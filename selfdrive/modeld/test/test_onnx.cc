@@ -0,0 +1,196 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/modeld/runners/cpukernels.h"
+#include "selfdrive/modeld/runners/onnxexec.h"
+
+// The CPU kernels and the executor against straightforward reference implementations
+
+static std::vector<float> random_floats(size_t n, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  std::vector<float> v(n);
+  for (float &x : v) x = dist(rng);
+  return v;
+}
+
+static void require_close(const std::vector<float> &a, const std::vector<float> &b) {
+  REQUIRE(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    INFO("index " << i);
+    REQUIRE(a[i] == Approx(b[i]).margin(1e-4).epsilon(1e-4));
+  }
+}
+
+static void conv2d_ref(const cpu::ConvParams &p, const float *in, const float *weight, const float *bias, float *out) {
+  const int cg = p.C / p.group, mg = p.M / p.group;
+  for (int m = 0; m < p.M; m++) {
+    const int g = m / mg;
+    for (int oy = 0; oy < p.OH; oy++) {
+      for (int ox = 0; ox < p.OW; ox++) {
+        double acc = bias ? bias[m] : 0.;
+        for (int c = 0; c < cg; c++) {
+          for (int ki = 0; ki < p.kh; ki++) {
+            const int iy = oy * p.stride_h - p.pad_h + ki * p.dilation_h;
+            for (int kj = 0; kj < p.kw; kj++) {
+              const int ix = ox * p.stride_w - p.pad_w + kj * p.dilation_w;
+              if (iy < 0 || iy >= p.H || ix < 0 || ix >= p.W) continue;
+              acc += (double)in[((g * cg + c) * p.H + iy) * p.W + ix] * weight[((m * cg + c) * p.kh + ki) * p.kw + kj];
+            }
+          }
+        }
+        out[(m * p.OH + oy) * p.OW + ox] = acc;
+      }
+    }
+  }
+}
+
+TEST_CASE("sgemm matches the reference") {
+  std::mt19937 rng(1);
+  cpu::ThreadPool pool(GENERATE(1, 4));
+  const bool accumulate = GENERATE(false, true);
+
+  // sizes around the register tiles, and with row strides larger than the rows
+  for (auto [M, N, K] : std::vector<std::tuple<int, int, int>>{{1, 1, 1}, {3, 5, 7}, {8, 16, 32}, {17, 33, 9}, {64, 1, 100}, {1, 70, 64}, {37, 41, 300}}) {
+    INFO("M " << M << " N " << N << " K " << K);
+    const int lda = K + 3, ldb = N + 1, ldc = N + 2;
+    const std::vector<float> A = random_floats(M * lda, rng), B = random_floats(K * ldb, rng);
+    std::vector<float> C = random_floats(M * ldc, rng), expected = C;
+
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        double acc = accumulate ? expected[i * ldc + j] : 0.;
+        for (int k = 0; k < K; k++) acc += (double)A[i * lda + k] * B[k * ldb + j];
+        expected[i * ldc + j] = acc;
+      }
+    }
+    cpu::sgemm(pool, M, N, K, A.data(), lda, B.data(), ldb, C.data(), ldc, accumulate);
+    // the padding between the rows is left alone
+    require_close(C, expected);
+  }
+}
+
+TEST_CASE("conv2d matches the reference") {
+  std::mt19937 rng(2);
+  cpu::ThreadPool pool(GENERATE(1, 3));
+
+  struct Case { const char *name; int C, H, W, M, kh, kw, stride, pad, dilation, group; };
+  const Case c = GENERATE(values<Case>({
+    {"1x1", 8, 5, 7, 16, 1, 1, 1, 0, 1, 1},
+    {"3x3 padded", 3, 9, 11, 8, 3, 3, 1, 1, 1, 1},
+    {"3x3 stride 2", 4, 10, 9, 6, 3, 3, 2, 1, 1, 1},
+    {"5x3 no padding", 2, 8, 8, 3, 5, 3, 1, 0, 1, 1},
+    {"padding larger than the image", 2, 2, 3, 4, 3, 3, 1, 2, 1, 1},
+    {"dilated", 3, 12, 12, 5, 3, 3, 1, 2, 2, 1},
+    {"two groups", 4, 7, 7, 6, 3, 3, 2, 1, 1, 2},
+    {"depthwise", 6, 8, 6, 6, 3, 3, 1, 1, 1, 6},
+    {"depthwise stride 2", 5, 9, 9, 10, 3, 3, 2, 1, 1, 5},
+  }));
+  INFO(c.name);
+
+  cpu::ConvParams p;
+  p.C = c.C; p.H = c.H; p.W = c.W; p.M = c.M;
+  p.kh = c.kh; p.kw = c.kw;
+  p.stride_h = p.stride_w = c.stride;
+  p.pad_h = p.pad_w = c.pad;
+  p.dilation_h = p.dilation_w = c.dilation;
+  p.group = c.group;
+  p.OH = (p.H + 2 * p.pad_h - (p.dilation_h * (p.kh - 1) + 1)) / p.stride_h + 1;
+  p.OW = (p.W + 2 * p.pad_w - (p.dilation_w * (p.kw - 1) + 1)) / p.stride_w + 1;
+
+  const std::vector<float> in = random_floats(p.C * p.H * p.W, rng);
+  const std::vector<float> weight = random_floats(p.M * (p.C / p.group) * p.kh * p.kw, rng);
+  const std::vector<float> bias = random_floats(p.M, rng);
+  const bool with_bias = GENERATE(false, true);
+
+  std::vector<float> out(p.M * p.OH * p.OW), expected(out.size());
+  std::vector<float> scratch;
+  conv2d_ref(p, in.data(), weight.data(), with_bias ? bias.data() : nullptr, expected.data());
+  cpu::conv2d(pool, p, in.data(), weight.data(), with_bias ? bias.data() : nullptr, out.data(), scratch);
+  require_close(out, expected);
+}
+
+static Tensor float_tensor(const std::vector<int64_t> &shape, const std::vector<float> &data) {
+  Tensor t;
+  t.reshape(shape, false);
+  t.f = data;
+  return t;
+}
+
+static OnnxNode node(const std::string &op_type, const std::vector<std::string> &inputs, const std::string &output) {
+  OnnxNode n;
+  n.name = op_type + "_" + output;
+  n.op_type = op_type;
+  n.inputs = inputs;
+  n.outputs = {output};
+  return n;
+}
+
+TEST_CASE("OnnxExecutor runs a small network") {
+  std::mt19937 rng(3);
+  // x -> Conv(3x3, stride 2, pad 1) -> Add(per channel) -> Relu -> GlobalAveragePool -> Flatten -> Gemm(transB) -> Softmax
+  const int C = 2, H = 7, W = 6, M = 4, classes = 3;
+  const std::vector<float> x = random_floats(C * H * W, rng);
+  const std::vector<float> conv_w = random_floats(M * C * 3 * 3, rng), conv_b = random_floats(M, rng);
+  const std::vector<float> shift = random_floats(M, rng);
+  const std::vector<float> fc_w = random_floats(classes * M, rng), fc_b = random_floats(classes, rng);
+
+  auto graph = std::make_shared<OnnxGraph>();
+  graph->opset = 13;
+  graph->inputs = {{"x", {0, C, H, W}}};
+  graph->outputs = {{"probs", {1, classes}}};
+  graph->initializers["conv_w"] = float_tensor({M, C, 3, 3}, conv_w);
+  graph->initializers["conv_b"] = float_tensor({M}, conv_b);
+  graph->initializers["shift"] = float_tensor({1, M, 1, 1}, shift);
+  graph->initializers["fc_w"] = float_tensor({classes, M}, fc_w);
+  graph->initializers["fc_b"] = float_tensor({classes}, fc_b);
+
+  OnnxNode conv = node("Conv", {"x", "conv_w", "conv_b"}, "conv");
+  conv.attrs["strides"].ints = {2, 2};
+  conv.attrs["pads"].ints = {1, 1, 1, 1};
+  OnnxNode gemm = node("Gemm", {"flat", "fc_w", "fc_b"}, "logits");
+  gemm.attrs["transB"].i = 1;
+  graph->nodes = {
+    conv,
+    node("Add", {"conv", "shift"}, "shifted"),
+    node("Relu", {"shifted"}, "relu"),
+    node("GlobalAveragePool", {"relu"}, "pooled"),
+    node("Flatten", {"pooled"}, "flat"),
+    gemm,
+    node("Softmax", {"logits"}, "probs"),
+  };
+
+  // reference
+  cpu::ConvParams p = {C, H, W, M, 4, 3, 3, 3, 2, 2, 1, 1, 1, 1, 1};
+  std::vector<float> conv_out(M * p.OH * p.OW);
+  conv2d_ref(p, x.data(), conv_w.data(), conv_b.data(), conv_out.data());
+  std::vector<float> pooled(M, 0.f);
+  for (int m = 0; m < M; m++) {
+    for (int k = 0; k < p.OH * p.OW; k++) pooled[m] += std::max(conv_out[m * p.OH * p.OW + k] + shift[m], 0.f);
+    pooled[m] /= p.OH * p.OW;
+  }
+  std::vector<float> expected(classes);
+  float sum = 0.f;
+  for (int j = 0; j < classes; j++) {
+    float logit = fc_b[j];
+    for (int m = 0; m < M; m++) logit += pooled[m] * fc_w[j * M + m];
+    expected[j] = std::exp(logit);
+    sum += expected[j];
+  }
+  for (float &v : expected) v /= sum;
+
+  OnnxExecutor executor(graph, 2);
+  for (int run = 0; run < 2; run++) {
+    // the second run reuses the activations and the cached transposed weights
+    Tensor &input = executor.input("x");
+    REQUIRE(input.shape == std::vector<int64_t>{1, C, H, W});
+    input.f = x;
+    executor.run();
+
+    const Tensor &probs = executor.output(0);
+    REQUIRE(probs.shape == std::vector<int64_t>{1, classes});
+    require_close(probs.f, expected);
+  }
+}
@@ -2,6 +2,7 @@
 # simple boardd wrapper that updates the panda first
 import os
 import time
+from typing import List
 
 from panda import BASEDIR as PANDA_BASEDIR, Panda, PandaDFU
 from common.basedir import BASEDIR
@@ -19,35 +20,27 @@ def get_expected_signature() -> bytes:
     return b""
 
 
-def update_panda() -> Panda:
-  panda = None
-  panda_dfu = None
-
+def wait_for_pandas() -> List[str]:
   cloudlog.info("Connecting to panda")
 
   while True:
-    # break on normal mode Panda
-    panda_list = Panda.list()
-    if len(panda_list) > 0:
-      cloudlog.info("Panda found, connecting")
-      panda = Panda(panda_list[0])
-      break
-
-    # flash on DFU mode Panda
-    panda_dfu = PandaDFU.list()
-    if len(panda_dfu) > 0:
+    # flash on DFU mode Pandas
+    for serial in PandaDFU.list():
       cloudlog.info("Panda in DFU mode found, flashing recovery")
-      panda_dfu = PandaDFU(panda_dfu[0])
-      panda_dfu.recover()
+      PandaDFU(serial).recover()
+
+    # break once all Pandas are in normal mode
+    panda_list = Panda.list()
+    if len(panda_list) > 0 and len(PandaDFU.list()) == 0:
+      cloudlog.info(f"{len(panda_list)} panda(s) found, connecting")
+      return panda_list
 
     time.sleep(1)
 
-  fw_signature = get_expected_signature()
 
-  try:
-    serial = panda.get_serial()[0].decode("utf-8")
-  except Exception:
-    serial = None
+def update_panda(serial: str) -> Panda:
+  panda = Panda(serial)
+  fw_signature = get_expected_signature()
 
   panda_version = "bootstub" if panda.bootstub else panda.get_version()
   panda_signature = b"" if panda.bootstub else panda.get_signature()
@@ -82,19 +75,26 @@ def update_panda() -> Panda:
 
 
 def main() -> None:
-  panda = update_panda()
+  # every panda runs the same firmware, boardd uses all of them
+  for serial in wait_for_pandas():
+    panda = update_panda(serial)
+
+    # check health for lost heartbeat
+    health = panda.health()
+    if health["heartbeat_lost"]:
+      Params().put_bool("PandaHeartbeatLost", True)
+      cloudlog.event("heartbeat lost", deviceState=health)
+
+    #cloudlog.info("Resetting panda")
+    #panda.reset()
 
-  # check health for lost heartbeat
-  health = panda.health()
-  if health["heartbeat_lost"]:
-    Params().put_bool("PandaHeartbeatLost", True)
-    cloudlog.event("heartbeat lost", deviceState=health)
+    panda.close()
 
-  #cloudlog.info("Resetting panda")
-  #panda.reset()
+  # boardd connects to every panda it finds. To pick them instead, list their serials with the main panda first
+  serials = [s for s in os.getenv("BOARDD_PANDA_SERIALS", "").split(",") if len(s)]
 
   os.chdir(os.path.join(BASEDIR, "selfdrive/boardd"))
-  os.execvp("./boardd", ["./boardd"])
+  os.execvp("./boardd", ["./boardd"] + serials)
 
 
 if __name__ == "__main__":
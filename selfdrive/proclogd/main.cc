@@ -1,21 +1,68 @@
-
 #include <sys/resource.h>
 
+#include <algorithm>
+#include <sstream>
+
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/proclogd/proclog.h"
 
 ExitHandler do_exit;
 
+const double FULL_SAMPLE_INTERVAL = 2000;  // 2 secs
+
+// processes to also sample per thread and at PROCLOG_DETAILED_HZ, e.g. PROCLOG_DETAILED=modeld,controlsd
+static std::vector<std::string> detailed_processes() {
+  std::vector<std::string> ret;
+  std::stringstream stream(util::getenv("PROCLOG_DETAILED"));
+  std::string name;
+  while (std::getline(stream, name, ',')) {
+    if (!name.empty()) ret.push_back(name);
+  }
+  return ret;
+}
+
 int main(int argc, char **argv) {
   setpriority(PRIO_PROCESS, 0, -15);
 
-  PubMaster publisher({"procLog"});
+  // the sampler keeps a stat fd open per process, and two per detailed thread
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  const std::vector<std::string> detailed = detailed_processes();
+  const double detailed_interval = detailed.empty() ? FULL_SAMPLE_INTERVAL : 1000. / std::max(util::getenv("PROCLOG_DETAILED_HZ", 10.0f), 0.5f);
+  ProcSampler sampler(detailed);
+
+  PubMaster publisher({"procLog", "procLogDetailed"});
+  double next_full = millis_since_boot();
   while (!do_exit) {
-    MessageBuilder msg;
-    buildProcLogMessage(msg);
-    publisher.send("procLog", msg);
+    const double start = millis_since_boot();
+    const bool full = start >= next_full;
+    if (full) {
+      sampler.sample();
+      next_full += FULL_SAMPLE_INTERVAL;
+
+      MessageBuilder msg;
+      buildProcLogMessage(msg, sampler);
+      publisher.send("procLog", msg);
+    } else {
+      sampler.sampleDetailed();
+    }
+
+    if (!detailed.empty()) {
+      MessageBuilder msg;
+      buildProcLogDetailedMessage(msg, sampler);
+      publisher.send("procLogDetailed", msg);
+    }
 
-    util::sleep_for(2000);  // 2 secs
+    const double next = std::min(next_full, start + detailed_interval);
+    const double remaining = next - millis_since_boot();
+    if (remaining > 0) {
+      util::sleep_for(remaining);
+    }
   }
 
   return 0;
@@ -1,8 +1,11 @@
 #include "selfdrive/proclogd/proclog.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <sstream>
@@ -62,51 +65,105 @@ enum StatPos {
   MAX_FIELD = 52,
 };
 
+template <typename T>
+static bool parseNumber(const char *s, const char *end, T &out) {
+  bool negative = s < end && *s == '-';
+  if (negative) s++;
+  if (s == end) return false;
+
+  T v = 0;
+  for (; s < end; s++) {
+    if (*s < '0' || *s > '9') return false;
+    v = v * 10 + (*s - '0');
+  }
+  out = negative ? -v : v;
+  return true;
+}
+
 // parse /proc/pid/stat
-std::optional<ProcStat> procStat(std::string stat) {
+bool procStat(const char *stat, size_t len, ProcStat &p) {
   // To avoid being fooled by names containing a closing paren, scan backwards.
-  auto open_paren = stat.find('(');
-  auto close_paren = stat.rfind(')');
-  if (open_paren == std::string::npos || close_paren == std::string::npos || open_paren > close_paren) {
-    return std::nullopt;
-  }
-
-  std::string name = stat.substr(open_paren + 1, close_paren - open_paren - 1);
-  // repace space in name with _
-  std::replace(&stat[open_paren], &stat[close_paren], ' ', '_');
-  std::istringstream iss(stat);
-  std::vector<std::string> v{std::istream_iterator<std::string>(iss),
-                             std::istream_iterator<std::string>()};
-  try {
-    if (v.size() != StatPos::MAX_FIELD) {
-      throw std::invalid_argument("stat");
+  const char *end = stat + len;
+  const char *open_paren = (const char *)memchr(stat, '(', len);
+  const char *close_paren = end;
+  while (close_paren > stat && *(close_paren - 1) != ')') close_paren--;
+  if (!open_paren || close_paren <= open_paren + 1) {
+    return false;
+  }
+  close_paren--;
+
+  p.name.assign(open_paren + 1, close_paren - open_paren - 1);
+  const char *pid_end = open_paren;
+  while (pid_end > stat && *(pid_end - 1) == ' ') pid_end--;
+  bool ok = parseNumber(stat, pid_end, p.pid);
+
+  int field = StatPos::state;
+  for (const char *s = close_paren + 1; ok && s < end; field++) {
+    while (s < end && (*s == ' ' || *s == '\n')) s++;
+    if (s == end) break;
+    const char *e = s;
+    while (e < end && *e != ' ' && *e != '\n') e++;
+
+    switch (field) {
+      case StatPos::state: p.state = *s; break;
+      case StatPos::ppid: ok = parseNumber(s, e, p.ppid); break;
+      case StatPos::utime: ok = parseNumber(s, e, p.utime); break;
+      case StatPos::stime: ok = parseNumber(s, e, p.stime); break;
+      case StatPos::cutime: ok = parseNumber(s, e, p.cutime); break;
+      case StatPos::cstime: ok = parseNumber(s, e, p.cstime); break;
+      case StatPos::priority: ok = parseNumber(s, e, p.priority); break;
+      case StatPos::nice: ok = parseNumber(s, e, p.nice); break;
+      case StatPos::num_threads: ok = parseNumber(s, e, p.num_threads); break;
+      case StatPos::starttime: ok = parseNumber(s, e, p.starttime); break;
+      case StatPos::vsize: ok = parseNumber(s, e, p.vms); break;
+      case StatPos::rss: ok = parseNumber(s, e, p.rss); break;
+      case StatPos::processor: ok = parseNumber(s, e, p.processor); break;
+      default: break;
     }
-    ProcStat p = {
-      .name = name,
-      .pid = stoi(v[StatPos::pid - 1]),
-      .state = v[StatPos::state - 1][0],
-      .ppid = stoi(v[StatPos::ppid - 1]),
-      .utime = stoul(v[StatPos::utime - 1]),
-      .stime = stoul(v[StatPos::stime - 1]),
-      .cutime = stol(v[StatPos::cutime - 1]),
-      .cstime = stol(v[StatPos::cstime - 1]),
-      .priority = stol(v[StatPos::priority - 1]),
-      .nice = stol(v[StatPos::nice - 1]),
-      .num_threads = stol(v[StatPos::num_threads - 1]),
-      .starttime = stoull(v[StatPos::starttime - 1]),
-      .vms = stoul(v[StatPos::vsize - 1]),
-      .rss = stoul(v[StatPos::rss - 1]),
-      .processor = stoi(v[StatPos::processor - 1]),
-    };
+    s = e;
+  }
+  return ok && field == StatPos::MAX_FIELD + 1;
+}
+
+std::optional<ProcStat> procStat(std::string stat) {
+  ProcStat p;
+  if (procStat(stat.data(), stat.size(), p)) {
     return p;
-  } catch (const std::invalid_argument &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  } catch (const std::out_of_range &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
   }
+  LOGE("failed to parse procStat :%s", stat.c_str());
   return std::nullopt;
 }
 
+// parse voluntary_ctxt_switches and nonvoluntary_ctxt_switches from /proc/pid/task/tid/status
+bool ctxtSwitches(const char *status, size_t len, uint64_t &voluntary, uint64_t &nonvoluntary) {
+  static const char voluntary_key[] = "voluntary_ctxt_switches:";
+  static const char nonvoluntary_key[] = "nonvoluntary_ctxt_switches:";
+  int found = 0;
+  const char *end = status + len;
+  for (const char *line = status; line < end;) {
+    const char *line_end = (const char *)memchr(line, '\n', end - line);
+    if (!line_end) line_end = end;
+
+    uint64_t *value = nullptr;
+    size_t key_len = 0;
+    if ((size_t)(line_end - line) >= sizeof(voluntary_key) && memcmp(line, voluntary_key, sizeof(voluntary_key) - 1) == 0) {
+      value = &voluntary;
+      key_len = sizeof(voluntary_key) - 1;
+    } else if ((size_t)(line_end - line) >= sizeof(nonvoluntary_key) && memcmp(line, nonvoluntary_key, sizeof(nonvoluntary_key) - 1) == 0) {
+      value = &nonvoluntary;
+      key_len = sizeof(nonvoluntary_key) - 1;
+    }
+    if (value) {
+      const char *s = line + key_len;
+      while (s < line_end && (*s == ' ' || *s == '\t')) s++;
+      if (!parseNumber(s, line_end, *value)) return false;
+      found++;
+    }
+    line = line_end + 1;
+  }
+  return found == 2;
+}
+
 // return list of PIDs from /proc
 std::vector<int> pids() {
   std::vector<int> ids;
@@ -138,20 +195,6 @@ std::vector<std::string> cmdline(std::istream &stream) {
   return ret;
 }
 
-const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
-  static std::unordered_map<pid_t, ProcCache> proc_cache;
-  ProcCache &cache = proc_cache[pid];
-  if (cache.pid != pid || cache.name != name) {
-    cache.pid = pid;
-    cache.name = name;
-    std::string proc_path = "/proc/" + std::to_string(pid);
-    cache.exe = util::readlink(proc_path + "/exe");
-    std::ifstream stream(proc_path + "/cmdline");
-    cache.cmdline = cmdline(stream);
-  }
-  return cache;
-}
-
 }  // namespace Parser
 
 const double jiffy = sysconf(_SC_CLK_TCK);
@@ -191,21 +234,189 @@ void buildMemInfo(cereal::ProcLog::Builder &builder) {
   mem.setShared(mem_info["Shmem:"]);
 }
 
-void buildProcs(cereal::ProcLog::Builder &builder) {
-  auto pids = Parser::pids();
-  std::vector<ProcStat> proc_stats;
-  proc_stats.reserve(pids.size());
-  for (int pid : pids) {
-    std::string path = "/proc/" + std::to_string(pid) + "/stat";
-    if (auto stat = Parser::procStat(util::read_file(path))) {
-      proc_stats.push_back(*stat);
+// ProcSampler
+
+// /proc/<pid>/<file>, or /proc/<pid>/task/<tid>/<file>
+static int openProcFile(const char *file, int pid, int tid = -1) {
+  char path[64];
+  if (tid < 0) {
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+  } else {
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/%s", pid, tid, file);
+  }
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void closeFd(int &fd) {
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+ProcSampler::ProcSampler(const std::vector<std::string> &detailed) : detailed(detailed) {}
+
+ProcSampler::~ProcSampler() {
+  for (auto &[pid, p] : procs) {
+    closeProcess(p);
+  }
+}
+
+static void closeThreads(std::map<int, ProcSampler::Thread> &threads) {
+  for (auto &[tid, t] : threads) {
+    closeFd(t.stat_fd);
+    closeFd(t.status_fd);
+  }
+  threads.clear();
+}
+
+void ProcSampler::closeProcess(Process &p) {
+  closeFd(p.stat_fd);
+  closeThreads(p.threads);
+}
+
+// false once the process is gone
+bool ProcSampler::readProcess(int pid, Process &p) {
+  if (p.stat_fd < 0) {
+    p.stat_fd = openProcFile("stat", pid);
+    if (p.stat_fd < 0) return false;
+  }
+
+  char buf[sizeof(p.raw)];
+  ssize_t len = pread(p.stat_fd, buf, sizeof(buf), 0);
+  if (len <= 0) return false;
+  if ((size_t)len == p.raw_len && memcmp(buf, p.raw, len) == 0) return true;
+
+  memcpy(p.raw, buf, len);
+  p.raw_len = len;
+  const unsigned long long prev_starttime = p.stat.starttime;
+  if (!Parser::procStat(buf, len, p.stat)) {
+    LOGE("failed to parse procStat :%.*s", (int)len, buf);
+    return false;
+  }
+
+  // new process, or the name changed with an exec
+  if (p.cache.pid != pid || p.cache.name != p.stat.name || p.stat.starttime != prev_starttime) {
+    p.cache.pid = pid;
+    p.cache.name = p.stat.name;
+    std::string proc_path = "/proc/" + std::to_string(pid);
+    p.cache.exe = util::readlink(proc_path + "/exe");
+    std::ifstream stream(proc_path + "/cmdline");
+    p.cache.cmdline = Parser::cmdline(stream);
+
+    p.detailed = false;
+    for (const std::string &d : detailed) {
+      p.detailed |= p.stat.name == d;
+      for (const std::string &arg : p.cache.cmdline) {
+        p.detailed |= arg.find(d) != std::string::npos;
+      }
+    }
+  }
+  return true;
+}
+
+bool ProcSampler::readThread(Thread &t) {
+  char buf[4096];
+  ssize_t len = pread(t.stat_fd, buf, sizeof(buf), 0);
+  if (len <= 0 || !Parser::procStat(buf, len, thread_stat)) return false;
+
+  t.stat.tid = thread_stat.pid;
+  t.stat.processor = thread_stat.processor;
+  t.stat.state = thread_stat.state;
+  t.stat.utime = thread_stat.utime;
+  t.stat.stime = thread_stat.stime;
+  t.stat.name = thread_stat.name;
+
+  len = pread(t.status_fd, buf, sizeof(buf), 0);
+  return len > 0 && Parser::ctxtSwitches(buf, len, t.stat.voluntary_ctxt_switches, t.stat.nonvoluntary_ctxt_switches);
+}
+
+void ProcSampler::scanThreads(int pid, Process &p) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task", pid);
+  DIR *d = opendir(path);
+  if (!d) return;
+
+  std::map<int, Thread> threads;
+  struct dirent *de = NULL;
+  while ((de = readdir(d))) {
+    char *p_end;
+    int tid = strtol(de->d_name, &p_end, 10);
+    if (de->d_name[0] == '.' || *p_end != '\0') continue;
+
+    auto it = p.threads.find(tid);
+    if (it != p.threads.end()) {
+      threads[tid] = it->second;
+      p.threads.erase(it);
+    } else {
+      Thread t;
+      t.stat_fd = openProcFile("stat", pid, tid);
+      t.status_fd = openProcFile("status", pid, tid);
+      threads[tid] = t;
+    }
+  }
+  closedir(d);
+
+  // the ones left exited
+  closeThreads(p.threads);
+  p.threads = std::move(threads);
+}
+
+void ProcSampler::sample() {
+  for (auto &[pid, p] : procs) {
+    p.alive = false;
+  }
+  for (int pid : Parser::pids()) {
+    procs[pid].alive = true;
+  }
+
+  for (auto it = procs.begin(); it != procs.end();) {
+    auto &[pid, p] = *it;
+    if (p.alive && !readProcess(pid, p)) {
+      // the pid might have been reused since its stat was opened
+      closeFd(p.stat_fd);
+      p.alive = readProcess(pid, p);
+    }
+    if (!p.alive) {
+      closeProcess(p);
+      it = procs.erase(it);
+      continue;
+    }
+
+    if (p.detailed) {
+      scanThreads(pid, p);
+      for (auto &[tid, t] : p.threads) {
+        readThread(t);
+      }
+    } else if (!p.threads.empty()) {
+      // no longer detailed after an exec
+      closeThreads(p.threads);
+    }
+    ++it;
+  }
+}
+
+void ProcSampler::sampleDetailed() {
+  for (auto &[pid, p] : procs) {
+    if (p.detailed && readProcess(pid, p)) {
+      for (auto &[tid, t] : p.threads) {
+        readThread(t);
+      }
     }
   }
+}
+
+void ProcSampler::build(cereal::ProcLog::Builder &builder, bool detailed_only) {
+  int num_procs = 0;
+  for (auto &[pid, p] : procs) {
+    num_procs += !detailed_only || p.detailed;
+  }
+
+  auto log_procs = builder.initProcs(num_procs);
+  int i = 0;
+  for (auto &[pid, p] : procs) {
+    if (detailed_only && !p.detailed) continue;
 
-  auto procs = builder.initProcs(proc_stats.size());
-  for (size_t i = 0; i < proc_stats.size(); i++) {
-    auto l = procs[i];
-    const ProcStat &r = proc_stats[i];
+    auto l = log_procs[i++];
+    const ProcStat &r = p.stat;
     l.setPid(r.pid);
     l.setState(r.state);
     l.setPpid(r.ppid);
@@ -222,18 +433,44 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
     l.setProcessor(r.processor);
     l.setName(r.name);
 
-    const ProcCache &extra_info = Parser::getProcExtraInfo(r.pid, r.name);
-    l.setExe(extra_info.exe);
-    auto lcmdline = l.initCmdline(extra_info.cmdline.size());
-    for (size_t i = 0; i < lcmdline.size(); i++) {
-      lcmdline.set(i, extra_info.cmdline[i]);
+    l.setExe(p.cache.exe);
+    auto lcmdline = l.initCmdline(p.cache.cmdline.size());
+    for (size_t j = 0; j < lcmdline.size(); j++) {
+      lcmdline.set(j, p.cache.cmdline[j]);
+    }
+
+    if (p.detailed) {
+      uint64_t voluntary = 0, nonvoluntary = 0;
+      auto lthreads = l.initThreads(p.threads.size());
+      int j = 0;
+      for (auto &[tid, t] : p.threads) {
+        auto lt = lthreads[j++];
+        lt.setTid(tid);
+        lt.setName(t.stat.name);
+        lt.setState(t.stat.state);
+        lt.setCpuUser(t.stat.utime / jiffy);
+        lt.setCpuSystem(t.stat.stime / jiffy);
+        lt.setProcessor(t.stat.processor);
+        lt.setVoluntaryCtxtSwitches(t.stat.voluntary_ctxt_switches);
+        lt.setNonvoluntaryCtxtSwitches(t.stat.nonvoluntary_ctxt_switches);
+        voluntary += t.stat.voluntary_ctxt_switches;
+        nonvoluntary += t.stat.nonvoluntary_ctxt_switches;
+      }
+      l.setVoluntaryCtxtSwitches(voluntary);
+      l.setNonvoluntaryCtxtSwitches(nonvoluntary);
     }
   }
 }
 
-void buildProcLogMessage(MessageBuilder &msg) {
+void buildProcLogMessage(MessageBuilder &msg, ProcSampler &sampler) {
   auto procLog = msg.initEvent().initProcLog();
-  buildProcs(procLog);
+  sampler.build(procLog, false);
   buildCPUTimes(procLog);
   buildMemInfo(procLog);
 }
+
+void buildProcLogDetailedMessage(MessageBuilder &msg, ProcSampler &sampler) {
+  auto procLog = msg.initEvent().initProcLogDetailed();
+  sampler.build(procLog, true);
+  buildCPUTimes(procLog);
+}
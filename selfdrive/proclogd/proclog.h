@@ -1,3 +1,4 @@
+#include <map>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -26,15 +27,74 @@ struct ProcStat {
   std::string name;
 };
 
+struct ThreadStat {
+  int tid, processor;
+  char state;
+  unsigned long utime, stime;
+  uint64_t voluntary_ctxt_switches, nonvoluntary_ctxt_switches;
+  std::string name;
+};
+
 namespace Parser {
 
 std::vector<int> pids();
 std::optional<ProcStat> procStat(std::string stat);
+// The same without allocating, for the sampler. stat doesn't need to be null terminated, and
+// names are at most 15 characters, which std::string keeps inline.
+bool procStat(const char *stat, size_t len, ProcStat &p);
+// the context switch counts of /proc/<pid>/task/<tid>/status
+bool ctxtSwitches(const char *status, size_t len, uint64_t &voluntary, uint64_t &nonvoluntary);
 std::vector<std::string> cmdline(std::istream &stream);
 std::vector<CPUTime> cpuTimes(std::istream &stream);
 std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream);
-const ProcCache &getProcExtraInfo(int pid, const std::string &name);
 
 };  // namespace Parser
 
-void buildProcLogMessage(MessageBuilder &msg);
+// Samples the processes for procLog. The stat file of every process stays open, so a sample is a
+// pread per process, and a stat is only parsed when it changed since the last one. The exe and
+// cmdline are read once per process. Processes whose name or cmdline contains one of `detailed`
+// are also sampled per thread, with context switches, and can be sampled on their own at a
+// higher rate.
+class ProcSampler {
+public:
+  struct Thread {
+    int stat_fd = -1, status_fd = -1;
+    ThreadStat stat = {};
+  };
+
+
+  ProcSampler(const std::vector<std::string> &detailed = {});
+  ~ProcSampler();
+
+  // rescans /proc for started and exited processes and threads, and samples all processes
+  void sample();
+  // only samples the detailed processes, and the threads found by the last sample()
+  void sampleDetailed();
+  void build(cereal::ProcLog::Builder &builder, bool detailed_only);
+
+private:
+  struct Process {
+    int stat_fd = -1;
+    char raw[1024];  // the last stat read
+    size_t raw_len = 0;
+    ProcStat stat = {};
+    ProcCache cache = {};
+    bool detailed = false;
+    bool alive = false;
+    std::map<int, Thread> threads;
+  };
+
+  bool readProcess(int pid, Process &p);
+  bool readThread(Thread &t);
+  void scanThreads(int pid, Process &p);
+  void closeProcess(Process &p);
+
+  std::vector<std::string> detailed;
+  std::map<int, Process> procs;
+  ProcStat thread_stat;  // parse buffer for the threads
+};
+
+// procLog from the last sample
+void buildProcLogMessage(MessageBuilder &msg, ProcSampler &sampler);
+// procLogDetailed, only the detailed processes and the cpu times
+void buildProcLogDetailedMessage(MessageBuilder &msg, ProcSampler &sampler);
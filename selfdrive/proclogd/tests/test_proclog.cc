@@ -0,0 +1,141 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/common/util.h"
+#include "selfdrive/proclogd/proclog.h"
+
+static std::string stat_line(const std::string &name) {
+  return "1234 (" + name + ") S 1 1234 1234 0 -1 4194560 2000 0 10 0 150 25 3 4 20 0 7 0 5000 "
+         "123456789 2048 18446744073709551615 1 1 0 0 0 0 0 4096 1260 0 0 0 17 2 0 0 0 0 0 0 0 0 0 0 0 0 0";
+}
+
+TEST_CASE("Parser::procStat") {
+  SECTION("names with spaces and parentheses") {
+    for (std::string name : {"proclogd", "a b", "(sd-pam)", "x) S 1 (y", ")"}) {
+      const std::string line = stat_line(name);
+      ProcStat p = {};
+      REQUIRE(Parser::procStat(line.c_str(), line.size(), p));
+      REQUIRE(p.pid == 1234);
+      REQUIRE(p.name == name);
+      REQUIRE(p.state == 'S');
+      REQUIRE(p.ppid == 1);
+      REQUIRE(p.utime == 150);
+      REQUIRE(p.stime == 25);
+      REQUIRE(p.cutime == 3);
+      REQUIRE(p.cstime == 4);
+      REQUIRE(p.priority == 20);
+      REQUIRE(p.nice == 0);
+      REQUIRE(p.num_threads == 7);
+      REQUIRE(p.starttime == 5000);
+      REQUIRE(p.vms == 123456789);
+      REQUIRE(p.rss == 2048);
+      REQUIRE(p.processor == 2);
+
+      // the allocating version agrees
+      auto s = Parser::procStat(line);
+      REQUIRE(s);
+      REQUIRE(s->name == p.name);
+      REQUIRE(s->starttime == p.starttime);
+    }
+  }
+  SECTION("trailing newline, not null terminated") {
+    std::string line = stat_line("modeld") + "\n";
+    line += "garbage";
+    ProcStat p = {};
+    REQUIRE(Parser::procStat(line.c_str(), line.size() - strlen("garbage"), p));
+    REQUIRE(p.name == "modeld");
+    REQUIRE(p.processor == 2);
+  }
+  SECTION("malformed") {
+    ProcStat p = {};
+    const std::string line = stat_line("modeld");
+    std::vector<std::string> malformed = {"", "1234 (modeld S 1", line.substr(0, line.size() - 2), line + " 0",
+                                          "x" + line, "1234 (modeld) S 1 1234 z"};
+    for (const std::string &bad : malformed) {
+      INFO(bad);
+      REQUIRE_FALSE(Parser::procStat(bad.c_str(), bad.size(), p));
+    }
+  }
+}
+
+TEST_CASE("Parser::ctxtSwitches") {
+  std::string status = "Name:\tmodeld\nState:\tS (sleeping)\nTgid:\t1234\n"
+                       "voluntary_ctxt_switches:\t1523\nnonvoluntary_ctxt_switches:\t87\n";
+  uint64_t voluntary = 0, nonvoluntary = 0;
+  REQUIRE(Parser::ctxtSwitches(status.c_str(), status.size(), voluntary, nonvoluntary));
+  REQUIRE(voluntary == 1523);
+  REQUIRE(nonvoluntary == 87);
+
+  status = "Name:\tmodeld\nvoluntary_ctxt_switches:\t1523\n";
+  REQUIRE_FALSE(Parser::ctxtSwitches(status.c_str(), status.size(), voluntary, nonvoluntary));
+}
+
+// a second thread that context switches, joined when the test case ends
+struct SleepingThread {
+  std::atomic<bool> done = false;
+  std::thread thread{[this]() {
+    while (!done) util::sleep_for(1);
+  }};
+  ~SleepingThread() {
+    done = true;
+    thread.join();
+  }
+};
+
+TEST_CASE("ProcSampler") {
+  SleepingThread worker;
+
+  // the shell that started the test also has the name in its cmdline
+  const std::string comm = util::read_file("/proc/self/comm");
+  ProcSampler sampler({comm.substr(0, comm.find('\n'))});
+  sampler.sample();
+  util::sleep_for(20);
+  sampler.sampleDetailed();
+
+  SECTION("procLog has every process") {
+    MessageBuilder msg;
+    buildProcLogMessage(msg, sampler);
+    auto procs = msg.getRoot<cereal::Event>().getProcLog().getProcs();
+    // processes come and go while the test runs, only this one is sure to be there
+    bool found = false;
+    for (auto p : procs) {
+      if (p.getPid() == getpid()) {
+        found = true;
+        REQUIRE(p.getPpid() == getppid());
+        REQUIRE(p.getThreads().size() == 2);
+        REQUIRE(p.getExe() == util::readlink("/proc/self/exe"));
+      }
+    }
+    REQUIRE(found);
+  }
+  SECTION("procLogDetailed only has the detailed processes") {
+    MessageBuilder msg;
+    buildProcLogDetailedMessage(msg, sampler);
+    auto procs = msg.getRoot<cereal::Event>().getProcLogDetailed().getProcs();
+    REQUIRE(procs.size() < Parser::pids().size());
+
+    bool found = false;
+    for (auto p : procs) {
+      REQUIRE(p.getThreads().size() > 0);
+      if (p.getPid() != getpid()) continue;
+
+      found = true;
+      auto threads = p.getThreads();
+      REQUIRE(threads.size() == 2);
+      REQUIRE(threads[0].getTid() == getpid());
+      uint64_t voluntary = 0;
+      for (auto t : threads) {
+        voluntary += t.getVoluntaryCtxtSwitches();
+      }
+      // the worker sleeps in a loop
+      REQUIRE(threads[1].getVoluntaryCtxtSwitches() > 0);
+      REQUIRE(p.getVoluntaryCtxtSwitches() == voluntary);
+    }
+    REQUIRE(found);
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+// Timestamps the samples read from a FIFO. The newest one is taken to be sampled at the read
+// and the others one ODR period apart before it. Reads don't happen at exact times, so the
+// timestamps continue from the previous read and are only slowly steered towards that estimate,
+// unless it is more than two periods off, like after an overrun.
+class FifoClock {
+public:
+  FifoClock(uint64_t period_ns) : period(period_ns) {}
+
+  // n samples were read at read_time, next() returns their timestamps oldest first
+  void start(int n, uint64_t read_time) {
+    const int64_t first = read_time - (n - 1) * period;
+    const int64_t error = first - (int64_t)(last + period);
+    if (last == 0 || std::abs(error) > 2 * (int64_t)period) {
+      last = first - period;
+    } else {
+      last += error / 16;
+    }
+  }
+  uint64_t next() { return last += period; }
+
+private:
+  uint64_t period;
+  uint64_t last = 0;
+};
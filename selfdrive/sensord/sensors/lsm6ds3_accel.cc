@@ -27,8 +27,8 @@ int LSM6DS3_Accel::init() {
     source = cereal::SensorEventData::SensorSource::LSM6DS3TRC;
   }
 
-  // TODO: set scale and bandwith. Default is +- 2G, 50 Hz
-  ret = set_register(LSM6DS3_ACCEL_I2C_REG_CTRL1_XL, LSM6DS3_ACCEL_ODR_104HZ);
+  // TODO: set scale and bandwith. Default is +- 2G, 100 Hz at 208 Hz ODR
+  ret = set_register(LSM6DS3_ACCEL_I2C_REG_CTRL1_XL, LSM6DS3_ACCEL_ODR_208HZ);
   if (ret < 0) {
     goto fail;
   }
@@ -45,16 +45,20 @@ void LSM6DS3_Accel::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
 
+  fill_event(event, buffer, start_time);
+}
+
+void LSM6DS3_Accel::fill_event(cereal::SensorEventData::Builder &event, const uint8_t *data, uint64_t timestamp) {
   float scale = 9.81 * 2.0f / (1 << 15);
-  float x = read_16_bit(buffer[0], buffer[1]) * scale;
-  float y = read_16_bit(buffer[2], buffer[3]) * scale;
-  float z = read_16_bit(buffer[4], buffer[5]) * scale;
+  float x = read_16_bit(data[0], data[1]) * scale;
+  float y = read_16_bit(data[2], data[3]) * scale;
+  float z = read_16_bit(data[4], data[5]) * scale;
 
   event.setSource(source);
   event.setVersion(1);
   event.setSensor(SENSOR_ACCELEROMETER);
   event.setType(SENSOR_TYPE_ACCELEROMETER);
-  event.setTimestamp(start_time);
+  event.setTimestamp(timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initAcceleration();
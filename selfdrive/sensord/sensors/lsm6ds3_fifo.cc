@@ -0,0 +1,131 @@
+#include "lsm6ds3_fifo.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "selfdrive/common/gpio.h"
+#include "selfdrive/common/swaglog.h"
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus, LSM6DS3_Accel *accel, LSM6DS3_Gyro *gyro, int gpio_nr)
+  : I2CSensor(bus), accel(accel), gyro(gyro), gpio_nr(gpio_nr), clock(LSM6DS3_FIFO_PERIOD_NS) {}
+
+LSM6DS3_Fifo::~LSM6DS3_Fifo() {
+  if (gpio_fd >= 0) close(gpio_fd);
+}
+
+int LSM6DS3_Fifo::init() {
+  int ret = 0;
+
+  // bypass mode empties the FIFO
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1, LSM6DS3_FIFO_WATERMARK & 0xFF);
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2, (LSM6DS3_FIFO_WATERMARK >> 8) & 0x0F);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // every gyro and accel sample goes in, at the ODR they are set up with
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3, (LSM6DS3_FIFO_DEC_NONE << 3) | LSM6DS3_FIFO_DEC_NONE);
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_ODR_208HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, LSM6DS3_INT1_FTH);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // without the interrupt the FIFO is still read every sensord cycle
+  if (gpio_nr > 0) {
+    if (gpio_init(gpio_nr, false) == 0 && gpio_set_edge(gpio_nr, "rising") == 0) {
+      gpio_fd = gpio_get_value_fd(gpio_nr);
+    }
+    if (gpio_fd < 0) {
+      LOGW("LSM6DS3 FIFO interrupt on gpio %d not available", gpio_nr);
+    }
+  }
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::read_fifo(uint64_t read_time) {
+  sets.clear();
+  timestamps.clear();
+  next_event = 0;
+
+  // number of unread words and the pattern index of the next one
+  uint8_t status[4];
+  int len = read_register(LSM6DS3_FIFO_I2C_REG_FIFO_STATUS1, status, sizeof(status));
+  if (len != sizeof(status)) {
+    LOGE("Reading FIFO status failed: %d", len);
+    return 0;
+  }
+  int words = status[0] | ((status[1] & LSM6DS3_FIFO_STATUS2_DIFF) << 8);
+  const int pattern = status[2] | ((status[3] & LSM6DS3_FIFO_STATUS4_PATTERN) << 8);
+  if (status[1] & LSM6DS3_FIFO_STATUS2_OVER_RUN) {
+    LOGW("LSM6DS3 FIFO overrun");
+  }
+
+  // start at a set boundary, the rest of a partial set is dropped
+  if (pattern % LSM6DS3_FIFO_SET_WORDS != 0) {
+    const int skip = std::min(words, LSM6DS3_FIFO_SET_WORDS - pattern % LSM6DS3_FIFO_SET_WORDS);
+    uint8_t buffer[LSM6DS3_FIFO_SET_BYTES];
+    len = read_register(LSM6DS3_FIFO_I2C_REG_FIFO_DATA_OUT, buffer, skip * 2);
+    if (len != skip * 2) {
+      // not at a set boundary, try again from the status next time
+      LOGE("Skipping partial FIFO set failed: %d", len);
+      return 0;
+    }
+    words -= skip;
+  }
+
+  // burst read whole sets, reading the data out register wraps around to its start
+  const int num_sets = words / LSM6DS3_FIFO_SET_WORDS;
+  sets.resize(num_sets * LSM6DS3_FIFO_SET_BYTES);
+  for (int i = 0; i < num_sets; i += LSM6DS3_FIFO_SETS_PER_READ) {
+    const int n = std::min(LSM6DS3_FIFO_SETS_PER_READ, num_sets - i);
+    len = read_register(LSM6DS3_FIFO_I2C_REG_FIFO_DATA_OUT, &sets[i * LSM6DS3_FIFO_SET_BYTES], n * LSM6DS3_FIFO_SET_BYTES);
+    if (len != n * LSM6DS3_FIFO_SET_BYTES) {
+      LOGE("Reading FIFO failed: %d", len);
+      sets.resize(i * LSM6DS3_FIFO_SET_BYTES);
+      break;
+    }
+  }
+
+  const int read_sets = sets.size() / LSM6DS3_FIFO_SET_BYTES;
+  if (read_sets > 0) {
+    clock.start(read_sets, read_time);
+    for (int i = 0; i < read_sets; i++) {
+      timestamps.push_back(clock.next());
+    }
+  }
+  // a gyro and an accel event per set
+  return read_sets * 2;
+}
+
+void LSM6DS3_Fifo::get_event(cereal::SensorEventData::Builder &event) {
+  assert(next_event < 2 * (int)timestamps.size());
+
+  const int set = next_event / 2;
+  const uint8_t *data = &sets[set * LSM6DS3_FIFO_SET_BYTES];
+  if (next_event % 2 == 0) {
+    gyro->fill_event(event, data, timestamps[set]);
+  } else {
+    accel->fill_event(event, data + 6, timestamps[set]);
+  }
+  next_event++;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "selfdrive/sensord/sensors/fifo_clock.h"
+#include "selfdrive/sensord/sensors/i2c_sensor.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_accel.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_gyro.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR       0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1    0x06
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2    0x07
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3    0x08
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5    0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL     0x0D
+#define LSM6DS3_FIFO_I2C_REG_FIFO_STATUS1  0x3A
+#define LSM6DS3_FIFO_I2C_REG_FIFO_DATA_OUT 0x3E
+
+// Constants
+#define LSM6DS3_FIFO_DEC_NONE         0b001  // decimation of the gyro << 3 and of the accel
+#define LSM6DS3_FIFO_ODR_208HZ        (0b0101 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS      0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS  0b110
+#define LSM6DS3_INT1_FTH              (1 << 3)
+
+#define LSM6DS3_FIFO_STATUS2_DIFF     0x0F
+#define LSM6DS3_FIFO_STATUS2_OVER_RUN (1 << 6)
+#define LSM6DS3_FIFO_STATUS4_PATTERN  0x03
+
+// a data set is the gyro x, y, z and then the accel x, y, z, each a 16 bit word
+#define LSM6DS3_FIFO_SET_WORDS        6
+#define LSM6DS3_FIFO_SET_BYTES        (LSM6DS3_FIFO_SET_WORDS * 2)
+#define LSM6DS3_FIFO_PERIOD_NS        (1000000000ULL / 208)
+// interrupt when 2 sets are in, ~10ms
+#define LSM6DS3_FIFO_WATERMARK        (2 * LSM6DS3_FIFO_SET_WORDS)
+// an smbus block read is at most 32 bytes
+#define LSM6DS3_FIFO_SETS_PER_READ    2
+
+// The accel and gyro samples of the LSM6DS3, from its FIFO. The FIFO watermark is routed to
+// INT1, whose gpio wakes sensord up. The accel and gyro are set up by their own classes first.
+class LSM6DS3_Fifo : public I2CSensor {
+  uint8_t get_device_address() {return LSM6DS3_FIFO_I2C_ADDR;}
+
+  LSM6DS3_Accel *accel;
+  LSM6DS3_Gyro *gyro;
+  int gpio_nr;
+  FifoClock clock;
+
+  // from the last read_fifo
+  std::vector<uint8_t> sets;
+  std::vector<uint64_t> timestamps;
+  int next_event = 0;
+
+public:
+  LSM6DS3_Fifo(I2CBus *bus, LSM6DS3_Accel *accel, LSM6DS3_Gyro *gyro, int gpio_nr);
+  ~LSM6DS3_Fifo();
+  int init();
+  bool has_fifo() { return true; }
+  int read_fifo(uint64_t read_time);
+  void get_event(cereal::SensorEventData::Builder &event);
+};
@@ -32,7 +32,7 @@ int LSM6DS3_Gyro::init() {
   }
 
   // TODO: set scale. Default is +- 250 deg/s
-  ret = set_register(LSM6DS3_GYRO_I2C_REG_CTRL2_G, LSM6DS3_GYRO_ODR_104HZ);
+  ret = set_register(LSM6DS3_GYRO_I2C_REG_CTRL2_G, LSM6DS3_GYRO_ODR_208HZ);
   if (ret < 0) {
     goto fail;
   }
@@ -49,16 +49,20 @@ void LSM6DS3_Gyro::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(LSM6DS3_GYRO_I2C_REG_OUTX_L_G, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
 
+  fill_event(event, buffer, start_time);
+}
+
+void LSM6DS3_Gyro::fill_event(cereal::SensorEventData::Builder &event, const uint8_t *data, uint64_t timestamp) {
   float scale = 8.75 / 1000.0;
-  float x = DEG2RAD(read_16_bit(buffer[0], buffer[1]) * scale);
-  float y = DEG2RAD(read_16_bit(buffer[2], buffer[3]) * scale);
-  float z = DEG2RAD(read_16_bit(buffer[4], buffer[5]) * scale);
+  float x = DEG2RAD(read_16_bit(data[0], data[1]) * scale);
+  float y = DEG2RAD(read_16_bit(data[2], data[3]) * scale);
+  float z = DEG2RAD(read_16_bit(data[4], data[5]) * scale);
 
   event.setSource(source);
   event.setVersion(2);
   event.setSensor(SENSOR_GYRO_UNCALIBRATED);
   event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
-  event.setTimestamp(start_time);
+  event.setTimestamp(timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initGyroUncalibrated();
@@ -14,6 +14,7 @@
 #define LSM6DS3_GYRO_CHIP_ID        0x69
 #define LSM6DS3TRC_GYRO_CHIP_ID     0x6A
 #define LSM6DS3_GYRO_ODR_104HZ      (0b0100 << 4)
+#define LSM6DS3_GYRO_ODR_208HZ      (0b0101 << 4)
 
 
 class LSM6DS3_Gyro : public I2CSensor {
@@ -23,4 +24,6 @@ public:
   LSM6DS3_Gyro(I2CBus *bus);
   int init();
   void get_event(cereal::SensorEventData::Builder &event);
+  // data is the 6 output bytes, from the output registers or from the FIFO
+  void fill_event(cereal::SensorEventData::Builder &event, const uint8_t *data, uint64_t timestamp);
 };
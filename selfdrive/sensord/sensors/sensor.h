@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cstdint>
+
 #include "cereal/gen/cpp/log.capnp.h"
 
 class Sensor {
 public:
+  int gpio_fd = -1;  // fd of the data ready interrupt, -1 if there is none
+
   virtual ~Sensor() {};
   virtual int init() = 0;
   virtual void get_event(cereal::SensorEventData::Builder &event) = 0;
+
+  // Sensors with a hardware FIFO burst read every sample it holds in read_fifo, and return how
+  // many there are. get_event then returns them in order, each with its own timestamp.
+  virtual bool has_fifo() { return false; }
+  virtual int read_fifo(uint64_t read_time) { return 0; }
 };
@@ -1,10 +1,13 @@
+#include <poll.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
-#include <chrono>
-#include <thread>
+#include <algorithm>
+#include <cerrno>
 #include <vector>
 
 #include "cereal/messaging/messaging.h"
+#include "selfdrive/common/gpio.h"
 #include "selfdrive/common/i2c.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
@@ -16,6 +19,7 @@
 #include "selfdrive/sensord/sensors/constants.h"
 #include "selfdrive/sensord/sensors/light_sensor.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_accel.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_gyro.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_temp.h"
 #include "selfdrive/sensord/sensors/mmc5603nj_magn.h"
@@ -23,6 +27,9 @@
 
 #define I2C_BUS_IMU 1
 
+// sensors without a FIFO are read this often
+#define POLL_INTERVAL_NS 10000000ULL
+
 ExitHandler do_exit;
 
 int sensor_loop() {
@@ -43,6 +50,7 @@ int sensor_loop() {
   LSM6DS3_Accel lsm6ds3_accel(i2c_bus_imu);
   LSM6DS3_Gyro lsm6ds3_gyro(i2c_bus_imu);
   LSM6DS3_Temp lsm6ds3_temp(i2c_bus_imu);
+  LSM6DS3_Fifo lsm6ds3_fifo(i2c_bus_imu, &lsm6ds3_accel, &lsm6ds3_gyro, GPIO_LSM_INT);
 
   MMC5603NJ_Magn mmc5603nj_magn(i2c_bus_imu);
 
@@ -79,24 +87,86 @@ int sensor_loop() {
     }
   }
 
+  // The LSM6DS3 accel and gyro are read from its FIFO when it can be set up, instead of one sample per cycle
+  if (lsm6ds3_fifo.init() >= 0) {
+    sensors.erase(std::remove_if(sensors.begin(), sensors.end(), [&](Sensor *s) {
+      return s == &lsm6ds3_accel || s == &lsm6ds3_gyro;
+    }), sensors.end());
+    sensors.push_back(&lsm6ds3_fifo);
+  } else {
+    LOGE("LSM6DS3 FIFO init failed, polling accel and gyro");
+  }
+
+  std::vector<Sensor *> fifo_sensors, polled_sensors;
+  std::vector<struct pollfd> fds;
+  for (Sensor *sensor : sensors) {
+    (sensor->has_fifo() ? fifo_sensors : polled_sensors).push_back(sensor);
+    if (sensor->gpio_fd >= 0) {
+      fds.push_back({.fd = sensor->gpio_fd, .events = POLLPRI});
+    }
+  }
+
   PubMaster pm({"sensorEvents"});
 
+  uint64_t next_poll = nanos_since_boot();
+  std::vector<int> fifo_counts(fifo_sensors.size());
   while (!do_exit) {
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    // sleep until a FIFO interrupt, or until the other sensors are due. With interrupts they are
+    // read along with the first FIFO read after that, so they don't need a wakeup of their own.
+    const uint64_t now = nanos_since_boot();
+    const uint64_t deadline = fds.empty() ? next_poll : next_poll + POLL_INTERVAL_NS;
+    const int timeout_ms = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+    int ret = poll(fds.data(), fds.size(), timeout_ms);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      LOGE("poll failed: %d", errno);
+      return -1;
+    }
+    for (auto &fd : fds) {
+      if (fd.revents & POLLPRI) {
+        // read the value to clear the edge
+        char value[2];
+        lseek(fd.fd, 0, SEEK_SET);
+        if (read(fd.fd, value, sizeof(value)) < 0) {
+          LOGW("reading gpio value failed: %d", errno);
+        }
+      }
+    }
+
+    const uint64_t read_time = nanos_since_boot();
+    const bool poll_due = read_time >= next_poll;
+    if (poll_due) {
+      next_poll += POLL_INTERVAL_NS;
+      if (next_poll < read_time) {
+        next_poll = read_time + POLL_INTERVAL_NS;
+      }
+    }
+
+    int num_events = poll_due ? polled_sensors.size() : 0;
+    for (int i = 0; i < (int)fifo_sensors.size(); i++) {
+      fifo_counts[i] = fifo_sensors[i]->read_fifo(read_time);
+      num_events += fifo_counts[i];
+    }
+    if (num_events == 0) continue;
 
-    const int num_events = sensors.size();
     MessageBuilder msg;
     auto sensor_events = msg.initEvent().initSensorEvents(num_events);
 
-    for (int i = 0; i < num_events; i++) {
-      auto event = sensor_events[i];
-      sensors[i]->get_event(event);
+    int e = 0;
+    for (int i = 0; i < (int)fifo_sensors.size(); i++) {
+      for (int j = 0; j < fifo_counts[i]; j++) {
+        auto event = sensor_events[e++];
+        fifo_sensors[i]->get_event(event);
+      }
+    }
+    if (poll_due) {
+      for (Sensor *sensor : polled_sensors) {
+        auto event = sensor_events[e++];
+        sensor->get_event(event);
+      }
     }
 
     pm.send("sensorEvents", msg);
-
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10) - (end - begin));
   }
   return 0;
 }
@@ -0,0 +1,172 @@
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/messaging.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
+
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+
+// Stands in for the LSM6DS3 on the bus. Its data sets come from a file, one "gx gy gz ax ay az"
+// line of raw values per set, and enter the FIFO as the test advances time.
+class MockLSM6DS3Bus : public I2CBus {
+public:
+  std::map<uint, uint8_t> registers;
+  std::vector<std::vector<int16_t>> samples;
+  std::deque<uint16_t> fifo;
+  int next_sample = 0, words_read = 0;
+  int transactions = 0;
+
+  MockLSM6DS3Bus(const std::string &filename) {
+    std::ifstream file(filename);
+    std::vector<int16_t> set(LSM6DS3_FIFO_SET_WORDS);
+    while (file >> set[0] >> set[1] >> set[2] >> set[3] >> set[4] >> set[5]) {
+      samples.push_back(set);
+    }
+  }
+
+  void produce(int sets) {
+    for (int i = 0; i < sets; i++, next_sample++) {
+      fifo.insert(fifo.end(), samples[next_sample].begin(), samples[next_sample].end());
+    }
+  }
+
+  int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
+    REQUIRE(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    transactions++;
+    if (len > 32) return -1;
+
+    if (register_address == LSM6DS3_ACCEL_I2C_REG_ID) {
+      buffer[0] = LSM6DS3_ACCEL_CHIP_ID;
+    } else if (register_address == LSM6DS3_FIFO_I2C_REG_FIFO_STATUS1) {
+      const int pattern = words_read % LSM6DS3_FIFO_SET_WORDS;
+      uint8_t status[4] = {uint8_t(fifo.size() & 0xFF), uint8_t(fifo.size() >> 8), uint8_t(pattern), 0};
+      std::copy(status, status + len, buffer);
+    } else if (register_address == LSM6DS3_FIFO_I2C_REG_FIFO_DATA_OUT) {
+      for (int i = 0; i < len / 2; i++) {
+        uint16_t word = 0;
+        if (!fifo.empty()) {
+          word = fifo.front();
+          fifo.pop_front();
+          words_read++;
+        }
+        buffer[2 * i] = word & 0xFF;
+        buffer[2 * i + 1] = word >> 8;
+      }
+    } else {
+      return -1;
+    }
+    return len;
+  }
+
+  int set_register(uint8_t device_address, uint register_address, uint8_t data) {
+    REQUIRE(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    registers[register_address] = data;
+    if (register_address == LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5 && (data & 0b111) == LSM6DS3_FIFO_MODE_BYPASS) {
+      fifo.clear();
+    }
+    return 0;
+  }
+};
+
+static std::string write_samples(int num_sets) {
+  const std::string filename = "/tmp/test_lsm6ds3_fifo_samples";
+  std::ofstream file(filename);
+  for (int i = 0; i < num_sets; i++) {
+    for (int j = 0; j < LSM6DS3_FIFO_SET_WORDS; j++) {
+      file << (i * 100 + j * 10 - 1000) << (j < LSM6DS3_FIFO_SET_WORDS - 1 ? " " : "\n");
+    }
+  }
+  return filename;
+}
+
+// checks the events are the sets [first_set, first_set + n), gyro then accel
+static void check_events(MockLSM6DS3Bus &bus, LSM6DS3_Fifo &fifo, int first_set, int n, uint64_t read_time) {
+  MessageBuilder msg;
+  auto events = msg.initEvent().initSensorEvents(n);
+  for (int i = 0; i < n; i++) {
+    auto event = events[i];
+    fifo.get_event(event);
+  }
+
+  for (int i = 0; i < n; i++) {
+    auto &raw = bus.samples[first_set + i / 2];
+    if (i % 2 == 0) {
+      REQUIRE(events[i].getSensor() == SENSOR_GYRO_UNCALIBRATED);
+      auto v = events[i].getGyroUncalibrated().getV();
+      REQUIRE(v[0] == Approx(DEG2RAD(raw[1] * 8.75 / 1000.0)));
+      REQUIRE(v[1] == Approx(-DEG2RAD(raw[0] * 8.75 / 1000.0)));
+      REQUIRE(v[2] == Approx(DEG2RAD(raw[2] * 8.75 / 1000.0)));
+    } else {
+      REQUIRE(events[i].getSensor() == SENSOR_ACCELEROMETER);
+      auto v = events[i].getAcceleration().getV();
+      const float scale = 9.81 * 2.0f / (1 << 15);
+      REQUIRE(v[0] == Approx(raw[4] * scale));
+      REQUIRE(v[1] == Approx(-raw[3] * scale));
+      REQUIRE(v[2] == Approx(raw[5] * scale));
+      REQUIRE(events[i].getTimestamp() == events[i - 1].getTimestamp());
+    }
+  }
+
+  // one ODR period apart, the newest one read at read_time
+  for (int i = 2; i < n; i += 2) {
+    REQUIRE(events[i].getTimestamp() - events[i - 2].getTimestamp() == LSM6DS3_FIFO_PERIOD_NS);
+  }
+  REQUIRE(events[n - 1].getTimestamp() == read_time);
+}
+
+TEST_CASE("LSM6DS3 FIFO") {
+  MockLSM6DS3Bus bus(write_samples(100));
+  REQUIRE(bus.samples.size() == 100);
+
+  LSM6DS3_Accel accel(&bus);
+  LSM6DS3_Gyro gyro(&bus);
+  LSM6DS3_Fifo fifo(&bus, &accel, &gyro, 0);
+  REQUIRE(accel.init() >= 0);
+  REQUIRE(gyro.init() >= 0);
+  REQUIRE(fifo.init() >= 0);
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5] == (LSM6DS3_FIFO_ODR_208HZ | LSM6DS3_FIFO_MODE_CONTINUOUS));
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_INT1_CTRL] == LSM6DS3_INT1_FTH);
+  REQUIRE(fifo.gpio_fd == -1);
+
+  uint64_t t = 1000000000ULL;
+  REQUIRE(fifo.read_fifo(t) == 0);
+
+  SECTION("burst reads every sample") {
+    bus.produce(5);
+    bus.transactions = 0;
+    REQUIRE(fifo.read_fifo(t) == 10);
+    // the status, then two sets per read
+    REQUIRE(bus.transactions == 1 + 3);
+    check_events(bus, fifo, 0, 10, t);
+    REQUIRE(bus.fifo.empty());
+
+    // the next read continues the timestamps
+    bus.produce(20);
+    t += 20 * LSM6DS3_FIFO_PERIOD_NS;
+    REQUIRE(fifo.read_fifo(t) == 40);
+    check_events(bus, fifo, 5, 40, t);
+  }
+
+  SECTION("drops a partial set") {
+    bus.produce(3);
+    uint8_t buffer[4];
+    bus.read_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_DATA_OUT, buffer, sizeof(buffer));
+
+    REQUIRE(fifo.read_fifo(t) == 4);
+    check_events(bus, fifo, 1, 4, t);
+    REQUIRE(bus.fifo.empty());
+  }
+
+  SECTION("leaves the words of an incomplete set") {
+    bus.produce(2);
+    bus.fifo.pop_back();
+    REQUIRE(fifo.read_fifo(t) == 2);
+    check_events(bus, fifo, 0, 2, t);
+    REQUIRE(bus.fifo.size() == LSM6DS3_FIFO_SET_WORDS - 1);
+  }
+}
@@ -2,6 +2,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
 
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
@@ -288,6 +292,73 @@ static void ui_draw_world(UIState *s) {
   nvgResetScissor(s->vg);
 }
 
+// the inputs a layer is drawn from, strings up to their terminator
+template <typename T, typename = std::enable_if_t<!std::is_array_v<T>>>
+static void layer_key(std::string &key, const T &v) {
+  key.append((const char *)&v, sizeof(v));
+}
+
+static void layer_key(std::string &key, const char *str) {
+  key.append(str, strlen(str) + 1);
+}
+
+// Draws a panel that only changes with its key. draw() renders it into the layer's
+// framebuffer when the key or the rect changed since the last frame, and every frame
+// the framebuffer is composited at rect as one image. draw() uses screen coordinates
+// and shouldn't leave rect.
+static void ui_draw_layer(UIState *s, const char *name, const Rect &rect, const std::string &key, const std::function<void()> &draw) {
+  UILayer &layer = s->layers[name];
+  if (layer.fb && (layer.rect.w != rect.w || layer.rect.h != rect.h)) {
+    nvgluDeleteFramebuffer(layer.fb);
+    layer.fb = nullptr;
+  }
+  if (!layer.fb) {
+    // FBO images are stored upside down, and nanovg renders premultiplied alpha into them
+    layer.fb = nvgluCreateFramebuffer(s->vg, rect.w, rect.h, NVG_IMAGE_FLIPY | NVG_IMAGE_PREMULTIPLIED);
+    if (!layer.fb) {
+      draw();
+      return;
+    }
+    layer.key.clear();
+  }
+
+  if (layer.key.empty() || layer.key != key || layer.rect.x != rect.x || layer.rect.y != rect.y) {
+    // nanovg frames don't nest, flush what's drawn so far to the screen
+    nvgEndFrame(s->vg);
+    GLint screen_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &screen_fbo);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fb->fbo);
+    glViewport(0, 0, rect.w, rect.h);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    nvgBeginFrame(s->vg, rect.w, rect.h, 1.0f);
+    nvgTranslate(s->vg, -rect.x, -rect.y);
+    draw();
+    nvgEndFrame(s->vg);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+    glViewport(0, 0, s->fb_w, s->fb_h);
+    nvgBeginFrame(s->vg, s->fb_w, s->fb_h, 1.0f);
+
+    layer.rect = rect;
+    layer.key = key;
+  }
+
+  nvgBeginPath(s->vg);
+  NVGpaint paint = nvgImagePattern(s->vg, rect.x, rect.y, rect.w, rect.h, 0, layer.fb->image, 1.0f);
+  nvgRect(s->vg, rect.x, rect.y, rect.w, rect.h);
+  nvgFillPaint(s->vg, paint);
+  nvgFill(s->vg);
+}
+
+void ui_free_layers(UIState *s) {
+  for (auto &[name, layer] : s->layers) {
+    if (layer.fb) nvgluDeleteFramebuffer(layer.fb);
+  }
+  s->layers.clear();
+}
+
 static int bb_ui_draw_measure(UIState *s,  const char* bb_value, const char* bb_uom, const char* bb_label,
     int bb_x, int bb_y, int bb_uom_dx,
     NVGcolor bb_valueColor, NVGcolor bb_labelColor, NVGcolor bb_uomColor,
@@ -324,23 +395,65 @@ static int bb_ui_draw_measure(UIState *s,  const char* bb_value, const char* bb_
   return (int)((bb_valueFontSize + bb_labelFontSize)*2.5) + 5;
 }
 
+// one value of the measure panels
+typedef struct Measure {
+  char value[16];
+  const char *uom;
+  const char *label;
+  NVGcolor color;
+} Measure;
+
+const int MAX_MEASURES = 8;
+
+// draws a measure panel as a layer, redrawn when one of its formatted values changes
+static void bb_ui_draw_measures(UIState *s, const char *layer, const Measure *measures, int count, int bb_x, int bb_y, int bb_w) {
+  const int value_fontSize = 30;
+  const int label_fontSize = 15;
+  const int uom_fontSize = 15;
+  const int bb_uom_dx = (int)(bb_w /2 - uom_fontSize*2.5);
+  const int bb_h = 5 + count * ((int)((value_fontSize + label_fontSize)*2.5) + 5) + 40;
+
+  std::string key;
+  for (int i = 0; i < count; i++) {
+    layer_key(key, measures[i].value);
+    layer_key(key, measures[i].uom);
+    layer_key(key, measures[i].label);
+    layer_key(key, measures[i].color);
+  }
+
+  // with room for the frame's stroke
+  const Rect rect = {bb_x - 4, bb_y - 4, bb_w + 8, bb_h + 8};
+  ui_draw_layer(s, layer, rect, key, [=]() {
+    NVGcolor lab_color = nvgRGBA(255, 255, 255, 200);
+    NVGcolor uom_color = nvgRGBA(255, 255, 255, 200);
+    int bb_rx = bb_x + (int)(bb_w/2);
+    int bb_ry = bb_y;
+    int h = 5;
+    for (int i = 0; i < count; i++) {
+      h += bb_ui_draw_measure(s, measures[i].value, measures[i].uom, measures[i].label,
+          bb_rx, bb_ry, bb_uom_dx,
+          measures[i].color, lab_color, uom_color,
+          value_fontSize, label_fontSize, uom_fontSize );
+      bb_ry = bb_y + h;
+    }
+
+    //finally draw the frame
+    nvgBeginPath(s->vg);
+    nvgRoundedRect(s->vg, bb_x, bb_y, bb_w, bb_h, 20);
+    nvgStrokeColor(s->vg, nvgRGBA(255,255,255,80));
+    nvgStrokeWidth(s->vg, 6);
+    nvgStroke(s->vg);
+  });
+}
+
 static void bb_ui_draw_measures_left(UIState *s, int bb_x, int bb_y, int bb_w ) {
-  const UIScene *scene = &s->scene;
-  int bb_rx = bb_x + (int)(bb_w/2);
-  int bb_ry = bb_y;
-  int bb_h = 5;
-  NVGcolor lab_color = nvgRGBA(255, 255, 255, 200);
-  NVGcolor uom_color = nvgRGBA(255, 255, 255, 200);
-  int value_fontSize=30;
-  int label_fontSize=15;
-  int uom_fontSize = 15;
-  int bb_uom_dx =  (int)(bb_w /2 - uom_fontSize*2.5) ;
+  Measure measures[MAX_MEASURES];
+  int count = 0;
 
   //add visual radar relative distance
   if (UI_FEATURE_LEFT_REL_DIST) {
-    char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "m   ", "REL DIST", nvgRGBA(255, 255, 255, 200)};
 
     auto radar_state = (*s->sm)["radarState"].getRadarState();
     auto lead_one = radar_state.getLeadOne();
@@ -349,68 +462,50 @@ static void bb_ui_draw_measures_left(UIState *s, int bb_x, int bb_y, int bb_w )
       //show RED if less than 5 meters
       //show orange if less than 15 meters
       if((int)(lead_one.getDRel()) < 15) {
-        val_color = nvgRGBA(255, 188, 3, 200);
+        m.color = nvgRGBA(255, 188, 3, 200);
       }
       if((int)(lead_one.getDRel()) < 5) {
-        val_color = nvgRGBA(255, 0, 0, 200);
+        m.color = nvgRGBA(255, 0, 0, 200);
       }
       // lead car relative distance is always in meters
-      snprintf(val_str, sizeof(val_str), "%.1f", lead_one.getDRel());
+      snprintf(m.value, sizeof(m.value), "%.1f", lead_one.getDRel());
     } else {
-       snprintf(val_str, sizeof(val_str), "-");
+       snprintf(m.value, sizeof(m.value), "-");
     }
-    snprintf(uom_str, sizeof(uom_str), "m   ");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "REL DIST",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
   }
 
   //add visual radar relative speed
   if (UI_FEATURE_LEFT_REL_SPEED) {
+    Measure &m = measures[count++];
+    m = {"", s->scene.is_metric ? "km/h" : "mph", "REL SPEED", nvgRGBA(255, 255, 255, 200)};
 
     auto radar_state = (*s->sm)["radarState"].getRadarState();
     auto lead_one = radar_state.getLeadOne();
 
-    char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
     if (lead_one.getStatus()) {
       //show Orange if negative speed (approaching)
       //show Orange if negative speed faster than 5mph (approaching fast)
       if((int)(lead_one.getVRel()) < 0) {
-        val_color = nvgRGBA(255, 188, 3, 200);
+        m.color = nvgRGBA(255, 188, 3, 200);
       }
       if((int)(lead_one.getVRel()) < -5) {
-        val_color = nvgRGBA(255, 0, 0, 200);
+        m.color = nvgRGBA(255, 0, 0, 200);
       }
       // lead car relative speed is always in meters
       if (s->scene.is_metric) {
-         snprintf(val_str, sizeof(val_str), "%d", (int)(lead_one.getVRel() * 3.6 + 0.5));
+         snprintf(m.value, sizeof(m.value), "%d", (int)(lead_one.getVRel() * 3.6 + 0.5));
       } else {
-         snprintf(val_str, sizeof(val_str), "%d", (int)(lead_one.getVRel() * 2.2374144 + 0.5));
+         snprintf(m.value, sizeof(m.value), "%d", (int)(lead_one.getVRel() * 2.2374144 + 0.5));
       }
     } else {
-       snprintf(val_str, sizeof(val_str), "-");
+       snprintf(m.value, sizeof(m.value), "-");
     }
-    if (s->scene.is_metric) {
-      snprintf(uom_str, sizeof(uom_str), "km/h");;
-    } else {
-      snprintf(uom_str, sizeof(uom_str), "mph");
-    }
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "REL SPEED",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
   }
 
   //add  steering angle
   if (UI_FEATURE_LEFT_REAL_STEER) {
-    char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(0, 255, 0, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "REAL STEER", nvgRGBA(0, 255, 0, 200)};
       //show Orange if more than 30 degrees
       //show red if  more than 50 degrees
 
@@ -418,27 +513,19 @@ static void bb_ui_draw_measures_left(UIState *s, int bb_x, int bb_y, int bb_w )
       float angleSteers = controls_state.getAngleSteers();
 
       if(((int)(angleSteers) < -30) || ((int)(angleSteers) > 30)) {
-        val_color = nvgRGBA(255, 175, 3, 200);
+        m.color = nvgRGBA(255, 175, 3, 200);
       }
       if(((int)(angleSteers) < -55) || ((int)(angleSteers) > 55)) {
-        val_color = nvgRGBA(255, 0, 0, 200);
+        m.color = nvgRGBA(255, 0, 0, 200);
       }
       // steering is in degrees
-      snprintf(val_str, sizeof(val_str), "%.1f°", angleSteers);
-
-      snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "REAL STEER",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+      snprintf(m.value, sizeof(m.value), "%.1f°", angleSteers);
   }
 
   //add  desired steering angle
   if (UI_FEATURE_LEFT_DESIRED_STEER) {
-    char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "DESIR STEER", nvgRGBA(255, 255, 255, 200)};
 
     auto carControl = (*s->sm)["carControl"].getCarControl();
     if (carControl.getEnabled()) {
@@ -449,53 +536,31 @@ static void bb_ui_draw_measures_left(UIState *s, int bb_x, int bb_y, int bb_w )
       float steeringAngleDeg  = actuators.getSteeringAngleDeg();
 
       if(((int)(steeringAngleDeg ) < -30) || ((int)(steeringAngleDeg ) > 30)) {
-        val_color = nvgRGBA(255, 255, 255, 200);
+        m.color = nvgRGBA(255, 255, 255, 200);
       }
       if(((int)(steeringAngleDeg ) < -50) || ((int)(steeringAngleDeg ) > 50)) {
-        val_color = nvgRGBA(255, 255, 255, 200);
+        m.color = nvgRGBA(255, 255, 255, 200);
       }
       // steering is in degrees
-      snprintf(val_str, sizeof(val_str), "%.1f°", steeringAngleDeg );
+      snprintf(m.value, sizeof(m.value), "%.1f°", steeringAngleDeg );
     } else {
-       snprintf(val_str, sizeof(val_str), "-");
+       snprintf(m.value, sizeof(m.value), "-");
     }
-      snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "DESIR STEER",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
   }
 
-
-  //finally draw the frame
-  bb_h += 40;
-  nvgBeginPath(s->vg);
-    nvgRoundedRect(s->vg, bb_x, bb_y, bb_w, bb_h, 20);
-    nvgStrokeColor(s->vg, nvgRGBA(255,255,255,80));
-    nvgStrokeWidth(s->vg, 6);
-    nvgStroke(s->vg);
+  bb_ui_draw_measures(s, "measures_left", measures, count, bb_x, bb_y, bb_w);
 }
 
 static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w ) {
-  const UIScene *scene = &s->scene;
-  int bb_rx = bb_x + (int)(bb_w/2);
-  int bb_ry = bb_y;
-  int bb_h = 5;
-  NVGcolor lab_color = nvgRGBA(255, 255, 255, 200);
-  NVGcolor uom_color = nvgRGBA(255, 255, 255, 200);
-  int value_fontSize=30;
-  int label_fontSize=15;
-  int uom_fontSize = 15;
-  int bb_uom_dx =  (int)(bb_w /2 - uom_fontSize*2.5) ;
+  Measure measures[MAX_MEASURES];
+  int count = 0;
 
   auto device_state = (*s->sm)["deviceState"].getDeviceState();
 
   // add CPU temperature
   if (UI_FEATURE_RIGHT_CPU_TEMP) {
-        char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "CPU TEMP", nvgRGBA(255, 255, 255, 200)};
 
     float cpuTemp = 0;
     auto cpuList = device_state.getCpuTempC();
@@ -509,43 +574,29 @@ static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w )
     }
 
       if(cpuTemp > 80.f) {
-        val_color = nvgRGBA(255, 188, 3, 200);
+        m.color = nvgRGBA(255, 188, 3, 200);
       }
       if(cpuTemp > 92.f) {
-        val_color = nvgRGBA(255, 0, 0, 200);
+        m.color = nvgRGBA(255, 0, 0, 200);
       }
       // temp is alway in C * 10
-      snprintf(val_str, sizeof(val_str), "%.1f°", cpuTemp);
-      snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "CPU TEMP",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+      snprintf(m.value, sizeof(m.value), "%.1f°", cpuTemp);
   }
 
   float ambientTemp = device_state.getAmbientTempC();
 
    // add ambient temperature
   if (UI_FEATURE_RIGHT_AMBIENT_TEMP) {
-
-    char val_str[16];
-    char uom_str[6];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "AMBIENT", nvgRGBA(255, 255, 255, 200)};
 
     if(ambientTemp > 40.f) {
-      val_color = nvgRGBA(255, 188, 3, 200);
+      m.color = nvgRGBA(255, 188, 3, 200);
     }
     if(ambientTemp > 50.f) {
-      val_color = nvgRGBA(255, 0, 0, 200);
+      m.color = nvgRGBA(255, 0, 0, 200);
     }
-    snprintf(val_str, sizeof(val_str), "%.1f°", ambientTemp);
-    snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "AMBIENT",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+    snprintf(m.value, sizeof(m.value), "%.1f°", ambientTemp);
   }
 
   float batteryTemp = device_state.getBatteryTempC();
@@ -553,41 +604,26 @@ static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w )
 
   // add battery level
     if(UI_FEATURE_RIGHT_BATTERY_LEVEL && !batteryless) {
-    char val_str[16];
-    char uom_str[6];
-    char bat_lvl[4] = "";
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "BAT LVL", nvgRGBA(255, 255, 255, 200)};
 
     int batteryPercent = device_state.getBatteryPercent();
 
-    snprintf(val_str, sizeof(val_str), "%d%%", batteryPercent);
-    snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "BAT LVL",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+    snprintf(m.value, sizeof(m.value), "%d%%", batteryPercent);
   }
 
   // add panda GPS altitude
   if (UI_FEATURE_RIGHT_GPS_ALTITUDE) {
-    char val_str[16];
-    char uom_str[3];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
-
-    snprintf(val_str, sizeof(val_str), "%.1f", s->scene.gps_ext.getAltitude());
-    snprintf(uom_str, sizeof(uom_str), "m");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "ALTITUDE",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+    Measure &m = measures[count++];
+    m = {"", "m", "ALTITUDE", nvgRGBA(255, 255, 255, 200)};
+
+    snprintf(m.value, sizeof(m.value), "%.1f", s->scene.gps_ext.getAltitude());
   }
 
   // add panda GPS accuracy
   if (UI_FEATURE_RIGHT_GPS_ACCURACY) {
-    char val_str[16];
-    char uom_str[3];
+    Measure &m = measures[count++];
+    m = {"", "m", "GPS PREC", nvgRGBA(255, 255, 255, 200)};
 
     auto gps_ext = s->scene.gps_ext;
     float verticalAccuracy = gps_ext.getVerticalAccuracy();
@@ -602,48 +638,28 @@ static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w )
     else if (gpsAccuracy == 0)
       gpsAccuracy = 99.8;
 
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
     if(gpsAccuracy > 1.0) {
-         val_color = nvgRGBA(255, 188, 3, 200);
+         m.color = nvgRGBA(255, 188, 3, 200);
       }
       if(gpsAccuracy > 2.0) {
-         val_color = nvgRGBA(255, 80, 80, 200);
+         m.color = nvgRGBA(255, 80, 80, 200);
       }
 
-    snprintf(val_str, sizeof(val_str), "%.2f", gpsAccuracy);
-    snprintf(uom_str, sizeof(uom_str), "m");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "GPS PREC",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+    snprintf(m.value, sizeof(m.value), "%.2f", gpsAccuracy);
   }
 
   // add panda GPS satellite
   if (UI_FEATURE_RIGHT_GPS_SATELLITE) {
-    char val_str[16];
-    char uom_str[3];
-    NVGcolor val_color = nvgRGBA(255, 255, 255, 200);
+    Measure &m = measures[count++];
+    m = {"", "", "SATELLITE", nvgRGBA(255, 255, 255, 200)};
 
     if(s->scene.satelliteCount < 6)
-         val_color = nvgRGBA(255, 80, 80, 200);
-
-    snprintf(val_str, sizeof(val_str), "%d", s->scene.satelliteCount > 0 ? s->scene.satelliteCount : 0);
-    snprintf(uom_str, sizeof(uom_str), "");
-    bb_h +=bb_ui_draw_measure(s,  val_str, uom_str, "SATELLITE",
-        bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
-        value_fontSize, label_fontSize, uom_fontSize );
-    bb_ry = bb_y + bb_h;
+         m.color = nvgRGBA(255, 80, 80, 200);
+
+    snprintf(m.value, sizeof(m.value), "%d", s->scene.satelliteCount > 0 ? s->scene.satelliteCount : 0);
   }
 
-  //finally draw the frame
-  bb_h += 40;
-  nvgBeginPath(s->vg);
-  nvgRoundedRect(s->vg, bb_x, bb_y, bb_w, bb_h, 20);
-  nvgStrokeColor(s->vg, nvgRGBA(255,255,255,80));
-  nvgStrokeWidth(s->vg, 6);
-  nvgStroke(s->vg);
+  bb_ui_draw_measures(s, "measures_right", measures, count, bb_x, bb_y, bb_w);
 }
 
 static void bb_ui_draw_basic_info(UIState *s)
@@ -684,21 +700,21 @@ static void bb_ui_draw_basic_info(UIState *s)
     int x = bdr_s * 2;
     int y = s->fb_h - 24;
 
-    nvgTextAlign(s->vg, NVG_ALIGN_LEFT | NVG_ALIGN_MIDDLE);
-
-    ui_draw_text(s, x, y, str, 20 * 2.5, COLOR_WHITE_ALPHA(200), "sans-semibold");
+    const Rect rect = {0, y - 40, s->fb_w, 64};
+    ui_draw_layer(s, "basic_info", rect, str, [&]() {
+      nvgTextAlign(s->vg, NVG_ALIGN_LEFT | NVG_ALIGN_MIDDLE);
+      ui_draw_text(s, x, y, str, 20 * 2.5, COLOR_WHITE_ALPHA(200), "sans-semibold");
+    });
 }
 
 static void bb_ui_draw_debug(UIState *s)
 {
     const UIScene *scene = &s->scene;
-    char str[1024];
+    char str[11][128];
 
     int y = 80;
     const int height = 60;
 
-    nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
-
     const int text_x = s->fb_w/2 + s->fb_w * 10 / 55;
 
     auto controls_state = (*s->sm)["controlsState"].getControlsState();
@@ -726,45 +742,17 @@ static void bb_ui_draw_debug(UIState *s)
 
     const NVGcolor textColor = COLOR_WHITE;
 
-    y += height;
-    snprintf(str, sizeof(str), "State: %s", long_state[longControlState]);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "vPid: %.3f(%.1f)", vPid, vPid * 3.6f);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "P: %.3f", upAccelCmd);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "I: %.3f", uiAccelCmd);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "F: %.3f", ufAccelCmd);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "Gas: %.3f, Brake: %.3f", gas, brake);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "Accel: %.3f/%.3f", applyAccel, aReqValue);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "%.3f (%.3f/%.3f)", aReqValue, aReqValueMin, aReqValueMax);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "Cam: %d/%d", sccStockCamAct, sccStockCamStatus);
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
-
-    y += height;
-    snprintf(str, sizeof(str), "Torque:%.1f/%.1f", car_state.getSteeringTorque(), car_state.getSteeringTorqueEps());
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
+    int n = 0;
+    snprintf(str[n++], sizeof(str[0]), "State: %s", long_state[longControlState]);
+    snprintf(str[n++], sizeof(str[0]), "vPid: %.3f(%.1f)", vPid, vPid * 3.6f);
+    snprintf(str[n++], sizeof(str[0]), "P: %.3f", upAccelCmd);
+    snprintf(str[n++], sizeof(str[0]), "I: %.3f", uiAccelCmd);
+    snprintf(str[n++], sizeof(str[0]), "F: %.3f", ufAccelCmd);
+    snprintf(str[n++], sizeof(str[0]), "Gas: %.3f, Brake: %.3f", gas, brake);
+    snprintf(str[n++], sizeof(str[0]), "Accel: %.3f/%.3f", applyAccel, aReqValue);
+    snprintf(str[n++], sizeof(str[0]), "%.3f (%.3f/%.3f)", aReqValue, aReqValueMin, aReqValueMax);
+    snprintf(str[n++], sizeof(str[0]), "Cam: %d/%d", sccStockCamAct, sccStockCamStatus);
+    snprintf(str[n++], sizeof(str[0]), "Torque:%.1f/%.1f", car_state.getSteeringTorque(), car_state.getSteeringTorqueEps());
 
     auto lead_radar = (*s->sm)["radarState"].getRadarState().getLeadOne();
     auto lead_one = (*s->sm)["modelV2"].getModelV2().getLeadsV3()[0];
@@ -772,11 +760,21 @@ static void bb_ui_draw_debug(UIState *s)
     float radar_dist = lead_radar.getStatus() && lead_radar.getRadar() ? lead_radar.getDRel() : 0;
     float vision_dist = lead_one.getProb() > .5 ? lead_one.getX()[0] : 0;
 
-    y += height;
-    snprintf(str, sizeof(str), "Lead: %.1f/%.1f/%.1f", radar_dist, vision_dist, (radar_dist - vision_dist));
-    ui_draw_text(s, text_x, y, str, 22 * 2.5, textColor, "sans-regular");
+    snprintf(str[n++], sizeof(str[0]), "Lead: %.1f/%.1f/%.1f", radar_dist, vision_dist, (radar_dist - vision_dist));
 
+    std::string key;
+    for (int i = 0; i < n; i++) {
+      layer_key(key, str[i]);
+    }
 
+    const Rect rect = {s->fb_w / 2, y, s->fb_w / 2, height * (n + 1)};
+    ui_draw_layer(s, "debug", rect, key, [&]() {
+      nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
+      for (int i = 0; i < n; i++) {
+        y += height;
+        ui_draw_text(s, text_x, y, str[i], 22 * 2.5, textColor, "sans-regular");
+      }
+    });
 }
 
 
@@ -895,48 +893,67 @@ static void ui_draw_vision_maxspeed(UIState *s) {
 
   bool is_cruise_set = (cruiseRealMaxSpeed > 0 && cruiseRealMaxSpeed < 255);
 
-  const Rect rect = {bdr_s * 2, int(bdr_s * 1.5), 184, 202};
-  ui_fill_rect(s->vg, rect, COLOR_BLACK_ALPHA(100), 30.);
-  ui_draw_rect(s->vg, rect, COLOR_WHITE_ALPHA(100), 10, 20.);
-
-  nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
-  const int text_x = rect.centerX();
-
+  char virtual_str[16] = "", real_str[16] = "";
   if(is_cruise_set)
   {
-    char str[256];
-
     if(s->scene.is_metric)
-        snprintf(str, sizeof(str), "%d", (int)(cruiseVirtualMaxSpeed + 0.5));
+        snprintf(virtual_str, sizeof(virtual_str), "%d", (int)(cruiseVirtualMaxSpeed + 0.5));
     else
-        snprintf(str, sizeof(str), "%d", (int)(cruiseVirtualMaxSpeed*0.621371 + 0.5));
-
-    ui_draw_text(s, text_x, 100, str, 33 * 2.5, COLOR_WHITE, "sans-semibold");
+        snprintf(virtual_str, sizeof(virtual_str), "%d", (int)(cruiseVirtualMaxSpeed*0.621371 + 0.5));
 
     if(s->scene.is_metric)
-        snprintf(str, sizeof(str), "%d", (int)(cruiseRealMaxSpeed + 0.5));
+        snprintf(real_str, sizeof(real_str), "%d", (int)(cruiseRealMaxSpeed + 0.5));
     else
-        snprintf(str, sizeof(str), "%d", (int)(cruiseRealMaxSpeed*0.621371 + 0.5));
-
-    ui_draw_text(s, text_x, 195, str, 48 * 2.5, COLOR_WHITE, "sans-bold");
+        snprintf(real_str, sizeof(real_str), "%d", (int)(cruiseRealMaxSpeed*0.621371 + 0.5));
   }
-  else
-  {
-    if(longControl)
-        ui_draw_text(s, text_x, 100, "OP", 25 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
+
+  std::string key;
+  layer_key(key, is_cruise_set);
+  layer_key(key, longControl);
+  layer_key(key, virtual_str);
+  layer_key(key, real_str);
+
+  const Rect rect = {bdr_s * 2, int(bdr_s * 1.5), 184, 202};
+  // with room for the border's stroke
+  const Rect layer_rect = {rect.x - 6, rect.y - 6, rect.w + 12, rect.h + 12};
+  ui_draw_layer(s, "maxspeed", layer_rect, key, [&]() {
+    ui_fill_rect(s->vg, rect, COLOR_BLACK_ALPHA(100), 30.);
+    ui_draw_rect(s->vg, rect, COLOR_WHITE_ALPHA(100), 10, 20.);
+
+    nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
+    const int text_x = rect.centerX();
+
+    if(is_cruise_set)
+    {
+      ui_draw_text(s, text_x, 100, virtual_str, 33 * 2.5, COLOR_WHITE, "sans-semibold");
+      ui_draw_text(s, text_x, 195, real_str, 48 * 2.5, COLOR_WHITE, "sans-bold");
+    }
     else
-        ui_draw_text(s, text_x, 100, "MAX", 25 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
+    {
+      if(longControl)
+          ui_draw_text(s, text_x, 100, "OP", 25 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
+      else
+          ui_draw_text(s, text_x, 100, "MAX", 25 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
 
-    ui_draw_text(s, text_x, 195, "N/A", 42 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
-  }
+      ui_draw_text(s, text_x, 195, "N/A", 42 * 2.5, COLOR_WHITE_ALPHA(100), "sans-semibold");
+    }
+  });
 }
 
 static void ui_draw_vision_speed(UIState *s) {
   const float speed = std::max(0.0, (*s->sm)["controlsState"].getControlsState().getCluSpeedMs() * (s->scene.is_metric ? 3.6 : 2.2369363));
   const std::string speed_str = std::to_string((int)std::nearbyint(speed));
-  nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
-  ui_draw_text(s, s->fb_w/2, 210, speed_str.c_str(), 96 * 2.5, COLOR_WHITE, "sans-bold");
-  ui_draw_text(s, s->fb_w/2, 290, s->scene.is_metric ? "km/h" : "mph", 36 * 2.5, COLOR_WHITE_ALPHA(200), "sans-regular");
+  const char *unit = s->scene.is_metric ? "km/h" : "mph";
+
+  std::string key = speed_str;
+  layer_key(key, unit);
+
+  const Rect rect = {s->fb_w/2 - 300, 0, 600, 320};
+  ui_draw_layer(s, "speed", rect, key, [&]() {
+    nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
+    ui_draw_text(s, s->fb_w/2, 210, speed_str.c_str(), 96 * 2.5, COLOR_WHITE, "sans-bold");
+    ui_draw_text(s, s->fb_w/2, 290, unit, 36 * 2.5, COLOR_WHITE_ALPHA(200), "sans-regular");
+  });
 }
 
 static void ui_draw_vision_event(UIState *s) {
@@ -969,6 +986,27 @@ static void ui_draw_vision_header(UIState *s) {
   ui_draw_extras(s);
 }
 
+// gap, brake lights and auto hold
+static void ui_draw_vision_footer(UIState *s) {
+  auto car_state = (*s->sm)["carState"].getCarState();
+  auto scc_smoother = s->scene.car_control.getSccSmoother();
+
+  std::string key;
+  layer_key(key, car_state.getCruiseGap());
+  layer_key(key, scc_smoother.getLongControl());
+  layer_key(key, scc_smoother.getAutoTrGap());
+  layer_key(key, car_state.getBrakeLights());
+  layer_key(key, car_state.getAutoHold());
+
+  const int radius = 96;
+  const Rect rect = {bdr_s * 2 - 2, s->fb_h - footer_h / 2 - radius - 2, (radius*2 + 60) * 2 + radius*2 + 4, radius*2 + 4};
+  ui_draw_layer(s, "footer", rect, key, [=]() {
+    ui_draw_vision_scc_gap(s);
+    ui_draw_vision_brake(s);
+    ui_draw_vision_autohold(s);
+  });
+}
+
 static void ui_draw_vision(UIState *s) {
   const UIScene *scene = &s->scene;
   // Draw augmented elements
@@ -977,9 +1015,7 @@ static void ui_draw_vision(UIState *s) {
   }
   // Set Speed, Current Speed, Status/Events
   ui_draw_vision_header(s);
-  ui_draw_vision_scc_gap(s);
-  ui_draw_vision_brake(s);
-  ui_draw_vision_autohold(s);
+  ui_draw_vision_footer(s);
 }
 
 void ui_draw(UIState *s, int w, int h) {
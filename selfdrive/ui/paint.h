@@ -8,4 +8,5 @@ void ui_draw_rect(NVGcontext *vg, const Rect &r, NVGcolor color, int width, floa
 void ui_fill_rect(NVGcontext *vg, const Rect &r, const NVGpaint &paint, float radius = 0);
 void ui_fill_rect(NVGcontext *vg, const Rect &r, const NVGcolor &color, float radius = 0);
 void ui_nvg_init(UIState *s);
+void ui_free_layers(UIState *s);
 void ui_resize(UIState *s, int width, int height);
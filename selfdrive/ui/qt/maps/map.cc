@@ -184,7 +184,7 @@ void MapWindow::timerUpdate() {
     auto cur_maneuver = segment.maneuver();
     auto attrs = cur_maneuver.extendedAttributes();
     if (cur_maneuver.isValid() && attrs.contains("mapbox.banner_instructions")) {
-      float along_geometry = distance_along_geometry(segment.path(), to_QGeoCoordinate(*last_position));
+      float along_geometry = route_segments[segment_idx].geometry.distanceAlong(to_QGeoCoordinate(*last_position));
       float distance_to_maneuver = segment.distance() - along_geometry;
       emit distanceChanged(std::max(0.0f, distance_to_maneuver));
 
@@ -202,6 +202,7 @@ void MapWindow::timerUpdate() {
         auto next_segment = segment.nextRouteSegment();
         if (next_segment.isValid()) {
           segment = next_segment;
+          segment_idx++;
 
           recompute_backoff = std::max(0, recompute_backoff - 1);
           recompute_countdown = 0;
@@ -311,19 +312,11 @@ void MapWindow::recomputeRoute() {
 
 void MapWindow::updateETA() {
   if (segment.isValid()) {
-    float progress = distance_along_geometry(segment.path(), to_QGeoCoordinate(*last_position)) / segment.distance();
-    float total_distance = segment.distance() * (1.0 - progress);
-    float total_time = segment.travelTime() * (1.0 - progress);
-    float total_time_typical = get_time_typical(segment) * (1.0 - progress);
-
-    auto s = segment.nextRouteSegment();
-    while (s.isValid()) {
-      total_distance += s.distance();
-      total_time += s.travelTime();
-      total_time_typical += get_time_typical(s);
-
-      s = s.nextRouteSegment();
-    }
+    RouteSegment &cur = route_segments[segment_idx];
+    float progress = cur.geometry.distanceAlong(to_QGeoCoordinate(*last_position)) / segment.distance();
+    float total_distance = segment.distance() * (1.0 - progress) + cur.distance_after;
+    float total_time = segment.travelTime() * (1.0 - progress) + cur.time_after;
+    float total_time_typical = get_time_typical(segment) * (1.0 - progress) + cur.time_typical_after;
 
     emit ETAChanged(total_time, total_time_typical, total_distance);
   }
@@ -354,6 +347,21 @@ void MapWindow::routeCalculated(QGeoRouteReply *reply) {
 
       route = reply->routes().at(0);
       segment = route.firstRouteSegment();
+      segment_idx = 0;
+
+      // index the geometry and sum up the remaining distance and time once per route
+      std::vector<QGeoRouteSegment> segments;
+      for (auto s = segment; s.isValid(); s = s.nextRouteSegment()) {
+        segments.push_back(s);
+      }
+      route_segments.resize(segments.size());
+      float distance_after = 0, time_after = 0, time_typical_after = 0;
+      for (int i = segments.size() - 1; i >= 0; i--) {
+        route_segments[i] = {RouteGeometry(segments[i].path(), REROUTE_DISTANCE), distance_after, time_after, time_typical_after};
+        distance_after += segments[i].distance();
+        time_after += segments[i].travelTime();
+        time_typical_after += get_time_typical(segments[i]);
+      }
 
       auto route_points = coordinate_list_to_collection(route.path());
       QMapbox::Feature feature(QMapbox::Feature::LineStringType, route_points, {}, {});
@@ -381,6 +389,8 @@ void MapWindow::routeCalculated(QGeoRouteReply *reply) {
 
 void MapWindow::clearRoute() {
   segment = QGeoRouteSegment();
+  route_segments.clear();
+  segment_idx = 0;
   nav_destination = QMapbox::Coordinate();
 
   if (!m_map.isNull()) {
@@ -399,18 +409,8 @@ bool MapWindow::shouldRecompute() {
     return true;
   }
 
-  // Compute closest distance to all line segments in the current path
-  float min_d = REROUTE_DISTANCE + 1;
-  auto path = segment.path();
-  auto cur = to_QGeoCoordinate(*last_position);
-  for (size_t i = 0; i < path.size() - 1; i++) {
-    auto a = path[i];
-    auto b = path[i+1];
-    if (a.distanceTo(b) < 1.0) {
-      continue;
-    }
-    min_d = std::min(min_d, minimum_distance(a, b, cur));
-  }
+  // Closest distance to the current path
+  float min_d = route_segments[segment_idx].geometry.distanceTo(to_QGeoCoordinate(*last_position));
   return min_d > REROUTE_DISTANCE;
 
   // TODO: Check for going wrong way in segment
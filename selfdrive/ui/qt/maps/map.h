@@ -26,6 +26,7 @@
 #include "selfdrive/common/params.h"
 #include "selfdrive/common/util.h"
 #include "cereal/messaging/messaging.h"
+#include "selfdrive/ui/qt/maps/map_helpers.h"
 
 class MapInstructions : public QWidget {
   Q_OBJECT
@@ -118,6 +119,14 @@ private:
   QGeoRoute route;
   QGeoRouteSegment segment;
 
+  // the geometry of each route segment, and what's left of the route after it
+  struct RouteSegment {
+    RouteGeometry geometry;
+    float distance_after, time_after, time_typical_after;
+  };
+  std::vector<RouteSegment> route_segments;
+  int segment_idx = 0;
+
   MapInstructions* map_instructions;
   MapETA* map_eta;
 
@@ -1,5 +1,8 @@
 #include "selfdrive/ui/qt/maps/map_helpers.h"
 
+#include <cmath>
+#include <limits>
+
 #include <QJsonDocument>
 #include <QJsonObject>
 
@@ -90,30 +93,6 @@ float minimum_distance(QGeoCoordinate a, QGeoCoordinate b, QGeoCoordinate p) {
   return projection.distanceTo(p);
 }
 
-float distance_along_geometry(QList<QGeoCoordinate> geometry, QGeoCoordinate pos) {
-  if (geometry.size() <= 2) {
-    return geometry[0].distanceTo(pos);
-  }
-
-  // 1. Find segment that is closest to current position
-  // 2. Total distance is sum of distance to start of closest segment
-  //    + all previous segments
-  double total_distance = 0;
-  double total_distance_closest = 0;
-  double closest_distance = std::numeric_limits<double>::max();
-
-  for (int i = 0; i < geometry.size() - 1; i++) {
-    double d = minimum_distance(geometry[i], geometry[i+1], pos);
-    if (d < closest_distance) {
-      closest_distance = d;
-      total_distance_closest = total_distance + geometry[i].distanceTo(pos);
-    }
-    total_distance += geometry[i].distanceTo(geometry[i+1]);
-  }
-
-  return total_distance_closest;
-}
-
 std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param) {
   QString json_str = QString::fromStdString(Params().get(param));
   if (json_str.isEmpty()) return {};
@@ -129,3 +108,108 @@ std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param) {
     return {};
   }
 }
+
+const double METERS_PER_DEGREE = 111320.0;
+
+static uint64_t cell_key(int32_t x, int32_t y) {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+RouteGeometry::RouteGeometry(const QList<QGeoCoordinate> &path, float match_radius)
+  : points(path.begin(), path.end()), match_radius(match_radius) {
+  if (points.empty()) return;
+
+  cumulative.resize(points.size(), 0);
+  for (int i = 1; i < points.size(); i++) {
+    cumulative[i] = cumulative[i-1] + points[i-1].distanceTo(points[i]);
+    // the projection onto repeated points is undefined
+    if (cumulative[i] - cumulative[i-1] >= 1.0) edges.push_back(i - 1);
+  }
+
+  // Local flat projection for the grid. An edge within match_radius of a position passes through
+  // the position's cell or a neighbouring one, with a lot of margin for the projection error.
+  cell_size = 4 * std::max(match_radius, 1.0f);
+  lat0 = points[0].latitude();
+  lon0 = points[0].longitude();
+  lon_scale = std::max(std::cos(lat0 * M_PI / 180.0), 0.01);
+  for (int e = 0; e < edges.size(); e++) {
+    const QGeoCoordinate &a = points[edges[e]], &b = points[edges[e] + 1];
+    const int steps = std::ceil((cumulative[edges[e] + 1] - cumulative[edges[e]]) / (cell_size / 4));
+    for (int k = 0; k <= steps; k++) {
+      const double t = (double)k / steps;
+      auto [x, y] = cell(a.latitude() + t * (b.latitude() - a.latitude()), a.longitude() + t * (b.longitude() - a.longitude()));
+      std::vector<int> &cell_edges = grid[cell_key(x, y)];
+      if (cell_edges.empty() || cell_edges.back() != e) cell_edges.push_back(e);
+    }
+  }
+}
+
+std::pair<int32_t, int32_t> RouteGeometry::cell(double lat, double lon) const {
+  return {(int32_t)std::floor((lon - lon0) * lon_scale * METERS_PER_DEGREE / cell_size),
+          (int32_t)std::floor((lat - lat0) * METERS_PER_DEGREE / cell_size)};
+}
+
+float RouteGeometry::edgeDistance(int e, const QGeoCoordinate &pos) const {
+  return minimum_distance(points[edges[e]], points[edges[e] + 1], pos);
+}
+
+int RouteGeometry::locate(const QGeoCoordinate &pos, float &distance) {
+  // Follow the path from the last matched edge to the closest edge around it
+  int best = last_edge;
+  distance = edgeDistance(best, pos);
+  while (best + 1 < edges.size()) {
+    const float d = edgeDistance(best + 1, pos);
+    if (d >= distance) break;
+    best++;
+    distance = d;
+  }
+  while (best > 0) {
+    const float d = edgeDistance(best - 1, pos);
+    if (d > distance) break;
+    best--;
+    distance = d;
+  }
+
+  if (distance > match_radius) {
+    // Lost the path there, check the edges in the cells around pos. When none are close the
+    // position is off the path, keep the last match until it is back.
+    auto [x, y] = cell(pos.latitude(), pos.longitude());
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        auto it = grid.find(cell_key(x + dx, y + dy));
+        if (it == grid.end()) continue;
+
+        for (int e : it->second) {
+          const float d = edgeDistance(e, pos);
+          if (d < distance || (d == distance && e < best)) {
+            best = e;
+            distance = d;
+          }
+        }
+      }
+    }
+  }
+
+  last_edge = best;
+  return edges[best];
+}
+
+float RouteGeometry::distanceAlong(const QGeoCoordinate &pos) {
+  if (points.size() <= 2 || edges.empty()) {
+    return points.empty() ? 0 : points[0].distanceTo(pos);
+  }
+
+  float distance;
+  const int i = locate(pos, distance);
+  return cumulative[i] + points[i].distanceTo(pos);
+}
+
+float RouteGeometry::distanceTo(const QGeoCoordinate &pos) {
+  if (edges.empty()) {
+    return std::numeric_limits<float>::max();
+  }
+
+  float distance;
+  locate(pos, distance);
+  return distance;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <optional>
+#include <unordered_map>
+#include <vector>
 #include <eigen3/Eigen/Dense>
 #include <QMapboxGL>
 #include <QGeoCoordinate>
@@ -23,4 +25,31 @@ QMapbox::CoordinatesCollections coordinate_list_to_collection(QList<QGeoCoordina
 
 float minimum_distance(QGeoCoordinate a, QGeoCoordinate b, QGeoCoordinate p);
 std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param);
-float distance_along_geometry(QList<QGeoCoordinate> geometry, QGeoCoordinate pos);
+
+// A route path with the distance along it to every point, and a grid of the cells its edges pass
+// through. The position is matched to an edge starting from the last matched one, so following
+// the route costs a few edges per update regardless of the length of the path. Only when the
+// position is further than match_radius from there the grid is searched.
+class RouteGeometry {
+public:
+  RouteGeometry() = default;
+  RouteGeometry(const QList<QGeoCoordinate> &path, float match_radius);
+  // distance along the path to the start of the closest edge, plus the distance from there to pos
+  float distanceAlong(const QGeoCoordinate &pos);
+  // distance from pos to the path, more than match_radius if pos is off the path
+  float distanceTo(const QGeoCoordinate &pos);
+
+private:
+  float edgeDistance(int e, const QGeoCoordinate &pos) const;
+  std::pair<int32_t, int32_t> cell(double lat, double lon) const;
+  // the index of the point the closest edge starts at
+  int locate(const QGeoCoordinate &pos, float &distance);
+
+  std::vector<QGeoCoordinate> points;
+  std::vector<double> cumulative;  // distance along the path to each point
+  std::vector<int> edges;  // the edges longer than a meter, by their first point
+  float match_radius = 0;
+  double cell_size = 0, lat0 = 0, lon0 = 0, lon_scale = 1;
+  std::unordered_map<uint64_t, std::vector<int>> grid;  // edges through each cell
+  int last_edge = 0;
+};
@@ -166,6 +166,7 @@ NvgWindow::NvgWindow(QWidget *parent) : QOpenGLWidget(parent) {
 
 NvgWindow::~NvgWindow() {
   makeCurrent();
+  ui_free_layers(&QUIState::ui_state);
   doneCurrent();
 }
 
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/ui/qt/maps/map_helpers.h"
+
+// RouteGeometry against matching every position to every edge of the path, like the maps used to
+static float brute_force_along(const QList<QGeoCoordinate> &path, const QGeoCoordinate &pos) {
+  if (path.size() <= 2) return path[0].distanceTo(pos);
+
+  double total = 0, total_closest = 0, closest = std::numeric_limits<double>::max();
+  for (int i = 0; i < path.size() - 1; i++) {
+    const double d = minimum_distance(path[i], path[i+1], pos);
+    if (d < closest) {
+      closest = d;
+      total_closest = total + path[i].distanceTo(pos);
+    }
+    total += path[i].distanceTo(path[i+1]);
+  }
+  return total_closest;
+}
+
+static float brute_force_to(const QList<QGeoCoordinate> &path, const QGeoCoordinate &pos) {
+  float closest = std::numeric_limits<float>::max();
+  for (int i = 0; i < path.size() - 1; i++) {
+    if (path[i].distanceTo(path[i+1]) < 1.0) continue;
+    closest = std::min(closest, minimum_distance(path[i], path[i+1], pos));
+  }
+  return closest;
+}
+
+// a winding road that doesn't cross itself, with some repeated points and a few long edges
+static QList<QGeoCoordinate> winding_road(std::mt19937 &rng) {
+  QList<QGeoCoordinate> path;
+  double lat = 32.7, lon = -117.1, heading = 0;
+  for (int i = 0; i < 5000; i++) {
+    path.push_back(QGeoCoordinate(lat, lon));
+    if (i % 97 == 0) path.push_back(QGeoCoordinate(lat, lon));
+    heading = std::clamp(heading + std::uniform_real_distribution<double>(-0.2, 0.2)(rng), -1.0, 1.0);
+    const double step = std::uniform_real_distribution<double>(2, (i % 500 == 0) ? 2000 : 30)(rng) / 111320;
+    lat += step * std::cos(heading);
+    lon += step * std::sin(heading) / std::cos(lat * M_PI / 180);
+  }
+  return path;
+}
+
+TEST_CASE("RouteGeometry matches the brute force search along a route") {
+  const float match_radius = 25;
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0, 3.0 / 111320);
+  const QList<QGeoCoordinate> path = winding_road(rng);
+  RouteGeometry geometry(path, match_radius);
+
+  // drive along the path with gps noise, with a detour off the route and back in the middle
+  int off_route = 0;
+  for (int i = 0; i + 1 < path.size(); i += 3) {
+    for (double t = 0; t < 1; t += 0.5) {
+      QGeoCoordinate pos(path[i].latitude() + t * (path[i+1].latitude() - path[i].latitude()) + noise(rng),
+                         path[i].longitude() + t * (path[i+1].longitude() - path[i].longitude()) + noise(rng));
+      if (i > 2000 && i < 2100) pos.setLatitude(pos.latitude() + 200.0 / 111320);
+
+      const float to = brute_force_to(path, pos);
+      REQUIRE((geometry.distanceTo(pos) > match_radius) == (to > match_radius));
+      if (to > match_radius) {
+        off_route++;
+        continue;
+      }
+      REQUIRE(geometry.distanceAlong(pos) == Approx(brute_force_along(path, pos)).margin(1.0));
+    }
+  }
+  REQUIRE(off_route > 0);
+
+  // jumping back to the start is found through the grid
+  REQUIRE(geometry.distanceAlong(path[1]) == Approx(brute_force_along(path, path[1])).margin(1.0));
+}
+
+TEST_CASE("RouteGeometry with short paths") {
+  const QGeoCoordinate a(32.7, -117.1), b(32.701, -117.1), pos(32.702, -117.1);
+
+  RouteGeometry one_edge({a, b}, 25);
+  REQUIRE(one_edge.distanceAlong(pos) == Approx(a.distanceTo(pos)));
+  REQUIRE(one_edge.distanceTo(pos) == Approx(b.distanceTo(pos)).margin(1.0));
+
+  RouteGeometry empty({}, 25);
+  REQUIRE(empty.distanceAlong(pos) == 0);
+  REQUIRE(empty.distanceTo(pos) > 25);
+}
@@ -154,6 +154,16 @@ typedef struct UIScene {
 
 } UIScene;
 
+struct NVGLUframebuffer;
+
+// A panel drawn into a framebuffer of its own, and only redrawn when the
+// inputs it was drawn from change. See ui_draw_layer.
+typedef struct UILayer {
+  Rect rect;
+  std::string key;
+  NVGLUframebuffer *fb = nullptr;
+} UILayer;
+
 typedef struct UIState {
   VisionIpcClient * vipc_client;
   VisionIpcClient * vipc_client_rear;
@@ -169,6 +179,9 @@ typedef struct UIState {
   // images
   std::map<std::string, int> images;
 
+  // cached panels
+  std::map<std::string, UILayer> layers;
+
   std::unique_ptr<SubMaster> sm;
 
   UIStatus status;